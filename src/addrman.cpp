@@ -73,27 +73,59 @@ double CAddrInfo::GetChance(int64_t nNow) const
 
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    auto it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return nullptr;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
-    if (it2 != mapInfo.end())
-        return &(*it2).second;
+    if (IsInUse((*it).second))
+        return &m_info[(*it).second];
     return nullptr;
 }
 
 CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, int* pnId)
 {
-    int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
+    int nId;
+    if (!m_free_ids.empty()) {
+        nId = m_free_ids.back();
+        m_free_ids.pop_back();
+        m_info[nId] = CAddrInfo(addr, addrSource);
+    } else {
+        nId = m_info.size();
+        m_info.emplace_back(addr, addrSource);
+    }
     mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
+    m_info[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
     if (pnId)
         *pnId = nId;
-    return &mapInfo[nId];
+    return &m_info[nId];
+}
+
+//! Set a position of a table and keep the list of its occupied positions up to date.
+static void SetSlot(int& entry, int slot, int nId, std::vector<int>& slots, int* slot_index)
+{
+    if (entry == -1 && nId != -1) {
+        slot_index[slot] = slots.size();
+        slots.push_back(slot);
+    } else if (entry != -1 && nId == -1) {
+        const int index = slot_index[slot];
+        slots[index] = slots.back();
+        slot_index[slots[index]] = index;
+        slots.pop_back();
+        slot_index[slot] = -1;
+    }
+    entry = nId;
+}
+
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    SetSlot(vvNew[nUBucket][nUBucketPos], nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos, nId, m_new_slots, m_new_slot_index);
+}
+
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId)
+{
+    SetSlot(vvTried[nKBucket][nKBucketPos], nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos, nId, m_tried_slots, m_tried_slot_index);
 }
 
 void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
@@ -106,11 +138,11 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
     int nId1 = vRandom[nRndPos1];
     int nId2 = vRandom[nRndPos2];
 
-    assert(mapInfo.count(nId1) == 1);
-    assert(mapInfo.count(nId2) == 1);
+    assert(IsInUse(nId1));
+    assert(IsInUse(nId2));
 
-    mapInfo[nId1].nRandomPos = nRndPos2;
-    mapInfo[nId2].nRandomPos = nRndPos1;
+    m_info[nId1].nRandomPos = nRndPos2;
+    m_info[nId2].nRandomPos = nRndPos1;
 
     vRandom[nRndPos1] = nId2;
     vRandom[nRndPos2] = nId1;
@@ -118,15 +150,18 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
 
 void CAddrMan::Delete(int nId)
 {
-    assert(mapInfo.count(nId) != 0);
-    CAddrInfo& info = mapInfo[nId];
+    assert(IsInUse(nId));
+    CAddrInfo& info = m_info[nId];
     assert(!info.fInTried);
     assert(info.nRefCount == 0);
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
     mapAddr.erase(info);
-    mapInfo.erase(nId);
+    // The nId is reused, so it must not be left behind for a later entry to inherit.
+    m_tried_collisions.erase(nId);
+    info = CAddrInfo();
+    m_free_ids.push_back(nId);
     nNew--;
 }
 
@@ -135,10 +170,10 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
     // if there is an entry in the specified bucket, delete it.
     if (vvNew[nUBucket][nUBucketPos] != -1) {
         int nIdDelete = vvNew[nUBucket][nUBucketPos];
-        CAddrInfo& infoDelete = mapInfo[nIdDelete];
+        CAddrInfo& infoDelete = m_info[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -148,11 +183,14 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
 void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 {
     // remove the entry from all new buckets
-    for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-        int pos = info.GetBucketPosition(nKey, true, bucket);
-        if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+    for (size_t i = 0; i < m_new_slots.size() && info.nRefCount > 0;) {
+        const int slot = m_new_slots[i];
+        if (vvNew[slot / ADDRMAN_BUCKET_SIZE][slot % ADDRMAN_BUCKET_SIZE] == nId) {
+            // This moves another position to index i.
+            SetNew(slot / ADDRMAN_BUCKET_SIZE, slot % ADDRMAN_BUCKET_SIZE, -1);
             info.nRefCount--;
+        } else {
+            i++;
         }
     }
     nNew--;
@@ -167,12 +205,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
     if (vvTried[nKBucket][nKBucketPos] != -1) {
         // find an item to evict
         int nIdEvict = vvTried[nKBucket][nKBucketPos];
-        assert(mapInfo.count(nIdEvict) == 1);
-        CAddrInfo& infoOld = mapInfo[nIdEvict];
+        assert(IsInUse(nIdEvict));
+        CAddrInfo& infoOld = m_info[nIdEvict];
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -183,12 +221,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -222,21 +260,9 @@ void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime
     if (info.fInTried)
         return;
 
-    // find a bucket it is in now
-    int nRnd = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
-    int nUBucket = -1;
-    for (unsigned int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
-        int nB = (n + nRnd) % ADDRMAN_NEW_BUCKET_COUNT;
-        int nBpos = info.GetBucketPosition(nKey, true, nB);
-        if (vvNew[nB][nBpos] == nId) {
-            nUBucket = nB;
-            break;
-        }
-    }
-
-    // if no bucket is found, something bad happened;
+    // if it is in no new bucket, something bad happened;
     // TODO: maybe re-add the node, but for now, just bail out
-    if (nUBucket == -1)
+    if (info.nRefCount == 0)
         return;
 
     // which tried bucket to move the entry to
@@ -246,8 +272,8 @@ void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime
     // Will moving this address into tried evict another entry?
     if (test_before_evict && (vvTried[tried_bucket][tried_bucket_pos] != -1)) {
         // Output the entry we'd be colliding with, for debugging purposes
-        auto colliding_entry = mapInfo.find(vvTried[tried_bucket][tried_bucket_pos]);
-        LogPrint(BCLog::ADDRMAN, "Collision inserting element into tried table (%s), moving %s to m_tried_collisions=%d\n", colliding_entry != mapInfo.end() ? colliding_entry->second.ToString() : "", addr.ToString(), m_tried_collisions.size());
+        const int colliding_id = vvTried[tried_bucket][tried_bucket_pos];
+        LogPrint(BCLog::ADDRMAN, "Collision inserting element into tried table (%s), moving %s to m_tried_collisions=%d\n", IsInUse(colliding_id) ? m_info[colliding_id].ToString() : "", addr.ToString(), m_tried_collisions.size());
         if (m_tried_collisions.size() < ADDRMAN_SET_TRIED_COLLISION_SIZE) {
             m_tried_collisions.insert(nId);
         }
@@ -313,7 +339,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
-            CAddrInfo& infoExisting = mapInfo[vvNew[nUBucket][nUBucketPos]];
+            CAddrInfo& infoExisting = m_info[vvNew[nUBucket][nUBucketPos]];
             if (infoExisting.IsTerrible() || (infoExisting.nRefCount > 1 && pinfo->nRefCount == 0)) {
                 // Overwrite the existing new table entry.
                 fInsert = true;
@@ -322,7 +348,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -365,35 +391,27 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
     // Use a 50% chance for choosing between tried and new table entries.
     if (!newOnly &&
        (nTried > 0 && (nNew == 0 || insecure_rand.randbool() == 0))) {
-        // use a tried node
+        // use a tried node, picking one of the occupied positions of the table
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = insecure_rand.randrange(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            int slot = m_tried_slots[insecure_rand.randrange(m_tried_slots.size())];
+            int nId = vvTried[slot / ADDRMAN_BUCKET_SIZE][slot % ADDRMAN_BUCKET_SIZE];
+            assert(IsInUse(nId));
+            CAddrInfo& info = m_info[nId];
             if (insecure_rand.randbits(30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
         }
     } else {
-        // use a new node
+        // use a new node, picking one of the occupied positions of the table
+        if (m_new_slots.empty())
+            return CAddrInfo();
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            int slot = m_new_slots[insecure_rand.randrange(m_new_slots.size())];
+            int nId = vvNew[slot / ADDRMAN_BUCKET_SIZE][slot % ADDRMAN_BUCKET_SIZE];
+            assert(IsInUse(nId));
+            CAddrInfo& info = m_info[nId];
             if (insecure_rand.randbits(30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -410,9 +428,17 @@ int CAddrMan::Check_()
     if (vRandom.size() != (size_t)(nTried + nNew))
         return -7;
 
-    for (const auto& entry : mapInfo) {
-        int n = entry.first;
-        const CAddrInfo& info = entry.second;
+    if (m_info.size() != vRandom.size() + m_free_ids.size())
+        return -20;
+    for (int n : m_free_ids) {
+        if (IsInUse(n))
+            return -21;
+    }
+
+    for (int n = 0; n < (int)m_info.size(); n++) {
+        if (!IsInUse(n))
+            continue;
+        const CAddrInfo& info = m_info[n];
         if (info.fInTried) {
             if (!info.nLastSuccess)
                 return -1;
@@ -446,10 +472,12 @@ int CAddrMan::Check_()
              if (vvTried[n][i] != -1) {
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
-                 if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey, m_asmap) != n)
+                 if (m_info[vvTried[n][i]].GetTriedBucket(nKey, m_asmap) != n)
                      return -17;
-                 if (mapInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
+                 if (m_info[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
                      return -18;
+                 if (m_tried_slot_index[n * ADDRMAN_BUCKET_SIZE + i] == -1)
+                     return -24;
                  setTried.erase(vvTried[n][i]);
              }
         }
@@ -460,14 +488,26 @@ int CAddrMan::Check_()
             if (vvNew[n][i] != -1) {
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
-                if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
+                if (m_info[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
                     return -19;
+                if (m_new_slot_index[n * ADDRMAN_BUCKET_SIZE + i] == -1)
+                    return -25;
                 if (--mapNew[vvNew[n][i]] == 0)
                     mapNew.erase(vvNew[n][i]);
             }
         }
     }
 
+    for (size_t i = 0; i < m_tried_slots.size(); i++) {
+        const int slot = m_tried_slots[i];
+        if (m_tried_slot_index[slot] != (int)i || vvTried[slot / ADDRMAN_BUCKET_SIZE][slot % ADDRMAN_BUCKET_SIZE] == -1)
+            return -22;
+    }
+    for (size_t i = 0; i < m_new_slots.size(); i++) {
+        const int slot = m_new_slots[i];
+        if (m_new_slot_index[slot] != (int)i || vvNew[slot / ADDRMAN_BUCKET_SIZE][slot % ADDRMAN_BUCKET_SIZE] == -1)
+            return -23;
+    }
     if (setTried.size())
         return -13;
     if (mapNew.size())
@@ -496,9 +536,9 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr, size_t max_addresses, size
 
         int nRndPos = insecure_rand.randrange(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        assert(IsInUse(vRandom[n]));
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
+        const CAddrInfo& ai = m_info[vRandom[n]];
         if (!ai.IsTerrible())
             vAddr.push_back(ai);
     }
@@ -549,11 +589,11 @@ void CAddrMan::ResolveCollisions_()
 
         bool erase_collision = false;
 
-        // If id_new not found in mapInfo remove it from m_tried_collisions
-        if (mapInfo.count(id_new) != 1) {
+        // If id_new not found in m_info remove it from m_tried_collisions
+        if (!IsInUse(id_new)) {
             erase_collision = true;
         } else {
-            CAddrInfo& info_new = mapInfo[id_new];
+            CAddrInfo& info_new = m_info[id_new];
 
             // Which tried bucket to move the entry to.
             int tried_bucket = info_new.GetTriedBucket(nKey, m_asmap);
@@ -564,7 +604,7 @@ void CAddrMan::ResolveCollisions_()
 
                 // Get the to-be-evicted address that is being tested
                 int id_old = vvTried[tried_bucket][tried_bucket_pos];
-                CAddrInfo& info_old = mapInfo[id_old];
+                CAddrInfo& info_old = m_info[id_old];
 
                 // Has successfully connected in last X hours
                 if (GetAdjustedTime() - info_old.nLastSuccess < ADDRMAN_REPLACEMENT_HOURS*(60*60)) {
@@ -611,13 +651,13 @@ CAddrInfo CAddrMan::SelectTriedCollision_()
     std::advance(it, insecure_rand.randrange(m_tried_collisions.size()));
     int id_new = *it;
 
-    // If id_new not found in mapInfo remove it from m_tried_collisions
-    if (mapInfo.count(id_new) != 1) {
+    // If id_new not found in m_info remove it from m_tried_collisions
+    if (!IsInUse(id_new)) {
         m_tried_collisions.erase(it);
         return CAddrInfo();
     }
 
-    CAddrInfo& newInfo = mapInfo[id_new];
+    CAddrInfo& newInfo = m_info[id_new];
 
     // which tried bucket to move the entry to
     int tried_bucket = newInfo.GetTriedBucket(nKey, m_asmap);
@@ -625,7 +665,7 @@ CAddrInfo CAddrMan::SelectTriedCollision_()
 
     int id_old = vvTried[tried_bucket][tried_bucket_pos];
 
-    return mapInfo[id_old];
+    return id_old != -1 ? m_info[id_old] : CAddrInfo();
 }
 
 std::vector<bool> CAddrMan::DecodeAsmap(fs::path path)
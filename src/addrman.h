@@ -16,6 +16,7 @@
 #include <tinyformat.h>
 #include <util/system.h>
 
+#include <algorithm>
 #include <fs.h>
 #include <hash.h>
 #include <iostream>
@@ -23,6 +24,7 @@
 #include <set>
 #include <stdint.h>
 #include <streams.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -53,7 +55,7 @@ private:
     //! in tried set? (memory only)
     bool fInTried{false};
 
-    //! position in vRandom
+    //! position in vRandom, or -1 if this slot of the table is unused
     int nRandomPos{-1};
 
     friend class CAddrMan;
@@ -120,6 +122,9 @@ public:
  *      be observable by adversaries.
  *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
  *      consistency checks for the entire data structure.
+ *    * Entries are stored contiguously and indexed by their nId, which is reused once an entry is deleted. The
+ *      occupied positions of both tables are listed as well, so selecting from a sparse table does not need to
+ *      probe empty positions.
  */
 
 //! total number of buckets for tried addresses
@@ -183,6 +188,7 @@ private:
         V1_DETERMINISTIC = 1, //!< for pre-asmap files
         V2_ASMAP = 2,         //!< for files including asmap version
         V3_BIP155 = 3,        //!< same as V2_ASMAP plus addresses are in BIP155 format
+        V4_BUCKET_LISTS = 4,  //!< same as V3_BIP155 but the new buckets of each entry are stored with it
     };
 
     //! The maximum format this software knows it can unserialize. Also, we always serialize
@@ -190,7 +196,7 @@ private:
     //! The format (first byte in the serialized stream) can be higher than this and
     //! still this software may be able to unserialize the file - if the second byte
     //! (see `lowest_compatible` in `Unserialize()`) is less or equal to this.
-    static constexpr Format FILE_FORMAT = Format::V3_BIP155;
+    static constexpr Format FILE_FORMAT = Format::V4_BUCKET_LISTS;
 
     //! The initial value of a field that is incremented every time an incompatible format
     //! change is made (such that old software versions would not be able to parse and
@@ -199,14 +205,14 @@ private:
     //! @note Don't increment this. Increment `lowest_compatible` in `Serialize()` instead.
     static constexpr uint8_t INCOMPATIBILITY_BASE = 32;
 
-    //! last used nId
-    int nIdCount GUARDED_BY(cs);
+    //! table with information about all nIds, indexed by nId
+    std::vector<CAddrInfo> m_info GUARDED_BY(cs);
 
-    //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
+    //! nIds of the unused slots of m_info, to be reused first
+    std::vector<int> m_free_ids GUARDED_BY(cs);
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr GUARDED_BY(cs);
+    std::unordered_map<CNetAddr, int, CNetAddrHash> mapAddr GUARDED_BY(cs);
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom GUARDED_BY(cs);
@@ -223,6 +229,14 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
 
+    //! occupied positions (nBucket * ADDRMAN_BUCKET_SIZE + nBucketPos) of vvNew and vvTried, in no particular order
+    std::vector<int> m_new_slots GUARDED_BY(cs);
+    std::vector<int> m_tried_slots GUARDED_BY(cs);
+
+    //! index of each position of vvNew and vvTried in m_new_slots and m_tried_slots, or -1 if empty
+    int m_new_slot_index[ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
+    int m_tried_slot_index[ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
+
     //! last time Good was called (memory only)
     int64_t nLastGood GUARDED_BY(cs);
 
@@ -241,8 +255,19 @@ protected:
 
     //! find an entry, creating it if necessary.
     //! nTime and nServices of the found node are updated, if necessary.
+    //! This invalidates pointers and references to other entries.
     CAddrInfo* Create(const CAddress &addr, const CNetAddr &addrSource, int *pnId = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Whether an entry with this nId exists.
+    bool IsInUse(int nId) const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return nId >= 0 && (size_t)nId < m_info.size() && m_info[nId].nRandomPos != -1;
+    }
+
+    //! Set a position in a "new" or "tried" table to an nId, or to -1 to empty it.
+    void SetNew(int nUBucket, int nUBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void SetTried(int nKBucket, int nKBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -325,9 +350,10 @@ public:
      * * nNew
      * * nTried
      * * number of "new" buckets XOR 2**30
-     * * all nNew addrinfos in vvNew
+     * * all nNew addrinfos in vvNew, each followed by (since V4_BUCKET_LISTS):
+     *   * the "new" buckets it is in
      * * all nTried addrinfos in vvTried
-     * * for each bucket:
+     * * (before V4_BUCKET_LISTS) for each bucket:
      *   * number of elements
      *   * for each element: index
      *
@@ -339,7 +365,9 @@ public:
      * they are instead reconstructed from the other information.
      *
      * vvNew is serialized, but only used if ADDRMAN_UNKNOWN_BUCKET_COUNT didn't change,
-     * otherwise it is reconstructed as well.
+     * otherwise it is reconstructed as well. Storing the buckets with each entry keeps all
+     * of its references to the "new" table, and lets them be read without building an index
+     * of the entries first.
      *
      * This format is more complex, but significantly smaller (at most 1.5 MiB), and supports
      * changes to the ADDRMAN_ parameters without breaking the on-disk structure.
@@ -360,7 +388,7 @@ public:
 
         // Increment `lowest_compatible` iff a newly introduced format is incompatible with
         // the previous one.
-        static constexpr uint8_t lowest_compatible = Format::V3_BIP155;
+        static constexpr uint8_t lowest_compatible = Format::V4_BUCKET_LISTS;
         s << static_cast<uint8_t>(INCOMPATIBILITY_BASE + lowest_compatible);
 
         s << nKey;
@@ -369,40 +397,41 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+
+        // The (nId, bucket) pairs of the "new" table, in nId order.
+        std::vector<std::pair<int, int>> new_buckets;
+        new_buckets.reserve(m_new_slots.size());
+        for (int slot : m_new_slots) {
+            const int bucket = slot / ADDRMAN_BUCKET_SIZE;
+            new_buckets.emplace_back(vvNew[bucket][slot % ADDRMAN_BUCKET_SIZE], bucket);
+        }
+        std::sort(new_buckets.begin(), new_buckets.end());
+
         int nIds = 0;
-        for (const auto& entry : mapInfo) {
-            mapUnkIds[entry.first] = nIds;
-            const CAddrInfo &info = entry.second;
+        auto it = new_buckets.begin();
+        for (int n = 0; n < (int)m_info.size(); n++) {
+            const CAddrInfo &info = m_info[n];
             if (info.nRefCount) {
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
                 s << info;
+                auto end = it;
+                while (end != new_buckets.end() && end->first == n) end++;
+                assert(end - it == info.nRefCount);
+                WriteCompactSize(s, info.nRefCount);
+                for (; it != end; it++) {
+                    s << it->second;
+                }
                 nIds++;
             }
         }
         nIds = 0;
-        for (const auto& entry : mapInfo) {
-            const CAddrInfo &info = entry.second;
+        for (const CAddrInfo& info : m_info) {
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
                 s << info;
                 nIds++;
             }
         }
-        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-            int nSize = 0;
-            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-                if (vvNew[bucket][i] != -1)
-                    nSize++;
-            }
-            s << nSize;
-            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-                if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
-                    s << nIndex;
-                }
-            }
-        }
         // Store asmap version after bucket entries so that it
         // can be ignored by older clients for backward compatibility.
         uint256 asmap_version;
@@ -458,15 +487,32 @@ public:
             throw std::ios_base::failure("Corrupt CAddrMan serialization, nTried exceeds limit.");
         }
 
+        m_info.reserve(std::max(nNew, 0) + std::max(nTried, 0));
+        vRandom.reserve(m_info.capacity());
+
+        // Positions in the new table buckets to apply later (if possible), as (entry, bucket) pairs.
+        std::vector<std::pair<int, int>> entry_buckets;
+
         // Deserialize entries from the new table.
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+            CAddrInfo info;
             s >> info;
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
             vRandom.push_back(n);
+            m_info.push_back(std::move(info));
+            if (format >= Format::V4_BUCKET_LISTS) {
+                const uint64_t nBuckets = ReadCompactSize(s);
+                if (nBuckets > ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
+                    throw std::ios_base::failure("Corrupt CAddrMan serialization, too many buckets for an entry.");
+                }
+                for (uint64_t i = 0; i < nBuckets; i++) {
+                    int bucket = 0;
+                    s >> bucket;
+                    entry_buckets.emplace_back(n, bucket);
+                }
+            }
         }
-        nIdCount = nNew;
 
         // Deserialize entries from the tried table.
         int nLost = 0;
@@ -476,32 +522,37 @@ public:
             int nKBucket = info.GetTriedBucket(nKey, m_asmap);
             int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
             if (vvTried[nKBucket][nKBucketPos] == -1) {
+                const int nId = m_info.size();
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
+                vRandom.push_back(nId);
+                mapAddr[info] = nId;
+                m_info.push_back(std::move(info));
+                SetTried(nKBucket, nKBucketPos, nId);
             } else {
                 nLost++;
             }
         }
         nTried -= nLost;
 
-        // Store positions in the new table buckets to apply later (if possible).
-        std::map<int, int> entryToBucket; // Represents which entry belonged to which bucket when serializing
-
-        for (int bucket = 0; bucket < nUBuckets; bucket++) {
-            int nSize = 0;
-            s >> nSize;
-            for (int n = 0; n < nSize; n++) {
-                int nIndex = 0;
-                s >> nIndex;
-                if (nIndex >= 0 && nIndex < nNew) {
-                    entryToBucket[nIndex] = bucket;
+        if (format < Format::V4_BUCKET_LISTS) {
+            // Represents which entry belonged to which bucket when serializing
+            std::vector<int> entryToBucket(nNew, 0);
+
+            for (int bucket = 0; bucket < nUBuckets; bucket++) {
+                int nSize = 0;
+                s >> nSize;
+                for (int n = 0; n < nSize; n++) {
+                    int nIndex = 0;
+                    s >> nIndex;
+                    if (nIndex >= 0 && nIndex < nNew) {
+                        entryToBucket[nIndex] = bucket;
+                    }
                 }
             }
+            for (int n = 0; n < nNew; n++) {
+                entry_buckets.emplace_back(n, entryToBucket[n]);
+            }
         }
 
         uint256 supplied_asmap_version;
@@ -513,37 +564,43 @@ public:
             s >> serialized_asmap_version;
         }
 
-        for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
-            int bucket = entryToBucket[n];
-            int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
-            if (format >= Format::V2_ASMAP && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 &&
-                info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS && serialized_asmap_version == supplied_asmap_version) {
-                // Bucketing has not changed, using existing bucket positions for the new table
-                vvNew[bucket][nUBucketPos] = n;
-                info.nRefCount++;
-            } else {
-                // In case the new table data cannot be used (format unknown, bucket count wrong or new asmap),
-                // try to give them a reference based on their primary source address.
-                LogPrint(BCLog::ADDRMAN, "Bucketing method was updated, re-bucketing addrman entries from disk\n");
-                bucket = info.GetNewBucket(nKey, m_asmap);
-                nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
+        const bool restore_buckets = format >= Format::V2_ASMAP && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT &&
+                                     serialized_asmap_version == supplied_asmap_version;
+        if (restore_buckets) {
+            // Bucketing has not changed, using existing bucket positions for the new table
+            for (const auto& entry : entry_buckets) {
+                CAddrInfo &info = m_info[entry.first];
+                const int bucket = entry.second;
+                if (bucket < 0 || bucket >= ADDRMAN_NEW_BUCKET_COUNT || info.nRefCount == ADDRMAN_NEW_BUCKETS_PER_ADDRESS) continue;
+                int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                 if (vvNew[bucket][nUBucketPos] == -1) {
-                    vvNew[bucket][nUBucketPos] = n;
+                    SetNew(bucket, nUBucketPos, entry.first);
                     info.nRefCount++;
                 }
             }
+        } else if (nNew > 0) {
+            LogPrint(BCLog::ADDRMAN, "Bucketing method was updated, re-bucketing addrman entries from disk\n");
+        }
+
+        // In case the new table data cannot be used (format unknown, bucket count wrong, new asmap or
+        // collisions), try to give the entries a reference based on their primary source address.
+        for (int n = 0; n < nNew; n++) {
+            CAddrInfo &info = m_info[n];
+            if (info.nRefCount > 0) continue;
+            int bucket = info.GetNewBucket(nKey, m_asmap);
+            int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
+            if (vvNew[bucket][nUBucketPos] == -1) {
+                SetNew(bucket, nUBucketPos, n);
+                info.nRefCount++;
+            }
         }
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
-            if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
-                Delete(itCopy->first);
+        for (int n = 0; n < (int)m_info.size(); n++) {
+            if (IsInUse(n) && !m_info[n].fInTried && m_info[n].nRefCount == 0) {
+                Delete(n);
                 nLostUnk++;
-            } else {
-                it++;
             }
         }
         if (nLost + nLostUnk > 0) {
@@ -561,22 +618,26 @@ public:
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
                 vvNew[bucket][entry] = -1;
+                m_new_slot_index[bucket * ADDRMAN_BUCKET_SIZE + entry] = -1;
             }
         }
         for (size_t bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
                 vvTried[bucket][entry] = -1;
+                m_tried_slot_index[bucket * ADDRMAN_BUCKET_SIZE + entry] = -1;
             }
         }
+        m_new_slots.clear();
+        m_tried_slots.clear();
 
-        nIdCount = 0;
         nTried = 0;
         nNew = 0;
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
-        mapInfo.clear();
+        std::vector<CAddrInfo>().swap(m_info);
+        m_free_ids.clear();
         mapAddr.clear();
+        m_tried_collisions.clear();
     }
-
     CAddrMan()
     {
         Clear();
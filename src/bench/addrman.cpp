@@ -4,7 +4,9 @@
 
 #include <addrman.h>
 #include <bench/bench.h>
+#include <netbase.h>
 #include <random.h>
+#include <streams.h>
 #include <util/time.h>
 
 #include <vector>
@@ -14,12 +16,19 @@
 static constexpr size_t NUM_SOURCES = 64;
 static constexpr size_t NUM_ADDRESSES_PER_SOURCE = 256;
 
+/* A large table, like the one of a long running node that heard from many peers. */
+static constexpr size_t NUM_SOURCES_LARGE = 2048;
+static constexpr size_t NUM_ADDRESSES_PER_SOURCE_LARGE = 64;
+
 static std::vector<CAddress> g_sources;
 static std::vector<std::vector<CAddress>> g_addresses;
 
-static void CreateAddresses()
+static std::vector<CAddress> g_sources_large;
+static std::vector<std::vector<CAddress>> g_addresses_large;
+
+static void CreateAddresses(std::vector<CAddress>& sources, std::vector<std::vector<CAddress>>& addresses, size_t num_sources, size_t num_addresses_per_source)
 {
-    if (g_sources.size() > 0) { // already created
+    if (sources.size() > 0) { // already created
         return;
     }
 
@@ -42,15 +51,20 @@ static void CreateAddresses()
         return ret;
     };
 
-    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
-        g_sources.emplace_back(randAddr());
-        g_addresses.emplace_back();
-        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
-            g_addresses[source_i].emplace_back(randAddr());
+    for (size_t source_i = 0; source_i < num_sources; ++source_i) {
+        sources.emplace_back(randAddr());
+        addresses.emplace_back();
+        for (size_t addr_i = 0; addr_i < num_addresses_per_source; ++addr_i) {
+            addresses[source_i].emplace_back(randAddr());
         }
     }
 }
 
+static void CreateAddresses()
+{
+    CreateAddresses(g_sources, g_addresses, NUM_SOURCES, NUM_ADDRESSES_PER_SOURCE);
+}
+
 static void AddAddressesToAddrMan(CAddrMan& addrman)
 {
     for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
@@ -65,6 +79,15 @@ static void FillAddrMan(CAddrMan& addrman)
     AddAddressesToAddrMan(addrman);
 }
 
+static void FillAddrManLarge(CAddrMan& addrman)
+{
+    CreateAddresses(g_sources_large, g_addresses_large, NUM_SOURCES_LARGE, NUM_ADDRESSES_PER_SOURCE_LARGE);
+
+    for (size_t source_i = 0; source_i < NUM_SOURCES_LARGE; ++source_i) {
+        addrman.Add(g_addresses_large[source_i], g_sources_large[source_i]);
+    }
+}
+
 /* Benchmarks */
 
 static void AddrManAdd(benchmark::Bench& bench)
@@ -91,6 +114,32 @@ static void AddrManSelect(benchmark::Bench& bench)
     });
 }
 
+static void AddrManSelectFromAlmostEmpty(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    // Add one address to the new table
+    CService addr;
+    Lookup("250.3.1.1", addr, 8333, false);
+    addrman.Add(CAddress(addr, NODE_NONE), addr);
+
+    bench.run([&] {
+        (void)addrman.Select();
+    });
+}
+
+static void AddrManSelectLarge(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    FillAddrManLarge(addrman);
+
+    bench.run([&] {
+        const auto& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    });
+}
+
 static void AddrManGetAddr(benchmark::Bench& bench)
 {
     CAddrMan addrman;
@@ -103,6 +152,47 @@ static void AddrManGetAddr(benchmark::Bench& bench)
     });
 }
 
+static void AddrManGetAddrLarge(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    FillAddrManLarge(addrman);
+
+    bench.run([&] {
+        const auto& addresses = addrman.GetAddr(2500, 23);
+        assert(addresses.size() > 0);
+    });
+}
+
+static void AddrManSerialize(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    FillAddrManLarge(addrman);
+
+    bench.run([&] {
+        CDataStream stream(SER_DISK, CLIENT_VERSION);
+        stream << addrman;
+        assert(stream.size() > 0);
+    });
+}
+
+static void AddrManDeserialize(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    FillAddrManLarge(addrman);
+
+    CDataStream serialized(SER_DISK, CLIENT_VERSION);
+    serialized << addrman;
+
+    bench.run([&] {
+        CDataStream stream(serialized);
+        stream >> addrman;
+        assert(addrman.size() > 0);
+    });
+}
+
 static void AddrManGood(benchmark::Bench& bench)
 {
     /* Create many CAddrMan objects - one to be modified at each loop iteration.
@@ -136,5 +226,10 @@ static void AddrManGood(benchmark::Bench& bench)
 
 BENCHMARK(AddrManAdd);
 BENCHMARK(AddrManSelect);
+BENCHMARK(AddrManSelectFromAlmostEmpty);
+BENCHMARK(AddrManSelectLarge);
 BENCHMARK(AddrManGetAddr);
+BENCHMARK(AddrManGetAddrLarge);
+BENCHMARK(AddrManSerialize);
+BENCHMARK(AddrManDeserialize);
 BENCHMARK(AddrManGood);
@@ -3,27 +3,26 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <chainparams.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <miner.h>
 #include <test/util/mining.h>
 #include <test/util/setup_common.h>
 #include <test/util/wallet.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 
 #include <vector>
 
-static void AssembleBlock(benchmark::Bench& bench)
+/**
+ * Mine blocks on test_setup and fill its mempool with loose transactions
+ * spending them. Returns the script they pay to.
+ */
+static CScript FillMempool(TestingSetup& test_setup)
 {
-    TestingSetup test_setup{
-        CBaseChainParams::REGTEST,
-        /* extra_args */ {
-            "-nodebuglogfile",
-            "-nodebug",
-        },
-    };
-
     const std::vector<unsigned char> op_true{OP_TRUE};
     CScriptWitness witness;
     witness.stack.push_back(op_true);
@@ -40,7 +39,9 @@ static void AssembleBlock(benchmark::Bench& bench)
         CMutableTransaction tx;
         tx.vin.push_back(MineBlock(test_setup.m_node, SCRIPT_PUB));
         tx.vin.back().scriptWitness = witness;
-        tx.vout.emplace_back(13370, SCRIPT_PUB);
+        // Just above the dust threshold: smooth emission leaves regtest coinbases
+        // of these heights worth less than 9000
+        tx.vout.emplace_back(3400, SCRIPT_PUB);
         if (NUM_BLOCKS - b >= COINBASE_MATURITY)
             txs.at(b) = MakeTransactionRef(tx);
     }
@@ -53,10 +54,49 @@ static void AssembleBlock(benchmark::Bench& bench)
             assert(ret);
         }
     }
+    return SCRIPT_PUB;
+}
+
+static void AssembleBlock(benchmark::Bench& bench)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+    const CScript SCRIPT_PUB{FillMempool(test_setup)};
 
     bench.run([&] {
         PrepareBlock(test_setup.m_node, SCRIPT_PUB);
     });
 }
 
+/**
+ * Same mempool as AssembleBlock, served by getblocktemplate's
+ * BlockTemplateCache between two changes to it, as pools polling it see.
+ */
+static void AssembleBlockCached(benchmark::Bench& bench)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+    FillMempool(test_setup);
+
+    BlockTemplateCache cache(*test_setup.m_node.mempool, Params());
+    RegisterValidationInterface(&cache);
+    WITH_LOCK(::cs_main, cache.GetBlockTemplate());
+    bench.run([&] {
+        LOCK(::cs_main);
+        cache.GetBlockTemplate();
+    });
+    UnregisterValidationInterface(&cache);
+}
+
 BENCHMARK(AssembleBlock);
+BENCHMARK(AssembleBlockCached);
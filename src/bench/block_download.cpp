@@ -0,0 +1,28 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <test/util/blockdownload.h>
+
+#include <assert.h>
+
+// An initial block download of 20000 small blocks from 8 peers with a 200ms
+// round trip, scheduled with a fixed or an adaptive number of blocks in flight.
+// See blockdownload_tests for how long either takes in simulated time.
+static void BlockDownload(benchmark::Bench& bench, bool adaptive)
+{
+    BlockDownloadSimulationOptions options;
+    for (BlockDownloadSimulationPeer& peer : options.peers) peer.round_trip = std::chrono::milliseconds{200};
+    options.adaptive = adaptive;
+    bench.batch(options.num_blocks).unit("block").run([&] {
+        const BlockDownloadSimulationResult result = SimulateBlockDownload(options);
+        assert(result.duration.count() > 0);
+    });
+}
+
+static void BlockDownloadFixed(benchmark::Bench& bench) { BlockDownload(bench, /* adaptive */ false); }
+static void BlockDownloadAdaptive(benchmark::Bench& bench) { BlockDownload(bench, /* adaptive */ true); }
+
+BENCHMARK(BlockDownloadFixed);
+BENCHMARK(BlockDownloadAdaptive);
@@ -0,0 +1,71 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <consensus/consensus.h>
+#include <miner.h>
+#include <policy/policy.h>
+#include <random.h>
+#include <tinyformat.h>
+
+#include <mw/consensus/Params.h>
+
+// Selecting the transactions of a block from a mempool of 20000 chunks, of
+// which one in three pays well to peg in to the MWEB and fills the MWEB block
+// long before the rest of the block is full. The fees collected are shown
+// next to the benchmark name.
+static constexpr size_t NUM_ITEMS = 20000;
+
+static std::vector<SelectionItem> CreateItems()
+{
+    FastRandomContext rand{true};
+    std::vector<SelectionItem> items;
+    for (size_t i = 0; i < NUM_ITEMS; ++i) {
+        const bool mweb = rand.randrange(3) == 0;
+        SelectionItem item;
+        item.weight = 400 + rand.randrange(4000);
+        item.mweb_weight = mweb ? 5 + rand.randrange(40) : 0;
+        item.fee = (mweb ? 60 : 20) * item.weight / WITNESS_SCALE_FACTOR * (50 + rand.randrange(100)) / 100;
+        item.sigops = 4;
+        // Some chunks are followed by a chunk of the same cluster
+        item.cluster = i % 4 == 1 ? i - 1 : i;
+        items.push_back(item);
+    }
+    return items;
+}
+
+static void BlockSelection(benchmark::Bench& bench, bool knapsack)
+{
+    const std::vector<SelectionItem> items = CreateItems();
+    SelectionLimits limits;
+    limits.weight = DEFAULT_BLOCK_MAX_WEIGHT - 4000 - 1;
+    limits.mweb_weight = mw::MAX_MINE_WEIGHT - 1;
+    limits.sigops = MAX_BLOCK_SIGOPS_COST - 1;
+
+    const auto select = [&] {
+        return knapsack ? SelectItemsKnapsack(items, limits, KNAPSACK_SEARCH_TIME) : SelectItemsGreedy(items, limits);
+    };
+    CAmount fees = 0;
+    for (size_t i : select()) {
+        fees += items[i].fee;
+    }
+
+    bench.name(strprintf("%s (%d fees)", bench.name(), fees)).unit("block").run([&] {
+        const std::vector<size_t> selected = select();
+        assert(!selected.empty());
+    });
+}
+
+static void BlockSelectionGreedy(benchmark::Bench& bench)
+{
+    BlockSelection(bench, /* knapsack */ false);
+}
+
+static void BlockSelectionKnapsack(benchmark::Bench& bench)
+{
+    BlockSelection(bench, /* knapsack */ true);
+}
+
+BENCHMARK(BlockSelectionGreedy);
+BENCHMARK(BlockSelectionKnapsack);
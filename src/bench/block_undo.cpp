@@ -0,0 +1,79 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <clientversion.h>
+#include <hash.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <undo.h>
+
+// Undo data of a block spending mostly recent coins, as seen on a chain with
+// 10 second blocks: 300 transactions with 1-3 inputs each, spending coins
+// created within the last day (8640 blocks) below height 2,000,000.
+static CBlockUndo CreateBlockUndo()
+{
+    FastRandomContext rng(true);
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(300);
+    for (CTxUndo& txundo : blockundo.vtxundo) {
+        txundo.vprevout.resize(1 + rng.randrange(3));
+        for (Coin& coin : txundo.vprevout) {
+            coin.nHeight = 2000000 - rng.randrange(8640);
+            coin.fCoinBase = rng.randrange(100) == 0;
+            coin.out.nValue = rng.randrange(50 * COIN);
+            if (rng.randrange(4) == 0) {
+                coin.out.scriptPubKey = GetScriptForDestination(PKHash(uint160(rng.randbytes(20))));
+            } else {
+                coin.out.scriptPubKey = GetScriptForDestination(WitnessV0KeyHash(uint160(rng.randbytes(20))));
+            }
+        }
+    }
+    return blockundo;
+}
+
+// Reading and verifying the undo record is the per-block disk work of
+// DisconnectBlock; see UndoReadFromDisk. The bench name reports the record size.
+template <typename Write, typename Read>
+static void BlockUndoRead(benchmark::Bench& bench, const std::string& name, Write write, Read read)
+{
+    const CBlockUndo blockundo = CreateBlockUndo();
+    const uint256 hash_block = GetRandHash();
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    write(stream, blockundo);
+    const size_t size = stream.size();
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    bench.name(strprintf("%s (%u bytes/block)", name, size)).unit("block").run([&] {
+        CBlockUndo undo;
+        CHashVerifier<CDataStream> verifier(&stream);
+        verifier << hash_block;
+        read(verifier, undo, size);
+        assert(undo.vtxundo.size() == blockundo.vtxundo.size());
+        bool rewound = stream.Rewind(size);
+        assert(rewound);
+    });
+}
+
+static void BlockUndoReadLegacy(benchmark::Bench& bench)
+{
+    BlockUndoRead(
+        bench, "BlockUndoReadLegacy",
+        [](CDataStream& s, const CBlockUndo& undo) { s << undo; },
+        [](CHashVerifier<CDataStream>& s, CBlockUndo& undo, size_t size) { UnserializeBlockUndo(undo, s, size); });
+}
+
+static void BlockUndoReadColumnar(benchmark::Bench& bench)
+{
+    BlockUndoRead(
+        bench, "BlockUndoReadColumnar",
+        [](CDataStream& s, const CBlockUndo& undo) { s << Using<BlockUndoColumnarFormatter>(undo); },
+        [](CHashVerifier<CDataStream>& s, CBlockUndo& undo, size_t size) { s >> Using<BlockUndoColumnarFormatter>(undo); });
+}
+
+BENCHMARK(BlockUndoReadLegacy);
+BENCHMARK(BlockUndoReadColumnar);
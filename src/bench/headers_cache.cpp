@@ -0,0 +1,66 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <headerscache.h>
+#include <netmessagemaker.h>
+#include <primitives/block.h>
+#include <protocol.h>
+#include <random.h>
+#include <version.h>
+
+#include <assert.h>
+
+// Answering a getheaders for a full batch of 2000 headers, as a peer syncing
+// from us asks for, by serializing the headers or from a cache holding the
+// responses for 100 such batches.
+static constexpr int NUM_HEADERS = 2000;
+static constexpr int NUM_CACHED = 100;
+
+static std::vector<CBlock> MakeHeaders()
+{
+    FastRandomContext rng(true);
+    std::vector<CBlock> headers(NUM_HEADERS);
+    for (CBlock& header : headers) {
+        header.nVersion = 0x20000000;
+        header.hashPrevBlock = rng.rand256();
+        header.hashMerkleRoot = rng.rand256();
+        header.nTime = rng.rand32();
+        header.nBits = 0x1e0ffff0;
+        header.nNonce = rng.rand32();
+    }
+    return headers;
+}
+
+static void HeadersResponseSerialize(benchmark::Bench& bench)
+{
+    const std::vector<CBlock> headers = MakeHeaders();
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    bench.batch(NUM_HEADERS).unit("header").run([&] {
+        const CSharedNetMsg msg(msgMaker.Make(NetMsgType::HEADERS, headers));
+        assert(!msg.data->empty());
+    });
+}
+
+static void HeadersResponseCached(benchmark::Bench& bench)
+{
+    const std::vector<CBlock> headers = MakeHeaders();
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    const CSharedNetMsg msg(msgMaker.Make(NetMsgType::HEADERS, headers));
+    FastRandomContext rng(true);
+    HeadersCache cache(NUM_CACHED * msg.data->size());
+    std::vector<HeadersCacheKey> keys;
+    for (int i = 0; i < NUM_CACHED; ++i) {
+        keys.push_back(HeadersCacheKey{false, 1 + NUM_HEADERS * i, rng.rand256()});
+        cache.Add(keys.back(), NUM_HEADERS * (i + 1), msg);
+    }
+    size_t i = 0;
+    bench.batch(NUM_HEADERS).unit("header").run([&] {
+        const Optional<CSharedNetMsg> cached = cache.Get(keys[i++ % keys.size()]);
+        assert(cached);
+    });
+}
+
+BENCHMARK(HeadersResponseSerialize);
+BENCHMARK(HeadersResponseCached);
@@ -0,0 +1,131 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <script/standard.h>
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <test_framework/models/Tx.h>
+
+#include <vector>
+
+// Accepting batches of independent transactions to the mempool, one in four of
+// which pegs in to the MWEB. Every batch spends the same coins with fresh
+// signatures and rangeproofs, so that nothing is verified from the caches of
+// an earlier batch.
+static constexpr size_t NUM_PARENTS = 10;
+static constexpr size_t OUTPUTS_PER_PARENT = 20;
+static constexpr size_t NUM_BATCHES = 4;
+static constexpr CAmount CHILD_FEE = 100000;
+
+static CTransactionRef SignSpend(const CKey& key, const std::vector<COutPoint>& prevouts, CMutableTransaction tx)
+{
+    const CScript script_pub_key = GetScriptForDestination(PKHash(key.GetPubKey()));
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        std::vector<unsigned char> sig;
+        const uint256 hash = SignatureHash(script_pub_key, tx, i, SIGHASH_ALL, 0, SigVersion::BASE);
+        const bool signed_hash = key.Sign(hash, sig);
+        assert(signed_hash);
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[i].scriptSig = CScript() << sig << ToByteVector(key.GetPubKey());
+    }
+    return MakeTransactionRef(tx);
+}
+
+static void RunMempoolAcceptance(benchmark::Bench& bench, bool prevalidate)
+{
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+    CTxMemPool& pool = *test_setup.m_node.mempool;
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript script_pub_key = GetScriptForDestination(PKHash(key.GetPubKey()));
+
+    // Split mature coinbases into the coins spent by every batch
+    std::vector<CTxIn> coinbases;
+    for (size_t i = 0; i < COINBASE_MATURITY + NUM_PARENTS; ++i) {
+        coinbases.push_back(MineBlock(test_setup.m_node, script_pub_key));
+    }
+    std::vector<CTxOut> coins;
+    std::vector<COutPoint> outpoints;
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < NUM_PARENTS; ++i) {
+            const CAmount value = ::ChainstateActive().CoinsTip().AccessCoin(coinbases[i].prevout).out.nValue;
+            CMutableTransaction tx;
+            for (size_t j = 0; j < OUTPUTS_PER_PARENT; ++j) {
+                tx.vout.emplace_back(value / (OUTPUTS_PER_PARENT + 1), script_pub_key);
+            }
+            const CTransactionRef parent = SignSpend(key, {coinbases[i].prevout}, tx);
+            TxValidationState state;
+            const bool accepted = AcceptToMemoryPool(pool, state, parent, nullptr /* plTxnReplaced */, false /* bypass_limits */);
+            assert(accepted);
+            for (size_t j = 0; j < OUTPUTS_PER_PARENT; ++j) {
+                coins.push_back(parent->vout[j]);
+                outpoints.emplace_back(parent->GetHash(), j);
+            }
+        }
+    }
+
+    std::vector<std::vector<CTransactionRef>> batches(NUM_BATCHES);
+    for (size_t b = 0; b < NUM_BATCHES; ++b) {
+        for (size_t i = 0; i < coins.size(); ++i) {
+            CMutableTransaction tx;
+            CAmount change = coins[i].nValue - CHILD_FEE - b;
+            if (i % 4 == 0) {
+                const CAmount pegin_amount = change / 2;
+                tx.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(pegin_amount).GetTransaction());
+                tx.vout.emplace_back(pegin_amount, GetScriptForPegin(tx.mweb_tx.GetPegIns().front().GetKernelID()));
+                change -= pegin_amount;
+            }
+            tx.vout.emplace_back(change, script_pub_key);
+            batches[b].push_back(SignSpend(key, {outpoints[i]}, tx));
+        }
+    }
+
+    size_t batch = 0;
+    bench.unit("tx").batch(coins.size()).epochs(1).epochIterations(NUM_BATCHES).run([&] {
+        const std::vector<CTransactionRef>& txs = batches[batch++ % NUM_BATCHES];
+        if (prevalidate) {
+            PrevalidateTransactions(pool, txs);
+        }
+        LOCK(cs_main);
+        for (const CTransactionRef& tx : txs) {
+            TxValidationState state;
+            const bool accepted = AcceptToMemoryPool(pool, state, tx, nullptr /* plTxnReplaced */, false /* bypass_limits */);
+            assert(accepted);
+        }
+        LOCK(pool.cs);
+        for (const CTransactionRef& tx : txs) {
+            pool.removeRecursive(*tx, MemPoolRemovalReason::CONFLICT);
+        }
+    });
+}
+
+static void MempoolAcceptance(benchmark::Bench& bench)
+{
+    RunMempoolAcceptance(bench, /* prevalidate */ false);
+}
+
+static void MempoolAcceptancePrevalidated(benchmark::Bench& bench)
+{
+    RunMempoolAcceptance(bench, /* prevalidate */ true);
+}
+
+BENCHMARK(MempoolAcceptance);
+BENCHMARK(MempoolAcceptancePrevalidated);
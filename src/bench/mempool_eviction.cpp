@@ -6,7 +6,9 @@
 #include <policy/policy.h>
 #include <test/util/setup_common.h>
 #include <txmempool.h>
+#include <validation.h>
 
+#include <test_framework/models/Tx.h>
 
 static void AddTx(const CTransactionRef& tx, const CAmount& nFee, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
 {
@@ -23,7 +25,7 @@ static void AddTx(const CTransactionRef& tx, const CAmount& nFee, CTxMemPool& po
 // Right now this is only testing eviction performance in an extremely small
 // mempool. Code needs to be written to generate a much wider variety of
 // unique transactions for a more meaningful performance measurement.
-static void MempoolEviction(benchmark::Bench& bench)
+static void RunMempoolEviction(benchmark::Bench& bench, bool cluster_mode, bool mweb)
 {
     TestingSetup test_setup{
         CBaseChainParams::REGTEST,
@@ -114,7 +116,16 @@ static void MempoolEviction(benchmark::Bench& bench)
     tx7.vout[1].scriptPubKey = CScript() << OP_7 << OP_EQUAL;
     tx7.vout[1].nValue = 10 * COIN;
 
+    // Have the children also peg in to the MWEB, which gives them MWEB weight
+    if (mweb) {
+        tx3.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(3 * COIN, 100).GetTransaction());
+        tx5.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(5 * COIN, 100).GetTransaction());
+        tx6.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(6 * COIN, 100).GetTransaction());
+        tx7.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(7 * COIN, 100).GetTransaction());
+    }
+
     CTxMemPool pool;
+    pool.SetClusterMode(cluster_mode, DEFAULT_CLUSTER_LIMIT);
     LOCK2(cs_main, pool.cs);
     // Create transaction references outside the "hot loop"
     const CTransactionRef tx1_r{MakeTransactionRef(tx1)};
@@ -138,4 +149,27 @@ static void MempoolEviction(benchmark::Bench& bench)
     });
 }
 
+static void MempoolEviction(benchmark::Bench& bench)
+{
+    RunMempoolEviction(bench, /* cluster_mode */ false, /* mweb */ false);
+}
+
+static void MempoolEvictionMWEB(benchmark::Bench& bench)
+{
+    RunMempoolEviction(bench, /* cluster_mode */ false, /* mweb */ true);
+}
+
+static void MempoolEvictionCluster(benchmark::Bench& bench)
+{
+    RunMempoolEviction(bench, /* cluster_mode */ true, /* mweb */ false);
+}
+
+static void MempoolEvictionClusterMWEB(benchmark::Bench& bench)
+{
+    RunMempoolEviction(bench, /* cluster_mode */ true, /* mweb */ true);
+}
+
 BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolEvictionMWEB);
+BENCHMARK(MempoolEvictionCluster);
+BENCHMARK(MempoolEvictionClusterMWEB);
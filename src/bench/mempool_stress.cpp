@@ -6,6 +6,9 @@
 #include <policy/policy.h>
 #include <test/util/setup_common.h>
 #include <txmempool.h>
+#include <validation.h>
+
+#include <test_framework/models/Tx.h>
 
 #include <vector>
 
@@ -26,7 +29,7 @@ struct Available {
     Available(CTransactionRef& ref, size_t tx_count) : ref(ref), tx_count(tx_count){}
 };
 
-static void ComplexMemPool(benchmark::Bench& bench)
+static void RunComplexMemPool(benchmark::Bench& bench, bool cluster_mode, bool mweb)
 {
     int childTxs = 800;
     if (bench.complexityN() > 1) {
@@ -76,11 +79,16 @@ static void ComplexMemPool(benchmark::Bench& bench)
                 out.nValue = 10 * COIN;
             }
         }
+        // Every fourth transaction also pegs in to the MWEB, which gives it MWEB weight
+        if (mweb && x % 4 == 0) {
+            tx.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(1000 + x, 100).GetTransaction());
+        }
         ordered_coins.emplace_back(MakeTransactionRef(tx));
         available_coins.emplace_back(ordered_coins.back(), tx_counter++);
     }
     TestingSetup test_setup;
     CTxMemPool pool;
+    pool.SetClusterMode(cluster_mode, DEFAULT_CLUSTER_LIMIT);
     LOCK2(cs_main, pool.cs);
     bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
         for (auto& tx : ordered_coins) {
@@ -91,4 +99,27 @@ static void ComplexMemPool(benchmark::Bench& bench)
     });
 }
 
+static void ComplexMemPool(benchmark::Bench& bench)
+{
+    RunComplexMemPool(bench, /* cluster_mode */ false, /* mweb */ false);
+}
+
+static void ComplexMemPoolMWEB(benchmark::Bench& bench)
+{
+    RunComplexMemPool(bench, /* cluster_mode */ false, /* mweb */ true);
+}
+
+static void ComplexMemPoolCluster(benchmark::Bench& bench)
+{
+    RunComplexMemPool(bench, /* cluster_mode */ true, /* mweb */ false);
+}
+
+static void ComplexMemPoolClusterMWEB(benchmark::Bench& bench)
+{
+    RunComplexMemPool(bench, /* cluster_mode */ true, /* mweb */ true);
+}
+
 BENCHMARK(ComplexMemPool);
+BENCHMARK(ComplexMemPoolMWEB);
+BENCHMARK(ComplexMemPoolCluster);
+BENCHMARK(ComplexMemPoolClusterMWEB);
@@ -0,0 +1,94 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <consensus/validation.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+#include <txmempool.h>
+
+#include <mw/consensus/Aggregation.h>
+#include <mw/mmr/MMR.h>
+#include <test_framework/models/Tx.h>
+
+// Relaying the MWEB extension block of a compact block, either in full or as
+// short IDs, when all of its MWEB transactions are already in the receiver's
+// mempool. Each run deserializes the cmpctblock and reconstructs the block;
+// the size of the cmpctblock message is shown next to the benchmark name.
+static constexpr size_t NUM_MWEB_TXS = 50;
+
+static void MWEBCmpctBlock(benchmark::Bench& bench, bool short_ids)
+{
+    const BasicTestingSetup test_setup{CBaseChainParams::REGTEST, {"-nodebuglogfile", "-nodebug"}};
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    std::vector<mw::Transaction::CPtr> mweb_txs;
+    for (size_t i = 0; i < NUM_MWEB_TXS; ++i) {
+        mweb_txs.push_back(test::Tx::CreatePegIn(1000 + i, 100).GetTransaction());
+        CMutableTransaction tx;
+        tx.mweb_tx = MWEB::Tx(mweb_txs.back());
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.FromTx(tx));
+    }
+    const mw::Transaction::CPtr aggregate = Aggregation::Aggregate(mweb_txs);
+    MemMMR kernel_mmr;
+    for (const Kernel& kernel : aggregate->GetKernels()) {
+        kernel_mmr.Add(kernel);
+    }
+    const mw::Header::CPtr mweb_header = std::make_shared<mw::Header>(
+        100, mw::Hash(), kernel_mmr.Root(), mw::Hash(),
+        BlindingFactor(aggregate->GetKernelOffset()), BlindingFactor(aggregate->GetStealthOffset()),
+        aggregate->GetOutputs().size(), aggregate->GetKernels().size());
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    CMutableTransaction hogex;
+    hogex.m_hogEx = true;
+    hogex.vin.resize(1);
+    hogex.vout.resize(1);
+    block.vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(hogex)};
+    block.mweb_block = MWEB::Block(std::make_shared<mw::Block>(mweb_header, aggregate->GetBody()));
+
+    const int version = PROTOCOL_VERSION | (short_ids ? SERIALIZE_MWEB_SHORT_IDS : 0);
+    CDataStream stream(SER_NETWORK, version);
+    stream << CBlockHeaderAndShortTxIDs(block, true);
+    const size_t size = stream.size();
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+    bench.name(strprintf("%s (%u bytes)", bench.name(), size)).unit("block").run([&] {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        stream >> cmpctblock;
+        bool rewound = stream.Rewind(size);
+        assert(rewound);
+
+        PartiallyDownloadedBlock partial_block(&pool, cmpctblock.mweb_block);
+        partial_block.m_check_block_mock = [](const CBlock&, BlockValidationState&, const Consensus::Params&, bool, bool) { return true; };
+        ReadStatus status = partial_block.InitData(cmpctblock, extra_txn);
+        assert(status == READ_STATUS_OK);
+        CBlock reconstructed;
+        status = partial_block.FillBlock(reconstructed, {});
+        assert(status == READ_STATUS_OK);
+        assert(!reconstructed.mweb_block.IsNull());
+    });
+}
+
+static void MWEBCmpctBlockFull(benchmark::Bench& bench)
+{
+    MWEBCmpctBlock(bench, /* short_ids */ false);
+}
+
+static void MWEBCmpctBlockShortIDs(benchmark::Bench& bench)
+{
+    MWEBCmpctBlock(bench, /* short_ids */ true);
+}
+
+BENCHMARK(MWEBCmpctBlockFull);
+BENCHMARK(MWEBCmpctBlockShortIDs);
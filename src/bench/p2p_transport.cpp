@@ -0,0 +1,86 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <net.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <test/util/setup_common.h>
+
+#include <assert.h>
+#include <memory>
+#include <vector>
+
+// Sending a message through a transport and receiving it on the other side:
+// the V1 format with its double-SHA256 checksum against the encrypted v2 one.
+static constexpr size_t INV_SIZE = 1 + 36; // one entry
+static constexpr size_t BLOCK_SIZE = 1000000;
+
+static void Feed(TransportDeserializer& deserializer, const std::vector<unsigned char>& wire)
+{
+    const char* pch = reinterpret_cast<const char*>(wire.data());
+    unsigned int bytes = wire.size();
+    while (bytes > 0) {
+        const int handled = deserializer.Read(pch, bytes);
+        assert(handled >= 0);
+        pch += handled;
+        bytes -= handled;
+    }
+}
+
+static void Receive(TransportDeserializer& deserializer, const std::vector<unsigned char>& wire)
+{
+    Feed(deserializer, wire);
+    assert(deserializer.Complete());
+    uint32_t err_raw_size{0};
+    assert(deserializer.GetMessage(std::chrono::microseconds{0}, err_raw_size));
+}
+
+static void P2PTransport(benchmark::Bench& bench, bool v2, const std::string& msg_type, size_t payload_size)
+{
+    const BasicTestingSetup test_setup{CBaseChainParams::REGTEST, {"-nodebuglogfile", "-nodebug"}};
+
+    std::unique_ptr<TransportSerializer> sender;
+    std::unique_ptr<TransportDeserializer> receiver;
+    if (v2) {
+        auto initiator = std::make_shared<V2Transport>(Params(), 0, /*initiator=*/true, SER_NETWORK, PROTOCOL_VERSION);
+        auto responder = std::make_shared<V2Transport>(Params(), 1, /*initiator=*/false, SER_NETWORK, PROTOCOL_VERSION);
+        sender = MakeUnique<V2TransportSerializer>(initiator);
+        receiver = MakeUnique<V2TransportDeserializer>(responder);
+        // Exchange the public keys
+        std::vector<unsigned char> key;
+        sender->prepareTransportData(key);
+        Feed(*receiver, key);
+        key.clear();
+        V2TransportSerializer{responder}.prepareTransportData(key);
+        V2TransportDeserializer initiator_in{initiator};
+        Feed(initiator_in, key);
+    } else {
+        sender = MakeUnique<V1TransportSerializer>();
+        receiver = MakeUnique<V1TransportDeserializer>(Params(), 1, SER_NETWORK, PROTOCOL_VERSION);
+    }
+    const std::vector<unsigned char> payload(payload_size, 0x42);
+
+    std::vector<unsigned char> wire;
+    bench.batch(payload_size).unit("byte").run([&] {
+        CSerializedNetMsg msg;
+        msg.m_type = msg_type;
+        msg.data = payload;
+        wire.clear();
+        sender->prepareForTransport(msg, wire);
+        wire.insert(wire.end(), msg.data.begin(), msg.data.end());
+        Receive(*receiver, wire);
+    });
+}
+
+static void P2PTransportV1Inv(benchmark::Bench& bench) { P2PTransport(bench, /* v2 */ false, NetMsgType::INV, INV_SIZE); }
+static void P2PTransportV2Inv(benchmark::Bench& bench) { P2PTransport(bench, /* v2 */ true, NetMsgType::INV, INV_SIZE); }
+static void P2PTransportV1Block(benchmark::Bench& bench) { P2PTransport(bench, /* v2 */ false, NetMsgType::BLOCK, BLOCK_SIZE); }
+static void P2PTransportV2Block(benchmark::Bench& bench) { P2PTransport(bench, /* v2 */ true, NetMsgType::BLOCK, BLOCK_SIZE); }
+
+BENCHMARK(P2PTransportV1Inv);
+BENCHMARK(P2PTransportV2Inv);
+BENCHMARK(P2PTransportV1Block);
+BENCHMARK(P2PTransportV2Block);
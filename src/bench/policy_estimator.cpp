@@ -0,0 +1,115 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/fees.h>
+#include <policy/policy.h>
+#include <random.h>
+#include <tinyformat.h>
+#include <txmempool.h>
+
+#include <map>
+#include <memory>
+
+// Replaying eight hours of 10 second blocks through a fresh fee estimator. Demand
+// swings above and below the capacity of a block, and the miner takes the
+// best paying transactions first. The share of blocks after which a
+// transaction paying the estimate would have confirmed within the target is
+// shown next to the benchmark name.
+static constexpr unsigned int NUM_BLOCKS = 2880;
+static constexpr size_t BLOCK_CAPACITY = 40;
+static constexpr int CONF_TARGET = 6;
+// Blocks replayed before estimates are checked for accuracy
+static constexpr unsigned int WARMUP_BLOCKS = 360;
+
+struct ReplayBlock {
+    //! Transactions entering the mempool while this block is the tip
+    std::vector<std::unique_ptr<CTxMemPoolEntry>> arrivals;
+    //! Transactions mined in the next block
+    std::vector<const CTxMemPoolEntry*> mined;
+    //! Lowest feerate mined in the next block, or zero if it was not full
+    CFeeRate clearing_feerate;
+};
+
+static std::vector<ReplayBlock> CreateTrace()
+{
+    FastRandomContext rand{true};
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+
+    std::vector<ReplayBlock> trace(NUM_BLOCKS);
+    std::multimap<CFeeRate, const CTxMemPoolEntry*> mempool;
+    uint32_t next_id = 0;
+    for (unsigned int height = 0; height < NUM_BLOCKS; ++height) {
+        ReplayBlock& block = trace[height];
+
+        // Demand runs between a quarter and twice the block capacity over a few hours
+        const size_t phase = height % 1440;
+        const size_t demand = BLOCK_CAPACITY / 4 + (phase < 720 ? phase : 1440 - phase) * BLOCK_CAPACITY * 7 / 4 / 720;
+        const size_t num_arrivals = rand.randrange(2 * demand + 1);
+        for (size_t i = 0; i < num_arrivals; ++i) {
+            tx.vin[0].prevout.n = next_id++;
+            const CTransactionRef ptx = MakeTransactionRef(tx);
+            const CAmount fee = GetVirtualTransactionSize(*ptx) * (1 + rand.randrange(200));
+            block.arrivals.emplace_back(new CTxMemPoolEntry(ptx, fee, /* time */ 0, height, /* spendsCoinbase */ false, /* sigOpsCost */ 4, LockPoints()));
+            const CTxMemPoolEntry& entry = *block.arrivals.back();
+            mempool.emplace(CFeeRate(entry.GetFee(), entry.GetTxSize(), entry.GetMWEBWeight()), &entry);
+        }
+
+        while (block.mined.size() < BLOCK_CAPACITY && !mempool.empty()) {
+            const auto best = std::prev(mempool.end());
+            block.mined.push_back(best->second);
+            block.clearing_feerate = best->first;
+            mempool.erase(best);
+        }
+        if (block.mined.size() < BLOCK_CAPACITY) block.clearing_feerate = CFeeRate(0);
+    }
+    return trace;
+}
+
+static void Replay(std::vector<ReplayBlock>& trace, std::vector<CFeeRate>* estimates)
+{
+    CBlockPolicyEstimator estimator;
+    for (unsigned int height = 0; height < trace.size(); ++height) {
+        for (const auto& entry : trace[height].arrivals) {
+            estimator.processTransaction(*entry, /* validFeeEstimate */ true);
+        }
+        estimator.processBlock(height + 1, trace[height].mined);
+        if (estimates) {
+            estimates->push_back(estimator.estimateSmartFee(CONF_TARGET, nullptr, /* conservative */ false));
+        }
+    }
+}
+
+static void PolicyEstimatorReplay(benchmark::Bench& bench)
+{
+    std::vector<ReplayBlock> trace = CreateTrace();
+
+    std::vector<CFeeRate> estimates;
+    Replay(trace, &estimates);
+    size_t checked = 0;
+    size_t confirmed = 0;
+    for (unsigned int height = WARMUP_BLOCKS; height + CONF_TARGET < trace.size(); ++height) {
+        if (estimates[height] == CFeeRate(0)) continue;
+        ++checked;
+        for (int i = 1; i <= CONF_TARGET; ++i) {
+            if (trace[height + i].clearing_feerate <= estimates[height]) {
+                ++confirmed;
+                break;
+            }
+        }
+    }
+    const size_t accuracy = checked ? confirmed * 100 / checked : 0;
+
+    bench.name(strprintf("%s (%d%% within target)", bench.name(), accuracy));
+    bench.epochs(5).epochIterations(1).batch(trace.size()).unit("block").run([&] {
+        Replay(trace, nullptr);
+    });
+}
+
+BENCHMARK(PolicyEstimatorReplay);
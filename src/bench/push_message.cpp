@@ -0,0 +1,63 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <net.h>
+#include <protocol.h>
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+
+#include <vector>
+
+// Queueing one block for many peers, as when it is relayed to all of them.
+// The nodes have no sockets, so that only the cost of building and queueing
+// the messages is measured.
+static constexpr int NUM_PEERS = 100;
+static constexpr size_t BLOCK_SIZE = 1000000;
+
+static void PushMessageManyPeers(benchmark::Bench& bench, bool shared)
+{
+    const BasicTestingSetup test_setup{CBaseChainParams::REGTEST, {"-nodebuglogfile", "-nodebug"}};
+    ConnmanTestMsg connman{0x1337, 0x1337};
+    connman.Init(CConnman::Options{});
+
+    std::vector<CNode*> nodes;
+    for (int i = 0; i < NUM_PEERS; ++i) {
+        nodes.push_back(new CNode(i, NODE_NETWORK, /* height */ 0, INVALID_SOCKET, CAddress(), /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress(), "", ConnectionType::INBOUND));
+        connman.AddTestNode(*nodes.back());
+    }
+    const std::vector<unsigned char> block(BLOCK_SIZE, 0x42);
+
+    bench.batch(NUM_PEERS).unit("peer").run([&] {
+        if (shared) {
+            CSerializedNetMsg msg;
+            msg.m_type = NetMsgType::BLOCK;
+            msg.data = block;
+            const CSharedNetMsg shared_msg(std::move(msg));
+            for (CNode* node : nodes) {
+                connman.PushMessage(node, shared_msg);
+            }
+        } else {
+            for (CNode* node : nodes) {
+                CSerializedNetMsg msg;
+                msg.m_type = NetMsgType::BLOCK;
+                msg.data = block;
+                connman.PushMessage(node, std::move(msg));
+            }
+        }
+        for (CNode* node : nodes) {
+            LOCK(node->cs_vSend);
+            node->vSendMsg.clear();
+            node->nSendSize = 0;
+        }
+    });
+
+    connman.ClearTestNodes();
+}
+
+static void PushMessageManyPeersCopied(benchmark::Bench& bench) { PushMessageManyPeers(bench, /* shared */ false); }
+static void PushMessageManyPeersShared(benchmark::Bench& bench) { PushMessageManyPeers(bench, /* shared */ true); }
+
+BENCHMARK(PushMessageManyPeersCopied);
+BENCHMARK(PushMessageManyPeersShared);
@@ -0,0 +1,89 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <net.h>
+#include <protocol.h>
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+
+#include <vector>
+
+#ifdef USE_POLL
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A node with many localhost peers, of which only a few send anything at a
+// time, like a node serving lots of mostly idle inbound connections. Each
+// iteration, NUM_ACTIVE_PEERS peers send a ping and the socket handler runs
+// until it has received all of them.
+static constexpr int NUM_PEERS = 1000;
+static constexpr int NUM_ACTIVE_PEERS = 10;
+
+static void SocketHandlerManyPeers(benchmark::Bench& bench, const std::string& mode_str)
+{
+    const BasicTestingSetup test_setup{CBaseChainParams::REGTEST, {"-nodebuglogfile", "-nodebug"}};
+    SocketEventsMode mode;
+    if (!ParseSocketEventsMode(mode_str, mode)) return;
+
+    ConnmanTestMsg connman{0x1337, 0x1337};
+    CConnman::Options options;
+    options.nReceiveFloodSize = DEFAULT_MAXRECEIVEBUFFER * 1000;
+    options.socket_events_mode = mode;
+    connman.Init(options);
+    connman.StartSocketEvents();
+
+    // Two sockets per peer, and a few to spare
+    const int num_peers = std::min(NUM_PEERS, (RaiseFileDescriptorLimit(2 * NUM_PEERS + 64) - 64) / 2);
+    std::vector<CNode*> nodes;
+    std::vector<int> remote_sockets;
+    for (int i = 0; i < num_peers; ++i) {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) break;
+        nodes.push_back(new CNode(i, NODE_NETWORK, /* height */ 0, sockets[0], CAddress(), /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress(), "", ConnectionType::INBOUND));
+        connman.AddTestNode(*nodes.back());
+        remote_sockets.push_back(sockets[1]);
+    }
+    assert(nodes.size() >= NUM_ACTIVE_PEERS);
+
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::PING;
+    msg.data.resize(8);
+    std::vector<unsigned char> ping;
+    nodes[0]->m_serializer->prepareForTransport(msg, ping);
+    ping.insert(ping.end(), msg.data.begin(), msg.data.end());
+
+    size_t next_peer = 0;
+    bench.batch(NUM_ACTIVE_PEERS).unit("message").run([&] {
+        std::vector<CNode*> active_nodes;
+        for (int i = 0; i < NUM_ACTIVE_PEERS; ++i) {
+            const ssize_t written = write(remote_sockets[next_peer], ping.data(), ping.size());
+            assert(written == (ssize_t)ping.size());
+            active_nodes.push_back(nodes[next_peer]);
+            next_peer = (next_peer + 7919) % nodes.size();
+        }
+        for (CNode* node : active_nodes) {
+            while (WITH_LOCK(node->cs_vProcessMsg, return node->vProcessMsg.empty())) {
+                connman.SocketHandlerOnce();
+            }
+            LOCK(node->cs_vProcessMsg);
+            node->vProcessMsg.clear();
+            node->nProcessQueueSize = 0;
+        }
+        connman.TakeMessageHandlerReadyNodes();
+    });
+
+    connman.ClearTestNodes();
+    for (int socket : remote_sockets) {
+        close(socket);
+    }
+}
+
+static void SocketHandlerManyPeersPoll(benchmark::Bench& bench) { SocketHandlerManyPeers(bench, "poll"); }
+static void SocketHandlerManyPeersEpoll(benchmark::Bench& bench) { SocketHandlerManyPeers(bench, "epoll"); }
+
+BENCHMARK(SocketHandlerManyPeersPoll);
+BENCHMARK(SocketHandlerManyPeersEpoll);
+#endif // USE_POLL
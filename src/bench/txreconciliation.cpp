@@ -0,0 +1,48 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <pinsketch.h>
+#include <random.h>
+#include <test/util/txrelay.h>
+
+#include <assert.h>
+
+// Decoding a set difference of 50 from sketches of the size a
+// reconciliation with q = 0.25 and 100 transactions on both sides uses.
+static void PinSketchDecode(benchmark::Bench& bench)
+{
+    static constexpr size_t CAPACITY{64};
+    static constexpr size_t DIFFERENCE{50};
+
+    FastRandomContext rng{/* fDeterministic */ true};
+    PinSketch sketch(CAPACITY);
+    for (size_t i = 0; i < DIFFERENCE; ++i) sketch.Add(rng.rand32() | 1);
+
+    bench.run([&] {
+        const auto elements = sketch.Decode(CAPACITY);
+        assert(elements && elements->size() == DIFFERENCE);
+    });
+}
+
+// A whole network relaying transactions. See txreconciliation_tests for
+// the bandwidth of either.
+static void TxRelay(benchmark::Bench& bench, bool reconciliation)
+{
+    TxRelaySimulationOptions options;
+    options.num_nodes = 30;
+    options.num_txs = 200;
+    options.reconciliation = reconciliation;
+    bench.run([&] {
+        const TxRelaySimulationResult result = SimulateTxRelay(options);
+        assert(result.complete);
+    });
+}
+
+static void TxRelayFlooding(benchmark::Bench& bench) { TxRelay(bench, /* reconciliation */ false); }
+static void TxRelayReconciliation(benchmark::Bench& bench) { TxRelay(bench, /* reconciliation */ true); }
+
+BENCHMARK(PinSketchDecode);
+BENCHMARK(TxRelayFlooding);
+BENCHMARK(TxRelayReconciliation);
@@ -0,0 +1,60 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <txrequest.h>
+
+#include <thread>
+#include <vector>
+
+// Announcements of 1000 transactions by each of 128 peers, which are then
+// requested, received and forgotten, as at a high transaction rate. The
+// peers are handled by 1 or 4 threads, like the message handler threads,
+// and the tracker has 1 or the default number of shards.
+static constexpr int NUM_PEERS = 128;
+static constexpr int NUM_TXHASHES = 1000;
+
+static void RunTxRequest(TxRequestTracker& txrequest, const std::vector<uint256>& txhashes, NodeId begin, NodeId end, std::chrono::microseconds now)
+{
+    for (const uint256& txhash : txhashes) {
+        for (NodeId peer = begin; peer < end; ++peer) {
+            txrequest.ReceivedInv(peer, GenTxid{true, txhash}, /* preferred */ peer % 8 == 0, now);
+        }
+    }
+    for (NodeId peer = begin; peer < end; ++peer) {
+        for (const GenTxid& gtxid : txrequest.GetRequestable(peer, now)) {
+            txrequest.RequestedTx(peer, gtxid.GetHash(), now + std::chrono::seconds{60});
+            txrequest.ForgetTxHash(gtxid.GetHash());
+        }
+    }
+    for (NodeId peer = begin; peer < end; ++peer) txrequest.DisconnectedPeer(peer);
+}
+
+static void TxRequest(benchmark::Bench& bench, int num_threads, size_t num_shards)
+{
+    FastRandomContext rng(true);
+    TxRequestTracker txrequest(/* deterministic */ true, num_shards);
+    std::chrono::microseconds now{1000000};
+    bench.batch(NUM_PEERS * NUM_TXHASHES).unit("announcement").run([&] {
+        std::vector<uint256> txhashes;
+        for (int i = 0; i < NUM_TXHASHES; ++i) txhashes.push_back(rng.rand256());
+        now += std::chrono::seconds{1};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back(RunTxRequest, std::ref(txrequest), std::cref(txhashes), t * NUM_PEERS / num_threads, (t + 1) * NUM_PEERS / num_threads, now);
+        }
+        for (std::thread& thread : threads) thread.join();
+    });
+}
+
+static void TxRequestOneThreadOneShard(benchmark::Bench& bench) { TxRequest(bench, 1, 1); }
+static void TxRequestOneThreadSharded(benchmark::Bench& bench) { TxRequest(bench, 1, DEFAULT_TXREQUEST_SHARDS); }
+static void TxRequestFourThreadsOneShard(benchmark::Bench& bench) { TxRequest(bench, 4, 1); }
+static void TxRequestFourThreadsSharded(benchmark::Bench& bench) { TxRequest(bench, 4, DEFAULT_TXREQUEST_SHARDS); }
+
+BENCHMARK(TxRequestOneThreadOneShard);
+BENCHMARK(TxRequestOneThreadSharded);
+BENCHMARK(TxRequestFourThreadsOneShard);
+BENCHMARK(TxRequestFourThreadsSharded);
@@ -0,0 +1,159 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bip324.h>
+
+#include <crypto/common.h>
+#include <crypto/hkdf_sha256_32.h>
+#include <crypto/sha256.h>
+#include <hash.h>
+#include <key.h>
+#include <pubkey.h>
+#include <support/cleanse.h>
+#include <util/memory.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+const std::array<std::string, 29> V2_MESSAGE_IDS{
+    "", // 12 bytes follow encoding the message type like in V1
+    NetMsgType::ADDR,
+    NetMsgType::BLOCK,
+    NetMsgType::BLOCKTXN,
+    NetMsgType::CMPCTBLOCK,
+    NetMsgType::FEEFILTER,
+    NetMsgType::FILTERADD,
+    NetMsgType::FILTERCLEAR,
+    NetMsgType::FILTERLOAD,
+    NetMsgType::GETBLOCKS,
+    NetMsgType::GETBLOCKTXN,
+    NetMsgType::GETDATA,
+    NetMsgType::GETHEADERS,
+    NetMsgType::HEADERS,
+    NetMsgType::INV,
+    NetMsgType::MEMPOOL,
+    NetMsgType::MERKLEBLOCK,
+    NetMsgType::NOTFOUND,
+    NetMsgType::PING,
+    NetMsgType::PONG,
+    NetMsgType::SENDCMPCT,
+    NetMsgType::TX,
+    NetMsgType::GETCFILTERS,
+    NetMsgType::CFILTER,
+    NetMsgType::GETCFHEADERS,
+    NetMsgType::CFHEADERS,
+    NetMsgType::GETCFCHECKPT,
+    NetMsgType::CFCHECKPT,
+    NetMsgType::ADDRV2,
+};
+
+uint8_t GetV2MessageID(const std::string& msg_type)
+{
+    const auto it = std::find(V2_MESSAGE_IDS.begin() + 1, V2_MESSAGE_IDS.end(), msg_type);
+    return it == V2_MESSAGE_IDS.end() ? 0 : it - V2_MESSAGE_IDS.begin();
+}
+
+BIP324Cipher::BIP324Cipher(const uint256& payload_key, const uint256& length_key)
+    : m_aead(payload_key.begin(), payload_key.size(), length_key.begin(), length_key.size()) {}
+
+void BIP324Cipher::EncryptInPlace(std::vector<unsigned char>& out, size_t start)
+{
+    const size_t contents_len = out.size() - start - EXPANSION;
+    assert(contents_len <= MAX_CONTENTS_LEN);
+    unsigned char* packet = out.data() + start;
+    packet[0] = contents_len & 0xff;
+    packet[1] = (contents_len >> 8) & 0xff;
+    packet[2] = (contents_len >> 16) & 0xff;
+    // The length keystream of one ChaCha20 block serves AAD_PACKAGES_PER_ROUND packets.
+    const bool ret = m_aead.Crypt(m_seqnr, m_seqnr / AAD_PACKAGES_PER_ROUND, (m_seqnr % AAD_PACKAGES_PER_ROUND) * LENGTH_LEN,
+                                  packet, out.size() - start, packet, LENGTH_LEN + contents_len, /*is_encrypt=*/true);
+    assert(ret);
+    ++m_seqnr;
+}
+
+void BIP324Cipher::Encrypt(Span<const unsigned char> contents, std::vector<unsigned char>& out)
+{
+    const size_t start = out.size();
+    out.resize(start + contents.size() + EXPANSION);
+    if (!contents.empty()) memcpy(out.data() + start + LENGTH_LEN, contents.data(), contents.size());
+    EncryptInPlace(out, start);
+}
+
+bool BIP324Cipher::EncryptMessage(const std::string& msg_type, Span<const unsigned char> payload, std::vector<unsigned char>& out)
+{
+    const uint8_t id = GetV2MessageID(msg_type);
+    const size_t type_len = id != 0 ? 1 : 1 + CMessageHeader::COMMAND_SIZE;
+    if (msg_type.size() > CMessageHeader::COMMAND_SIZE || type_len + payload.size() > MAX_CONTENTS_LEN) return false;
+
+    const size_t start = out.size();
+    out.resize(start + type_len + payload.size() + EXPANSION);
+    unsigned char* contents = out.data() + start + LENGTH_LEN;
+    contents[0] = id;
+    if (id == 0) {
+        // Null padded like the message type of a V1 header
+        memset(contents + 1, 0, CMessageHeader::COMMAND_SIZE);
+        memcpy(contents + 1, msg_type.data(), msg_type.size());
+    }
+    if (!payload.empty()) memcpy(contents + type_len, payload.data(), payload.size());
+    EncryptInPlace(out, start);
+    return true;
+}
+
+uint32_t BIP324Cipher::DecryptLength(Span<const unsigned char> input)
+{
+    assert(input.size() >= LENGTH_LEN);
+    uint32_t len;
+    m_aead.GetLength(&len, m_seqnr / AAD_PACKAGES_PER_ROUND, (m_seqnr % AAD_PACKAGES_PER_ROUND) * LENGTH_LEN, input.data());
+    return len;
+}
+
+bool BIP324Cipher::Decrypt(Span<unsigned char> packet)
+{
+    if (packet.size() < EXPANSION) return false;
+    if (!m_aead.Crypt(m_seqnr, m_seqnr / AAD_PACKAGES_PER_ROUND, (m_seqnr % AAD_PACKAGES_PER_ROUND) * LENGTH_LEN,
+                      packet.data(), packet.size(), packet.data(), packet.size(), /*is_encrypt=*/false)) {
+        return false;
+    }
+    ++m_seqnr;
+    return true;
+}
+
+bool BIP324Handshake(const CKey& our_key, const CPubKey& their_pubkey, bool initiator, const CMessageHeader::MessageStartChars& message_start, BIP324Session& session)
+{
+    CPubKey ecdh_point;
+    if (!our_key.ComputeECDHPoint(their_pubkey, ecdh_point)) return false;
+
+    // Bind the shared secret to the public keys of both sides, in a fixed order.
+    const CPubKey our_pubkey = our_key.GetPubKey();
+    const CPubKey& initiator_pubkey = initiator ? our_pubkey : their_pubkey;
+    const CPubKey& responder_pubkey = initiator ? their_pubkey : our_pubkey;
+    uint256 shared_secret;
+    CSHA256()
+        .Write(ecdh_point.data(), ecdh_point.size())
+        .Write(initiator_pubkey.data(), initiator_pubkey.size())
+        .Write(responder_pubkey.data(), responder_pubkey.size())
+        .Finalize(shared_secret.begin());
+
+    const std::string salt = std::string("bitcoin_v2_shared_secret") + std::string(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE);
+    CHKDF_HMAC_SHA256_L32 hkdf(shared_secret.begin(), shared_secret.size(), salt);
+    memory_cleanse(shared_secret.begin(), shared_secret.size());
+
+    uint256 initiator_l, initiator_p, responder_l, responder_p;
+    hkdf.Expand32("initiator_L", initiator_l.begin());
+    hkdf.Expand32("initiator_P", initiator_p.begin());
+    hkdf.Expand32("responder_L", responder_l.begin());
+    hkdf.Expand32("responder_P", responder_p.begin());
+    hkdf.Expand32("session_id", session.session_id.begin());
+
+    auto initiator_cipher = MakeUnique<BIP324Cipher>(initiator_p, initiator_l);
+    auto responder_cipher = MakeUnique<BIP324Cipher>(responder_p, responder_l);
+    session.send_cipher = std::move(initiator ? initiator_cipher : responder_cipher);
+    session.recv_cipher = std::move(initiator ? responder_cipher : initiator_cipher);
+
+    for (uint256* key : {&initiator_l, &initiator_p, &responder_l, &responder_p}) {
+        memory_cleanse(key->begin(), key->size());
+    }
+    return true;
+}
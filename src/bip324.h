@@ -0,0 +1,87 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BIP324_H
+#define BITCOIN_BIP324_H
+
+#include <crypto/chacha_poly_aead.h>
+#include <crypto/poly1305.h>
+#include <protocol.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CKey;
+class CPubKey;
+
+/**
+ * Message types with a one byte short ID in the v2 transport, in the order of
+ * BIP324. Index 0 is not a short ID: it introduces a 12-byte message type.
+ */
+extern const std::array<std::string, 29> V2_MESSAGE_IDS;
+
+/** Short ID of a message type, or 0 if it has none. */
+uint8_t GetV2MessageID(const std::string& msg_type);
+
+/**
+ * One direction of an encrypted v2 transport session. Packets are sent with
+ * the ChaCha20Poly1305@bitcoin AEAD (see crypto/chacha_poly_aead.h): a 3-byte
+ * encrypted contents length, the encrypted contents and a Poly1305 tag over
+ * both. Every packet uses the next sequence number, so packets must be
+ * decrypted in the order in which they were encrypted.
+ */
+class BIP324Cipher
+{
+public:
+    static constexpr unsigned int LENGTH_LEN = CHACHA20_POLY1305_AEAD_AAD_LEN;
+    static constexpr unsigned int EXPANSION = LENGTH_LEN + POLY1305_TAGLEN;
+    static constexpr uint32_t MAX_CONTENTS_LEN = (1 << (8 * LENGTH_LEN)) - 1;
+
+    BIP324Cipher(const uint256& payload_key, const uint256& length_key);
+
+    /** Append a packet with the given contents to out. */
+    void Encrypt(Span<const unsigned char> contents, std::vector<unsigned char>& out);
+    /**
+     * Append a packet for a message with the given type and payload to out,
+     * encoding the type as in V2_MESSAGE_IDS. Returns false if the message
+     * is too large for one packet.
+     */
+    bool EncryptMessage(const std::string& msg_type, Span<const unsigned char> payload, std::vector<unsigned char>& out);
+    /** Contents length of the next packet, from its first LENGTH_LEN bytes. */
+    uint32_t DecryptLength(Span<const unsigned char> input);
+    /**
+     * Authenticate and decrypt the next packet in place. Afterwards it starts
+     * with the plaintext length and contents, followed by the now unused tag.
+     * Returns false if it is not authentic.
+     */
+    bool Decrypt(Span<unsigned char> packet);
+
+private:
+    ChaCha20Poly1305AEAD m_aead;
+    uint64_t m_seqnr{0};
+
+    //! Append an encrypted packet to out, whose contents are already at out[start + LENGTH_LEN..]
+    void EncryptInPlace(std::vector<unsigned char>& out, size_t start);
+};
+
+/** Ciphers of an established v2 transport session. */
+struct BIP324Session {
+    std::unique_ptr<BIP324Cipher> send_cipher;
+    std::unique_ptr<BIP324Cipher> recv_cipher;
+    //! Identifies the session; equal on both sides
+    uint256 session_id;
+};
+
+/**
+ * Derive the session keys from our ephemeral key and the public key the other
+ * side sent, bound to both public keys and the network magic. Returns false
+ * if their public key is invalid.
+ */
+bool BIP324Handshake(const CKey& our_key, const CPubKey& their_pubkey, bool initiator, const CMessageHeader::MessageStartChars& message_start, BIP324Session& session);
+
+#endif // BITCOIN_BIP324_H
@@ -0,0 +1,57 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdownload.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+//! Weight of a new sample in the moving averages
+constexpr double RATE_SAMPLE_WEIGHT{1.0 / 8};
+constexpr double LATENCY_SAMPLE_WEIGHT{1.0 / 4};
+
+double Average(double average, double sample, double weight)
+{
+    return average == 0 ? sample : average + (sample - average) * weight;
+}
+
+double Seconds(std::chrono::microseconds duration)
+{
+    // Clocks are not precise enough to tell apart blocks that arrive together.
+    return std::max<double>(duration.count(), 1000) / 1e6;
+}
+
+} // namespace
+
+void BlockDownloadRate::BlockReceived(size_t bytes, std::chrono::microseconds requested, std::chrono::microseconds now)
+{
+    if (requested < m_last_received) {
+        // The peer had this one queued when it sent the previous one.
+        m_bytes_per_second = Average(m_bytes_per_second, bytes / Seconds(now - m_last_received), RATE_SAMPLE_WEIGHT);
+    } else {
+        m_latency = Average(m_latency, Seconds(now - requested), LATENCY_SAMPLE_WEIGHT);
+    }
+    m_block_bytes = Average(m_block_bytes, std::max<double>(bytes, 1), RATE_SAMPLE_WEIGHT);
+    m_last_received = std::max(m_last_received, now);
+
+    if (m_bytes_per_second == 0 || m_latency == 0) return;
+    // Twice the bandwidth-delay product, so that blocks queued at the peer
+    // cover the time between a block arriving and its replacement being
+    // requested, and the link stays busy while the estimate lags behind.
+    const double blocks_per_round_trip = m_bytes_per_second * m_latency / m_block_bytes;
+    m_target = std::min<double>(std::max<double>(std::ceil(2 * blocks_per_round_trip), MIN_BLOCKS_IN_TRANSIT_PER_PEER), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+bool BlockDownloadRate::ShouldRequest(int in_flight) const
+{
+    if (in_flight >= m_target) return false;
+    return in_flight == 0 || m_target - in_flight >= std::max(1, m_target / 8);
+}
+
+int GetBlockDownloadWindow(int total_target_in_flight)
+{
+    return std::min(std::max(2 * total_target_in_flight, MIN_BLOCK_DOWNLOAD_WINDOW), MAX_BLOCK_DOWNLOAD_WINDOW);
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKDOWNLOAD_H
+#define BITCOIN_BLOCKDOWNLOAD_H
+
+#include <chrono>
+
+#include <stddef.h>
+
+/** Number of blocks requested from a peer at a time until we know how fast it is. */
+static constexpr int MIN_BLOCKS_IN_TRANSIT_PER_PEER{16};
+/** Most blocks that can be requested from a single peer at any given time. */
+static constexpr int MAX_BLOCKS_IN_TRANSIT_PER_PEER{1024};
+/** Size of the "block download window" with few blocks in transit: how far ahead of our current height
+ *  do we fetch? Larger windows tolerate larger download speed differences between peers, but increase
+ *  the potential degree of disordering of blocks on disk (which make reindexing and pruning harder). */
+static constexpr int MIN_BLOCK_DOWNLOAD_WINDOW{1024};
+/** Largest the block download window grows to with many blocks in transit. */
+static constexpr int MAX_BLOCK_DOWNLOAD_WINDOW{16384};
+
+/**
+ * Estimate of how many blocks to keep requested from a peer so that its
+ * link never idles: the number of blocks it sends during one round trip
+ * (the bandwidth-delay product), with some headroom.
+ *
+ * With small blocks, a fixed number of blocks in flight leaves most of the
+ * time of a block download to round trips. The estimate is measured from
+ * the blocks a peer sends us:
+ * - a block requested while none was queued before it at the peer measures
+ *   the latency of the peer: the time from request to arrival;
+ * - a block requested before the previous one arrived was queued at the
+ *   peer, and the time since that previous one measures its bandwidth.
+ *
+ * Both are moving averages. Not thread-safe; the caller synchronizes.
+ */
+class BlockDownloadRate
+{
+    //! Throughput of the peer in bytes per second, 0 until measured
+    double m_bytes_per_second{0};
+    //! Time from request to arrival of a block with nothing queued before it, in seconds
+    double m_latency{0};
+    //! Average size of the blocks received
+    double m_block_bytes{0};
+    //! When the last block arrived
+    std::chrono::microseconds m_last_received{0};
+    int m_target{MIN_BLOCKS_IN_TRANSIT_PER_PEER};
+
+public:
+    /** A block of this serialized size that was requested at `requested` arrived at `now`. */
+    void BlockReceived(size_t bytes, std::chrono::microseconds requested, std::chrono::microseconds now);
+
+    /** Number of blocks to keep in flight from the peer. */
+    int GetTargetInFlight() const { return m_target; }
+
+    /**
+     * Whether to top up the blocks in flight from the peer. Requests are
+     * batched: with a large target they wait until a few blocks arrived.
+     */
+    bool ShouldRequest(int in_flight) const;
+};
+
+/** How far ahead of the last common block to fetch, with this many blocks in transit from all peers together. */
+int GetBlockDownloadWindow(int total_target_in_flight);
+
+#endif // BITCOIN_BLOCKDOWNLOAD_H
@@ -14,26 +14,46 @@
 #include <validation.h>
 #include <util/system.h>
 
+#include <mw/consensus/Params.h>
+#include <mw/mmr/MMR.h>
+
 #include <unordered_map>
 
-CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const PrefillFn& prefill) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())), header(block), mweb_block(block.mweb_block) {
     FillShortTxIDSelector();
-    //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
     prefilledtxn.push_back({0, block.vtx[0]});
 
-    // MWEB: Include HogEx transaction
-    if (!mweb_block.IsNull()) {
-        prefilledtxn.push_back({(uint16_t)(block.vtx.size() - 2), block.vtx.back()});
-    }
-
+    // Prefilled indexes are differentially encoded
+    size_t last_prefilled = 0;
     shorttxids.reserve(block.vtx.size() - 1);
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        if (!tx.IsHogEx()) {
+        // MWEB: Include HogEx transaction
+        if (tx.IsHogEx() || (prefill && prefill(tx))) {
+            prefilledtxn.push_back({(uint16_t)(i - last_prefilled - 1), block.vtx[i]});
+            last_prefilled = i;
+        } else {
             shorttxids.push_back(GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash()));
         }
     }
+
+    if (!mweb_block.IsNull()) {
+        const mw::Block::CPtr& mw_block = mweb_block.m_block;
+        mweb_short_ids.header = mw_block->GetHeader();
+        mweb_short_ids.input_ids.reserve(mw_block->GetInputs().size());
+        for (const Input& input : mw_block->GetInputs()) {
+            mweb_short_ids.input_ids.push_back(GetShortID(input.GetHash()));
+        }
+        mweb_short_ids.output_ids.reserve(mw_block->GetOutputs().size());
+        for (const Output& output : mw_block->GetOutputs()) {
+            mweb_short_ids.output_ids.push_back(GetShortID(output.GetOutputID()));
+        }
+        mweb_short_ids.kernel_ids.reserve(mw_block->GetKernels().size());
+        for (const Kernel& kernel : mw_block->GetKernels()) {
+            mweb_short_ids.kernel_ids.push_back(GetShortID(kernel.GetKernelID()));
+        }
+    }
 }
 
 void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
@@ -52,6 +72,56 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const mw::Hash& hash) const {
+    uint256 hash256;
+    std::copy(hash.vec().begin(), hash.vec().end(), hash256.begin());
+    return GetShortID(hash256);
+}
+
+/**
+ * Map MWEB short IDs to their index in the block. Returns false on a short ID
+ * collision or a suspiciously uneven distribution (see InitData).
+ */
+static bool MapMWEBShortIDs(const std::vector<uint64_t>& ids, std::unordered_map<uint64_t, uint32_t>& id_map)
+{
+    id_map.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        id_map.emplace(ids[i], i);
+        if (id_map.bucket_size(id_map.bucket(ids[i])) > 12) return false;
+    }
+    return id_map.size() == ids.size();
+}
+
+/** Place an MWEB piece found in the mempool. Pieces matched by two different candidates are requested instead. */
+template <typename T>
+static void AddMWEBPiece(std::vector<Optional<T>>& available, std::vector<bool>& conflicted, size_t index, const T& piece)
+{
+    if (conflicted[index]) return;
+    if (!available[index]) {
+        available[index] = piece;
+    } else if (available[index]->GetHash() != piece.GetHash()) {
+        available[index].reset();
+        conflicted[index] = true;
+    }
+}
+
+/** Merge the MWEB pieces found in the mempool with the missing ones received from the peer, in block order. */
+template <typename T>
+static bool MergeMWEBPieces(std::vector<Optional<T>>& available, const std::vector<T>& missing, std::vector<T>& pieces)
+{
+    size_t missing_offset = 0;
+    pieces.reserve(available.size());
+    for (Optional<T>& piece : available) {
+        if (piece) {
+            pieces.push_back(std::move(*piece));
+        } else {
+            if (missing_offset >= missing.size()) return false;
+            pieces.push_back(missing[missing_offset++]);
+        }
+    }
+    return missing_offset == missing.size();
+}
+
 
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
@@ -172,7 +242,80 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
             break;
     }
 
-    LogPrint(BCLog::CMPCTBLOCK, "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n", cmpctblock.header.GetHash().ToString(), GetSerializeSize(cmpctblock, PROTOCOL_VERSION));
+    const ReadStatus mweb_status = InitMWEBData(cmpctblock, extra_txn);
+    if (mweb_status != READ_STATUS_OK) return mweb_status;
+
+    LogPrint(BCLog::CMPCTBLOCK, "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n", cmpctblock.header.GetHash().ToString(), GetSerializeSize(cmpctblock, PROTOCOL_VERSION | (cmpctblock.mweb_short_ids.IsNull() ? 0 : SERIALIZE_MWEB_SHORT_IDS)));
+
+    return READ_STATUS_OK;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitMWEBData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn)
+{
+    const MWEBShortIDs& short_ids = cmpctblock.mweb_short_ids;
+    if (short_ids.IsNull()) return READ_STATUS_OK;
+
+    if (!cmpctblock.mweb_block.IsNull() ||
+            short_ids.kernel_ids.size() != short_ids.header->GetNumKernels() ||
+            short_ids.input_ids.size() > mw::MAX_BLOCK_WEIGHT ||
+            short_ids.output_ids.size() > mw::MAX_BLOCK_WEIGHT / mw::BASE_OUTPUT_WEIGHT ||
+            short_ids.kernel_ids.size() > mw::MAX_BLOCK_WEIGHT / mw::BASE_KERNEL_WEIGHT)
+        return READ_STATUS_INVALID;
+
+    mweb_header = short_ids.header;
+    mweb_inputs_available.resize(short_ids.input_ids.size());
+    mweb_outputs_available.resize(short_ids.output_ids.size());
+    mweb_kernels_available.resize(short_ids.kernel_ids.size());
+
+    std::unordered_map<uint64_t, uint32_t> input_ids, output_ids, kernel_ids;
+    if (!MapMWEBShortIDs(short_ids.input_ids, input_ids) ||
+            !MapMWEBShortIDs(short_ids.output_ids, output_ids) ||
+            !MapMWEBShortIDs(short_ids.kernel_ids, kernel_ids))
+        return READ_STATUS_FAILED; // Short ID collision
+
+    std::vector<bool> inputs_conflicted(mweb_inputs_available.size());
+    std::vector<bool> outputs_conflicted(mweb_outputs_available.size());
+    std::vector<bool> kernels_conflicted(mweb_kernels_available.size());
+    const auto add_mweb_tx = [&](const CTransaction& tx) {
+        if (!tx.HasMWEBTx()) return;
+        const mw::Transaction::CPtr& mweb_tx = tx.mweb_tx.m_transaction;
+
+        // Inputs and outputs are only taken from MWEB transactions with a kernel in
+        // the block, so a short ID collision can't pull in pieces of unrelated ones.
+        bool in_block = false;
+        for (const Kernel& kernel : mweb_tx->GetKernels()) {
+            auto it = kernel_ids.find(cmpctblock.GetShortID(kernel.GetKernelID()));
+            if (it != kernel_ids.end()) {
+                AddMWEBPiece(mweb_kernels_available, kernels_conflicted, it->second, kernel);
+                in_block = true;
+            }
+        }
+        if (!in_block) return;
+
+        for (const Input& input : mweb_tx->GetInputs()) {
+            auto it = input_ids.find(cmpctblock.GetShortID(input.GetHash()));
+            if (it != input_ids.end()) AddMWEBPiece(mweb_inputs_available, inputs_conflicted, it->second, input);
+        }
+        for (const Output& output : mweb_tx->GetOutputs()) {
+            auto it = output_ids.find(cmpctblock.GetShortID(output.GetOutputID()));
+            if (it != output_ids.end()) AddMWEBPiece(mweb_outputs_available, outputs_conflicted, it->second, output);
+        }
+    };
+
+    {
+        LOCK(pool->cs);
+        for (const auto& tx_hash : pool->vTxHashes) {
+            add_mweb_tx(tx_hash.second->GetTx());
+        }
+    }
+    for (const auto& tx : extra_txn) {
+        if (tx.second) add_mweb_tx(*tx.second);
+    }
+
+    const auto count_available = [](const auto& available) {
+        return std::count_if(available.begin(), available.end(), [](const auto& piece) { return bool(piece); });
+    };
+    mweb_mempool_count = count_available(mweb_inputs_available) + count_available(mweb_outputs_available) + count_available(mweb_kernels_available);
 
     return READ_STATUS_OK;
 }
@@ -185,7 +328,57 @@ bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const
     return txn_available[index] != nullptr;
 }
 
-ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing)
+void PartiallyDownloadedBlock::GetMissingMWEB(BlockTransactionsRequest& req) const
+{
+    for (size_t i = 0; i < mweb_inputs_available.size(); i++) {
+        if (!mweb_inputs_available[i]) req.mweb_input_indexes.push_back(i);
+    }
+    for (size_t i = 0; i < mweb_outputs_available.size(); i++) {
+        if (!mweb_outputs_available[i]) req.mweb_output_indexes.push_back(i);
+    }
+    for (size_t i = 0; i < mweb_kernels_available.size(); i++) {
+        if (!mweb_kernels_available[i]) req.mweb_kernel_indexes.push_back(i);
+    }
+}
+
+ReadStatus PartiallyDownloadedBlock::FillMWEBBlock(CBlock& block, const TxBody& mweb_missing)
+{
+    if (!mweb_header) {
+        if (!mweb_missing.GetInputs().empty() || !mweb_missing.GetOutputs().empty() || !mweb_missing.GetKernels().empty())
+            return READ_STATUS_INVALID;
+        return READ_STATUS_OK;
+    }
+
+    const size_t mweb_count = mweb_inputs_available.size() + mweb_outputs_available.size() + mweb_kernels_available.size();
+    std::vector<Input> inputs;
+    std::vector<Output> outputs;
+    std::vector<Kernel> kernels;
+    const bool merged = MergeMWEBPieces(mweb_inputs_available, mweb_missing.GetInputs(), inputs) &&
+                        MergeMWEBPieces(mweb_outputs_available, mweb_missing.GetOutputs(), outputs) &&
+                        MergeMWEBPieces(mweb_kernels_available, mweb_missing.GetKernels(), kernels);
+    mw::Header::CPtr header_mweb = std::move(mweb_header);
+    mweb_header.reset();
+    mweb_inputs_available.clear();
+    mweb_outputs_available.clear();
+    mweb_kernels_available.clear();
+    if (!merged) return READ_STATUS_INVALID;
+
+    // Kernels are committed to by the MWEB header, so a short ID collision among
+    // them shows up here rather than as an invalid block.
+    MemMMR kernel_mmr;
+    for (const Kernel& kernel : kernels) {
+        kernel_mmr.Add(kernel);
+    }
+    if (kernel_mmr.Root() != header_mweb->GetKernelRoot())
+        return READ_STATUS_FAILED;
+
+    block.mweb_block = MWEB::Block(std::make_shared<mw::Block>(header_mweb, TxBody(std::move(inputs), std::move(outputs), std::move(kernels))));
+
+    LogPrint(BCLog::CMPCTBLOCK, "Reconstructed MWEB block %s with %lu of %lu pieces from mempool\n", header.GetHash().ToString(), mweb_mempool_count, mweb_count);
+    return READ_STATUS_OK;
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing, const TxBody& mweb_missing)
 {
     if (header.IsNull()) return READ_STATUS_INVALID;
 
@@ -204,12 +397,14 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
             block.vtx[i] = std::move(txn_available[i]);
     }
 
+    const ReadStatus mweb_status = FillMWEBBlock(block, mweb_missing);
+
     // Make sure we can't call FillBlock again.
     header.SetNull();
     txn_available.clear();
 
-    if (vtx_missing.size() != tx_missing_offset)
-        return READ_STATUS_INVALID;
+    if (vtx_missing.size() != tx_missing_offset || mweb_status != READ_STATUS_OK)
+        return mweb_status == READ_STATUS_FAILED ? READ_STATUS_FAILED : READ_STATUS_INVALID;
 
     BlockValidationState state;
     CheckBlockFn check_block = m_check_block_mock ? m_check_block_mock : CheckBlock;
@@ -5,9 +5,12 @@
 #ifndef BITCOIN_BLOCKENCODINGS_H
 #define BITCOIN_BLOCKENCODINGS_H
 
+#include <optional.h>
 #include <primitives/block.h>
 
+#include <algorithm>
 #include <functional>
+#include <limits>
 
 
 class CTxMemPool;
@@ -20,6 +23,13 @@ struct Params;
 // an actual formatter here.
 using TransactionCompression = DefaultFormatter;
 
+/**
+ * Serialization flag for compact block version 4: the MWEB extension block of a
+ * cmpctblock is sent as short IDs (see MWEBShortIDs), and getblocktxn/blocktxn
+ * carry the MWEB inputs, outputs and kernels the receiver could not find.
+ */
+static const int SERIALIZE_MWEB_SHORT_IDS = 0x10000000;
+
 class DifferenceFormatter
 {
     uint64_t m_shift = 0;
@@ -42,15 +52,129 @@ public:
     }
 };
 
+/**
+ * Formatter for the headers of a headers2 message, a chain in which each
+ * header builds on the one before it. What follows from the previous header
+ * is left out: its hash as hashPrevBlock, an nBits that did not change, an
+ * nVersion that is one of the last 7 different ones (by its index), and
+ * nTime as a 2 byte difference. A flags byte tells which of these are
+ * included in full. Most headers take 39 bytes instead of 81 in HEADERS.
+ */
+class CompressedHeaderFormatter
+{
+    enum Flags : uint8_t {
+        //! 1 + the index of nVersion in m_versions, or 0 if it is included
+        VERSION_INDEX_MASK = 0x07,
+        PREV_BLOCK = 0x08,
+        FULL_TIME = 0x10,
+        BITS = 0x20,
+    };
+    static constexpr size_t MAX_VERSIONS = VERSION_INDEX_MASK;
+
+    //! Recently seen versions, most recent first
+    std::vector<int32_t> m_versions;
+    Optional<CBlockHeader> m_prev;
+    uint256 m_prev_hash;
+
+    void UseVersion(size_t index, int32_t version)
+    {
+        if (index < m_versions.size()) m_versions.erase(m_versions.begin() + index);
+        m_versions.insert(m_versions.begin(), version);
+        if (m_versions.size() > MAX_VERSIONS) m_versions.pop_back();
+    }
+
+    void SetPrev(const CBlockHeader& header)
+    {
+        m_prev = header;
+        m_prev_hash = header.GetHash();
+    }
+
+public:
+    template<typename Stream>
+    void Ser(Stream& s, const CBlockHeader& header)
+    {
+        uint8_t flags = 0;
+        const size_t version_index = std::find(m_versions.begin(), m_versions.end(), header.nVersion) - m_versions.begin();
+        if (version_index < m_versions.size()) flags |= version_index + 1;
+        if (!m_prev || header.hashPrevBlock != m_prev_hash) flags |= PREV_BLOCK;
+        const int64_t time_diff = m_prev ? int64_t{header.nTime} - m_prev->nTime : 0;
+        if (!m_prev || time_diff < std::numeric_limits<int16_t>::min() || time_diff > std::numeric_limits<int16_t>::max()) flags |= FULL_TIME;
+        if (!m_prev || header.nBits != m_prev->nBits) flags |= BITS;
+
+        ser_writedata8(s, flags);
+        if (!(flags & VERSION_INDEX_MASK)) ser_writedata32(s, header.nVersion);
+        if (flags & PREV_BLOCK) s << header.hashPrevBlock;
+        s << header.hashMerkleRoot;
+        if (flags & FULL_TIME) {
+            ser_writedata32(s, header.nTime);
+        } else {
+            ser_writedata16(s, static_cast<uint16_t>(static_cast<int16_t>(time_diff)));
+        }
+        if (flags & BITS) ser_writedata32(s, header.nBits);
+        ser_writedata32(s, header.nNonce);
+
+        UseVersion(version_index, header.nVersion);
+        SetPrev(header);
+    }
+
+    template<typename Stream>
+    void Unser(Stream& s, CBlockHeader& header)
+    {
+        const uint8_t flags = ser_readdata8(s);
+        if (flags & ~(VERSION_INDEX_MASK | PREV_BLOCK | FULL_TIME | BITS)) throw std::ios_base::failure("unknown compressed header flags");
+        if (!m_prev && (flags & (PREV_BLOCK | FULL_TIME | BITS)) != (PREV_BLOCK | FULL_TIME | BITS)) {
+            throw std::ios_base::failure("first compressed header is incomplete");
+        }
+
+        const size_t version_index = (flags & VERSION_INDEX_MASK) ? (flags & VERSION_INDEX_MASK) - 1 : m_versions.size();
+        if (flags & VERSION_INDEX_MASK) {
+            if (version_index >= m_versions.size()) throw std::ios_base::failure("compressed header version index out of range");
+            header.nVersion = m_versions[version_index];
+        } else {
+            header.nVersion = ser_readdata32(s);
+        }
+        if (flags & PREV_BLOCK) {
+            s >> header.hashPrevBlock;
+        } else {
+            header.hashPrevBlock = m_prev_hash;
+        }
+        s >> header.hashMerkleRoot;
+        if (flags & FULL_TIME) {
+            header.nTime = ser_readdata32(s);
+        } else {
+            header.nTime = m_prev->nTime + static_cast<int16_t>(ser_readdata16(s));
+        }
+        header.nBits = (flags & BITS) ? ser_readdata32(s) : m_prev->nBits;
+        header.nNonce = ser_readdata32(s);
+
+        UseVersion(version_index, header.nVersion);
+        SetPrev(header);
+    }
+};
+
 class BlockTransactionsRequest {
 public:
     // A BlockTransactionsRequest message
     uint256 blockhash;
     std::vector<uint16_t> indexes;
+    // Indexes of missing MWEB inputs, outputs and kernels (SERIALIZE_MWEB_SHORT_IDS only)
+    std::vector<uint32_t> mweb_input_indexes;
+    std::vector<uint32_t> mweb_output_indexes;
+    std::vector<uint32_t> mweb_kernel_indexes;
+
+    bool IsEmpty() const
+    {
+        return indexes.empty() && mweb_input_indexes.empty() && mweb_output_indexes.empty() && mweb_kernel_indexes.empty();
+    }
 
     SERIALIZE_METHODS(BlockTransactionsRequest, obj)
     {
         READWRITE(obj.blockhash, Using<VectorFormatter<DifferenceFormatter>>(obj.indexes));
+        if (s.GetVersion() & SERIALIZE_MWEB_SHORT_IDS) {
+            READWRITE(Using<VectorFormatter<DifferenceFormatter>>(obj.mweb_input_indexes));
+            READWRITE(Using<VectorFormatter<DifferenceFormatter>>(obj.mweb_output_indexes));
+            READWRITE(Using<VectorFormatter<DifferenceFormatter>>(obj.mweb_kernel_indexes));
+        }
     }
 };
 
@@ -59,6 +183,8 @@ public:
     // A BlockTransactions message
     uint256 blockhash;
     std::vector<CTransactionRef> txn;
+    // The requested MWEB inputs, outputs and kernels (SERIALIZE_MWEB_SHORT_IDS only)
+    TxBody mweb_body;
 
     BlockTransactions() {}
     explicit BlockTransactions(const BlockTransactionsRequest& req) :
@@ -67,6 +193,9 @@ public:
     SERIALIZE_METHODS(BlockTransactions, obj)
     {
         READWRITE(obj.blockhash, Using<VectorFormatter<TransactionCompression>>(obj.txn));
+        if (s.GetVersion() & SERIALIZE_MWEB_SHORT_IDS) {
+            READWRITE(obj.mweb_body);
+        }
     }
 };
 
@@ -89,6 +218,33 @@ typedef enum ReadStatus_t
                                    // failure in CheckBlock.
 } ReadStatus;
 
+/**
+ * The MWEB extension block of a compact block, as short IDs. The inputs, outputs
+ * and kernels of an MWEB block are aggregated from MWEB transactions that the
+ * receiver most likely has in its mempool already, so only the MWEB header and a
+ * short ID for each input, output and kernel are sent. Short IDs are computed
+ * like short transaction IDs, from the input hash, output ID and kernel ID. The
+ * body of an MWEB block is sorted, so the short IDs are in block order.
+ */
+struct MWEBShortIDs {
+    mw::Header::CPtr header;
+    std::vector<uint64_t> input_ids;
+    std::vector<uint64_t> output_ids;
+    std::vector<uint64_t> kernel_ids;
+
+    bool IsNull() const { return header == nullptr; }
+
+    SERIALIZE_METHODS(MWEBShortIDs, obj)
+    {
+        READWRITE(WrapOptionalPtr(obj.header));
+        if (obj.header) {
+            READWRITE(Using<VectorFormatter<CustomUintFormatter<6>>>(obj.input_ids));
+            READWRITE(Using<VectorFormatter<CustomUintFormatter<6>>>(obj.output_ids));
+            READWRITE(Using<VectorFormatter<CustomUintFormatter<6>>>(obj.kernel_ids));
+        }
+    }
+};
+
 class CBlockHeaderAndShortTxIDs {
 private:
     mutable uint64_t shorttxidk0, shorttxidk1;
@@ -107,13 +263,19 @@ public:
 
     CBlockHeader header;
     MWEB::Block mweb_block;
+    //! Short ID form of mweb_block, which is sent instead with SERIALIZE_MWEB_SHORT_IDS
+    MWEBShortIDs mweb_short_ids;
+
+    //! Decides which transactions of a block to send in full, e.g. because the peer is missing them
+    using PrefillFn = std::function<bool(const CTransaction&)>;
 
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const PrefillFn& prefill = nullptr);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    uint64_t GetShortID(const mw::Hash& hash) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
@@ -123,7 +285,11 @@ public:
 		
         READWRITE(obj.header, obj.nonce, Using<VectorFormatter<CustomUintFormatter<SHORTTXIDS_LENGTH>>>(obj.shorttxids), obj.prefilledtxn);
         if (fAllowMWEB) {
-            READWRITE(obj.mweb_block);
+            if (s.GetVersion() & SERIALIZE_MWEB_SHORT_IDS) {
+                READWRITE(obj.mweb_short_ids);
+            } else {
+                READWRITE(obj.mweb_block);
+            }
         }
 
         if (ser_action.ForRead()) {
@@ -140,6 +306,16 @@ protected:
     std::vector<CTransactionRef> txn_available;
     size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
     const CTxMemPool* pool;
+
+    // MWEB block pieces, if the compact block carried MWEB short IDs
+    mw::Header::CPtr mweb_header;
+    std::vector<Optional<Input>> mweb_inputs_available;
+    std::vector<Optional<Output>> mweb_outputs_available;
+    std::vector<Optional<Kernel>> mweb_kernels_available;
+    size_t mweb_mempool_count = 0;
+
+    ReadStatus InitMWEBData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
+    ReadStatus FillMWEBBlock(CBlock& block, const TxBody& mweb_missing);
 public:
     CBlockHeader header;
     MWEB::Block mweb_block;
@@ -153,7 +329,9 @@ public:
     // extra_txn is a list of extra transactions to look at, in <witness hash, reference> form
     ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
     bool IsTxAvailable(size_t index) const;
-    ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
+    // Add the indexes of the MWEB inputs, outputs and kernels that are still missing to req
+    void GetMissingMWEB(BlockTransactionsRequest& req) const;
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing, const TxBody& mweb_missing = TxBody());
 };
 
 #endif // BITCOIN_BLOCKENCODINGS_H
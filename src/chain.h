@@ -128,7 +128,8 @@ enum BlockStatus: uint32_t {
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
 
-    BLOCK_HAVE_MWEB         =   (1 << 28)
+    BLOCK_HAVE_MWEB         =   (1 << 28),
+    BLOCK_UNDO_COLUMNAR     =   (1 << 29), //!< undo data in rev*.dat uses the columnar format (BlockUndoColumnarFormatter)
 };
 
 /** The block chain is a tree shaped structure starting with the
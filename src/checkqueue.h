@@ -196,8 +196,11 @@ public:
 
     void Add(std::vector<T>& vChecks)
     {
-        if (pqueue != nullptr)
+        if (pqueue != nullptr) {
             pqueue->Add(vChecks);
+            // Checks added after a Wait() must be waited for again on destruction
+            fDone = false;
+        }
     }
 
     ~CCheckQueueControl()
@@ -53,6 +53,11 @@ enum class TxValidationResult {
      */
     TX_CONFLICT,
     TX_MEMPOOL_POLICY,        //!< violated mempool's fee/size/descendant/RBF/etc limits
+    /**
+     * Fell short of the minimum feerate on its own, but may be accepted as
+     * part of a package whose descendants pay for it (see ProcessNewPackage).
+     */
+    TX_RECONSIDERABLE,
 };
 
 /** A "reason" why a block was invalid, suitable for determining whether the
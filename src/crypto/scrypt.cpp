@@ -255,17 +255,14 @@ static inline void xor_salsa8(uint32_t B[16], const uint32_t Bx[16])
 	B[15] += x15;
 }
 
-void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad)
+static void scrypt_core_generic(uint8_t *B, char *scratchpad)
 {
-	uint8_t B[128];
 	uint32_t X[32];
 	uint32_t *V;
 	uint32_t i, j, k;
 
 	V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
 
-	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
-
 	for (k = 0; k < 32; k++)
 		X[k] = le32dec(&B[4 * k]);
 
@@ -284,10 +281,78 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 
 	for (k = 0; k < 32; k++)
 		le32enc(&B[4 * k], X[k]);
+}
+
+void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+
+	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
+
+	scrypt_core_generic(B, scratchpad);
 
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
+void scrypt_1024_1_1_256_sp_batch(const char *input, uint32_t first_nonce, size_t count, char *output, char *scratchpad)
+{
+	uint8_t header[80];
+	uint8_t khash[32];
+	uint8_t ivec[4];
+	uint8_t B[128];
+	SHA256_CTX prefix, ctx;
+	HMAC_SHA256_CTX key, PShctx, hctx;
+	size_t n, i;
+	void (*core)(uint8_t *, char *);
+
+#if defined(USE_SSE2_ALWAYS)
+	core = &scrypt_core_sse2;
+#elif defined(USE_SSE2)
+	core = scrypt_1024_1_1_256_sp_detected == &scrypt_1024_1_1_256_sp_sse2 ? &scrypt_core_sse2 : &scrypt_core_generic;
+#else
+	core = &scrypt_core_generic;
+#endif
+
+	memcpy(header, input, 80);
+
+	/* The first 64 bytes of the header are the same for every nonce. */
+	SHA256_Init(&prefix);
+	SHA256_Update(&prefix, header, 64);
+
+	for (n = 0; n < count; n++) {
+		le32enc(&header[76], first_nonce + (uint32_t)n);
+
+		/* The header is longer than a block, so the HMAC key is its hash. */
+		memcpy(&ctx, &prefix, sizeof(SHA256_CTX));
+		SHA256_Update(&ctx, &header[64], 16);
+		SHA256_Final(khash, &ctx);
+		HMAC_SHA256_Init(&key, khash, 32);
+
+		/* B = PBKDF2(header, header, 1, 128) */
+		memcpy(&PShctx, &key, sizeof(HMAC_SHA256_CTX));
+		HMAC_SHA256_Update(&PShctx, header, 80);
+		for (i = 0; i < 4; i++) {
+			be32enc(ivec, (uint32_t)(i + 1));
+			memcpy(&hctx, &PShctx, sizeof(HMAC_SHA256_CTX));
+			HMAC_SHA256_Update(&hctx, ivec, 4);
+			HMAC_SHA256_Final(&B[i * 32], &hctx);
+		}
+
+		core(B, scratchpad);
+
+		/* output = PBKDF2(header, B, 1, 32), with the same key. */
+		memcpy(&hctx, &key, sizeof(HMAC_SHA256_CTX));
+		HMAC_SHA256_Update(&hctx, B, 128);
+		be32enc(ivec, 1);
+		HMAC_SHA256_Update(&hctx, ivec, 4);
+		HMAC_SHA256_Final((unsigned char *)&output[n * 32], &hctx);
+	}
+
+	/* Clean the stack. */
+	memset(khash, 0, 32);
+	memset(&key, 0, sizeof(HMAC_SHA256_CTX));
+}
+
 #if defined(USE_SSE2)
 // By default, set to generic scrypt function. This will prevent crash in case when scrypt_detect_sse2() wasn't called
 void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
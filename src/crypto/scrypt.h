@@ -8,6 +8,13 @@ static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
+/**
+ * Hash the 80 byte block header in input with count consecutive nonces,
+ * starting at first_nonce, and write the 32 byte hashes to output one after
+ * the other. The part of the work that doesn't depend on the nonce is done
+ * once for all of them.
+ */
+void scrypt_1024_1_1_256_sp_batch(const char *input, uint32_t first_nonce, size_t count, char *output, char *scratchpad);
 
 #if defined(USE_SSE2)
 #include <string>
@@ -20,6 +27,7 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 
 std::string scrypt_detect_sse2();
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
+void scrypt_core_sse2(uint8_t *B, char *scratchpad);
 extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
 #else
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
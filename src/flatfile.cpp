@@ -8,8 +8,30 @@
 #include <flatfile.h>
 #include <logging.h>
 #include <tinyformat.h>
+#include <util/memory.h>
 #include <util/system.h>
 
+#include <mio/mmap.hpp>
+
+struct FlatFileMapping::Impl
+{
+    mio::mmap_source mmap;
+};
+
+FlatFileMapping::FlatFileMapping(std::unique_ptr<Impl> impl) : m_impl(std::move(impl)) {}
+
+FlatFileMapping::~FlatFileMapping() = default;
+
+const unsigned char* FlatFileMapping::data() const
+{
+    return reinterpret_cast<const unsigned char*>(m_impl->mmap.data());
+}
+
+size_t FlatFileMapping::size() const
+{
+    return m_impl->mmap.size();
+}
+
 FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size) :
     m_dir(std::move(dir)),
     m_prefix(prefix),
@@ -52,6 +74,24 @@ FILE* FlatFileSeq::Open(const FlatFilePos& pos, bool read_only)
     return file;
 }
 
+std::shared_ptr<const FlatFileMapping> FlatFileSeq::Map(const FlatFilePos& pos) const
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    if (pos.IsNull() || sizeof(void*) < 8) {
+        return nullptr;
+    }
+    std::error_code error;
+    auto impl = MakeUnique<FlatFileMapping::Impl>();
+    impl->mmap = mio::make_mmap_source(FileName(pos).string(), error);
+    if (error) {
+        return nullptr;
+    }
+    return std::make_shared<const FlatFileMapping>(std::move(impl));
+#endif
+}
+
 size_t FlatFileSeq::Allocate(const FlatFilePos& pos, size_t add_size, bool& out_of_space)
 {
     out_of_space = false;
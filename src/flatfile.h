@@ -6,6 +6,7 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <memory>
 #include <string>
 
 #include <fs.h>
@@ -39,6 +40,25 @@ struct FlatFilePos
     std::string ToString() const;
 };
 
+/**
+ * Read-only memory mapping of one file of a FlatFileSeq, see FlatFileSeq::Map().
+ * Data appended to the file after it was mapped is not covered by the mapping.
+ */
+class FlatFileMapping
+{
+public:
+    struct Impl;
+
+    explicit FlatFileMapping(std::unique_ptr<Impl> impl);
+    ~FlatFileMapping();
+
+    const unsigned char* data() const;
+    size_t size() const;
+
+private:
+    const std::unique_ptr<Impl> m_impl;
+};
+
 /**
  * FlatFileSeq represents a sequence of numbered files storing raw data. This class facilitates
  * access to and efficient management of these files.
@@ -66,6 +86,14 @@ public:
     /** Open a handle to the file at the given position. */
     FILE* Open(const FlatFilePos& pos, bool read_only = false);
 
+    /**
+     * Map the file at the given position read-only into memory. Returns nullptr if
+     * the file cannot be mapped. Mapping is not used on Windows, where a mapped file
+     * cannot be truncated by Flush(), nor on 32-bit platforms, where address space
+     * is too scarce for files of this size.
+     */
+    std::shared_ptr<const FlatFileMapping> Map(const FlatFilePos& pos) const;
+
     /**
      * Allocate additional space in a file after the given starting position. The amount allocated
      * will be the minimum multiple of the sequence chunk size greater than add_size.
@@ -0,0 +1,60 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <headerscache.h>
+
+Optional<CSharedNetMsg> HeadersCache::Get(const HeadersCacheKey& key)
+{
+    LOCK(m_mutex);
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->key == key) {
+            m_entries.splice(m_entries.begin(), m_entries, it);
+            return it->msg;
+        }
+    }
+    return nullopt;
+}
+
+void HeadersCache::Add(const HeadersCacheKey& key, int last_height, CSharedNetMsg msg)
+{
+    const size_t bytes = msg.data->size();
+    if (bytes > m_max_bytes) return;
+
+    LOCK(m_mutex);
+    for (const Entry& entry : m_entries) {
+        // Another peer asked for the same range at the same time.
+        if (entry.key == key) return;
+    }
+    m_entries.push_front(Entry{key, last_height, std::move(msg)});
+    m_bytes += bytes;
+    while (m_bytes > m_max_bytes) {
+        m_bytes -= m_entries.back().msg.data->size();
+        m_entries.pop_back();
+    }
+}
+
+void HeadersCache::BlockDisconnected(int height)
+{
+    LOCK(m_mutex);
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->last_height >= height) {
+            m_bytes -= it->msg.data->size();
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t HeadersCache::Count() const
+{
+    LOCK(m_mutex);
+    return m_entries.size();
+}
+
+size_t HeadersCache::Bytes() const
+{
+    LOCK(m_mutex);
+    return m_bytes;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_HEADERSCACHE_H
+#define BITCOIN_HEADERSCACHE_H
+
+#include <net.h> // For CSharedNetMsg
+#include <optional.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+
+#include <stddef.h>
+
+/** Default size of the cache of serialized headers and headers2 responses */
+static constexpr size_t DEFAULT_HEADERS_CACHE_BYTES{16 << 20};
+
+/**
+ * A full headers (or headers2) response is determined by the height of its
+ * first header and the hash of its last one: the block hash commits to all
+ * of its ancestors. An entry for it can never go stale, a reorg just makes
+ * the chain stop leading to it.
+ */
+struct HeadersCacheKey {
+    bool compressed{false};
+    int start_height{0};
+    uint256 last_hash;
+
+    friend bool operator==(const HeadersCacheKey& a, const HeadersCacheKey& b)
+    {
+        return a.compressed == b.compressed && a.start_height == b.start_height && a.last_hash == b.last_hash;
+    }
+};
+
+/**
+ * Serialized responses to getheaders and getheaders2 that return a full
+ * batch of headers below the tip.
+ *
+ * Peers doing their initial sync from us ask for the same batches: the
+ * first MAX_HEADERS_RESULTS headers after genesis, then the next batch,
+ * and so on. The response for each batch is serialized and checksummed
+ * once and then shared between them, like recently requested blocks are.
+ *
+ * Entries are immutable, so the cache is consistent with the active chain
+ * without reading it: the caller looks up the block at the end of the
+ * requested range and asks for the response ending in it. Entries for
+ * disconnected blocks are dropped to free their memory, and otherwise the
+ * least recently used ones once the cache is full. Thread-safe.
+ */
+class HeadersCache
+{
+    struct Entry {
+        HeadersCacheKey key;
+        int last_height;
+        CSharedNetMsg msg;
+    };
+
+    const size_t m_max_bytes;
+    mutable Mutex m_mutex;
+    //! Most recently used first
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+    size_t m_bytes GUARDED_BY(m_mutex){0};
+
+public:
+    explicit HeadersCache(size_t max_bytes = DEFAULT_HEADERS_CACHE_BYTES) : m_max_bytes(max_bytes) {}
+
+    /** Get the response for a range of headers, if cached. */
+    Optional<CSharedNetMsg> Get(const HeadersCacheKey& key);
+
+    /** Cache the response for a range of headers ending at last_height. */
+    void Add(const HeadersCacheKey& key, int last_height, CSharedNetMsg msg);
+
+    /** Drop the responses containing the block at this height, which was disconnected. */
+    void BlockDisconnected(int height);
+
+    /** Number of responses cached, and their total size */
+    size_t Count() const;
+    size_t Bytes() const;
+};
+
+#endif // BITCOIN_HEADERSCACHE_H
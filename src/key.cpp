@@ -229,6 +229,14 @@ bool CKey::Sign(const uint256 &hash, std::vector<unsigned char>& vchSig, bool gr
     return true;
 }
 
+bool CKey::ComputeECDHPoint(const CPubKey& pubkey, CPubKey& point) const {
+    assert(fValid);
+    if (!pubkey.IsFullyValid()) return false;
+    // The sign context of this file has no multiplication tables for
+    // arbitrary points, so let CPubKey do the multiplication.
+    return pubkey.Multiply(MakeSpan(keydata), point);
+}
+
 bool CKey::VerifyPubKey(const CPubKey& pubkey) const {
     if (pubkey.IsCompressed() != fCompressed) {
         return false;
@@ -137,6 +137,14 @@ public:
      */
     bool VerifyPubKey(const CPubKey& vchPubKey) const;
 
+    /**
+     * Compute the ECDH point of this key and another party's public key, as a
+     * compressed public key. Both parties arrive at the same point, which is
+     * only suitable as input to a key derivation function. Returns false if
+     * the other public key is invalid.
+     */
+    bool ComputeECDHPoint(const CPubKey& pubkey, CPubKey& point) const;
+
     //! Load private key and check that public key matches.
     bool Load(const CPrivKey& privkey, const CPubKey& vchPubKey, bool fSkipCheck);
 };
@@ -13,16 +13,26 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/scrypt.h>
 #include <mw/consensus/Params.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <pow.h>
 #include <primitives/transaction.h>
+#include <shutdown.h>
+#include <streams.h>
 #include <timedata.h>
+#include <util/memory.h>
 #include <util/moneystr.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 
 #include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -41,12 +51,17 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
 }
 
 void RegenerateCommitments(CBlock& block)
+{
+    RegenerateCommitments(block, WITH_LOCK(cs_main, return LookupBlockIndex(block.hashPrevBlock)));
+}
+
+void RegenerateCommitments(CBlock& block, const CBlockIndex* pindexPrev)
 {
     CMutableTransaction tx{*block.vtx.at(0)};
     tx.vout.erase(tx.vout.begin() + GetWitnessCommitmentIndex(block));
     block.vtx.at(0) = MakeTransactionRef(tx);
 
-    GenerateCoinbaseCommitment(block, WITH_LOCK(cs_main, return LookupBlockIndex(block.hashPrevBlock)), Params().GetConsensus());
+    GenerateCoinbaseCommitment(block, pindexPrev, Params().GetConsensus());
 
     block.hashMerkleRoot = BlockMerkleRoot(block);
 }
@@ -54,6 +69,7 @@ void RegenerateCommitments(CBlock& block)
 BlockAssembler::Options::Options() {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    knapsack = DEFAULT_BLOCK_KNAPSACK;
 }
 
 BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, const Options& options)
@@ -61,6 +77,7 @@ BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& pa
       m_mempool(mempool)
 {
     blockMinFeeRate = options.blockMinFeeRate;
+    fKnapsack = options.knapsack;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
 }
@@ -77,6 +94,7 @@ static BlockAssembler::Options DefaultOptions()
     } else {
         options.blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     }
+    options.knapsack = gArgs.GetBoolArg("-blockknapsack", DEFAULT_BLOCK_KNAPSACK);
     return options;
 }
 
@@ -86,6 +104,7 @@ BlockAssembler::BlockAssembler(const CTxMemPool& mempool, const CChainParams& pa
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
+    setBlockTxids.clear();
 
     // Reserve space for coinbase tx
     nBlockWeight = 4000;
@@ -124,6 +143,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     CBlockIndex* pindexPrev = ::ChainActive().Tip();
     assert(pindexPrev != nullptr);
     nHeight = pindexPrev->nHeight + 1;
+    m_prev_block = pindexPrev;
 
     pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
     // -regtest only: allow overriding block.nVersion with
@@ -156,7 +176,14 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    // Knapsack selection relies on the cluster size limit of cluster mode
+    if (fKnapsack && m_mempool.IsClusterMode()) {
+        addKnapsackTxs(nPackagesSelected);
+    } else if (m_mempool.IsClusterMode()) {
+        addChunkTxs(nPackagesSelected);
+    } else {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     if (fIncludeMWEB) {
         // Check if we need to create a HogEx transaction
@@ -325,6 +352,7 @@ bool BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nBlockMWEBWeight += iter->GetMWEBWeight();
     nFees += iter->GetFee();
     inBlock.insert(iter);
+    setBlockTxids.insert(iter->GetTx().GetHash());
 
     bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
@@ -336,6 +364,60 @@ bool BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     return true;
 }
 
+BlockAssembler::AppendResult BlockAssembler::AppendTransaction(CBlockTemplate& block_template, CTxMemPool::txiter iter)
+{
+    const CTransaction& tx = iter->GetTx();
+    if (HasTransaction(tx.GetHash())) {
+        return AppendResult::SKIPPED;
+    }
+    if (tx.HasMWEBTx()) {
+        return AppendResult::IMPROVABLE;
+    }
+    for (const CTxMemPoolEntry& parent : iter->GetMemPoolParentsConst()) {
+        // Together with its parents, it may be a package worth including
+        if (!HasTransaction(parent.GetTx().GetHash())) return AppendResult::IMPROVABLE;
+    }
+    if (iter->GetModifiedFee() < blockMinFeeRate.GetTotalFee(iter->GetTxSize(), iter->GetMWEBWeight())) {
+        return AppendResult::SKIPPED;
+    }
+    if (!TestPackage(iter->GetTxSize(), iter->GetSigOpCost(), iter->GetMWEBWeight())) {
+        // It may pay more than what is in the block already
+        return AppendResult::IMPROVABLE;
+    }
+    if (!TestPackageTransactions({iter}, {})) {
+        return AppendResult::SKIPPED;
+    }
+
+    // Insert before the HogEx, which must be the last transaction
+    CBlock& block = block_template.block;
+    const size_t pos = block.vtx.size() - (block.vtx.back()->IsHogEx() ? 1 : 0);
+    block.vtx.insert(block.vtx.begin() + pos, iter->GetSharedTx());
+    block_template.vTxFees.insert(block_template.vTxFees.begin() + pos, iter->GetFee());
+    block_template.vTxSigOpsCost.insert(block_template.vTxSigOpsCost.begin() + pos, iter->GetSigOpCost());
+
+    nBlockWeight += iter->GetTxWeight();
+    nBlockSigOpsCost += iter->GetSigOpCost();
+    nFees += iter->GetFee();
+    ++nBlockTx;
+    setBlockTxids.insert(tx.GetHash());
+
+    CMutableTransaction coinbase(*block.vtx[0]);
+    coinbase.vout[0].nValue += iter->GetFee();
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    block_template.vTxFees[0] = -nFees;
+
+    const int commitpos = GetWitnessCommitmentIndex(block);
+    if (commitpos != NO_WITNESS_COMMITMENT) {
+        RegenerateCommitments(block, m_prev_block);
+        const CScript& commitment = block.vtx[0]->vout[GetWitnessCommitmentIndex(block)].scriptPubKey;
+        block_template.vchCoinbaseCommitment.assign(commitment.begin(), commitment.end());
+    } else {
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+    }
+
+    return AppendResult::ADDED;
+}
+
 int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
         indexed_modified_transaction_set &mapModifiedTx)
 {
@@ -543,6 +625,449 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+BlockTemplateCache::BlockTemplateCache(const CTxMemPool& mempool, const CChainParams& params)
+    : m_mempool(mempool), m_params(params), m_assembler(mempool, params) {}
+
+void BlockTemplateCache::Rebuild()
+{
+    m_template.reset();
+    m_template = m_assembler.CreateNewBlock(CScript() << OP_TRUE);
+    m_template_time = GetTime();
+    m_must_rebuild = false;
+    m_improvable = false;
+    // CreateNewBlock has already run TestBlockValidity
+    m_validated = true;
+    Updated(/* appended_tx */ nullptr, /* fee */ 0);
+}
+
+void BlockTemplateCache::Updated(const CTransactionRef& appended_tx, CAmount fee)
+{
+    ++m_sequence;
+    m_shared_template.reset();
+    m_update_cv.notify_all();
+    GetMainSignals().BlockTemplateUpdated(m_template->block.hashPrevBlock, m_sequence, appended_tx, fee);
+}
+
+std::shared_ptr<const CBlockTemplate> BlockTemplateCache::GetBlockTemplate(uint64_t* sequence)
+{
+    AssertLockHeld(cs_main);
+    LOCK2(m_mempool.cs, m_mutex);
+    m_active = true;
+    m_tip_hash = ::ChainActive().Tip()->GetBlockHash();
+    if (!m_template || m_must_rebuild ||
+            m_template->block.hashPrevBlock != m_tip_hash ||
+            (m_improvable && GetTime() - m_template_time >= TEMPLATE_REBUILD_INTERVAL)) {
+        Rebuild();
+    }
+    if (!m_validated) {
+        BlockValidationState state;
+        if (!TestBlockValidity(state, m_params, m_template->block, ::ChainActive().Tip(), false, false)) {
+            LogPrintf("%s: Appended block template failed validity check, rebuilding: %s\n", __func__, state.ToString());
+            Rebuild();
+        }
+        m_validated = true;
+    }
+    if (!m_shared_template) {
+        m_shared_template = std::make_shared<const CBlockTemplate>(*m_template);
+    }
+    if (sequence) *sequence = m_sequence;
+    return m_shared_template;
+}
+
+void BlockTemplateCache::WaitForUpdate(const uint256& prev_block_hash, uint64_t sequence, std::chrono::steady_clock::time_point tx_deadline)
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (!m_interrupted && m_tip_hash == prev_block_hash) {
+        const bool changed = m_sequence != sequence || m_must_rebuild || m_improvable;
+        if (!changed) {
+            m_update_cv.wait(lock);
+        } else if (m_update_cv.wait_until(lock, tx_deadline) == std::cv_status::timeout) {
+            break;
+        }
+    }
+}
+
+void BlockTemplateCache::Interrupt()
+{
+    LOCK(m_mutex);
+    m_interrupted = true;
+    m_update_cv.notify_all();
+}
+
+void BlockTemplateCache::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence)
+{
+    // Doesn't take cs_main, so as not to hold up validation. A template for a tip
+    // that is already replaced, but not yet announced through UpdatedBlockTip,
+    // is never served: GetBlockTemplate and UpdatedBlockTip rebuild it.
+    LOCK2(m_mempool.cs, m_mutex);
+    if (!m_template || m_must_rebuild) return;
+    if (m_template->block.hashPrevBlock != m_tip_hash) return;
+    // The transaction may have left the mempool again since
+    const auto iter = m_mempool.GetIter(tx->GetHash());
+    if (!iter) return;
+    switch (m_assembler.AppendTransaction(*m_template, *iter)) {
+    case BlockAssembler::AppendResult::ADDED:
+        m_validated = false;
+        Updated(tx, (*iter)->GetFee());
+        break;
+    case BlockAssembler::AppendResult::IMPROVABLE:
+        m_improvable = true;
+        m_update_cv.notify_all();
+        break;
+    case BlockAssembler::AppendResult::SKIPPED:
+        break;
+    }
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence)
+{
+    // Mined transactions are handled in UpdatedBlockTip
+    if (reason == MemPoolRemovalReason::BLOCK) return;
+    LOCK(m_mutex);
+    if (m_template && m_assembler.HasTransaction(tx->GetHash())) {
+        m_must_rebuild = true;
+        m_update_cv.notify_all();
+    }
+}
+
+void BlockTemplateCache::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    {
+        LOCK(m_mutex);
+        m_tip_hash = pindexNew->GetBlockHash();
+        m_update_cv.notify_all();
+        if (fInitialDownload || !m_active) return;
+    }
+    LOCK2(cs_main, m_mempool.cs);
+    LOCK(m_mutex);
+    // Have a template ready for the new tip before it is requested
+    try {
+        Rebuild();
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: Failed to build block template: %s\n", __func__, e.what());
+    }
+}
+
+namespace {
+/** A selection of items, and the block space it takes up */
+class ItemSelection
+{
+public:
+    ItemSelection(const std::vector<SelectionItem>& items, const SelectionLimits& limits)
+        : m_items(&items), m_limits(&limits), m_prev(items.size(), items.size()), m_next(items.size(), items.size()), m_selected(items.size(), false)
+    {
+        std::map<size_t, size_t> last_of_cluster;
+        for (size_t i = 0; i < items.size(); ++i) {
+            const auto it = last_of_cluster.find(items[i].cluster);
+            if (it != last_of_cluster.end()) {
+                m_prev[i] = it->second;
+                m_next[it->second] = i;
+                it->second = i;
+            } else {
+                last_of_cluster.emplace(items[i].cluster, i);
+            }
+        }
+    }
+
+    const SelectionItem& Item(size_t i) const { return (*m_items)[i]; }
+    const SelectionLimits& Limits() const { return *m_limits; }
+    size_t Size() const { return m_items->size(); }
+    size_t Next(size_t i) const { return m_next[i]; }
+    size_t Prev(size_t i) const { return m_prev[i]; }
+    bool IsSelected(size_t i) const { return m_selected[i]; }
+    CAmount Fee() const { return m_fee; }
+    uint64_t Weight() const { return m_weight; }
+    uint64_t MWEBWeight() const { return m_mweb_weight; }
+    int64_t SigOps() const { return m_sigops; }
+
+    /** Whether the item can be selected next as far as its cluster is concerned */
+    bool IsEligible(size_t i) const { return !m_selected[i] && (m_prev[i] == Size() || m_selected[m_prev[i]]); }
+    /** Whether the item can be unselected without unselecting others */
+    bool IsRemovable(size_t i) const { return m_selected[i] && (m_next[i] == Size() || !m_selected[m_next[i]]); }
+    bool Fits(size_t i) const
+    {
+        return m_weight + Item(i).weight <= m_limits->weight &&
+               m_mweb_weight + Item(i).mweb_weight <= m_limits->mweb_weight &&
+               m_sigops + Item(i).sigops <= m_limits->sigops;
+    }
+
+    void Add(size_t i)
+    {
+        assert(IsEligible(i));
+        m_selected[i] = true;
+        m_fee += Item(i).fee;
+        m_weight += Item(i).weight;
+        m_mweb_weight += Item(i).mweb_weight;
+        m_sigops += Item(i).sigops;
+    }
+    void Remove(size_t i)
+    {
+        assert(IsRemovable(i));
+        m_selected[i] = false;
+        m_fee -= Item(i).fee;
+        m_weight -= Item(i).weight;
+        m_mweb_weight -= Item(i).mweb_weight;
+        m_sigops -= Item(i).sigops;
+    }
+
+    std::vector<size_t> GetSelected() const
+    {
+        std::vector<size_t> selected;
+        for (size_t i = 0; i < Size(); ++i) {
+            if (m_selected[i]) selected.push_back(i);
+        }
+        return selected;
+    }
+
+private:
+    const std::vector<SelectionItem>* m_items;
+    const SelectionLimits* m_limits;
+    //! The previous and next item of the same cluster, or Size() if there is none
+    std::vector<size_t> m_prev;
+    std::vector<size_t> m_next;
+    std::vector<bool> m_selected;
+    CAmount m_fee{0};
+    uint64_t m_weight{0};
+    uint64_t m_mweb_weight{0};
+    int64_t m_sigops{0};
+};
+} // namespace
+
+// Add the items that fit, in order of decreasing fee per space used as given
+// by cost. An item that comes up before the one preceding it in its cluster
+// is added right after that one, if it still fits.
+template <typename Cost>
+static void FillSelection(ItemSelection& selection, Cost cost)
+{
+    const size_t n = selection.Size();
+    std::vector<double> scores(n);
+    for (size_t i = 0; i < n; ++i) {
+        const double space = cost(selection.Item(i));
+        scores[i] = space > 0 ? selection.Item(i).fee / space : std::numeric_limits<double>::infinity();
+    }
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return scores[a] > scores[b]; });
+
+    std::vector<bool> waiting(n, false);
+    std::set<size_t> failed_clusters;
+    for (size_t i : order) {
+        if (selection.IsSelected(i) || failed_clusters.count(selection.Item(i).cluster)) continue;
+        if (!selection.IsEligible(i)) {
+            waiting[i] = true;
+            continue;
+        }
+        for (size_t j = i; j != n && (j == i || waiting[j]); j = selection.Next(j)) {
+            if (!selection.Fits(j)) {
+                failed_clusters.insert(selection.Item(j).cluster);
+                break;
+            }
+            selection.Add(j);
+        }
+    }
+}
+
+static constexpr int MAX_KNAPSACK_ROUNDS = 1000;
+static constexpr size_t MAX_KNAPSACK_CANDIDATES = 100;
+
+// Keep swapping the best paying unselected items in for selected ones that
+// take up the space they need and pay less, until nothing improves or the
+// deadline passes.
+static void ImproveSelection(ItemSelection& selection, std::chrono::steady_clock::time_point deadline)
+{
+    const size_t n = selection.Size();
+    const SelectionLimits& limits = selection.Limits();
+    for (int round = 0; round < MAX_KNAPSACK_ROUNDS && std::chrono::steady_clock::now() < deadline; ++round) {
+        std::vector<size_t> candidates, removable;
+        for (size_t i = 0; i < n; ++i) {
+            if (selection.IsEligible(i)) candidates.push_back(i);
+            if (selection.IsRemovable(i)) removable.push_back(i);
+        }
+        const auto by_fee = [&](size_t a, size_t b) { return selection.Item(a).fee > selection.Item(b).fee; };
+        if (candidates.size() > MAX_KNAPSACK_CANDIDATES) {
+            std::partial_sort(candidates.begin(), candidates.begin() + MAX_KNAPSACK_CANDIDATES, candidates.end(), by_fee);
+            candidates.resize(MAX_KNAPSACK_CANDIDATES);
+        } else {
+            std::sort(candidates.begin(), candidates.end(), by_fee);
+        }
+
+        bool improved = false;
+        for (size_t u : candidates) {
+            if (std::chrono::steady_clock::now() >= deadline) break;
+            const SelectionItem& item = selection.Item(u);
+            if (selection.Fits(u)) {
+                selection.Add(u);
+                improved = true;
+                break;
+            }
+
+            // How much space is missing in each dimension
+            const double need_weight = double(selection.Weight() + item.weight) - double(limits.weight);
+            const double need_mweb_weight = double(selection.MWEBWeight() + item.mweb_weight) - double(limits.mweb_weight);
+            const double need_sigops = double(selection.SigOps() + item.sigops) - double(limits.sigops);
+            const auto freed = [&](size_t r) {
+                const SelectionItem& other = selection.Item(r);
+                return (need_weight > 0 ? other.weight / need_weight : 0) +
+                       (need_mweb_weight > 0 ? other.mweb_weight / need_mweb_weight : 0) +
+                       (need_sigops > 0 ? other.sigops / need_sigops : 0);
+            };
+            std::vector<std::pair<double, size_t>> victims;
+            for (size_t r : removable) {
+                const double space = freed(r);
+                if (r == selection.Prev(u) || space <= 0) continue;
+                victims.emplace_back(selection.Item(r).fee / space, r);
+            }
+            std::sort(victims.begin(), victims.end());
+
+            // Free the space as cheaply as possible, and go ahead only if the
+            // item pays more than what it replaces
+            CAmount lost = 0;
+            std::vector<size_t> removed;
+            for (const auto& victim : victims) {
+                if (lost + selection.Item(victim.second).fee >= item.fee) break;
+                selection.Remove(victim.second);
+                removed.push_back(victim.second);
+                lost += selection.Item(victim.second).fee;
+                if (selection.Fits(u)) break;
+            }
+            if (selection.Fits(u)) {
+                selection.Add(u);
+                improved = true;
+                break;
+            }
+            for (auto it = removed.rbegin(); it != removed.rend(); ++it) {
+                selection.Add(*it);
+            }
+        }
+        if (!improved) break;
+    }
+}
+
+std::vector<size_t> SelectItemsGreedy(const std::vector<SelectionItem>& items, const SelectionLimits& limits)
+{
+    ItemSelection selection(items, limits);
+    FillSelection(selection, [](const SelectionItem& item) { return double(item.weight); });
+    return selection.GetSelected();
+}
+
+std::vector<size_t> SelectItemsKnapsack(const std::vector<SelectionItem>& items, const SelectionLimits& limits, std::chrono::microseconds time_budget)
+{
+    const auto deadline = std::chrono::steady_clock::now() + time_budget;
+    const double max_weight = std::max<uint64_t>(limits.weight, 1);
+    const double max_mweb_weight = std::max<uint64_t>(limits.mweb_weight, 1);
+
+    // Start from what SelectItemsGreedy would pick, so that this never does worse
+    ItemSelection best(items, limits);
+    FillSelection(best, [](const SelectionItem& item) { return double(item.weight); });
+    // Charge for MWEB weight as a share of the MWEB block, at different rates
+    // relative to the share of the block taken up
+    for (const double mweb_price : {0.25, 0.5, 1.0, 2.0, 4.0, 16.0}) {
+        if (std::chrono::steady_clock::now() >= deadline) break;
+        ItemSelection selection(items, limits);
+        FillSelection(selection, [&](const SelectionItem& item) {
+            return item.weight / max_weight + mweb_price * item.mweb_weight / max_mweb_weight;
+        });
+        if (selection.Fee() > best.Fee()) best = std::move(selection);
+    }
+
+    ImproveSelection(best, deadline);
+    // Use up any space that swapping left
+    FillSelection(best, [&](const SelectionItem& item) {
+        return item.weight / max_weight + item.mweb_weight / max_mweb_weight;
+    });
+    return best.GetSelected();
+}
+
+void BlockAssembler::addKnapsackTxs(int& nPackagesSelected)
+{
+    const std::vector<CTxMemPool::Chunk> chunks = m_mempool.GetChunks();
+    std::vector<SelectionItem> items;
+    std::vector<const CTxMemPool::Chunk*> itemChunks;
+    // Clusters that had a chunk left out, whose later chunks may depend on it
+    std::set<size_t> failedClusters;
+    for (const CTxMemPool::Chunk& chunk : chunks) {
+        if (failedClusters.count(chunk.cluster)) continue;
+        const CTxMemPool::setEntries package(chunk.txs.begin(), chunk.txs.end());
+        if (chunk.fee < blockMinFeeRate.GetTotalFee(chunk.size, chunk.mweb_weight) || !TestPackageTransactions(package, {})) {
+            failedClusters.insert(chunk.cluster);
+            continue;
+        }
+        SelectionItem item;
+        item.fee = chunk.fee;
+        item.weight = WITNESS_SCALE_FACTOR * chunk.size;
+        item.mweb_weight = chunk.mweb_weight;
+        item.sigops = chunk.sigops;
+        item.cluster = chunk.cluster;
+        items.push_back(item);
+        itemChunks.push_back(&chunk);
+    }
+
+    // Like TestPackage, stay below each limit
+    SelectionLimits limits;
+    limits.weight = nBlockMaxWeight > nBlockWeight ? nBlockMaxWeight - nBlockWeight - 1 : 0;
+    limits.mweb_weight = mw::MAX_MINE_WEIGHT > nBlockMWEBWeight ? mw::MAX_MINE_WEIGHT - nBlockMWEBWeight - 1 : 0;
+    limits.sigops = MAX_BLOCK_SIGOPS_COST > nBlockSigOpsCost ? MAX_BLOCK_SIGOPS_COST - nBlockSigOpsCost - 1 : 0;
+
+    failedClusters.clear();
+    for (size_t i : SelectItemsKnapsack(items, limits, KNAPSACK_SEARCH_TIME)) {
+        const CTxMemPool::Chunk& chunk = *itemChunks[i];
+        if (failedClusters.count(chunk.cluster)) continue;
+        for (CTxMemPool::txiter it : chunk.txs) {
+            if (!AddToBlock(it)) {
+                failedClusters.insert(chunk.cluster);
+                break;
+            }
+        }
+        ++nPackagesSelected;
+    }
+}
+
+void BlockAssembler::addChunkTxs(int& nPackagesSelected)
+{
+    // Clusters that had a chunk left out, whose later chunks may depend on it
+    std::set<size_t> failedClusters;
+
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+
+    for (const CTxMemPool::Chunk& chunk : m_mempool.GetChunks()) {
+        if (failedClusters.count(chunk.cluster)) continue;
+
+        // Chunks are ordered by a feerate that also charges for MWEB weight, so
+        // a chunk below the minimum doesn't mean all following ones are too.
+        if (chunk.fee < blockMinFeeRate.GetTotalFee(chunk.size, chunk.mweb_weight)) {
+            failedClusters.insert(chunk.cluster);
+            continue;
+        }
+
+        const CTxMemPool::setEntries package(chunk.txs.begin(), chunk.txs.end());
+        if (!TestPackage(chunk.size, chunk.sigops, chunk.mweb_weight) || !TestPackageTransactions(package, {})) {
+            failedClusters.insert(chunk.cluster);
+
+            ++nConsecutiveFailed;
+
+            if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
+                    nBlockMaxWeight - 4000) {
+                // Give up if we're close to full and haven't succeeded in a while
+                break;
+            }
+            continue;
+        }
+
+        // This chunk will make it in; reset the failed counter.
+        nConsecutiveFailed = 0;
+
+        for (CTxMemPool::txiter it : chunk.txs) {
+            if (!AddToBlock(it)) {
+                failedClusters.insert(chunk.cluster);
+                break;
+            }
+        }
+
+        ++nPackagesSelected;
+    }
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -561,3 +1086,137 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+PowSearcher::PowSearcher(int num_threads) : m_num_threads(std::max(num_threads, 1)) {}
+
+PowSearcher::~PowSearcher()
+{
+    Interrupt();
+}
+
+PowSearcher::Result PowSearcher::Search(CBlockHeader& header, uint64_t& max_tries, const Consensus::Params& params)
+{
+    LOCK(m_search_mutex);
+    if (m_interrupted) return Result::INTERRUPTED;
+    const auto start_time = std::chrono::steady_clock::now();
+
+    const uint64_t first_nonce = header.nNonce;
+    const uint64_t last_nonce = std::numeric_limits<uint32_t>::max();
+    std::vector<unsigned char> serialized;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, serialized, 0, header);
+    m_params = &params;
+    m_bits = header.nBits;
+    m_end_nonce = std::min(first_nonce + max_tries, last_nonce);
+    m_next_nonce = first_nonce;
+    m_found_nonce = std::numeric_limits<uint64_t>::max();
+    m_hashes = 0;
+
+    // Most regtest searches are over after a nonce or two, so only wake up
+    // the workers if the first batch comes up empty
+    std::vector<char> scratchpad(SCRYPT_SCRATCHPAD_SIZE);
+    HashNextBatch(serialized, scratchpad);
+    const bool search_on = m_found_nonce == std::numeric_limits<uint64_t>::max() && m_next_nonce < m_end_nonce;
+    if (search_on && m_num_threads > 1) {
+        {
+            LOCK(m_mutex);
+            if (m_threads.empty() && !m_interrupted) {
+                for (int i = 0; i < m_num_threads - 1; ++i) {
+                    m_threads.emplace_back([this, i] { ThreadSearch(i); });
+                }
+            }
+            m_header = serialized;
+            m_busy_workers = static_cast<int>(m_threads.size());
+            ++m_search_id;
+        }
+        m_search_cv.notify_all();
+        while (HashNextBatch(serialized, scratchpad)) {}
+        WAIT_LOCK(m_mutex, lock);
+        while (m_busy_workers > 0) m_done_cv.wait(lock);
+    } else if (search_on) {
+        while (HashNextBatch(serialized, scratchpad)) {}
+    }
+
+    {
+        LOCK(m_mutex);
+        m_total_hashes += m_hashes;
+        m_total_time += std::chrono::steady_clock::now() - start_time;
+    }
+
+    const uint64_t found_nonce = m_found_nonce;
+    if (found_nonce != std::numeric_limits<uint64_t>::max()) {
+        max_tries -= found_nonce - first_nonce;
+        header.nNonce = found_nonce;
+        return Result::FOUND;
+    }
+    if (m_interrupted || ShutdownRequested()) return Result::INTERRUPTED;
+    if (max_tries <= last_nonce - first_nonce) {
+        max_tries = 0;
+        return Result::OUT_OF_TRIES;
+    }
+    max_tries -= last_nonce - first_nonce;
+    header.nNonce = last_nonce;
+    return Result::NONCES_EXHAUSTED;
+}
+
+bool PowSearcher::HashNextBatch(const std::vector<unsigned char>& header, std::vector<char>& scratchpad)
+{
+    if (m_interrupted || ShutdownRequested()) return false;
+    const uint64_t first_nonce = m_next_nonce.fetch_add(POW_SEARCH_BATCH_SIZE);
+    // Batches past a nonce already found can't hold a lower one
+    if (first_nonce >= m_end_nonce || first_nonce >= m_found_nonce) return false;
+
+    const size_t count = std::min<uint64_t>(POW_SEARCH_BATCH_SIZE, m_end_nonce - first_nonce);
+    char hashes[32 * POW_SEARCH_BATCH_SIZE];
+    scrypt_1024_1_1_256_sp_batch((const char*)header.data(), first_nonce, count, hashes, scratchpad.data());
+    m_hashes += count;
+    for (size_t i = 0; i < count; ++i) {
+        uint256 hash;
+        memcpy(hash.begin(), hashes + 32 * i, 32);
+        if (!CheckProofOfWork(hash, m_bits, *m_params)) continue;
+        uint64_t found_nonce = m_found_nonce;
+        while (first_nonce + i < found_nonce && !m_found_nonce.compare_exchange_weak(found_nonce, first_nonce + i)) {}
+        break;
+    }
+    return true;
+}
+
+void PowSearcher::ThreadSearch(int worker_num)
+{
+    util::ThreadRename(strprintf("powsearch.%i", worker_num));
+    std::vector<char> scratchpad(SCRYPT_SCRATCHPAD_SIZE);
+    uint64_t last_search_id = 0;
+    while (true) {
+        std::vector<unsigned char> header;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            while (!m_interrupted && m_search_id == last_search_id) m_search_cv.wait(lock);
+            // Take part in a search even once interrupted, so that it isn't
+            // left waiting for us
+            if (m_search_id == last_search_id) return;
+            last_search_id = m_search_id;
+            header = m_header;
+        }
+        while (HashNextBatch(header, scratchpad)) {}
+        LOCK(m_mutex);
+        if (--m_busy_workers == 0) m_done_cv.notify_all();
+    }
+}
+
+void PowSearcher::Interrupt()
+{
+    std::vector<std::thread> threads;
+    {
+        LOCK(m_mutex);
+        m_interrupted = true;
+        threads.swap(m_threads);
+    }
+    m_search_cv.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+double PowSearcher::GetHashRate() const
+{
+    LOCK(m_mutex);
+    const double seconds = std::chrono::duration<double>(m_total_time).count();
+    return seconds > 0 ? m_total_hashes / seconds : 0;
+}
@@ -8,12 +8,20 @@
 
 #include <optional.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 #include <mweb/mweb_miner.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
 #include <memory>
 #include <stdint.h>
+#include <thread>
+#include <vector>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -25,6 +33,10 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -blockknapsack */
+static const bool DEFAULT_BLOCK_KNAPSACK = false;
+/** How long the knapsack selection may spend improving on its greedy passes */
+static constexpr std::chrono::milliseconds KNAPSACK_SEARCH_TIME{50};
 
 struct CBlockTemplate
 {
@@ -128,6 +140,42 @@ struct update_for_parent_inclusion
     CTxMemPool::txiter iter;
 };
 
+/** Something that is included in a block as a whole, such as a mempool chunk */
+struct SelectionItem
+{
+    CAmount fee{0};
+    uint64_t weight{0};
+    uint64_t mweb_weight{0};
+    int64_t sigops{0};
+    //! Items with the same cluster can only be selected in the order they are given in
+    size_t cluster{0};
+};
+
+/** The space left in a block, in each dimension */
+struct SelectionLimits
+{
+    uint64_t weight{0};
+    uint64_t mweb_weight{0};
+    int64_t sigops{0};
+};
+
+/**
+ * Select items that fit within limits, ordered by fee per block space used,
+ * where the MWEB weight is left out of the space used. This is how
+ * addPackageTxs treats MWEB weight, and it returns the indexes of the
+ * selected items in increasing order.
+ */
+std::vector<size_t> SelectItemsGreedy(const std::vector<SelectionItem>& items, const SelectionLimits& limits);
+
+/**
+ * Select items that fit within limits, trying to maximize their total fee.
+ * Greedy passes price MWEB weight at different rates relative to the rest of
+ * the block. A local search then tries to swap items out for an unselected
+ * one that pays more than them, until time_budget runs out. Returns the
+ * indexes of the selected items in increasing order.
+ */
+std::vector<size_t> SelectItemsKnapsack(const std::vector<SelectionItem>& items, const SelectionLimits& limits, std::chrono::microseconds time_budget);
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
@@ -143,6 +191,7 @@ private:
     bool fIncludeMWEB;
     unsigned int nBlockMaxWeight;
     CFeeRate blockMinFeeRate;
+    bool fKnapsack;
 
     // Information on the current status of the block
     uint64_t nBlockWeight;
@@ -151,8 +200,12 @@ private:
     uint64_t nBlockMWEBWeight;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // Txids of the transactions in the block, which unlike inBlock stay valid
+    // after they leave the mempool
+    std::set<uint256> setBlockTxids;
 
     // Chain context for the block
+    const CBlockIndex* m_prev_block{nullptr};
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams& chainparams;
@@ -163,6 +216,7 @@ public:
         Options();
         size_t nBlockMaxWeight;
         CFeeRate blockMinFeeRate;
+        bool knapsack;
     };
 
     explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params);
@@ -171,6 +225,23 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
 
+    enum class AppendResult {
+        ADDED,      //!< The transaction was appended to the template
+        SKIPPED,    //!< The transaction doesn't belong in the template
+        IMPROVABLE, //!< The transaction may belong in the template, but only by rebuilding it
+    };
+
+    /**
+     * Append a transaction that entered the mempool after CreateNewBlock to the
+     * template it returned, without rebuilding it. Only transactions whose
+     * in-mempool parents are all in the block and that fit in the remaining
+     * space are appended. MWEB transactions are never appended, as the MWEB
+     * block and HogEx would have to be rebuilt.
+     */
+    AppendResult AppendTransaction(CBlockTemplate& block_template, CTxMemPool::txiter iter) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Whether the block built by the last CreateNewBlock call contains the given transaction */
+    bool HasTransaction(const uint256& txid) const { return setBlockTxids.count(txid) > 0; }
+
     static Optional<int64_t> m_last_block_num_txs;
     static Optional<int64_t> m_last_block_weight;
     static Optional<int64_t> m_last_block_mweb_weight;
@@ -187,6 +258,13 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Add transactions chunk by chunk, in the order of the mempool's cluster
+      * linearization. Increments nPackagesSelected with the chunks added. */
+    void addChunkTxs(int& nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Add the mempool chunks picked by SelectItemsKnapsack, which trades
+      * off fees against both block weight and MWEB weight. Increments
+      * nPackagesSelected with the chunks added. */
+    void addKnapsackTxs(int& nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -209,11 +287,172 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
+/** Seconds between rebuilds of an improvable template in BlockTemplateCache */
+static const int64_t TEMPLATE_REBUILD_INTERVAL = 5;
+
+/**
+ * Keeps the block template for the current tip up to date as the mempool
+ * changes, so getblocktemplate can serve it without walking the mempool.
+ *
+ * Transactions entering the mempool are appended with
+ * BlockAssembler::AppendTransaction. Transactions that can't be appended
+ * mark the template as improvable, and it is then rebuilt at most every
+ * TEMPLATE_REBUILD_INTERVAL seconds. It is rebuilt right away when the tip
+ * changes, or when one of its transactions leaves the mempool other than
+ * by being mined. Nothing is built until the first template is requested.
+ *
+ * MWEB transactions are never appended, as they would need the extension
+ * block and the HogEx rebuilt. They mark the template as improvable and get
+ * in at the next rebuild. A template with appended transactions is checked
+ * with TestBlockValidity before it is first served, and rebuilt if that
+ * fails.
+ *
+ * All callers asking for the template between two changes to it share one
+ * copy, and long-polling callers wait on the cache rather than on every new
+ * tip and mempool change, so many waiters don't each rebuild the template.
+ * Every change is announced with CValidationInterface::BlockTemplateUpdated.
+ */
+class BlockTemplateCache final : public CValidationInterface
+{
+public:
+    BlockTemplateCache(const CTxMemPool& mempool, const CChainParams& params);
+
+    /**
+     * Return the template for the current tip (with an OP_TRUE coinbase output).
+     *
+     * @param[out] sequence  Set to the number of this version of the template, for WaitForUpdate
+     */
+    std::shared_ptr<const CBlockTemplate> GetBlockTemplate(uint64_t* sequence = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    /**
+     * Wait until the given version of the template for the given tip is out
+     * of date, without holding cs_main. A new tip ends the wait straight
+     * away. Any other change only ends it once tx_deadline has passed.
+     */
+    void WaitForUpdate(const uint256& prev_block_hash, uint64_t sequence, std::chrono::steady_clock::time_point tx_deadline) LOCKS_EXCLUDED(m_mutex);
+
+    /** Return from all current and future WaitForUpdate calls */
+    void Interrupt() LOCKS_EXCLUDED(m_mutex);
+
+protected:
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override;
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+
+private:
+    void Rebuild() EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs, m_mutex);
+    /** Record a change to the template and wake up waiters */
+    void Updated(const CTransactionRef& appended_tx, CAmount fee) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    const CTxMemPool& m_mempool;
+    const CChainParams& m_params;
+
+    Mutex m_mutex;
+    std::condition_variable m_update_cv;
+    BlockAssembler m_assembler GUARDED_BY(m_mutex);
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    //! Copy of m_template handed out until the template next changes
+    std::shared_ptr<const CBlockTemplate> m_shared_template GUARDED_BY(m_mutex);
+    //! Counts the changes to the template
+    uint64_t m_sequence GUARDED_BY(m_mutex){0};
+    //! The tip the template should be built on
+    uint256 m_tip_hash GUARDED_BY(m_mutex);
+    bool m_interrupted GUARDED_BY(m_mutex){false};
+    int64_t m_template_time GUARDED_BY(m_mutex){0};
+    bool m_must_rebuild GUARDED_BY(m_mutex){false};
+    bool m_improvable GUARDED_BY(m_mutex){false};
+    //! Whether m_template passed TestBlockValidity since transactions were last appended
+    bool m_validated GUARDED_BY(m_mutex){false};
+    //! Whether a template was ever requested, i.e. whether we are being used for mining
+    bool m_active GUARDED_BY(m_mutex){false};
+};
+
+/** Default for -genproclimit, the number of threads the generate RPCs search for proof of work on (-1 = one per core) */
+static const int DEFAULT_GENPROCLIMIT = -1;
+/** Consecutive nonces a PowSearcher thread hashes at a time */
+static constexpr uint32_t POW_SEARCH_BATCH_SIZE = 8;
+
+/**
+ * Searches the nonces of a block header for one meeting its proof of work
+ * target, for the generate RPCs on regtest and testnet.
+ *
+ * The calling thread hashes the first batch of nonces on its own, which is
+ * usually enough on regtest. Beyond that, worker threads join in, each
+ * claiming the next POW_SEARCH_BATCH_SIZE nonces in turn. A search returns
+ * the lowest nonce meeting the target, as one thread going through them in
+ * order would. The workers are started by the first search that needs them.
+ */
+class PowSearcher
+{
+public:
+    enum class Result {
+        FOUND,            //!< header.nNonce meets the target
+        NONCES_EXHAUSTED, //!< No nonce below 0xffffffff meets the target; header.nNonce is 0xffffffff
+        OUT_OF_TRIES,     //!< max_tries nonces did not meet the target
+        INTERRUPTED,      //!< Interrupt() was called or shutdown requested
+    };
+
+    /** @param num_threads  Threads to search on, including the calling one */
+    explicit PowSearcher(int num_threads);
+    ~PowSearcher();
+
+    /**
+     * Search the nonces from header.nNonce upwards, trying at most max_tries
+     * of them, for one meeting the target of header.nBits. max_tries is
+     * reduced by the number of nonces below the one found.
+     */
+    Result Search(CBlockHeader& header, uint64_t& max_tries, const Consensus::Params& params) LOCKS_EXCLUDED(m_search_mutex, m_mutex);
+
+    /** End the current search and stop the threads */
+    void Interrupt() LOCKS_EXCLUDED(m_mutex);
+
+    /** Hashes per second while searching, or 0 before the first search */
+    double GetHashRate() const LOCKS_EXCLUDED(m_mutex);
+
+private:
+    void ThreadSearch(int worker_num) LOCKS_EXCLUDED(m_mutex);
+    /** Hash the next batch of nonces of the current search. Returns false once there are none left. */
+    bool HashNextBatch(const std::vector<unsigned char>& header, std::vector<char>& scratchpad);
+
+    const int m_num_threads;
+
+    //! Held for the whole of a search, as there is one at a time
+    Mutex m_search_mutex;
+    mutable Mutex m_mutex;
+    //! Signals the workers that a search started or that they should stop
+    std::condition_variable m_search_cv;
+    //! Signals the searching thread that the workers are done
+    std::condition_variable m_done_cv;
+    std::vector<std::thread> m_threads GUARDED_BY(m_mutex);
+    //! Counts the searches the workers were woken up for
+    uint64_t m_search_id GUARDED_BY(m_mutex){0};
+    //! Workers still taking part in the current search
+    int m_busy_workers GUARDED_BY(m_mutex){0};
+    //! Serialized header of the current search
+    std::vector<unsigned char> m_header GUARDED_BY(m_mutex);
+    uint64_t m_total_hashes GUARDED_BY(m_mutex){0};
+    std::chrono::steady_clock::duration m_total_time GUARDED_BY(m_mutex){0};
+
+    // State of the current search shared by all threads searching
+    std::atomic<bool> m_interrupted{false};
+    const Consensus::Params* m_params{nullptr};
+    uint32_t m_bits{0};
+    //! First nonce past the range being searched
+    uint64_t m_end_nonce{0};
+    //! Next nonce to be claimed
+    std::atomic<uint64_t> m_next_nonce{0};
+    //! Lowest nonce found to meet the target, or UINT64_MAX
+    std::atomic<uint64_t> m_found_nonce{std::numeric_limits<uint64_t>::max()};
+    std::atomic<uint64_t> m_hashes{0};
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
 /** Update an old GenerateCoinbaseCommitment from CreateNewBlock after the block txs have changed */
 void RegenerateCommitments(CBlock& block);
+/** Same as above, for a block on top of pindexPrev; doesn't need cs_main */
+void RegenerateCommitments(CBlock& block, const CBlockIndex* pindexPrev);
 
 #endif // BITCOIN_MINER_H
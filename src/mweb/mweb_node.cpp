@@ -2,6 +2,8 @@
 
 #include <chain.h>
 #include <consensus/validation.h>
+#include <mw/crypto/Bulletproofs.h>
+#include <mw/crypto/Schnorr.h>
 #include <mw/node/BlockValidator.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
@@ -10,8 +12,47 @@
 #include <util/system.h>
 #include <validation.h>
 
+#include <deque>
+#include <unordered_set>
+
 using namespace MWEB;
 
+namespace {
+
+/** Maximum number of MWEB transactions remembered as verified by Node::CheckTransaction(). */
+static constexpr size_t MAX_VERIFIED_TXS = 10000;
+
+/** Hashes of MWEB transactions whose signatures and rangeproofs were verified, oldest first. */
+class VerifiedTxCache
+{
+public:
+    bool Contains(const mw::Hash& hash)
+    {
+        LOCK(m_mutex);
+        return m_hashes.count(hash) > 0;
+    }
+
+    void Insert(const mw::Hash& hash)
+    {
+        LOCK(m_mutex);
+        if (!m_hashes.insert(hash).second) return;
+        m_order.push_back(hash);
+        while (m_order.size() > MAX_VERIFIED_TXS) {
+            m_hashes.erase(m_order.front());
+            m_order.pop_front();
+        }
+    }
+
+private:
+    Mutex m_mutex;
+    std::unordered_set<mw::Hash> m_hashes GUARDED_BY(m_mutex);
+    std::deque<mw::Hash> m_order GUARDED_BY(m_mutex);
+};
+
+VerifiedTxCache g_verified_txs;
+
+} // namespace
+
 bool Node::CheckBlock(const CBlock& block, BlockValidationState& state)
 {
     // HasMWEBTx() is true only when mweb txs being shared outside of a block (for use by mempools).
@@ -252,7 +293,7 @@ bool Node::ConnectBlock(const CBlock& block, const Consensus::Params& consensus_
     return true;
 }
 
-bool Node::CheckTransaction(const CTransaction& tx, TxValidationState& state)
+bool Node::CheckTransaction(const CTransaction& tx, TxValidationState& state, const bool cache_store)
 {
     std::unordered_map<mw::Hash, CAmount> tx_pegins;
     for (const CTxOut& out : tx.vout) {
@@ -280,12 +321,49 @@ bool Node::CheckTransaction(const CTransaction& tx, TxValidationState& state)
 
     // If the transaction has MWEB data, call the libmw transaction validation logic.
     if (tx.HasMWEBTx()) {
+        const mw::Hash& mweb_tx_hash = tx.mweb_tx.m_transaction->GetHash();
+        if (g_verified_txs.Contains(mweb_tx_hash)) {
+            return true;
+        }
+
         try {
             tx.mweb_tx.m_transaction->Validate();
         } catch (const std::exception& e) {
             return state.Invalid(TxValidationResult::TX_WITNESS_MUTATED, "bad-mweb-txn");
         }
+
+        if (cache_store) {
+            g_verified_txs.Insert(mweb_tx_hash);
+        }
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+void Node::BatchVerifyPackage(const std::vector<CTransactionRef>& txs)
+{
+    std::vector<SignedMessage> signatures;
+    std::vector<ProofData> proofs;
+    for (const CTransactionRef& tx : txs) {
+        if (!tx->HasMWEBTx()) continue;
+
+        const TxBody& body = tx->mweb_tx.m_transaction->GetBody();
+        for (const Kernel& kernel : body.GetKernels()) {
+            signatures.push_back(kernel.BuildSignedMsg());
+        }
+        for (const Input& input : body.GetInputs()) {
+            signatures.push_back(input.BuildSignedMsg());
+        }
+        for (const Output& output : body.GetOutputs()) {
+            signatures.push_back(output.BuildSignedMsg());
+            proofs.push_back(output.BuildProofData());
+        }
+    }
+
+    try {
+        if (!signatures.empty()) Schnorr::BatchVerify(signatures);
+        if (!proofs.empty()) Bulletproofs::BatchVerify(proofs);
+    } catch (const std::exception&) {
+        // Malformed keys or commitments are reported by CheckTransaction()
+    }
+}
@@ -2,12 +2,14 @@
 
 #include <consensus/params.h>
 #include <mw/node/CoinsView.h>
+#include <primitives/transaction.h>
+
+#include <vector>
 
 // Forward Declarations
 class CBlock;
 class CBlockUndo;
 class CBlockIndex;
-class CTransaction;
 class BlockValidationState;
 class TxValidationState;
 
@@ -94,12 +96,25 @@ public:
     /// * All signatures and rangeproofs are valid
     /// * Kernel features are valid
     /// 
+    /// The signatures and rangeproofs of an MWEB transaction which recently passed a check with cache_store set
+    /// are not verified again.
+    /// 
     /// WARNING: Don't apply this when validating blocks that pre-date MWEB activation.
     /// </summary>
     /// <param name="tx">The CTransaction to validate.</param>
     /// <param name="state">The CValidationState to update if validation fails.</param>
+    /// <param name="cache_store">Remember the MWEB transaction if its signatures and rangeproofs are valid.</param>
     /// <returns>True if all validation checks succeed.</returns>
-    static bool CheckTransaction(const CTransaction& tx, TxValidationState& state);
+    static bool CheckTransaction(const CTransaction& tx, TxValidationState& state, const bool cache_store = false);
+
+    /// <summary>
+    /// Verifies the signatures and rangeproofs of the MWEB transactions of a package in one batch each.
+    /// Valid ones are cached by libmw, so that the CheckTransaction() calls which follow for each
+    /// transaction of the package do not verify them again. A failure is not attributed to any
+    /// transaction here, but left to those CheckTransaction() calls.
+    /// </summary>
+    /// <param name="txs">The transactions of the package.</param>
+    static void BatchVerifyPackage(const std::vector<CTransactionRef>& txs);
 
 private:
     static bool ValidateMWEBBlock(const CBlock& block);
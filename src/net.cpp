@@ -19,6 +19,7 @@
 #include <protocol.h>
 #include <random.h>
 #include <scheduler.h>
+#include <span.h>
 #include <util/strencodings.h>
 #include <util/translation.h>
 
@@ -26,6 +27,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #if HAVE_DECL_GETIFADDRS && HAVE_DECL_FREEIFADDRS
@@ -36,6 +38,10 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/upnpcommands.h>
@@ -46,6 +52,7 @@ static_assert(MINIUPNPC_API_VERSION >= 10, "miniUPnPc API version >= 10 assumed"
 #endif
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <unordered_map>
 
@@ -79,6 +86,9 @@ static constexpr int DNSSEEDS_DELAY_PEER_THRESHOLD = 1000; // "many" vs "few" pe
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+/** Maximum number of buffers (message headers and payloads) passed to one sendmsg() call */
+static constexpr size_t MAX_SEND_SEGMENTS = 64;
+
 // MSG_NOSIGNAL is not available on some platforms, if it doesn't exist define it as 0
 #if !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
@@ -105,6 +115,9 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+/** Maximum number of events returned by one epoll_wait() */
+static const int MAX_EPOLL_EVENTS = 256;
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -484,6 +497,9 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     uint64_t nonce = GetDeterministicRandomizer(RANDOMIZER_ID_LOCALHOSTNONCE).Write(id).Finalize();
     CAddress addr_bind = GetBindAddress(hSocket);
     CNode* pnode = new CNode(id, nLocalServices, GetBestHeight(), hSocket, addrConnect, CalculateKeyedNetGroup(addrConnect), nonce, addr_bind, pszDest ? pszDest : "", conn_type);
+    if (m_v2_transport && (addrConnect.nServices & NODE_P2P_V2)) {
+        pnode->UseV2Transport(/*initiator=*/true);
+    }
     pnode->AddRef();
 
     // We're making a new connection, harvest entropy from the time (and our peer count)
@@ -793,46 +809,338 @@ Optional<CNetMessage> V1TransportDeserializer::GetMessage(const std::chrono::mic
     return msg;
 }
 
-void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
-    // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data);
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg)
+    : CSharedNetMsg(std::move(msg.m_type), std::make_shared<const std::vector<unsigned char>>(std::move(msg.data))) {}
+
+CSharedNetMsg::CSharedNetMsg(std::string type, std::shared_ptr<const std::vector<unsigned char>> data_in)
+    : data(std::move(data_in)), m_type(std::move(type)), m_hash(Hash(*data)) {}
 
+static void MakeV1Header(const std::string& msg_type, size_t payload_size, const uint256& payload_hash, std::vector<unsigned char>& header)
+{
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.data.size());
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CMessageHeader hdr(Params().MessageStart(), msg_type.c_str(), payload_size);
+    memcpy(hdr.pchChecksum, payload_hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
-    header.reserve(CMessageHeader::HEADER_SIZE);
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
+    header.reserve(header.size() + CMessageHeader::HEADER_SIZE);
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, header.size(), hdr};
+}
+
+void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
+    // create dbl-sha256 checksum
+    MakeV1Header(msg.m_type, msg.data.size(), Hash(msg.data), header);
+}
+
+bool V1TransportSerializer::prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) {
+    MakeV1Header(msg.m_type, msg.data->size(), msg.m_hash, header);
+    return true;
+}
+
+V2Transport::V2Transport(const CChainParams& chain_params, NodeId node_id, bool initiator, int nTypeIn, int nVersionIn)
+    : m_chain_params(chain_params),
+      m_node_id(node_id),
+      m_initiator(initiator),
+      m_key([] { CKey key; key.MakeNewKey(/*fCompressed=*/true); return key; }()),
+      m_recv_state(initiator ? RecvState::KEY : RecvState::V1_DETECT),
+      m_recv_packet(nTypeIn, nVersionIn),
+      m_v1_deserializer(chain_params, node_id, nTypeIn, nVersionIn)
+{
+    if (m_initiator) {
+        // The initiator speaks first, the responder answers with its key once it has ours.
+        const CPubKey pubkey = m_key.GetPubKey();
+        LOCK(m_send_mutex);
+        m_send_buffer.assign(pubkey.begin(), pubkey.end());
+    }
+}
+
+bool V2Transport::Complete() const
+{
+    if (m_recv_state == RecvState::V1) return m_v1_deserializer.Complete();
+    return m_recv_complete;
+}
+
+void V2Transport::SetVersion(int nVersionIn)
+{
+    m_recv_packet.SetVersion(nVersionIn);
+    m_v1_deserializer.SetVersion(nVersionIn);
+}
+
+int V2Transport::Read(const char* pch, unsigned int nBytes)
+{
+    switch (m_recv_state) {
+    case RecvState::V1_DETECT: {
+        // A V1 peer starts with the header of its version message.
+        unsigned char prefix[CMessageHeader::MESSAGE_START_SIZE + CMessageHeader::COMMAND_SIZE] = {};
+        memcpy(prefix, m_chain_params.MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+        memcpy(prefix + CMessageHeader::MESSAGE_START_SIZE, NetMsgType::VERSION, strlen(NetMsgType::VERSION));
+        unsigned int handled = 0;
+        for (; handled < nBytes && m_recv_buffer.size() < sizeof(prefix); ++handled) {
+            const unsigned char c = pch[handled];
+            if (c != prefix[m_recv_buffer.size()]) {
+                // What was received so far is the start of a public key.
+                m_recv_state = RecvState::KEY;
+                return handled;
+            }
+            m_recv_buffer.push_back(c);
+        }
+        if (m_recv_buffer.size() == sizeof(prefix)) {
+            LogPrint(BCLog::NET, "peer does not use the v2 transport, falling back to v1, peer=%d\n", m_node_id);
+            {
+                LOCK(m_send_mutex);
+                SetSendState(SendState::V1, nullptr);
+            }
+            m_recv_state = RecvState::V1;
+            const int ret = m_v1_deserializer.Read(reinterpret_cast<const char*>(m_recv_buffer.data()), m_recv_buffer.size());
+            assert(ret == (int)m_recv_buffer.size());
+            m_recv_buffer.clear();
+        }
+        return handled;
+    }
+    case RecvState::KEY:
+        return ReadKey(pch, nBytes);
+    case RecvState::LENGTH:
+    case RecvState::PACKET:
+        return ReadPacket(pch, nBytes);
+    case RecvState::V1:
+        return m_v1_deserializer.Read(pch, nBytes);
+    }
+    assert(false);
+}
+
+int V2Transport::ReadKey(const char* pch, unsigned int nBytes)
+{
+    const unsigned int copy = std::min<size_t>(nBytes, CPubKey::COMPRESSED_SIZE - m_recv_buffer.size());
+    m_recv_buffer.insert(m_recv_buffer.end(), pch, pch + copy);
+    if (m_recv_buffer.size() < CPubKey::COMPRESSED_SIZE) return copy;
+
+    const CPubKey their_pubkey(m_recv_buffer.begin(), m_recv_buffer.end());
+    BIP324Session session;
+    if (!BIP324Handshake(m_key, their_pubkey, m_initiator, m_chain_params.MessageStart(), session)) {
+        LogPrint(BCLog::NET, "invalid v2 transport public key, peer=%d\n", m_node_id);
+        return -1;
+    }
+    LogPrint(BCLog::NET, "v2 transport session %s established, peer=%d\n", session.session_id.ToString(), m_node_id);
+    m_recv_cipher = std::move(session.recv_cipher);
+    {
+        LOCK(m_send_mutex);
+        if (!m_initiator) {
+            const CPubKey pubkey = m_key.GetPubKey();
+            m_send_buffer.insert(m_send_buffer.end(), pubkey.begin(), pubkey.end());
+        }
+        SetSendState(SendState::READY, std::move(session.send_cipher));
+    }
+    m_recv_buffer.clear();
+    m_recv_state = RecvState::LENGTH;
+    return copy;
+}
+
+int V2Transport::ReadPacket(const char* pch, unsigned int nBytes)
+{
+    if (m_recv_state == RecvState::LENGTH) {
+        const unsigned int copy = std::min<size_t>(nBytes, BIP324Cipher::LENGTH_LEN - m_recv_pos);
+        m_recv_packet.resize(BIP324Cipher::LENGTH_LEN);
+        memcpy(&m_recv_packet[m_recv_pos], pch, copy);
+        m_recv_pos += copy;
+        if (m_recv_pos < BIP324Cipher::LENGTH_LEN) return copy;
+        m_recv_len = m_recv_cipher->DecryptLength(Span<const unsigned char>(UCharCast(m_recv_packet.data()), BIP324Cipher::LENGTH_LEN));
+        // reject packets that cannot hold a message within MAX_PROTOCOL_MESSAGE_LENGTH
+        // (one byte of message id, plus the message type for id 0)
+        if (m_recv_len > MAX_PROTOCOL_MESSAGE_LENGTH + 1 + CMessageHeader::COMMAND_SIZE) {
+            LogPrint(BCLog::NET, "v2 transport packet too large (%u bytes), peer=%d\n", m_recv_len, m_node_id);
+            return -1;
+        }
+        m_recv_state = RecvState::PACKET;
+        return copy;
+    }
+
+    const size_t packet_size = m_recv_len + BIP324Cipher::EXPANSION;
+    const unsigned int copy = std::min<size_t>(nBytes, packet_size - m_recv_pos);
+    if (m_recv_packet.size() < m_recv_pos + copy) {
+        // Allocate up to 256 KiB ahead, but never more than the packet length
+        // as the peer claims it (see V1TransportDeserializer::readData).
+        m_recv_packet.resize(std::min(packet_size, m_recv_pos + copy + 256 * 1024));
+    }
+    memcpy(&m_recv_packet[m_recv_pos], pch, copy);
+    m_recv_pos += copy;
+    if (m_recv_pos < packet_size) return copy;
+
+    if (!m_recv_cipher->Decrypt(Span<unsigned char>(UCharCast(m_recv_packet.data()), packet_size))) {
+        LogPrint(BCLog::NET, "v2 transport packet authentication failed, peer=%d\n", m_node_id);
+        return -1;
+    }
+    m_recv_authenticated = true;
+    m_recv_complete = true;
+    return copy;
+}
+
+Optional<CNetMessage> V2Transport::GetMessage(const std::chrono::microseconds time, uint32_t& out_err_raw_size)
+{
+    if (m_recv_state == RecvState::V1) return m_v1_deserializer.GetMessage(time, out_err_raw_size);
+    assert(m_recv_complete);
+
+    const uint32_t raw_size = m_recv_len + BIP324Cipher::EXPANSION;
+    // We just received a message off the wire, harvest entropy from the time (and the packet tag)
+    RandAddEvent(ReadLE32(UCharCast(&m_recv_packet[BIP324Cipher::LENGTH_LEN + m_recv_len])));
+
+    // Leave only the message type and the payload
+    m_recv_packet.resize(BIP324Cipher::LENGTH_LEN + m_recv_len);
+    m_recv_packet.ignore(BIP324Cipher::LENGTH_LEN);
+    std::string msg_type;
+    if (!m_recv_packet.empty()) {
+        const uint8_t id = m_recv_packet[0];
+        m_recv_packet.ignore(1);
+        if (id == 0 && m_recv_packet.size() >= CMessageHeader::COMMAND_SIZE) {
+            CMessageHeader hdr;
+            memcpy(hdr.pchCommand, &m_recv_packet[0], CMessageHeader::COMMAND_SIZE);
+            m_recv_packet.ignore(CMessageHeader::COMMAND_SIZE);
+            if (hdr.IsCommandValid()) msg_type = hdr.GetCommand();
+        } else if (id != 0 && id < V2_MESSAGE_IDS.size()) {
+            msg_type = V2_MESSAGE_IDS[id];
+        }
+    }
+
+    Optional<CNetMessage> msg;
+    if (msg_type.empty()) {
+        LogPrint(BCLog::NET, "HEADER ERROR - V2 MESSAGE TYPE (%u bytes), peer=%d\n", m_recv_len, m_node_id);
+        out_err_raw_size = raw_size;
+        m_recv_packet.clear();
+    } else {
+        const int type = m_recv_packet.GetType(), version = m_recv_packet.GetVersion();
+        msg.emplace(std::move(m_recv_packet));
+        msg->m_command = std::move(msg_type);
+        msg->m_time = time;
+        msg->m_message_size = msg->m_recv.size();
+        msg->m_raw_message_size = raw_size;
+        m_recv_packet = CDataStream(type, version);
+    }
+
+    // Prepare for the next packet
+    m_recv_pos = 0;
+    m_recv_len = 0;
+    m_recv_complete = false;
+    m_recv_state = RecvState::LENGTH;
+    return msg;
+}
+
+void V2Transport::SetSendState(SendState state, std::unique_ptr<BIP324Cipher> cipher)
+{
+    assert(m_send_state == SendState::AWAITING_KEY && state != SendState::AWAITING_KEY);
+    m_send_state = state;
+    m_send_cipher = std::move(cipher);
+    for (const CSerializedNetMsg& msg : m_send_pending) {
+        if (PrepareMessageLocked(msg.m_type, msg.data, nullptr, m_send_buffer)) {
+            m_send_buffer.insert(m_send_buffer.end(), msg.data.begin(), msg.data.end());
+        }
+    }
+    m_send_pending.clear();
+}
+
+bool V2Transport::PrepareMessageLocked(const std::string& msg_type, Span<const unsigned char> payload, const uint256* payload_hash, std::vector<unsigned char>& header)
+{
+    switch (m_send_state) {
+    case SendState::AWAITING_KEY:
+        m_send_pending.emplace_back();
+        m_send_pending.back().m_type = msg_type;
+        m_send_pending.back().data.assign(payload.begin(), payload.end());
+        return false;
+    case SendState::READY:
+        if (!m_send_cipher->EncryptMessage(msg_type, payload, header)) {
+            LogPrint(BCLog::NET, "not sending %s (%d bytes), too large for the v2 transport, peer=%d\n", SanitizeString(msg_type), payload.size(), m_node_id);
+        }
+        return false;
+    case SendState::V1:
+        MakeV1Header(msg_type, payload.size(), payload_hash ? *payload_hash : Hash(payload), header);
+        return true;
+    }
+    assert(false);
+}
+
+bool V2Transport::PrepareMessage(const std::string& msg_type, Span<const unsigned char> payload, const uint256* payload_hash, std::vector<unsigned char>& header)
+{
+    LOCK(m_send_mutex);
+    header.insert(header.end(), m_send_buffer.begin(), m_send_buffer.end());
+    m_send_buffer.clear();
+    return PrepareMessageLocked(msg_type, payload, payload_hash, header);
+}
+
+void V2Transport::PrepareTransportData(std::vector<unsigned char>& data)
+{
+    LOCK(m_send_mutex);
+    data.insert(data.end(), m_send_buffer.begin(), m_send_buffer.end());
+    m_send_buffer.clear();
+}
+
+void V2TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
+    if (!m_transport->PrepareMessage(msg.m_type, msg.data, nullptr, header)) {
+        // The payload is part of the encrypted packet already
+        msg.data.clear();
+    }
+}
+
+bool V2TransportSerializer::prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) {
+    return m_transport->PrepareMessage(msg.m_type, *msg.data, &msg.m_hash, header);
 }
 
 size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
 {
-    auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+    while (!pnode->vSendMsg.empty()) {
+        assert(pnode->vSendMsg.front().size() > pnode->nSendOffset);
+        // Gather the unsent headers and payloads, so that as much of them as
+        // the socket takes is sent with one call and without copying.
+        std::array<Span<const unsigned char>, MAX_SEND_SEGMENTS> segments;
+        size_t num_segments = 0;
+        size_t gathered_size = 0;
+        size_t skip = pnode->nSendOffset;
+        for (const CQueuedNetMsg& msg : pnode->vSendMsg) {
+            for (Span<const unsigned char> part : {MakeSpan(msg.header), msg.payload ? MakeSpan(*msg.payload) : Span<const unsigned char>()}) {
+                if (skip >= part.size()) {
+                    skip -= part.size();
+                    continue;
+                }
+                if (num_segments == MAX_SEND_SEGMENTS) break;
+                segments[num_segments++] = part.subspan(skip);
+                gathered_size += part.size() - skip;
+                skip = 0;
+            }
+            if (num_segments == MAX_SEND_SEGMENTS) break;
+        }
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            gathered_size = segments[0].size();
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(segments[0].data()), segments[0].size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            struct iovec iov[MAX_SEND_SEGMENTS];
+            for (size_t i = 0; i < num_segments; ++i) {
+                iov[i].iov_base = const_cast<unsigned char*>(segments[i].data());
+                iov[i].iov_len = segments[i].size();
+            }
+            struct msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = num_segments;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
-                pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
-                // could not send full message; stop sending more
+            // drop the messages which were sent completely
+            size_t sent = pnode->nSendOffset + nBytes;
+            while (!pnode->vSendMsg.empty() && sent >= pnode->vSendMsg.front().size()) {
+                sent -= pnode->vSendMsg.front().size();
+                pnode->nSendSize -= pnode->vSendMsg.front().size();
+                pnode->vSendMsg.pop_front();
+            }
+            pnode->nSendOffset = sent;
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < gathered_size) {
+                // could not send all of it; stop sending more
                 break;
             }
         } else {
@@ -850,11 +1158,10 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1143,6 +1450,10 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     const bool inbound_onion = std::find(m_onion_binds.begin(), m_onion_binds.end(), addr_bind) != m_onion_binds.end();
     CNode* pnode = new CNode(id, nodeServices, GetBestHeight(), hSocket, addr, CalculateKeyedNetGroup(addr), nonce, addr_bind, "", ConnectionType::INBOUND, inbound_onion);
+    if (m_v2_transport) {
+        // Recognizes V1 peers by their first bytes
+        pnode->UseV2Transport(/*initiator=*/false);
+    }
     pnode->AddRef();
     pnode->m_permissionFlags = permissionFlags;
     // If this flag is present, the user probably expect that RPC and QT report it as whitelisted (backward compatibility)
@@ -1152,6 +1463,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+    RegisterSocketEvents(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1221,11 +1533,25 @@ void CConnman::DisconnectNodes()
                 // remove from vNodes
                 vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
+                // A peer that closed the connection during our V2 handshake may
+                // only speak V1, so try it once more with V1, keeping the grant
+                if (pnode->m_v2_transport && pnode->m_deserializer->ShouldReconnectV1()) {
+                    LogPrint(BCLog::NET, "v2 handshake failed, retrying %s with v1, peer=%d\n", pnode->addr.ToString(), pnode->GetId());
+                    CAddress addr_v1 = pnode->addr;
+                    addr_v1.nServices = ServiceFlags(addr_v1.nServices & ~NODE_P2P_V2);
+                    LOCK(m_reconnections_mutex);
+                    ReconnectionInfo& reconnection = *m_reconnections.emplace(m_reconnections.end());
+                    reconnection.addr = addr_v1;
+                    reconnection.conn_type = pnode->m_conn_type;
+                    pnode->grantOutbound.MoveTo(reconnection.grant);
+                }
+
                 // release outbound grant (if any)
                 pnode->grantOutbound.Release();
 
                 // close socket and cleanup
                 pnode->CloseSocketDisconnect();
+                m_readable_nodes.erase(pnode);
 
                 // hold in disconnected pool until all refs are released
                 pnode->Release();
@@ -1303,6 +1629,49 @@ void CConnman::InactivityCheck(CNode *pnode)
     }
 }
 
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& mode)
+{
+    if (str == "select") {
+        mode = SocketEventsMode::SELECT;
+        return true;
+    }
+#ifdef USE_POLL
+    if (str == "poll") {
+        mode = SocketEventsMode::POLL;
+        return true;
+    }
+#endif
+#ifdef USE_EPOLL
+    if (str == "epoll") {
+        mode = SocketEventsMode::EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string SocketEventsModeToString(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SocketEventsMode::SELECT: return "select";
+    case SocketEventsMode::POLL: return "poll";
+    case SocketEventsMode::EPOLL: return "epoll";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+    std::string modes = "select";
+#ifdef USE_POLL
+    modes += ", poll";
+#endif
+#ifdef USE_EPOLL
+    modes += ", epoll";
+#endif
+    return modes;
+}
+
 bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     for (const ListenSocket& hListenSocket : vhListenSocket) {
@@ -1350,7 +1719,7 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
 }
 
 #ifdef USE_POLL
-void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+void CConnman::SocketEventsPoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
     if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
@@ -1391,8 +1760,9 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
         if (pollfd_entry.revents & (POLLERR|POLLHUP)) error_set.insert(pollfd_entry.fd);
     }
 }
-#else
-void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+#endif
+
+void CConnman::SocketEventsSelect(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
     if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
@@ -1465,7 +1835,138 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
         }
     }
 }
+
+void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+#ifdef USE_POLL
+    if (m_socket_events_mode != SocketEventsMode::SELECT) {
+        SocketEventsPoll(recv_set, send_set, error_set);
+        return;
+    }
+#endif
+    SocketEventsSelect(recv_set, send_set, error_set);
+}
+
+void CConnman::StartSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (m_socket_events_mode != SocketEventsMode::EPOLL) return;
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        LogPrintf("Failed to create epoll instance (%s), falling back to poll\n", NetworkErrorString(WSAGetLastError()));
+        m_socket_events_mode = SocketEventsMode::POLL;
+        return;
+    }
+    // Listening sockets are level-triggered, as one connection is accepted per wait
+    for (ListenSocket& listen_socket : vhListenSocket) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = &listen_socket;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, listen_socket.socket, &event) != 0) {
+            LogPrintf("Failed to register listening socket with epoll: %s\n", NetworkErrorString(WSAGetLastError()));
+        }
+    }
+#endif
+}
+
+void CConnman::RegisterSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (m_epoll_fd == -1) return;
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) return;
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("Failed to register socket of peer=%d with epoll: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
 #endif
+}
+
+bool CConnman::ServiceNodeSocket(CNode* pnode, bool recv, bool send)
+{
+    bool buffer_filled = false;
+
+    //
+    // Receive
+    //
+    if (recv)
+    {
+        // typical socket buffer is 8K-64K
+        char pchBuf[0x10000];
+        int nBytes = 0;
+        {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                return false;
+            nBytes = ::recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        }
+        if (nBytes > 0)
+        {
+            buffer_filled = nBytes == sizeof(pchBuf);
+            bool notify = false;
+            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify)) {
+                pnode->CloseSocketDisconnect();
+            } else if (pnode->m_v2_transport) {
+                // e.g. answer the handshake
+                PushTransportData(pnode);
+            }
+            RecordBytesRecv(nBytes);
+            if (notify) {
+                size_t nSizeAdded = 0;
+                auto it(pnode->vRecvMsg.begin());
+                for (; it != pnode->vRecvMsg.end(); ++it) {
+                    // vRecvMsg contains only completed CNetMessage
+                    // the single possible partially deserialized message are held by TransportDeserializer
+                    nSizeAdded += it->m_raw_message_size;
+                }
+                {
+                    LOCK(pnode->cs_vProcessMsg);
+                    pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                    pnode->nProcessQueueSize += nSizeAdded;
+                    pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+                }
+                WakeMessageHandlerForNode(pnode->GetId());
+            }
+        }
+        else if (nBytes == 0)
+        {
+            // socket closed gracefully
+            if (!pnode->fDisconnect) {
+                LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
+            }
+            pnode->CloseSocketDisconnect();
+        }
+        else if (nBytes < 0)
+        {
+            // error
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+            {
+                if (!pnode->fDisconnect) {
+                    LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
+                }
+                pnode->CloseSocketDisconnect();
+            }
+        }
+    }
+
+    //
+    // Send
+    //
+    if (send)
+    {
+        LOCK(pnode->cs_vSend);
+        size_t nBytes = SocketSendData(pnode);
+        if (nBytes) {
+            RecordBytesSent(nBytes);
+        }
+    }
+
+    return buffer_filled;
+}
 
 void CConnman::SocketHandler()
 {
@@ -1500,9 +2001,6 @@ void CConnman::SocketHandler()
         if (interruptNet)
             return;
 
-        //
-        // Receive
-        //
         bool recvSet = false;
         bool sendSet = false;
         bool errorSet = false;
@@ -1514,73 +2012,7 @@ void CConnman::SocketHandler()
             sendSet = send_set.count(pnode->hSocket) > 0;
             errorSet = error_set.count(pnode->hSocket) > 0;
         }
-        if (recvSet || errorSet)
-        {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-            }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                    pnode->CloseSocketDisconnect();
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        // vRecvMsg contains only completed CNetMessage
-                        // the single possible partially deserialized message are held by TransportDeserializer
-                        nSizeAdded += it->m_raw_message_size;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
-                }
-            }
-            else if (nBytes == 0)
-            {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
-                }
-                pnode->CloseSocketDisconnect();
-            }
-            else if (nBytes < 0)
-            {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
-                    }
-                    pnode->CloseSocketDisconnect();
-                }
-            }
-        }
-
-        //
-        // Send
-        //
-        if (sendSet)
-        {
-            LOCK(pnode->cs_vSend);
-            size_t nBytes = SocketSendData(pnode);
-            if (nBytes) {
-                RecordBytesSent(nBytes);
-            }
-        }
+        ServiceNodeSocket(pnode, recvSet || errorSet, sendSet);
 
         InactivityCheck(pnode);
     }
@@ -1591,23 +2023,115 @@ void CConnman::SocketHandler()
     }
 }
 
+#ifdef USE_EPOLL
+void CConnman::SocketHandlerEpoll()
+{
+    // Sockets are registered edge-triggered, so there won't be another event
+    // for data we didn't read. Don't wait if there is such data to read.
+    bool more_to_read = false;
+    for (const CNode* pnode : m_readable_nodes) {
+        if (!pnode->fPauseRecv) more_to_read = true;
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    const int num_events = epoll_wait(m_epoll_fd, events, MAX_EPOLL_EVENTS, more_to_read ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+
+    if (interruptNet) return;
+
+    if (num_events < 0) {
+        const int err = WSAGetLastError();
+        if (err != WSAEINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(err));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    std::set<CNode*> writable_nodes;
+    for (int i = 0; i < num_events; ++i) {
+        // Nodes are only deleted by this thread, and their sockets are closed
+        // (and so unregistered) before that, so the pointers are valid.
+        const ListenSocket* listen_socket = nullptr;
+        for (const ListenSocket& s : vhListenSocket) {
+            if (&s == events[i].data.ptr) listen_socket = &s;
+        }
+        if (listen_socket) {
+            AcceptConnection(*listen_socket);
+            continue;
+        }
+        CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) m_readable_nodes.insert(pnode);
+        if (events[i].events & EPOLLOUT) writable_nodes.insert(pnode);
+    }
+
+    // The inactivity checks count in seconds, so only check every node once a
+    // second. Also retry sending for every node with data left over, in case
+    // the last send stopped short of filling the socket buffer.
+    const int64_t now = GetSystemTimeInSeconds();
+    std::vector<CNode*> vNodesCopy;
+    if (now != m_last_inactivity_check) {
+        m_last_inactivity_check = now;
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+    }
+    for (CNode* pnode : vNodesCopy) {
+        if (WITH_LOCK(pnode->cs_vSend, return !pnode->vSendMsg.empty())) writable_nodes.insert(pnode);
+    }
+
+    std::set<CNode*> nodes = writable_nodes;
+    for (CNode* pnode : m_readable_nodes) {
+        if (!pnode->fPauseRecv) nodes.insert(pnode);
+    }
+    for (CNode* pnode : nodes) {
+        if (interruptNet) return;
+        const bool recv = !pnode->fPauseRecv && m_readable_nodes.count(pnode) > 0;
+        const bool send = writable_nodes.count(pnode) > 0;
+        if (!ServiceNodeSocket(pnode, recv, send) && recv) {
+            m_readable_nodes.erase(pnode);
+        }
+    }
+
+    for (CNode* pnode : vNodesCopy) {
+        InactivityCheck(pnode);
+    }
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     while (!interruptNet)
     {
         DisconnectNodes();
         NotifyNumConnectionsChanged();
+#ifdef USE_EPOLL
+        if (m_socket_events_mode == SocketEventsMode::EPOLL) {
+            SocketHandlerEpoll();
+            continue;
+        }
+#endif
         SocketHandler();
     }
 }
 
 void CConnman::WakeMessageHandler()
 {
+    for (const auto& shard : m_msghand_shards) {
+        {
+            LOCK(shard->mutexMsgProc);
+            shard->fMsgProcWake = true;
+        }
+        shard->condMsgProc.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandlerForNode(NodeId id)
+{
+    MessageHandlerShard& shard = GetMessageHandlerShard(id);
     {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = true;
+        LOCK(shard.mutexMsgProc);
+        shard.m_ready_nodes.insert(id);
     }
-    condMsgProc.notify_one();
+    shard.condMsgProc.notify_one();
 }
 
 
@@ -1863,6 +2387,18 @@ void CConnman::ProcessAddrFetch()
     }
 }
 
+void CConnman::ProcessReconnections()
+{
+    std::list<ReconnectionInfo> reconnections;
+    {
+        LOCK(m_reconnections_mutex);
+        reconnections.swap(m_reconnections);
+    }
+    for (ReconnectionInfo& item : reconnections) {
+        OpenNetworkConnection(item.addr, false, &item.grant, nullptr, item.conn_type);
+    }
+}
+
 bool CConnman::GetTryNewOutboundPeer()
 {
     return m_try_another_outbound_peer;
@@ -1925,6 +2461,7 @@ void CConnman::ThreadOpenConnections(const std::vector<std::string> connect)
     while (!interruptNet)
     {
         ProcessAddrFetch();
+        ProcessReconnections();
 
         if (!interruptNet.sleep_for(std::chrono::milliseconds(500)))
             return;
@@ -2241,27 +2778,43 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     if (grantOutbound)
         grantOutbound->MoveTo(pnode->grantOutbound);
 
+    if (pnode->m_v2_transport) {
+        // Our public key, ahead of the version message
+        PushTransportData(pnode);
+    }
     m_msgproc->InitializeNode(pnode);
+    RegisterSocketEvents(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(size_t shard_index)
 {
+    MessageHandlerShard& shard = *m_msghand_shards[shard_index];
+    // Every node is served at least every MESSAGE_HANDLER_FULL_PASS_INTERVAL,
+    // for the timers in SendMessages(). In between, only nodes which received
+    // new messages or have more work left are served.
+    bool full_pass = true;
+    auto next_full_pass = std::chrono::steady_clock::now();
+    std::set<NodeId> ready_nodes;
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (&GetMessageHandlerShard(pnode->GetId()) != &shard) continue;
+                if (!full_pass && ready_nodes.count(pnode->GetId()) == 0) continue;
+                vNodesCopy.push_back(pnode);
                 pnode->AddRef();
             }
         }
-
-        bool fMoreWork = false;
+        if (full_pass) {
+            next_full_pass = std::chrono::steady_clock::now() + MESSAGE_HANDLER_FULL_PASS_INTERVAL;
+        }
+        ready_nodes.clear();
 
         for (CNode* pnode : vNodesCopy)
         {
@@ -2270,7 +2823,9 @@ void CConnman::ThreadMessageHandler()
 
             // Receive messages
             bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
+            if (fMoreNodeWork && !pnode->fPauseSend) {
+                ready_nodes.insert(pnode->GetId());
+            }
             if (flagInterruptMsgProc)
                 return;
             // Send messages
@@ -2289,11 +2844,14 @@ void CConnman::ThreadMessageHandler()
                 pnode->Release();
         }
 
-        WAIT_LOCK(mutexMsgProc, lock);
-        if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) { return fMsgProcWake; });
+        WAIT_LOCK(shard.mutexMsgProc, lock);
+        if (ready_nodes.empty()) {
+            shard.condMsgProc.wait_until(lock, next_full_pass, [&shard]() EXCLUSIVE_LOCKS_REQUIRED(shard.mutexMsgProc) { return shard.fMsgProcWake || !shard.m_ready_nodes.empty(); });
         }
-        fMsgProcWake = false;
+        full_pass = shard.fMsgProcWake || std::chrono::steady_clock::now() >= next_full_pass;
+        shard.fMsgProcWake = false;
+        ready_nodes.insert(shard.m_ready_nodes.begin(), shard.m_ready_nodes.end());
+        shard.m_ready_nodes.clear();
     }
 }
 
@@ -2510,6 +3068,8 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         return false;
     }
 
+    StartSocketEvents();
+
     for (const auto& strDest : connOptions.vSeedNodes) {
         AddAddrFetch(strDest);
     }
@@ -2560,9 +3120,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
+    for (const auto& shard : m_msghand_shards) {
+        LOCK(shard->mutexMsgProc);
+        shard->fMsgProcWake = false;
     }
 
     // Send and receive from sockets, accept connections
@@ -2588,7 +3148,11 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    LogPrintf("Using %u message handler threads\n", m_msghand_shards.size());
+    for (size_t i = 0; i < m_msghand_shards.size(); ++i) {
+        const std::string thread_name = m_msghand_shards.size() == 1 ? "msghand" : strprintf("msghand.%u", i);
+        m_msghand_shards[i]->thread = std::thread([this, i, thread_name] { TraceThread(thread_name.c_str(), [this, i] { ThreadMessageHandler(i); }); });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery([this] { DumpAddresses(); }, DUMP_PEERS_INTERVAL);
@@ -2613,11 +3177,13 @@ static CNetCleanup instance_of_cnetcleanup;
 
 void CConnman::Interrupt()
 {
-    {
-        LOCK(mutexMsgProc);
-        flagInterruptMsgProc = true;
+    for (const auto& shard : m_msghand_shards) {
+        {
+            LOCK(shard->mutexMsgProc);
+            flagInterruptMsgProc = true;
+        }
+        shard->condMsgProc.notify_all();
     }
-    condMsgProc.notify_all();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2637,8 +3203,10 @@ void CConnman::Interrupt()
 
 void CConnman::StopThreads()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (const auto& shard : m_msghand_shards) {
+        if (shard->thread.joinable())
+            shard->thread.join();
+    }
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2684,6 +3252,13 @@ void CConnman::StopNodes()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    m_readable_nodes.clear();
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+#endif
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -2741,6 +3316,7 @@ std::vector<CAddress> CConnman::GetAddresses(CNode& requestor, size_t max_addres
         .Write(local_socket_bytes.data(), local_socket_bytes.size())
         .Finalize();
     const auto current_time = GetTime<std::chrono::microseconds>();
+    LOCK(m_addr_response_caches_mutex);
     auto r = m_addr_response_caches.emplace(cache_id, CachedAddrResponse{});
     CachedAddrResponse& cache_entry = r.first->second;
     if (cache_entry.m_cache_entry_expiration < current_time) { // If emplace() added new one it has expiration 0.
@@ -3029,6 +3605,14 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     m_serializer = MakeUnique<V1TransportSerializer>(V1TransportSerializer());
 }
 
+void CNode::UseV2Transport(bool initiator)
+{
+    auto transport = std::make_shared<V2Transport>(Params(), GetId(), initiator, SER_NETWORK, INIT_PROTO_VERSION);
+    m_deserializer = MakeUnique<V2TransportDeserializer>(transport);
+    m_serializer = MakeUnique<V2TransportSerializer>(transport);
+    m_v2_transport = true;
+}
+
 CNode::~CNode()
 {
     CloseSocket(hSocket);
@@ -3041,37 +3625,77 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.m_type), nMessageSize, pnode->GetId());
-
-    // make sure we use the appropriate network transport format
-    std::vector<unsigned char> serializedHeader;
-    pnode->m_serializer->prepareForTransport(msg, serializedHeader);
-    size_t nTotalSize = nMessageSize + serializedHeader.size();
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.m_type), msg.data.size(), pnode->GetId());
 
     size_t nBytesSent = 0;
     {
+        // Prepare the message with cs_vSend held, so that a transport which
+        // encrypts sees the messages in the order in which they are queued.
         LOCK(pnode->cs_vSend);
-        bool optimisticSend(pnode->vSendMsg.empty());
+        // make sure we use the appropriate network transport format
+        CQueuedNetMsg queued;
+        pnode->m_serializer->prepareForTransport(msg, queued.header);
+        if (!msg.data.empty()) {
+            queued.payload = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+        }
+        nBytesSent = QueueMessage(pnode, msg.m_type, std::move(queued));
+    }
+    if (nBytesSent)
+        RecordBytesSent(nBytesSent);
+}
 
-        //log total amount of bytes per message type
-        pnode->mapSendBytesPerMsgCmd[msg.m_type] += nTotalSize;
-        pnode->nSendSize += nTotalSize;
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.m_type), msg.data->size(), pnode->GetId());
 
-        if (pnode->nSendSize > nSendBufferMaxSize)
-            pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+    size_t nBytesSent = 0;
+    {
+        LOCK(pnode->cs_vSend);
+        CQueuedNetMsg queued;
+        if (pnode->m_serializer->prepareForTransport(msg, queued.header) && !msg.data->empty()) {
+            queued.payload = msg.data;
+        }
+        nBytesSent = QueueMessage(pnode, msg.m_type, std::move(queued));
+    }
+    if (nBytesSent)
+        RecordBytesSent(nBytesSent);
+}
 
-        // If write queue empty, attempt "optimistic write"
-        if (optimisticSend == true)
-            nBytesSent = SocketSendData(pnode);
+void CConnman::PushTransportData(CNode* pnode)
+{
+    size_t nBytesSent = 0;
+    {
+        LOCK(pnode->cs_vSend);
+        CQueuedNetMsg queued;
+        pnode->m_serializer->prepareTransportData(queued.header);
+        nBytesSent = QueueMessage(pnode, NET_MESSAGE_COMMAND_OTHER, std::move(queued));
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
 }
 
+size_t CConnman::QueueMessage(CNode* pnode, const std::string& msg_type, CQueuedNetMsg&& msg) EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
+{
+    size_t nTotalSize = msg.size();
+    // The transport may hold a message back, e.g. until its handshake is done
+    if (nTotalSize == 0) return 0;
+
+    bool optimisticSend(pnode->vSendMsg.empty());
+
+    //log total amount of bytes per message type
+    pnode->mapSendBytesPerMsgCmd[msg_type] += nTotalSize;
+    pnode->nSendSize += nTotalSize;
+
+    if (pnode->nSendSize > nSendBufferMaxSize)
+        pnode->fPauseSend = true;
+    pnode->vSendMsg.push_back(std::move(msg));
+
+    // If write queue empty, attempt "optimistic write"
+    if (optimisticSend == true)
+        return SocketSendData(pnode);
+    return 0;
+}
+
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
 {
     CNode* found = nullptr;
@@ -3087,13 +3711,14 @@ bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
 
 int64_t CConnman::PoissonNextSendInbound(int64_t now, int average_interval_seconds)
 {
-    if (m_next_send_inv_to_incoming < now) {
-        // If this function were called from multiple threads simultaneously
-        // it would possible that both update the next send variable, and return a different result to their caller.
-        // This is not possible in practice as only the net processing thread invokes this function.
-        m_next_send_inv_to_incoming = PoissonNextSend(now, average_interval_seconds);
+    int64_t next = m_next_send_inv_to_incoming;
+    if (next < now) {
+        // Message handler threads may call this simultaneously. Only one of them
+        // moves the next send time forward, and all of them return that time.
+        const int64_t updated = PoissonNextSend(now, average_interval_seconds);
+        if (m_next_send_inv_to_incoming.compare_exchange_strong(next, updated)) return updated;
     }
-    return m_next_send_inv_to_incoming;
+    return next;
 }
 
 int64_t PoissonNextSend(int64_t now, int average_interval_seconds)
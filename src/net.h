@@ -9,26 +9,33 @@
 #include <addrdb.h>
 #include <addrman.h>
 #include <amount.h>
+#include <bip324.h>
 #include <bloom.h>
 #include <chainparams.h>
 #include <compat.h>
 #include <crypto/siphash.h>
 #include <hash.h>
+#include <key.h>
 #include <net_permissions.h>
 #include <netaddress.h>
 #include <optional.h>
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <span.h>
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
 #include <uint256.h>
+#include <util/memory.h>
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <deque>
+#include <list>
 #include <map>
+#include <set>
 #include <thread>
 #include <memory>
 #include <condition_variable>
@@ -89,6 +96,34 @@ static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
+/** How the socket handler thread waits for events on the sockets of peers */
+enum class SocketEventsMode {
+    SELECT, //!< select(), passing every socket on each wait
+    POLL,   //!< poll(), passing every socket on each wait
+    EPOLL,  //!< Edge-triggered epoll, with every socket registered once
+};
+#if defined(USE_EPOLL)
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SocketEventsMode::EPOLL;
+#elif defined(USE_POLL)
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SocketEventsMode::POLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SocketEventsMode::SELECT;
+#endif
+/** Interval at which the message handler serves every peer, not just those with new messages */
+static constexpr std::chrono::milliseconds MESSAGE_HANDLER_FULL_PASS_INTERVAL{100};
+/** -msghandthreads default: number of threads processing peer messages, each serving a shard of the peers */
+static const int DEFAULT_MSGHAND_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
+/** -v2transport default: whether to offer and use the encrypted v2 transport */
+static const bool DEFAULT_V2_TRANSPORT = false;
+
+/** Parse a -socketevents value. Returns false if it is unknown or not supported on this platform. */
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& mode);
+std::string SocketEventsModeToString(SocketEventsMode mode);
+/** The -socketevents values supported on this platform */
+std::string GetSupportedSocketEventsModes();
+
 typedef int64_t NodeId;
 
 struct AddedNodeInfo
@@ -115,6 +150,32 @@ struct CSerializedNetMsg
     std::string m_type;
 };
 
+/**
+ * A serialized message to be sent to several peers. The payload is shared
+ * between them rather than copied for each, and its checksum is computed once.
+ */
+struct CSharedNetMsg
+{
+    CSharedNetMsg() = default;
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+    CSharedNetMsg(std::string type, std::shared_ptr<const std::vector<unsigned char>> data);
+
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    std::string m_type;
+    //! Double-SHA256 of the payload
+    uint256 m_hash;
+};
+
+/** A message queued for sending to a peer */
+struct CQueuedNetMsg
+{
+    std::vector<unsigned char> header;
+    //! May be shared with the queues of other peers. nullptr if empty.
+    std::shared_ptr<const std::vector<unsigned char>> payload;
+
+    size_t size() const { return header.size() + (payload ? payload->size() : 0); }
+};
+
 /** Different types of connections to a peer. This enum encapsulates the
  * information we have available at the time of opening or accepting the
  * connection. Aside from INBOUND, all types are initiated by us.
@@ -221,6 +282,9 @@ public:
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
         std::vector<bool> m_asmap;
+        SocketEventsMode socket_events_mode = DEFAULT_SOCKETEVENTS;
+        int m_msghand_threads = DEFAULT_MSGHAND_THREADS;
+        bool m_v2_transport = DEFAULT_V2_TRANSPORT;
     };
 
     void Init(const Options& connOptions) {
@@ -250,6 +314,12 @@ public:
             vAddedNodes = connOptions.m_added_nodes;
         }
         m_onion_binds = connOptions.onion_binds;
+        m_socket_events_mode = connOptions.socket_events_mode;
+        m_v2_transport = connOptions.m_v2_transport;
+        m_msghand_shards.clear();
+        for (int i = 0; i < std::max(1, std::min(connOptions.m_msghand_threads, MAX_MSGHAND_THREADS)); ++i) {
+            m_msghand_shards.emplace_back(MakeUnique<MessageHandlerShard>());
+        }
     }
 
     CConnman(uint64_t seed0, uint64_t seed1, bool network_active = true);
@@ -274,6 +344,8 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    /** Queue a message whose payload is shared with other peers, without copying it */
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     using NodeFn = std::function<void(CNode*)>;
     void ForEachNode(const NodeFn& func)
@@ -407,7 +479,10 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake every message handler thread to serve all of its nodes */
     void WakeMessageHandler();
+    /** Wake the message handler thread of a node that received new messages */
+    void WakeMessageHandlerForNode(NodeId id);
 
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
@@ -437,15 +512,32 @@ private:
     void ThreadOpenAddedConnections();
     void AddAddrFetch(const std::string& strDest);
     void ProcessAddrFetch();
+    void ProcessReconnections();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(size_t shard_index);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#ifdef USE_POLL
+    void SocketEventsPoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
+    void SocketEventsSelect(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+    /** Set up the epoll instance, if that is the mode, and register the listening sockets with it */
+    void StartSocketEvents();
+    /** Register the socket of a new node, before it is added to vNodes */
+    void RegisterSocketEvents(CNode* pnode);
+    /**
+     * Receive from and send to the socket of a node.
+     * @return whether the receive filled the whole buffer, so more data may be waiting
+     */
+    bool ServiceNodeSocket(CNode* pnode, bool recv, bool send);
     void SocketHandler();
+#ifdef USE_EPOLL
+    void SocketHandlerEpoll();
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -471,6 +563,10 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+    /** Add a prepared message to the send queue of a node (cs_vSend held) and try to send it. Returns the number of bytes sent. */
+    size_t QueueMessage(CNode* pnode, const std::string& msg_type, CQueuedNetMsg&& msg);
+    /** Queue the data the transport of a node has to send of its own accord, e.g. during its handshake */
+    void PushTransportData(CNode* pnode);
     void DumpAddresses();
 
     // Network stats
@@ -513,6 +609,16 @@ private:
     CAddrMan addrman;
     std::deque<std::string> m_addr_fetches GUARDED_BY(m_addr_fetches_mutex);
     RecursiveMutex m_addr_fetches_mutex;
+
+    /** Outbound connection to retry with the V1 transport, after the V2 handshake failed. */
+    struct ReconnectionInfo
+    {
+        CAddress addr;
+        CSemaphoreGrant grant;
+        ConnectionType conn_type;
+    };
+    std::list<ReconnectionInfo> m_reconnections GUARDED_BY(m_reconnections_mutex);
+    Mutex m_reconnections_mutex;
     std::vector<std::string> vAddedNodes GUARDED_BY(cs_vAddedNodes);
     RecursiveMutex cs_vAddedNodes;
     std::vector<CNode*> vNodes GUARDED_BY(cs_vNodes);
@@ -546,7 +652,8 @@ private:
      * resulting in at most ~196 KB. Every separate local socket may
      * add up to ~196 KB extra.
      */
-    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches;
+    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches GUARDED_BY(m_addr_response_caches_mutex);
+    Mutex m_addr_response_caches_mutex;
 
     /**
      * Services this instance offers.
@@ -577,6 +684,8 @@ private:
     int nMaxFeeler;
     int m_max_outbound;
     bool m_use_addrman_outgoing;
+    //! Whether to use the v2 transport with peers that offer it, and offer it to inbound peers
+    bool m_v2_transport{DEFAULT_V2_TRANSPORT};
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface;
     NetEventsInterface* m_msgproc;
@@ -592,20 +701,42 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake GUARDED_BY(mutexMsgProc);
+    /**
+     * A message handler thread and its wakeup state. Every node is served by
+     * the shard at index (node id % number of shards), so that the messages of
+     * one peer are processed in order while different peers are processed in
+     * parallel. Shared state in PeerManager is protected by its own locks.
+     */
+    struct MessageHandlerShard {
+        Mutex mutexMsgProc;
+        std::condition_variable condMsgProc;
+        /** flag for waking the thread to serve each of its nodes. */
+        bool fMsgProcWake GUARDED_BY(mutexMsgProc){false};
+        /** Nodes the thread was woken up for, having received new messages */
+        std::set<NodeId> m_ready_nodes GUARDED_BY(mutexMsgProc);
+        std::thread thread;
+    };
+    MessageHandlerShard& GetMessageHandlerShard(NodeId id) { return *m_msghand_shards[id % m_msghand_shards.size()]; }
 
-    std::condition_variable condMsgProc;
-    Mutex mutexMsgProc;
+    //! Set up by Init(), the threads are started by Start()
+    std::vector<std::unique_ptr<MessageHandlerShard>> m_msghand_shards;
     std::atomic<bool> flagInterruptMsgProc{false};
 
     CThreadInterrupt interruptNet;
 
+    SocketEventsMode m_socket_events_mode{DEFAULT_SOCKETEVENTS};
+    //! The epoll instance in SocketEventsMode::EPOLL, set up by Start()
+    int m_epoll_fd{-1};
+    //! Nodes whose sockets may have more data than was last read from them.
+    //! Used only by the socket handler thread, in SocketEventsMode::EPOLL.
+    std::set<CNode*> m_readable_nodes;
+    //! When every node was last checked for inactivity, in SocketEventsMode::EPOLL
+    int64_t m_last_inactivity_check{0};
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of m_max_outbound_full_relay
@@ -775,6 +906,8 @@ public:
     virtual int Read(const char *data, unsigned int bytes) = 0;
     // decomposes a message from the context
     virtual Optional<CNetMessage> GetMessage(std::chrono::microseconds time, uint32_t& out_err) = 0;
+    // whether a connection that ends now should be retried with the V1 transport
+    virtual bool ShouldReconnectV1() const { return false; }
     virtual ~TransportDeserializer() {}
 };
 
@@ -841,13 +974,128 @@ public:
 class TransportSerializer {
 public:
     // prepare message for transport (header construction, error-correction computation, payload encryption, etc.)
+    // (msg.data is left empty when the payload was encoded into the header)
     virtual void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) = 0;
+    // same, for a message whose payload is shared with other peers and so must be left as it is
+    // returns whether msg.data has to be sent after the header (false when it was encoded into the header)
+    virtual bool prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) = 0;
+    // take the data the transport has to send of its own accord, e.g. during a handshake
+    virtual void prepareTransportData(std::vector<unsigned char>& data) {}
     virtual ~TransportSerializer() {}
 };
 
 class V1TransportSerializer  : public TransportSerializer {
 public:
     void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) override;
+    bool prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) override;
+};
+
+/**
+ * The opt-in v2 transport, shared by the serializer and deserializer of a
+ * connection. Both sides first send an ephemeral public key, from which
+ * BIP324Handshake derives the session keys. After that every message is one
+ * BIP324Cipher packet: the message type as a one byte short ID (or a 0 byte
+ * and 12 bytes of message type), then the payload. There is no checksum, as
+ * the Poly1305 tag authenticates each packet.
+ *
+ * The responder of a connection also accepts V1 peers, which it recognizes by
+ * the magic and "version" message type they start with, and then falls back
+ * to the V1 format in both directions.
+ *
+ * The receiving side is protected by the caller (CNode::cs_vRecv), the sending
+ * side by m_send_mutex, as the receiving side completes the handshake for both.
+ */
+class V2Transport
+{
+public:
+    V2Transport(const CChainParams& chain_params, NodeId node_id, bool initiator, int nTypeIn, int nVersionIn);
+
+    bool Complete() const;
+    void SetVersion(int nVersionIn);
+    int Read(const char* pch, unsigned int nBytes);
+    Optional<CNetMessage> GetMessage(std::chrono::microseconds time, uint32_t& out_err_raw_size);
+    //! Whether we initiated the connection and the peer never sent an authenticated packet, as a V1 peer wouldn't
+    bool ShouldReconnectV1() const { return m_initiator && !m_recv_authenticated; }
+
+    //! Append the wire format of a message to header. Returns whether the payload has to follow, which is only the case for V1 peers.
+    bool PrepareMessage(const std::string& msg_type, Span<const unsigned char> payload, const uint256* payload_hash, std::vector<unsigned char>& header) LOCKS_EXCLUDED(m_send_mutex);
+    void PrepareTransportData(std::vector<unsigned char>& data) LOCKS_EXCLUDED(m_send_mutex);
+
+private:
+    enum class RecvState {
+        V1_DETECT, //!< responder: checking whether the peer starts like a V1 connection
+        KEY,       //!< receiving the public key of the peer
+        LENGTH,    //!< receiving the encrypted length of a packet
+        PACKET,    //!< receiving the rest of a packet
+        V1,        //!< falling back to V1
+    };
+    enum class SendState {
+        AWAITING_KEY, //!< messages wait in m_send_pending until the session keys are known
+        READY,        //!< messages are encrypted with m_send_cipher
+        V1,           //!< falling back to V1
+    };
+
+    const CChainParams& m_chain_params;
+    const NodeId m_node_id; // Only for logging
+    const bool m_initiator;
+    const CKey m_key;
+
+    RecvState m_recv_state;
+    //! Bytes of the V1 prefix or the public key of the peer received so far
+    std::vector<unsigned char> m_recv_buffer;
+    std::unique_ptr<BIP324Cipher> m_recv_cipher;
+    //! Packet being received; decrypted in place when complete
+    CDataStream m_recv_packet;
+    size_t m_recv_pos{0};
+    uint32_t m_recv_len{0};
+    bool m_recv_complete{false};
+    //! Set once a packet of the peer decrypted, read when the connection is closed
+    std::atomic<bool> m_recv_authenticated{false};
+    V1TransportDeserializer m_v1_deserializer;
+
+    Mutex m_send_mutex;
+    SendState m_send_state GUARDED_BY(m_send_mutex){SendState::AWAITING_KEY};
+    std::unique_ptr<BIP324Cipher> m_send_cipher GUARDED_BY(m_send_mutex);
+    //! Bytes to send before the next message: our public key and messages prepared before the session keys were known
+    std::vector<unsigned char> m_send_buffer GUARDED_BY(m_send_mutex);
+    std::vector<CSerializedNetMsg> m_send_pending GUARDED_BY(m_send_mutex);
+
+    int ReadKey(const char* pch, unsigned int nBytes);
+    int ReadPacket(const char* pch, unsigned int nBytes);
+    //! Leave AWAITING_KEY, preparing the pending messages in the new state
+    void SetSendState(SendState state, std::unique_ptr<BIP324Cipher> cipher) EXCLUSIVE_LOCKS_REQUIRED(m_send_mutex);
+    bool PrepareMessageLocked(const std::string& msg_type, Span<const unsigned char> payload, const uint256* payload_hash, std::vector<unsigned char>& header) EXCLUSIVE_LOCKS_REQUIRED(m_send_mutex);
+};
+
+class V2TransportDeserializer final : public TransportDeserializer
+{
+private:
+    const std::shared_ptr<V2Transport> m_transport;
+
+public:
+    explicit V2TransportDeserializer(std::shared_ptr<V2Transport> transport) : m_transport(std::move(transport)) {}
+
+    bool Complete() const override { return m_transport->Complete(); }
+    void SetVersion(int nVersionIn) override { m_transport->SetVersion(nVersionIn); }
+    int Read(const char* pch, unsigned int nBytes) override { return m_transport->Read(pch, nBytes); }
+    Optional<CNetMessage> GetMessage(std::chrono::microseconds time, uint32_t& out_err_raw_size) override
+    {
+        return m_transport->GetMessage(time, out_err_raw_size);
+    }
+    bool ShouldReconnectV1() const override { return m_transport->ShouldReconnectV1(); }
+};
+
+class V2TransportSerializer final : public TransportSerializer
+{
+private:
+    const std::shared_ptr<V2Transport> m_transport;
+
+public:
+    explicit V2TransportSerializer(std::shared_ptr<V2Transport> transport) : m_transport(std::move(transport)) {}
+
+    void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) override;
+    bool prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) override;
+    void prepareTransportData(std::vector<unsigned char>& data) override { m_transport->PrepareTransportData(data); }
 };
 
 /** Information about a peer */
@@ -859,6 +1107,8 @@ class CNode
 public:
     std::unique_ptr<TransportDeserializer> m_deserializer;
     std::unique_ptr<TransportSerializer> m_serializer;
+    //! Whether the transport is the v2 one, which may have data of its own to send
+    bool m_v2_transport{false};
 
     // socket
     std::atomic<ServiceFlags> nServices{NODE_NONE};
@@ -866,7 +1116,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CQueuedNetMsg> vSendMsg GUARDED_BY(cs_vSend);
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -1000,8 +1250,12 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    std::unique_ptr<CRollingBloomFilter> m_addr_known{nullptr};
+    // Addresses are relayed to a peer from whichever message handler thread
+    // processes the sending peer, so the queue and the known filter need
+    // their own lock.
+    Mutex m_addr_send_mutex;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(m_addr_send_mutex);
+    std::unique_ptr<CRollingBloomFilter> m_addr_known PT_GUARDED_BY(m_addr_send_mutex){nullptr};
     bool fGetAddr{false};
     std::chrono::microseconds m_next_addr_send GUARDED_BY(cs_sendProcessing){0};
     std::chrono::microseconds m_next_local_addr_send GUARDED_BY(cs_sendProcessing){0};
@@ -1162,6 +1416,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(m_addr_send_mutex);
         assert(m_addr_known);
         m_addr_known->insert(_addr.GetKey());
     }
@@ -1176,6 +1431,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(m_addr_send_mutex);
         assert(m_addr_known);
         if (_addr.IsValid() && !m_addr_known->contains(_addr.GetKey()) && addr_format_supported) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
@@ -1206,6 +1462,9 @@ public:
 
     void CloseSocketDisconnect();
 
+    /** Switch to the v2 transport; must be called before anything is sent or received. */
+    void UseV2Transport(bool initiator);
+
     void copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap);
 
     ServiceFlags GetLocalServices() const
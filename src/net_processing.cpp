@@ -7,6 +7,7 @@
 
 #include <addrman.h>
 #include <banman.h>
+#include <blockdownload.h>
 #include <blockencodings.h>
 #include <blockfilter.h>
 #include <chainparams.h>
@@ -18,6 +19,7 @@
 #include <netbase.h>
 #include <netmessagemaker.h>
 #include <policy/fees.h>
+#include <policy/packages.h>
 #include <policy/policy.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
@@ -32,6 +34,7 @@
 #include <util/system.h>
 #include <validation.h>
 
+#include <list>
 #include <memory>
 #include <typeinfo>
 
@@ -91,27 +94,32 @@ static constexpr auto OVERLOADED_PEER_TX_DELAY = std::chrono::seconds{2};
 static constexpr std::chrono::microseconds GETDATA_TX_INTERVAL{std::chrono::seconds{60}};
 /** Limit to avoid sending big packets. Not used in processing incoming GETDATA for compatibility */
 static const unsigned int MAX_GETDATA_SZ = 1000;
-/** Number of blocks that can be requested at any given time from a single peer. */
-static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Number of headers sent in one getheaders2 result. headers2 only exists between peers that
+ *  negotiated it with sendheaders2 at protocol version 70019 or later, and this batch size is part
+ *  of that protocol: a shorter result means we reached the sender's tip. */
+static const unsigned int MAX_HEADERS2_RESULTS = 8000;
 /** Maximum depth of blocks we're willing to serve as compact blocks to peers
  *  when requested. For older blocks, a regular BLOCK response will be sent. */
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
 /** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
 static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Maximum total size of the transactions we prefill in a compact block announcement,
+ *  beyond the coinbase and HogEx. */
+static const unsigned int MAX_CMPCTBLOCK_PREFILL_SIZE = 10000;
+/** Maximum depth of blocks kept in the serialized block cache when served as full blocks. */
+static const int MAX_SERIALIZED_BLOCK_DEPTH = 10;
+/** Maximum number of entries in the serialized block cache. Each block may be cached in up to
+ *  three serializations (without witness and MWEB data, without MWEB data, and complete). */
+static const size_t MAX_SERIALIZED_BLOCK_ENTRIES = 12;
 /** Maximum depth of blocks we're willing to serve MWEB leafsets for. */
 static const int MAX_MWEB_LEAFSET_DEPTH = 10;
 /** Maximum number of MWEB UTXOs that can be requested in a batch. */
 static const uint16_t MAX_REQUESTED_MWEB_UTXOS = 4096;
-/** Size of the "block download window": how far ahead of our current height do we fetch?
- *  Larger windows tolerate larger download speed differences between peer, but increase the potential
- *  degree of disordering of blocks on disk (which make reindexing and pruning harder). We'll probably
- *  want to make this a per-peer adaptive value at some point. */
-static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Block download timeout base, expressed in millionths of the block interval (i.e. 10 min) */
 static const int64_t BLOCK_DOWNLOAD_TIMEOUT_BASE = 1000000;
 /** Additional block download timeout per parallel downloading peer (i.e. 5 min) */
@@ -228,6 +236,17 @@ namespace {
     std::unique_ptr<CRollingBloomFilter> recentRejects GUARDED_BY(cs_main);
     uint256 hashRecentRejectsChainTip GUARDED_BY(cs_main);
 
+    /**
+     * Filter for the wtxids of transactions which were rejected only for
+     * paying too low a feerate (TX_RECONSIDERABLE), and for the hashes of
+     * packages which failed. Unlike recentRejects, such a transaction may
+     * still be accepted in a package with a child paying for it, so its txid
+     * is still requested when an orphan spends from it.
+     *
+     * Reset together with recentRejects.
+     */
+    std::unique_ptr<CRollingBloomFilter> g_recent_rejects_reconsiderable GUARDED_BY(cs_main);
+
     /*
      * Filter for transactions that have been recently confirmed.
      * We use this to avoid requesting transactions that have already been
@@ -242,6 +261,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        std::chrono::microseconds m_requested;                   //!< When the block was requested.
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
 
@@ -254,8 +274,11 @@ namespace {
     /** Number of peers from which we're downloading blocks. */
     int nPeersWithValidatedDownloads GUARDED_BY(cs_main) = 0;
 
-    /** Number of peers with wtxid relay. */
-    int g_wtxid_relay_peers GUARDED_BY(cs_main) = 0;
+    /** Sum of the blocks we aim to have in flight from each peer (see BlockDownloadRate). */
+    int g_block_download_target GUARDED_BY(cs_main) = 0;
+
+    /** Number of peers with wtxid relay. Atomic so that announcements can be added without cs_main. */
+    std::atomic<int> g_wtxid_relay_peers{0};
 
     /** Number of outbound peers with m_chain_sync.m_protect. */
     int g_outbound_peers_with_protect_from_disconnect GUARDED_BY(cs_main) = 0;
@@ -325,6 +348,8 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! How many blocks to keep in flight from this peer.
+    BlockDownloadRate m_block_download;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -345,6 +370,8 @@ struct CNodeState {
     bool fWantsCmpctWitness;
     //! Whether this peer wants MWEB transactions in cmpctblocks/blocktxns
     bool fWantsCmpctMWEB;
+    //! Whether this peer wants the MWEB block as short IDs in cmpctblocks (version 4)
+    bool fWantsCmpctMWEBShortIDs;
     /**
      * If we've announced NODE_WITNESS to this peer: whether the peer sends witnesses in cmpctblocks/blocktxns,
      * otherwise: whether this peer sends non-witnesses in cmpctblocks/blocktxns.
@@ -353,7 +380,9 @@ struct CNodeState {
 
     int GetCmpctBlockVersion()
     {
-        if (fWantsCmpctMWEB) {
+        if (fWantsCmpctMWEBShortIDs) {
+            return 4;
+        } else if (fWantsCmpctMWEB) {
             return 3;
         } else if (fWantsCmpctWitness) {
             return 2;
@@ -414,6 +443,12 @@ struct CNodeState {
     //! Whether this peer relays txs via wtxid
     bool m_wtxid_relay{false};
 
+    //! Whether this peer accepts packages of transactions in pkgtxns messages
+    bool m_package_relay{false};
+
+    //! Whether this peer supports compressed headers in getheaders2 and headers2 messages
+    bool m_compressed_headers{false};
+
     CNodeState(CAddress addrIn, bool is_inbound, bool is_manual)
         : address(addrIn), m_is_inbound(is_inbound), m_is_manual_connection(is_manual)
     {
@@ -437,6 +472,7 @@ struct CNodeState {
         fHaveMWEB = false;
         fWantsCmpctWitness = false;
         fWantsCmpctMWEB = false;
+        fWantsCmpctMWEBShortIDs = false;
         fSupportsDesiredCmpctVersion = false;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
@@ -554,7 +590,8 @@ static void PushNodeVersion(CNode& pnode, CConnman& connman, int64_t nTime)
 
 // Returns a bool indicating whether we requested this block.
 // Also used if a block was /not/ received and timed out or started with another peer
-static bool MarkBlockAsReceived(const uint256& hash, Optional<NodeId> from_peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+// received_bytes is the size of a full block received from from_peer, to measure its download rate
+static bool MarkBlockAsReceived(const uint256& hash, Optional<NodeId> from_peer, size_t received_bytes = 0) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         auto node_id = itInFlight->second.first;
@@ -565,6 +602,11 @@ static bool MarkBlockAsReceived(const uint256& hash, Optional<NodeId> from_peer)
 
         CNodeState *state = State(itInFlight->second.first);
         assert(state != nullptr);
+        if (from_peer && received_bytes > 0) {
+            const int old_target = state->m_block_download.GetTargetInFlight();
+            state->m_block_download.BlockReceived(received_bytes, itInFlight->second.second->m_requested, GetTime<std::chrono::microseconds>());
+            g_block_download_target += state->m_block_download.GetTargetInFlight() - old_target;
+        }
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         if (state->nBlocksInFlightValidHeaders == 0 && itInFlight->second.second->fValidatedHeaders) {
             // Last validated block on the queue was received.
@@ -605,7 +647,7 @@ static bool MarkBlockAsInFlight(CTxMemPool& mempool, NodeId nodeid, const uint25
         mweb_block = (*(*pit))->partialBlock->mweb_block;
     }
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool, mweb_block) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool, mweb_block) : nullptr), GetTime<std::chrono::microseconds>()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -753,10 +795,11 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
 
     std::vector<const CBlockIndex*> vToFetch;
     const CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
-    // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
-    // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    // Never fetch further than the best block we know the peer has, or more than the block download window + 1 beyond
+    // the last linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be
+    // able to download that next block if the window were 1 larger. The window grows with the number of blocks we keep
+    // in flight, so that the peers that deliver fast are not held back by the one we wait for.
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + GetBlockDownloadWindow(g_block_download_target);
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -815,15 +858,13 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
 
 } // namespace
 
-void PeerManager::AddTxAnnouncement(const CNode& node, const GenTxid& gtxid, std::chrono::microseconds current_time)
+void PeerManager::AddTxAnnouncement(const CNode& node, const GenTxid& gtxid, bool preferred, std::chrono::microseconds current_time)
 {
-    AssertLockHeld(::cs_main); // For m_txrequest
     NodeId nodeid = node.GetId();
     if (!node.HasPermission(PF_RELAY) && m_txrequest.Count(nodeid) >= MAX_PEER_TX_ANNOUNCEMENTS) {
         // Too many queued announcements from this peer
         return;
     }
-    const CNodeState* state = State(nodeid);
 
     // Decide the TxRequestTracker parameters for this announcement:
     // - "preferred": if fPreferredDownload is set (= outbound, or PF_NOBAN permission)
@@ -833,7 +874,6 @@ void PeerManager::AddTxAnnouncement(const CNode& node, const GenTxid& gtxid, std
     //   - OVERLOADED_PEER_TX_DELAY for announcements from peers which have at least
     //     MAX_PEER_TX_REQUEST_IN_FLIGHT requests in flight (and don't have PF_RELAY).
     auto delay = std::chrono::microseconds{0};
-    const bool preferred = state->fPreferredDownload;
     if (!preferred) delay += NONPREF_PEER_TX_DELAY;
     if (!gtxid.IsWtxid() && g_wtxid_relay_peers > 0) delay += TXID_RELAY_DELAY;
     const bool overloaded = !node.HasPermission(PF_RELAY) &&
@@ -857,7 +897,8 @@ void PeerManager::InitializeNode(CNode *pnode) {
     NodeId nodeid = pnode->GetId();
     {
         LOCK(cs_main);
-        mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, pnode->IsInboundConn(), pnode->IsManualConn()));
+        auto it = mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, pnode->IsInboundConn(), pnode->IsManualConn()));
+        g_block_download_target += it->second.m_block_download.GetTargetInFlight();
         assert(m_txrequest.Count(nodeid) == 0);
     }
     {
@@ -919,9 +960,11 @@ void PeerManager::FinalizeNode(const CNode& node, bool& fUpdateConnectionTime) {
     }
     EraseOrphansFor(nodeid);
     m_txrequest.DisconnectedPeer(nodeid);
+    if (m_txreconciliation) m_txreconciliation->ForgetPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
+    g_block_download_target -= state->m_block_download.GetTargetInFlight();
     g_outbound_peers_with_protect_from_disconnect -= state->m_chain_sync.m_protect;
     assert(g_outbound_peers_with_protect_from_disconnect >= 0);
     g_wtxid_relay_peers -= state->m_wtxid_relay;
@@ -934,6 +977,7 @@ void PeerManager::FinalizeNode(const CNode& node, bool& fUpdateConnectionTime) {
         assert(mapBlocksInFlight.empty());
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
+        assert(g_block_download_target == 0);
         assert(g_outbound_peers_with_protect_from_disconnect == 0);
         assert(g_wtxid_relay_peers == 0);
         assert(m_txrequest.Size() == 0);
@@ -1187,6 +1231,7 @@ bool PeerManager::MaybePunishNodeForTx(NodeId nodeid, const TxValidationState& s
     case TxValidationResult::TX_WITNESS_STRIPPED:
     case TxValidationResult::TX_CONFLICT:
     case TxValidationResult::TX_MEMPOOL_POLICY:
+    case TxValidationResult::TX_RECONSIDERABLE:
         break;
     }
     if (message != "") {
@@ -1225,6 +1270,7 @@ PeerManager::PeerManager(const CChainParams& chainparams, CConnman& connman, Ban
 {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    g_recent_rejects_reconsiderable.reset(new CRollingBloomFilter(120000, 0.000001));
 
     // Blocks don't typically have more than 4000 transactions, so this should
     // be at least six blocks (~1 hr) worth of transactions that we can store,
@@ -1247,6 +1293,10 @@ PeerManager::PeerManager(const CChainParams& chainparams, CConnman& connman, Ban
     // schedule next run for 10-15 minutes in the future
     const std::chrono::milliseconds delta = std::chrono::minutes{10} + GetRandMillis(std::chrono::minutes{5});
     scheduler.scheduleFromNow([&] { ReattemptInitialBroadcast(scheduler); }, delta);
+
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION_ENABLE)) {
+        m_txreconciliation = MakeUnique<TxReconciliationTracker>();
+    }
 }
 
 /**
@@ -1315,8 +1365,12 @@ void PeerManager::BlockDisconnected(const std::shared_ptr<const CBlock> &block,
     // block's worth of transactions in it, but that should be fine, since
     // presumably the most common case of relaying a confirmed transaction
     // should be just after a new block containing it is found.
-    LOCK(g_cs_recent_confirmed_transactions);
-    g_recent_confirmed_transactions->reset();
+    {
+        LOCK(g_cs_recent_confirmed_transactions);
+        g_recent_confirmed_transactions->reset();
+    }
+
+    m_headers_cache.BlockDisconnected(pindex->nHeight);
 }
 
 // All of the following cache a recent block, and are protected by cs_most_recent_block
@@ -1326,6 +1380,95 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_bloc
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
 static bool fMWEBPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
+static std::map<int, CSharedNetMsg> most_recent_compact_block_msgs GUARDED_BY(cs_most_recent_block);
+
+/**
+ * Make a CMPCTBLOCK message. When it is for the most recent compact block, which is
+ * announced to many peers at once, the serialization for the given flags is shared
+ * between all of them.
+ */
+static CSharedNetMsg MakeCompactBlockMsg(const CBlockHeaderAndShortTxIDs& cmpctblock, int ser_flags)
+{
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    LOCK(cs_most_recent_block);
+    if (&cmpctblock != most_recent_compact_block.get()) {
+        return CSharedNetMsg(msgMaker.Make(ser_flags, NetMsgType::CMPCTBLOCK, cmpctblock));
+    }
+    auto it = most_recent_compact_block_msgs.find(ser_flags);
+    if (it == most_recent_compact_block_msgs.end()) {
+        it = most_recent_compact_block_msgs.emplace(ser_flags, CSharedNetMsg(msgMaker.Make(ser_flags, NetMsgType::CMPCTBLOCK, cmpctblock))).first;
+    }
+    return it->second;
+}
+
+// Full blocks near the tip are requested by many peers at once. Their BLOCK messages are
+// shared between those requests instead of being read from disk, serialized and
+// checksummed for each one. Entries are keyed by block hash and serialization flags,
+// most recently used first.
+typedef std::pair<uint256, int> SerializedBlockKey;
+static Mutex cs_serialized_blocks;
+static std::list<std::pair<SerializedBlockKey, CSharedNetMsg>> g_serialized_blocks GUARDED_BY(cs_serialized_blocks);
+
+static Optional<CSharedNetMsg> GetSerializedBlock(const uint256& hash, int ser_flags)
+{
+    LOCK(cs_serialized_blocks);
+    for (auto it = g_serialized_blocks.begin(); it != g_serialized_blocks.end(); ++it) {
+        if (it->first == SerializedBlockKey(hash, ser_flags)) {
+            g_serialized_blocks.splice(g_serialized_blocks.begin(), g_serialized_blocks, it);
+            return it->second;
+        }
+    }
+    return nullopt;
+}
+
+static void AddSerializedBlock(const uint256& hash, int ser_flags, CSharedNetMsg block_msg)
+{
+    LOCK(cs_serialized_blocks);
+    g_serialized_blocks.emplace_front(SerializedBlockKey(hash, ser_flags), std::move(block_msg));
+    if (g_serialized_blocks.size() > MAX_SERIALIZED_BLOCK_ENTRIES) {
+        g_serialized_blocks.pop_back();
+    }
+}
+
+/**
+ * Select the transactions of a compact block announcement to prefill for a peer:
+ * those it has neither announced to us nor been sent by us (per
+ * filterInventoryKnown), as it most likely doesn't have them and would otherwise
+ * need a getblocktxn round trip. Returns their indexes in the block, or nothing
+ * if we don't relay transactions with the peer and so can't tell what it has.
+ */
+static std::vector<size_t> GetCompactBlockPrefill(const CNode& node, const CBlock& block)
+{
+    std::vector<size_t> prefill;
+    if (node.m_tx_relay == nullptr) return prefill;
+
+    size_t prefill_size = 0;
+    LOCK(node.m_tx_relay->cs_tx_inventory);
+    const CRollingBloomFilter& known = node.m_tx_relay->filterInventoryKnown;
+    // The coinbase and the HogEx transaction are always prefilled
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (tx.IsHogEx() || known.contains(tx.GetHash()) || known.contains(tx.GetWitnessHash())) continue;
+        const size_t tx_size = tx.GetTotalSize();
+        if (prefill_size + tx_size > MAX_CMPCTBLOCK_PREFILL_SIZE) continue;
+        prefill_size += tx_size;
+        prefill.push_back(i);
+    }
+    return prefill;
+}
+
+/** Build a compact block, prefilling the transactions at the given indexes in the block */
+static std::unique_ptr<const CBlockHeaderAndShortTxIDs> MakeCompactBlock(const CBlock& block, bool fUseWTXID, const std::vector<size_t>& prefill)
+{
+    if (prefill.empty()) return std::make_unique<const CBlockHeaderAndShortTxIDs>(block, fUseWTXID);
+    LogPrint(BCLog::CMPCTBLOCK, "Prefilling %u txn of block %s\n", prefill.size(), block.GetHash().ToString());
+    auto next = prefill.begin();
+    return std::make_unique<const CBlockHeaderAndShortTxIDs>(block, fUseWTXID, [&](const CTransaction& tx) {
+        if (next == prefill.end() || block.vtx[*next].get() != &tx) return false;
+        ++next;
+        return true;
+    });
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -1334,51 +1477,77 @@ static bool fMWEBPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block
 void PeerManager::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    uint256 hashBlock(pblock->GetHash());
 
-    LOCK(cs_main);
+    // Peers to announce the block to, with the serialization flags they want
+    std::map<NodeId, int> announce_flags;
+    {
+        LOCK(cs_main);
 
-    static int nHighestFastAnnounce = 0;
-    if (pindex->nHeight <= nHighestFastAnnounce)
-        return;
-    nHighestFastAnnounce = pindex->nHeight;
+        static int nHighestFastAnnounce = 0;
+        if (pindex->nHeight <= nHighestFastAnnounce)
+            return;
+        nHighestFastAnnounce = pindex->nHeight;
 
-    bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, m_chainparams.GetConsensus());
-    bool mweb_enabled = IsMWEBEnabled(pindex->pprev, m_chainparams.GetConsensus());
-    uint256 hashBlock(pblock->GetHash());
+        bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, m_chainparams.GetConsensus());
+        bool mweb_enabled = IsMWEBEnabled(pindex->pprev, m_chainparams.GetConsensus());
 
-    {
-        LOCK(cs_most_recent_block);
-        most_recent_block_hash = hashBlock;
-        most_recent_block = pblock;
-        most_recent_compact_block = pcmpctblock;
-        fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
-        fMWEBPresentInMostRecentCompactBlock = mweb_enabled;
+        {
+            LOCK(cs_most_recent_block);
+            most_recent_block_hash = hashBlock;
+            most_recent_block = pblock;
+            most_recent_compact_block = pcmpctblock;
+            most_recent_compact_block_msgs.clear();
+            fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+            fMWEBPresentInMostRecentCompactBlock = mweb_enabled;
+        }
+
+        m_connman.ForEachNode([this, pindex, fWitnessEnabled, mweb_enabled, &hashBlock, &announce_flags](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+            AssertLockHeld(::cs_main);
+
+            if (pnode->GetCommonVersion() < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
+                return;
+            ProcessBlockAvailability(pnode->GetId());
+            CNodeState &state = *State(pnode->GetId());
+            // If the peer has, or we announced to them the previous block already,
+            // but we don't think they have this one, go ahead and announce it
+            if (state.fPreferHeaderAndIDs && (!fWitnessEnabled || state.fWantsCmpctWitness) &&
+                    (!mweb_enabled || state.fWantsCmpctMWEB) &&
+                    !PeerHasHeader(&state, pindex) && PeerHasHeader(&state, pindex->pprev)) {
+
+                int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+                nSendFlags |= state.fWantsCmpctMWEB ? 0 : SERIALIZE_NO_MWEB;
+                nSendFlags |= state.fWantsCmpctMWEBShortIDs ? SERIALIZE_MWEB_SHORT_IDS : 0;
+
+                LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerManager::NewPoWValidBlock",
+                        hashBlock.ToString(), pnode->GetId());
+                announce_flags.emplace(pnode->GetId(), nSendFlags);
+                state.pindexBestHeaderSent = pindex;
+            }
+        });
     }
 
-    m_connman.ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, mweb_enabled, &hashBlock](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
-        AssertLockHeld(::cs_main);
+    // Build and serialize each distinct announcement once, without cs_main. Peers
+    // with nothing to prefill share the most recent compact block's messages.
+    std::map<std::vector<size_t>, std::unique_ptr<const CBlockHeaderAndShortTxIDs>> prefilled_cmpctblocks;
+    std::map<std::pair<int, std::vector<size_t>>, CSharedNetMsg> prefilled_msgs;
+    m_connman.ForEachNode([&](CNode* pnode) {
+        const auto flags_it = announce_flags.find(pnode->GetId());
+        if (flags_it == announce_flags.end()) return;
+        const int nSendFlags = flags_it->second;
 
-        // TODO: Avoid the repeated-serialization here
-        if (pnode->GetCommonVersion() < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
+        std::vector<size_t> prefill = GetCompactBlockPrefill(*pnode, *pblock);
+        if (prefill.empty()) {
+            m_connman.PushMessage(pnode, MakeCompactBlockMsg(*pcmpctblock, nSendFlags));
             return;
-        ProcessBlockAvailability(pnode->GetId());
-        CNodeState &state = *State(pnode->GetId());
-        // If the peer has, or we announced to them the previous block already,
-        // but we don't think they have this one, go ahead and announce it
-        if (state.fPreferHeaderAndIDs && (!fWitnessEnabled || state.fWantsCmpctWitness) &&
-                (!mweb_enabled || state.fWantsCmpctMWEB) &&
-                !PeerHasHeader(&state, pindex) && PeerHasHeader(&state, pindex->pprev)) {
-
-            bool fPeerWantsWitness = State(pnode->GetId())->fWantsCmpctWitness;
-            bool fPeerWantsMWEB = State(pnode->GetId())->fWantsCmpctMWEB;
-            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-            nSendFlags |= fPeerWantsMWEB ? 0 : SERIALIZE_NO_MWEB;
-
-            LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerManager::NewPoWValidBlock",
-                    hashBlock.ToString(), pnode->GetId());
-            m_connman.PushMessage(pnode, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *pcmpctblock));
-            state.pindexBestHeaderSent = pindex;
         }
+        auto msg_it = prefilled_msgs.find({nSendFlags, prefill});
+        if (msg_it == prefilled_msgs.end()) {
+            auto& cmpctblock = prefilled_cmpctblocks[prefill];
+            if (!cmpctblock) cmpctblock = MakeCompactBlock(*pblock, /* fUseWTXID */ true, prefill);
+            msg_it = prefilled_msgs.emplace(std::make_pair(nSendFlags, std::move(prefill)), CSharedNetMsg(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *cmpctblock))).first;
+        }
+        m_connman.PushMessage(pnode, msg_it->second);
     });
 }
 
@@ -1457,7 +1626,11 @@ void PeerManager::BlockChecked(const CBlock& block, const BlockValidationState&
 //
 
 
-bool static AlreadyHaveTx(const GenTxid& gtxid, const CTxMemPool& mempool) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+/**
+ * @param[in] include_reconsiderable  Whether transactions which failed only on their feerate count as
+ *                                    known; they must not when fetching the parents of an orphan.
+ */
+bool static AlreadyHaveTx(const GenTxid& gtxid, const CTxMemPool& mempool, bool include_reconsiderable = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     assert(recentRejects);
     if (::ChainActive().Tip()->GetBlockHash() != hashRecentRejectsChainTip) {
@@ -1467,6 +1640,7 @@ bool static AlreadyHaveTx(const GenTxid& gtxid, const CTxMemPool& mempool) EXCLU
         // txs a second chance.
         hashRecentRejectsChainTip = ::ChainActive().Tip()->GetBlockHash();
         recentRejects->reset();
+        g_recent_rejects_reconsiderable->reset();
     }
 
     const uint256& hash = gtxid.GetHash();
@@ -1485,6 +1659,8 @@ bool static AlreadyHaveTx(const GenTxid& gtxid, const CTxMemPool& mempool) EXCLU
         if (g_recent_confirmed_transactions->contains(hash)) return true;
     }
 
+    if (include_reconsiderable && g_recent_rejects_reconsiderable->contains(hash)) return true;
+
     return recentRejects->contains(hash) || mempool.exists(gtxid);
 }
 
@@ -1508,6 +1684,26 @@ void RelayTransaction(const uint256& txid, const uint256& wtxid, const CConnman&
     });
 }
 
+/** Announce transactions that came out of a reconciliation with a peer. */
+static void AnnounceReconciledTxs(CNode& node, const std::vector<uint256>& wtxids, CConnman& connman)
+{
+    if (wtxids.empty()) return;
+    const CNetMsgMaker msgMaker(node.GetCommonVersion());
+    std::vector<CInv> invs;
+    LOCK(cs_main);
+    CNodeState* state = State(node.GetId());
+    for (const uint256& wtxid : wtxids) {
+        // Only now may the peer request them (see FindTxForGetData)
+        if (state) state->m_recently_announced_invs.insert(wtxid);
+        invs.emplace_back(MSG_WTX, wtxid);
+        if (invs.size() == MAX_INV_SZ) {
+            connman.PushMessage(&node, msgMaker.Make(NetMsgType::INV, invs));
+            invs.clear();
+        }
+    }
+    if (!invs.empty()) connman.PushMessage(&node, msgMaker.Make(NetMsgType::INV, invs));
+}
+
 static void RelayAddress(const CAddress& addr, bool fReachable, const CConnman& connman)
 {
     if (!fReachable && !addr.IsRelayable()) return;
@@ -1600,130 +1796,190 @@ void static ProcessGetBlockData(CNode& pfrom, const CChainParams& chainparams, c
 
     ActivateBestChainIfNeeded(chainparams, inv);
 
-    LOCK(cs_main);
-    const CBlockIndex* pindex = LookupBlockIndex(inv.hash);
-    if (pindex) {
-        send = BlockRequestAllowed(pindex, consensusParams);
-        if (!send) {
-            LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom.GetId());
-        }
-    }
+    // The request is checked under cs_main, but the block is read from disk
+    // and sent without it, so that serving a large block does not stall the
+    // other message handler threads.
+    const CBlockIndex* pindex;
+    int chain_height;
+    uint256 tip_hash;
+    bool can_direct_fetch;
+    bool fPeerWantsWitness{false};
+    bool fPeerWantsMWEB{false};
+    bool fPeerWantsMWEBShortIDs{false};
     const CNetMsgMaker msgMaker(pfrom.GetCommonVersion());
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    if (send &&
-        connman.OutboundTargetReached(true) &&
-        (((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.IsMsgFilteredBlk()) &&
-        !pfrom.HasPermission(PF_DOWNLOAD) // nodes with the download permission may exceed target
-    ) {
-        LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom.GetId());
-
-        //disconnect node
-        pfrom.fDisconnect = true;
-        send = false;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(inv.hash);
+        if (pindex) {
+            send = BlockRequestAllowed(pindex, consensusParams);
+            if (!send) {
+                LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom.GetId());
+            }
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        if (send &&
+            connman.OutboundTargetReached(true) &&
+            (((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.IsMsgFilteredBlk()) &&
+            !pfrom.HasPermission(PF_DOWNLOAD) // nodes with the download permission may exceed target
+        ) {
+            LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom.GetId());
+
+            //disconnect node
+            pfrom.fDisconnect = true;
+            send = false;
+        }
+        // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
+        if (send && !pfrom.HasPermission(PF_NOBAN) && (
+                (((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
+           )) {
+            LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom.GetId());
+
+            //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+            pfrom.fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!send || !(pindex->nStatus & BLOCK_HAVE_DATA)) return;
+        chain_height = ::ChainActive().Height();
+        tip_hash = ::ChainActive().Tip()->GetBlockHash();
+        can_direct_fetch = CanDirectFetch(consensusParams);
+        if (inv.IsMsgCmpctBlk()) {
+            const CNodeState* state = State(pfrom.GetId());
+            fPeerWantsWitness = state->fWantsCmpctWitness;
+            fPeerWantsMWEB = state->fWantsCmpctMWEB;
+            fPeerWantsMWEBShortIDs = state->fWantsCmpctMWEBShortIDs;
+        }
     }
-    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
-    if (send && !pfrom.HasPermission(PF_NOBAN) && (
-            (((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
-       )) {
-        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom.GetId());
 
-        //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+    // Should the block be pruned while it is read, the peer is disconnected
+    // rather than left waiting for it.
+    const auto read_failed = [&]() {
+        if (WITH_LOCK(cs_main, return pindex->nStatus & BLOCK_HAVE_DATA)) {
+            assert(!"cannot load block from disk");
+        }
+        LogPrint(BCLog::NET, "Cannot load block %s for peer=%d, it was pruned while being read\n", pindex->GetBlockHash().ToString(), pfrom.GetId());
         pfrom.fDisconnect = true;
-        send = false;
+    };
+
+    std::shared_ptr<const CBlock> pblock;
+    if ((inv.IsMsgBlk() || inv.IsMsgWitnessBlk() || inv.IsMsgMWEBBlk()) && pindex->nHeight >= chain_height - MAX_SERIALIZED_BLOCK_DEPTH) {
+        const int ser_flags = inv.IsMsgBlk() ? SERIALIZE_TRANSACTION_NO_WITNESS | SERIALIZE_NO_MWEB :
+                              inv.IsMsgWitnessBlk() ? SERIALIZE_NO_MWEB : 0;
+        Optional<CSharedNetMsg> block_msg = GetSerializedBlock(pindex->GetBlockHash(), ser_flags);
+        if (!block_msg) {
+            std::shared_ptr<std::vector<uint8_t>> new_block_data = std::make_shared<std::vector<uint8_t>>();
+            if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+                CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | ser_flags, *new_block_data, 0, *a_recent_block);
+            } else if (ser_flags == 0) {
+                // The network format matches the format on disk
+                if (!ReadRawBlockFromDisk(*new_block_data, pindex, chainparams.MessageStart())) {
+                    read_failed();
+                    return;
+                }
+            } else {
+                CBlock block;
+                if (!ReadBlockFromDisk(block, pindex, consensusParams)) {
+                    read_failed();
+                    return;
+                }
+                CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | ser_flags, *new_block_data, 0, block);
+            }
+            block_msg = CSharedNetMsg(NetMsgType::BLOCK, std::move(new_block_data));
+            AddSerializedBlock(pindex->GetBlockHash(), ser_flags, *block_msg);
+        }
+        connman.PushMessage(&pfrom, *block_msg);
+        // Don't set pblock as we've sent the block
+    } else if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        pblock = a_recent_block;
+    } else if (inv.IsMsgMWEBBlk()) {
+        // Fast-path: in this case it is possible to serve the block directly from disk,
+        // as the network format matches the format on disk
+        CSerializedNetMsg block_msg;
+        block_msg.m_type = NetMsgType::BLOCK;
+        if (!ReadRawBlockFromDisk(block_msg.data, pindex, chainparams.MessageStart())) {
+            read_failed();
+            return;
+        }
+        connman.PushMessage(&pfrom, std::move(block_msg));
+        // Don't set pblock as we've sent the block
+    } else {
+        // Send block from disk
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+            read_failed();
+            return;
+        }
+        pblock = pblockRead;
     }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
-    {
-        std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
-            pblock = a_recent_block;
+    if (pblock) {
+        if (inv.IsMsgBlk()) {
+            connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS | SERIALIZE_NO_MWEB, NetMsgType::BLOCK, *pblock));
+        } else if (inv.IsMsgWitnessBlk()) {
+            connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_NO_MWEB, NetMsgType::BLOCK, *pblock));
         } else if (inv.IsMsgMWEBBlk()) {
-            // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
-                assert(!"cannot load block from disk");
-            }
-            connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
-            // Don't set pblock as we've sent the block
-        } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
-                assert(!"cannot load block from disk");
-            pblock = pblockRead;
-        }
-        if (pblock) {
-            if (inv.IsMsgBlk()) {
-                connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS | SERIALIZE_NO_MWEB, NetMsgType::BLOCK, *pblock));
-            } else if (inv.IsMsgWitnessBlk()) {
-                connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_NO_MWEB, NetMsgType::BLOCK, *pblock));
-            } else if (inv.IsMsgMWEBBlk()) {
-                connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
-            } else if (inv.IsMsgFilteredBlk()) {
-                bool sendMerkleBlock = false;
-                CMerkleBlock merkleBlock;
-                if (pfrom.m_tx_relay != nullptr) {
-                    LOCK(pfrom.m_tx_relay->cs_filter);
-                    if (pfrom.m_tx_relay->pfilter) {
-                        sendMerkleBlock = true;
-                        merkleBlock = CMerkleBlock(*pblock, *pfrom.m_tx_relay->pfilter);
-                    }
-                }
-                if (sendMerkleBlock) {
-                    connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                    // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                    // This avoids hurting performance by pointlessly requiring a round-trip
-                    // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                    // they must either disconnect and retry or request the full block.
-                    // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                    // however we MUST always provide at least what the remote peer needs
-                    typedef std::pair<unsigned int, uint256> PairType;
-                    for (PairType& pair : merkleBlock.vMatchedTxn)
-                        connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS | SERIALIZE_NO_MWEB, NetMsgType::TX, *pblock->vtx[pair.first]));
+            connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+        } else if (inv.IsMsgFilteredBlk()) {
+            bool sendMerkleBlock = false;
+            CMerkleBlock merkleBlock;
+            if (pfrom.m_tx_relay != nullptr) {
+                LOCK(pfrom.m_tx_relay->cs_filter);
+                if (pfrom.m_tx_relay->pfilter) {
+                    sendMerkleBlock = true;
+                    merkleBlock = CMerkleBlock(*pblock, *pfrom.m_tx_relay->pfilter);
                 }
-                // else
-                    // no response
-            } else if (inv.IsMsgCmpctBlk()) {
-                // If a peer is asking for old blocks, we're almost guaranteed
-                // they won't have a useful mempool to match against a compact block,
-                // and we don't feel like constructing the object for them, so
-                // instead we respond with the full, non-compact block.
-                bool fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
-                bool fPeerWantsMWEB = State(pfrom.GetId())->fWantsCmpctMWEB;
-                int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                nSendFlags |= fPeerWantsMWEB ? 0 : SERIALIZE_NO_MWEB;
-
-                if (CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                    if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && (fPeerWantsMWEB || !fMWEBPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                        connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
-                    } else {
-                        CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                        connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                    }
+            }
+            if (sendMerkleBlock) {
+                connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                // This avoids hurting performance by pointlessly requiring a round-trip
+                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                // they must either disconnect and retry or request the full block.
+                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                // however we MUST always provide at least what the remote peer needs
+                typedef std::pair<unsigned int, uint256> PairType;
+                for (PairType& pair : merkleBlock.vMatchedTxn)
+                    connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS | SERIALIZE_NO_MWEB, NetMsgType::TX, *pblock->vtx[pair.first]));
+            }
+            // else
+                // no response
+        } else if (inv.IsMsgCmpctBlk()) {
+            // If a peer is asking for old blocks, we're almost guaranteed
+            // they won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+            nSendFlags |= fPeerWantsMWEB ? 0 : SERIALIZE_NO_MWEB;
+            nSendFlags |= fPeerWantsMWEBShortIDs ? SERIALIZE_MWEB_SHORT_IDS : 0;
+
+            if (can_direct_fetch && pindex->nHeight >= chain_height - MAX_CMPCTBLOCK_DEPTH) {
+                if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && (fPeerWantsMWEB || !fMWEBPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
+                    connman.PushMessage(&pfrom, MakeCompactBlockMsg(*a_recent_compact_block, nSendFlags));
                 } else {
-                    connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
-                }
-            } else if (inv.IsMsgMWEBHeader()) {
-                if (pblock->GetHogEx() != nullptr && !pblock->mweb_block.IsNull()) {
-                    CMerkleBlockWithMWEB merkle_block_with_mweb(*pblock);
-                    connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::MWEBHEADER, merkle_block_with_mweb));
+                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
+                    connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                 }
+            } else {
+                connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+            }
+        } else if (inv.IsMsgMWEBHeader()) {
+            if (pblock->GetHogEx() != nullptr && !pblock->mweb_block.IsNull()) {
+                CMerkleBlockWithMWEB merkle_block_with_mweb(*pblock);
+                connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::MWEBHEADER, merkle_block_with_mweb));
             }
         }
+    }
 
-        // Trigger the peer node to send a getblocks request for the next batch of inventory
-        if (inv.hash == pfrom.hashContinue)
-        {
-            // Send immediately. This must send even if redundant,
-            // and we want it right after the last block so they don't
-            // wait for other stuff first.
-            std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, ::ChainActive().Tip()->GetBlockHash()));
-            connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-            pfrom.hashContinue.SetNull();
-        }
+    // Trigger the peer node to send a getblocks request for the next batch of inventory
+    if (inv.hash == pfrom.hashContinue)
+    {
+        // Send immediately. This must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, tip_hash));
+        connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom.hashContinue.SetNull();
     }
 }
 
@@ -1959,6 +2215,56 @@ static CTransactionRef FindTxForGetData(const CTxMemPool& mempool, const CNode&
     return {};
 }
 
+/**
+ * Return the package of a transaction's unconfirmed ancestors and the
+ * transaction, if the peer relays packages and would not accept an ancestor
+ * it does not know yet because its feerate is below the peer's fee filter.
+ * Otherwise return an empty package and just send the transaction.
+ */
+static Package GetPackageForGetData(const CTxMemPool& mempool, const CNode& peer, const CTransactionRef& tx) LOCKS_EXCLUDED(cs_main)
+{
+    if (!WITH_LOCK(cs_main, return State(peer.GetId())->m_package_relay)) return {};
+    const CAmount fee_filter = peer.m_tx_relay->minFeeFilter;
+    if (fee_filter <= 0) return {};
+
+    LOCK(mempool.cs);
+    auto txiter = mempool.GetIter(tx->GetHash());
+    if (!txiter || (*txiter)->GetMemPoolParentsConst().empty()) return {};
+
+    CTxMemPool::setEntries ancestors;
+    const uint64_t no_limit = std::numeric_limits<uint64_t>::max();
+    std::string dummy_err_string;
+    mempool.CalculateMemPoolAncestors(**txiter, ancestors, no_limit, no_limit, no_limit, no_limit, dummy_err_string, /* fSearchForParents */ false);
+    if (ancestors.size() >= MAX_PACKAGE_COUNT) return {};
+
+    std::vector<CTxMemPool::txiter> unknown_ancestors;
+    bool below_filter = false;
+    {
+        LOCK(peer.m_tx_relay->cs_tx_inventory);
+        for (CTxMemPool::txiter it : ancestors) {
+            if (peer.m_tx_relay->filterInventoryKnown.contains(it->GetTx().GetHash()) ||
+                peer.m_tx_relay->filterInventoryKnown.contains(it->GetTx().GetWitnessHash())) {
+                continue;
+            }
+            unknown_ancestors.push_back(it);
+            below_filter |= it->GetFee() < CFeeRate(fee_filter).GetTotalFee(it->GetTxSize(), it->GetMWEBWeight());
+        }
+    }
+    if (!below_filter) return {};
+
+    // Parents have fewer ancestors than their children, so this sorts the
+    // package topologically
+    std::sort(unknown_ancestors.begin(), unknown_ancestors.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    });
+    Package package;
+    for (CTxMemPool::txiter it : unknown_ancestors) {
+        package.push_back(it->GetSharedTx());
+    }
+    package.push_back(tx);
+    return package;
+}
+
 void static ProcessGetData(CNode& pfrom, Peer& peer, const ChainstateManager& chainman, const CChainParams& chainparams, CConnman& connman, CTxMemPool& mempool, const std::atomic<bool>& interruptMsgProc) EXCLUSIVE_LOCKS_REQUIRED(!cs_main, peer.m_getdata_requests_mutex)
 {
     AssertLockNotHeld(cs_main);
@@ -1992,7 +2298,16 @@ void static ProcessGetData(CNode& pfrom, Peer& peer, const ChainstateManager& ch
         if (tx) {
             // WTX and WITNESS_TX imply we serialize with witness
             int nSendFlags = (inv.IsMsgTx() ? SERIALIZE_TRANSACTION_NO_WITNESS | SERIALIZE_NO_MWEB : (State(pfrom.GetId())->fHaveMWEB ? 0 : SERIALIZE_NO_MWEB));
-            connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::TX, *tx));
+            const Package package = GetPackageForGetData(mempool, pfrom, tx);
+            if (!package.empty()) {
+                connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::PKGTXNS, package));
+                for (const CTransactionRef& ancestor : package) {
+                    pfrom.AddKnownTx(ancestor->GetHash());
+                    pfrom.AddKnownTx(ancestor->GetWitnessHash());
+                }
+            } else {
+                connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::TX, *tx));
+            }
             mempool.RemoveUnbroadcastTx(tx->GetHash());
             // As we're going to send tx, make sure its unconfirmed parents are made requestable.
             std::vector<uint256> parent_ids_to_add;
@@ -2076,18 +2391,60 @@ void PeerManager::SendBlockTransactions(CNode& pfrom, const CBlock& block, const
         }
         resp.txn[i] = block.vtx[req.indexes[i]];
     }
+    if (!req.mweb_input_indexes.empty() || !req.mweb_output_indexes.empty() || !req.mweb_kernel_indexes.empty()) {
+        if (block.mweb_block.IsNull()) {
+            Misbehaving(pfrom.GetId(), 100, "getblocktxn with MWEB indices for a block without MWEB");
+            return;
+        }
+        const mw::Block::CPtr& mw_block = block.mweb_block.m_block;
+        std::vector<Input> inputs;
+        std::vector<Output> outputs;
+        std::vector<Kernel> kernels;
+        for (const uint32_t index : req.mweb_input_indexes) {
+            if (index >= mw_block->GetInputs().size()) {
+                Misbehaving(pfrom.GetId(), 100, "getblocktxn with out-of-bounds MWEB input indices");
+                return;
+            }
+            inputs.push_back(mw_block->GetInputs()[index]);
+        }
+        for (const uint32_t index : req.mweb_output_indexes) {
+            if (index >= mw_block->GetOutputs().size()) {
+                Misbehaving(pfrom.GetId(), 100, "getblocktxn with out-of-bounds MWEB output indices");
+                return;
+            }
+            outputs.push_back(mw_block->GetOutputs()[index]);
+        }
+        for (const uint32_t index : req.mweb_kernel_indexes) {
+            if (index >= mw_block->GetKernels().size()) {
+                Misbehaving(pfrom.GetId(), 100, "getblocktxn with out-of-bounds MWEB kernel indices");
+                return;
+            }
+            kernels.push_back(mw_block->GetKernels()[index]);
+        }
+        resp.mweb_body = TxBody(std::move(inputs), std::move(outputs), std::move(kernels));
+    }
     LOCK(cs_main);
     const CNetMsgMaker msgMaker(pfrom.GetCommonVersion());
     int nSendFlags = State(pfrom.GetId())->fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
     nSendFlags |= State(pfrom.GetId())->fWantsCmpctMWEB ? 0 : SERIALIZE_NO_MWEB;
+    nSendFlags |= State(pfrom.GetId())->fWantsCmpctMWEBShortIDs ? SERIALIZE_MWEB_SHORT_IDS : 0;
 
     m_connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
-void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHeader>& headers, bool via_compact_block)
+void PeerManager::SendGetHeaders(CNode& pto, const CBlockLocator& locator, const uint256& hash_stop)
+{
+    const CNetMsgMaker msgMaker(pto.GetCommonVersion());
+    const bool compressed = State(pto.GetId())->m_compressed_headers;
+    m_connman.PushMessage(&pto, msgMaker.Make(compressed ? NetMsgType::GETHEADERS2 : NetMsgType::GETHEADERS, locator, hash_stop));
+}
+
+void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHeader>& headers, bool via_compact_block, bool compressed)
 {
     const CNetMsgMaker msgMaker(pfrom.GetCommonVersion());
     size_t nCount = headers.size();
+    // A message with the most headers it can hold means the peer may have more.
+    const size_t max_headers = compressed ? MAX_HEADERS2_RESULTS : MAX_HEADERS_RESULTS;
 
     if (nCount == 0) {
         // Nothing interesting. Stop asking this peers for more headers.
@@ -2110,7 +2467,7 @@ void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHe
         //   nUnconnectingHeaders gets reset back to 0.
         if (!LookupBlockIndex(headers[0].hashPrevBlock) && nCount < MAX_BLOCKS_TO_ANNOUNCE) {
             nodestate->nUnconnectingHeaders++;
-            m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexBestHeader), uint256()));
+            SendGetHeaders(pfrom, ::ChainActive().GetLocator(pindexBestHeader), uint256());
             LogPrint(BCLog::NET, "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
                     headers[0].GetHash().ToString(),
                     headers[0].hashPrevBlock.ToString(),
@@ -2170,12 +2527,12 @@ void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHe
             nodestate->m_last_block_announcement = GetTime();
         }
 
-        if (nCount == MAX_HEADERS_RESULTS) {
+        if (nCount == max_headers) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of ::ChainActive().Tip or pindexBestHeader, continue
             // from there instead.
             LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom.GetId(), pfrom.nStartingHeight);
-            m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexLast), uint256()));
+            SendGetHeaders(pfrom, ::ChainActive().GetLocator(pindexLast), uint256());
         }
 
         bool fCanDirectFetch = CanDirectFetch(m_chainparams.GetConsensus());
@@ -2185,7 +2542,7 @@ void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHe
             std::vector<const CBlockIndex*> vToFetch;
             const CBlockIndex *pindexWalk = pindexLast;
             // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
-            while (pindexWalk && !::ChainActive().Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            while (pindexWalk && !::ChainActive().Contains(pindexWalk) && vToFetch.size() <= size_t(nodestate->m_block_download.GetTargetInFlight())) {
                 if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
                         !mapBlocksInFlight.count(pindexWalk->GetBlockHash()) &&
                         (!IsWitnessEnabled(pindexWalk->pprev, m_chainparams.GetConsensus()) || State(pfrom.GetId())->fHaveWitness) &&
@@ -2207,7 +2564,7 @@ void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHe
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= nodestate->m_block_download.GetTargetInFlight()) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -2232,8 +2589,8 @@ void PeerManager::ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHe
         }
         // If we're in IBD, we want outbound peers that will serve us a useful
         // chain. Disconnect peers that are on chains with insufficient work.
-        if (::ChainstateActive().IsInitialBlockDownload() && nCount != MAX_HEADERS_RESULTS) {
-            // When nCount < MAX_HEADERS_RESULTS, we know we have no more
+        if (::ChainstateActive().IsInitialBlockDownload() && nCount != max_headers) {
+            // When nCount < max_headers, we know we have no more
             // headers to fetch from this peer.
             if (nodestate->pindexBestKnownBlock && nodestate->pindexBestKnownBlock->nChainWork < nMinimumChainWork) {
                 // This peer has too little work on their headers chain to help
@@ -2320,7 +2677,10 @@ void PeerManager::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
             // Has inputs but not accepted to mempool
             // Probably non-standard or insufficient fee
             LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-            if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
+            if (state.GetResult() == TxValidationResult::TX_RECONSIDERABLE) {
+                // A child of its own may still pay for it in a package
+                g_recent_rejects_reconsiderable->insert(porphanTx->GetWitnessHash());
+            } else if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
                 // We can add the wtxid of this transaction to our reject filter.
                 // Do not add txids of witness transactions or witness-stripped
                 // transactions to the filter, as they can have been malleated;
@@ -2357,6 +2717,70 @@ void PeerManager::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
     m_mempool.check(&::ChainstateActive().CoinsTip());
 }
 
+Optional<Package> PeerManager::Find1P1CPackage(const CTransactionRef& ptx, NodeId nodeid)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(g_cs_orphans);
+
+    std::vector<CTransactionRef> children_same_peer;
+    std::vector<CTransactionRef> children_other_peers;
+    for (unsigned int i = 0; i < ptx->vout.size(); i++) {
+        auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(ptx->GetHash(), i));
+        if (it_by_prev == mapOrphanTransactionsByPrev.end()) continue;
+        for (const auto& elem : it_by_prev->second) {
+            (elem->second.fromPeer == nodeid ? children_same_peer : children_other_peers).push_back(elem->second.tx);
+        }
+    }
+
+    for (const auto* children : {&children_same_peer, &children_other_peers}) {
+        for (const CTransactionRef& child : *children) {
+            Package package{ptx, child};
+            if (!g_recent_rejects_reconsiderable->contains(GetPackageHash(package))) return package;
+        }
+    }
+    return nullopt;
+}
+
+void PeerManager::ProcessPackageResult(const Package& package, const PackageMempoolAcceptResult& result, std::set<uint256>& orphan_work_set)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(g_cs_orphans);
+
+    for (const CTransactionRef& tx : result.m_accepted) {
+        m_txrequest.ForgetTxHash(tx->GetHash());
+        m_txrequest.ForgetTxHash(tx->GetWitnessHash());
+        RelayTransaction(tx->GetHash(), tx->GetWitnessHash(), m_connman);
+        EraseOrphanTx(tx->GetHash());
+        for (unsigned int i = 0; i < tx->vout.size(); i++) {
+            auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(tx->GetHash(), i));
+            if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
+                for (const auto& elem : it_by_prev->second) {
+                    orphan_work_set.insert(elem->first);
+                }
+            }
+        }
+        LogPrint(BCLog::MEMPOOL, "ProcessNewPackage: accepted %s (poolsz %u txn, %u kB)\n",
+            tx->GetHash().ToString(), m_mempool.size(), m_mempool.DynamicMemoryUsage() / 1000);
+    }
+    if (result.m_state.IsValid()) return;
+
+    LogPrint(BCLog::MEMPOOLREJ, "package %s was not accepted: %s\n", GetPackageHash(package).ToString(), result.m_state.ToString());
+    // Don't evaluate the same package again
+    g_recent_rejects_reconsiderable->insert(GetPackageHash(package));
+    for (const auto& tx_result : result.m_tx_results) {
+        const TxValidationResult tx_result_type = tx_result.second.GetResult();
+        if (!tx_result.second.IsInvalid() || tx_result_type == TxValidationResult::TX_RECONSIDERABLE ||
+            tx_result_type == TxValidationResult::TX_MISSING_INPUTS || tx_result_type == TxValidationResult::TX_WITNESS_STRIPPED) {
+            continue;
+        }
+        // Fails regardless of the rest of the package
+        recentRejects->insert(tx_result.first);
+        m_txrequest.ForgetTxHash(tx_result.first);
+        const auto orphan_it = g_orphans_by_wtxid.find(tx_result.first);
+        if (orphan_it != g_orphans_by_wtxid.end()) EraseOrphanTx(orphan_it->second->first);
+    }
+}
+
 /**
  * Validation logic for compact filters request handling.
  *
@@ -2669,6 +3093,21 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             m_connman.PushMessage(&pfrom, msg_maker.Make(NetMsgType::WTXIDRELAY));
         }
 
+        if (greatest_common_version >= PACKAGE_RELAY_VERSION && g_relay_txes) {
+            m_connman.PushMessage(&pfrom, msg_maker.Make(NetMsgType::SENDPACKAGES));
+        }
+
+        if (greatest_common_version >= COMPRESSED_HEADERS_VERSION) {
+            m_connman.PushMessage(&pfrom, msg_maker.Make(NetMsgType::SENDHEADERS2));
+        }
+
+        // Offer transaction reconciliation (BIP330) to peers that want
+        // transactions from us. It only takes effect with wtxid relay.
+        if (m_txreconciliation && greatest_common_version >= WTXID_RELAY_VERSION && g_relay_txes && fRelay && pfrom.m_tx_relay != nullptr) {
+            const uint64_t recon_salt = m_txreconciliation->PreRegisterPeer(pfrom.GetId());
+            m_connman.PushMessage(&pfrom, msg_maker.Make(NetMsgType::SENDTXRCNCL, TXRECONCILIATION_VERSION, recon_salt));
+        }
+
         // Signal ADDRv2 support (BIP155).
         if (greatest_common_version >= 70016) {
             // BIP155 defines addrv2 and sendaddrv2 for all protocol versions, but some
@@ -2829,7 +3268,10 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             // We send this to non-NODE NETWORK peers as well, because
             // they may wish to request compact blocks from us
             bool fAnnounceUsingCMPCTBLOCK = false;
-            uint64_t nCMPCTBLOCKVersion = 3;
+            uint64_t nCMPCTBLOCKVersion = 4;
+            if (pfrom.GetLocalServices() & NODE_MWEB)
+                m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
+            nCMPCTBLOCKVersion = 3;
             if (pfrom.GetLocalServices() & NODE_MWEB)
                 m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
             nCMPCTBLOCKVersion = 2;
@@ -2838,6 +3280,10 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             nCMPCTBLOCKVersion = 1;
             m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
         }
+        if (m_txreconciliation && !m_txreconciliation->IsPeerRegistered(pfrom.GetId())) {
+            // The peer did not take up our offer of reconciliation.
+            m_txreconciliation->ForgetPeer(pfrom.GetId());
+        }
         pfrom.fSuccessfullyConnected = true;
         return;
     }
@@ -2861,6 +3307,60 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         return;
     }
 
+    // Like wtxidrelay, package relay is negotiated between VERSION and VERACK
+    if (msg_type == NetMsgType::SENDPACKAGES) {
+        if (pfrom.fSuccessfullyConnected) {
+            pfrom.fDisconnect = true;
+            return;
+        }
+        if (pfrom.GetCommonVersion() >= PACKAGE_RELAY_VERSION) {
+            LOCK(cs_main);
+            State(pfrom.GetId())->m_package_relay = true;
+        }
+        return;
+    }
+
+    if (msg_type == NetMsgType::SENDHEADERS2) {
+        if (pfrom.fSuccessfullyConnected) {
+            // Like wtxidrelay, this must be negotiated between VERSION and VERACK.
+            LogPrint(BCLog::NET, "sendheaders2 received after verack from peer=%d; disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+        if (pfrom.GetCommonVersion() >= COMPRESSED_HEADERS_VERSION) {
+            LOCK(cs_main);
+            State(pfrom.GetId())->m_compressed_headers = true;
+        }
+        return;
+    }
+
+    // Like wtxidrelay, reconciliation is negotiated between VERSION and VERACK,
+    // and only after wtxidrelay, as short IDs are computed from wtxids.
+    if (msg_type == NetMsgType::SENDTXRCNCL) {
+        if (!m_txreconciliation) {
+            LogPrint(BCLog::NET, "sendtxrcncl from peer=%d ignored, as our node does not have txreconciliation enabled\n", pfrom.GetId());
+            return;
+        }
+        if (pfrom.fSuccessfullyConnected) {
+            LogPrint(BCLog::NET, "sendtxrcncl received after verack from peer=%d; disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+        if (!WITH_LOCK(cs_main, return State(pfrom.GetId())->m_wtxid_relay)) {
+            LogPrint(BCLog::NET, "sendtxrcncl received before wtxidrelay from peer=%d; ignoring\n", pfrom.GetId());
+            return;
+        }
+        uint32_t peer_recon_version;
+        uint64_t remote_salt;
+        vRecv >> peer_recon_version >> remote_salt;
+        const ReconciliationRegisterResult result = m_txreconciliation->RegisterPeer(pfrom.GetId(), pfrom.IsInboundConn(), peer_recon_version, remote_salt);
+        if (result == ReconciliationRegisterResult::PROTOCOL_VIOLATION || result == ReconciliationRegisterResult::ALREADY_REGISTERED) {
+            LogPrint(BCLog::NET, "sendtxrcncl protocol violation from peer=%d; disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+        }
+        return;
+    }
+
     if (msg_type == NetMsgType::SENDADDRV2) {
         if (pfrom.fSuccessfullyConnected) {
             // Disconnect peers that send SENDADDRV2 message after VERACK; this
@@ -2979,19 +3479,20 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         bool fAnnounceUsingCMPCTBLOCK = false;
         uint64_t nCMPCTBLOCKVersion = 0;
         vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
-        if (nCMPCTBLOCKVersion == 1 || ((pfrom.GetLocalServices() & NODE_WITNESS) && nCMPCTBLOCKVersion == 2) || ((pfrom.GetLocalServices() & NODE_MWEB) && nCMPCTBLOCKVersion == 3)) {
+        if (nCMPCTBLOCKVersion == 1 || ((pfrom.GetLocalServices() & NODE_WITNESS) && nCMPCTBLOCKVersion == 2) || ((pfrom.GetLocalServices() & NODE_MWEB) && (nCMPCTBLOCKVersion == 3 || nCMPCTBLOCKVersion == 4))) {
             LOCK(cs_main);
             // fProvidesHeaderAndIDs is used to "lock in" version of compact blocks we send (fWantsCmpctWitness)
             if (!State(pfrom.GetId())->fProvidesHeaderAndIDs) {
                 State(pfrom.GetId())->fProvidesHeaderAndIDs = true;
                 State(pfrom.GetId())->fWantsCmpctWitness = nCMPCTBLOCKVersion >= 2;
                 State(pfrom.GetId())->fWantsCmpctMWEB = nCMPCTBLOCKVersion >= 3;
+                State(pfrom.GetId())->fWantsCmpctMWEBShortIDs = nCMPCTBLOCKVersion >= 4;
             }
-            if (State(pfrom.GetId())->fWantsCmpctWitness == (nCMPCTBLOCKVersion >= 2) && State(pfrom.GetId())->fWantsCmpctMWEB == (nCMPCTBLOCKVersion >= 3))
+            if (State(pfrom.GetId())->GetCmpctBlockVersion() == (int)nCMPCTBLOCKVersion)
                 State(pfrom.GetId())->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
             if (!State(pfrom.GetId())->fSupportsDesiredCmpctVersion) {
                 if (pfrom.GetLocalServices() & NODE_MWEB)
-                    State(pfrom.GetId())->fSupportsDesiredCmpctVersion = (nCMPCTBLOCKVersion == 3); 
+                    State(pfrom.GetId())->fSupportsDesiredCmpctVersion = (nCMPCTBLOCKVersion == 3 || nCMPCTBLOCKVersion == 4);
                 else if (pfrom.GetLocalServices() & NODE_WITNESS)
                     State(pfrom.GetId())->fSupportsDesiredCmpctVersion = (nCMPCTBLOCKVersion == 2);
                 else
@@ -3019,59 +3520,69 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             fBlocksOnly = false;
         }
 
-        LOCK(cs_main);
-
         const auto current_time = GetTime<std::chrono::microseconds>();
-        uint256* best_block{nullptr};
+        // Announcements are passed to the tracker once cs_main is released
+        std::vector<GenTxid> announced;
+        bool preferred;
+        {
+            LOCK(cs_main);
 
-        for (CInv& inv : vInv) {
-            if (interruptMsgProc) return;
+            preferred = State(pfrom.GetId())->fPreferredDownload;
+            uint256* best_block{nullptr};
 
-            // Ignore INVs that don't match wtxidrelay setting.
-            // Note that orphan parent fetching always uses MSG_TX GETDATAs regardless of the wtxidrelay setting.
-            // This is fine as no INV messages are involved in that process.
-            if (State(pfrom.GetId())->m_wtxid_relay) {
-                if (inv.IsMsgTx()) continue;
-            } else {
-                if (inv.IsMsgWtx()) continue;
-            }
+            for (CInv& inv : vInv) {
+                if (interruptMsgProc) return;
 
-            if (inv.IsMsgBlk()) {
-                const bool fAlreadyHave = AlreadyHaveBlock(inv.hash);
-                LogPrint(BCLog::NET, "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom.GetId());
-
-                UpdateBlockAvailability(pfrom.GetId(), inv.hash);
-                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Headers-first is the primary method of announcement on
-                    // the network. If a node fell back to sending blocks by inv,
-                    // it's probably for a re-org. The final block hash
-                    // provided should be the highest, so send a getheaders and
-                    // then fetch the blocks we need to catch up.
-                    best_block = &inv.hash;
+                // Ignore INVs that don't match wtxidrelay setting.
+                // Note that orphan parent fetching always uses MSG_TX GETDATAs regardless of the wtxidrelay setting.
+                // This is fine as no INV messages are involved in that process.
+                if (State(pfrom.GetId())->m_wtxid_relay) {
+                    if (inv.IsMsgTx()) continue;
+                } else {
+                    if (inv.IsMsgWtx()) continue;
                 }
-            } else if (inv.IsGenTxMsg()) {
-                const GenTxid gtxid = ToGenTxid(inv);
-                const bool fAlreadyHave = AlreadyHaveTx(gtxid, m_mempool);
-                LogPrint(BCLog::NET, "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom.GetId());
-
-                pfrom.AddKnownTx(inv.hash);
-                if (fBlocksOnly) {
-                    LogPrint(BCLog::NET, "transaction (%s) inv sent in violation of protocol, disconnecting peer=%d\n", inv.hash.ToString(), pfrom.GetId());
-                    pfrom.fDisconnect = true;
-                    return;
-                } else if (!fAlreadyHave && !m_chainman.ActiveChainstate().IsInitialBlockDownload()) {
-                    AddTxAnnouncement(pfrom, gtxid, current_time);
+
+                if (inv.IsMsgBlk()) {
+                    const bool fAlreadyHave = AlreadyHaveBlock(inv.hash);
+                    LogPrint(BCLog::NET, "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom.GetId());
+
+                    UpdateBlockAvailability(pfrom.GetId(), inv.hash);
+                    if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+                        // Headers-first is the primary method of announcement on
+                        // the network. If a node fell back to sending blocks by inv,
+                        // it's probably for a re-org. The final block hash
+                        // provided should be the highest, so send a getheaders and
+                        // then fetch the blocks we need to catch up.
+                        best_block = &inv.hash;
+                    }
+                } else if (inv.IsGenTxMsg()) {
+                    const GenTxid gtxid = ToGenTxid(inv);
+                    const bool fAlreadyHave = AlreadyHaveTx(gtxid, m_mempool);
+                    LogPrint(BCLog::NET, "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom.GetId());
+
+                    pfrom.AddKnownTx(inv.hash);
+                    if (m_txreconciliation && inv.IsMsgWtx()) m_txreconciliation->TryRemovingFromSet(pfrom.GetId(), inv.hash);
+                    if (fBlocksOnly) {
+                        LogPrint(BCLog::NET, "transaction (%s) inv sent in violation of protocol, disconnecting peer=%d\n", inv.hash.ToString(), pfrom.GetId());
+                        pfrom.fDisconnect = true;
+                        return;
+                    } else if (!fAlreadyHave && !m_chainman.ActiveChainstate().IsInitialBlockDownload()) {
+                        announced.push_back(gtxid);
+                    }
+                } else {
+                    LogPrint(BCLog::NET, "Unknown inv type \"%s\" received from peer=%d\n", inv.ToString(), pfrom.GetId());
                 }
-            } else {
-                LogPrint(BCLog::NET, "Unknown inv type \"%s\" received from peer=%d\n", inv.ToString(), pfrom.GetId());
             }
-        }
 
-        if (best_block != nullptr) {
-            m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexBestHeader), *best_block));
-            LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, best_block->ToString(), pfrom.GetId());
+            if (best_block != nullptr) {
+                SendGetHeaders(pfrom, ::ChainActive().GetLocator(pindexBestHeader), *best_block);
+                LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, best_block->ToString(), pfrom.GetId());
+            }
         }
 
+        for (const GenTxid& gtxid : announced) {
+            AddTxAnnouncement(pfrom, gtxid, preferred, current_time);
+        }
         return;
     }
 
@@ -3168,6 +3679,9 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
     }
 
     if (msg_type == NetMsgType::GETBLOCKTXN) {
+        if (WITH_LOCK(cs_main, return State(pfrom.GetId())->fWantsCmpctMWEBShortIDs)) {
+            vRecv.SetVersion(vRecv.GetVersion() | SERIALIZE_MWEB_SHORT_IDS);
+        }
         BlockTransactionsRequest req;
         vRecv >> req;
 
@@ -3219,7 +3733,8 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         return;
     }
 
-    if (msg_type == NetMsgType::GETHEADERS) {
+    if (msg_type == NetMsgType::GETHEADERS || msg_type == NetMsgType::GETHEADERS2) {
+        const bool compressed = msg_type == NetMsgType::GETHEADERS2;
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -3230,59 +3745,91 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             return;
         }
 
-        LOCK(cs_main);
-        if (::ChainstateActive().IsInitialBlockDownload() && !pfrom.HasPermission(PF_DOWNLOAD)) {
-            LogPrint(BCLog::NET, "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom.GetId());
-            return;
-        }
-
-        CNodeState *nodestate = State(pfrom.GetId());
-        const CBlockIndex* pindex = nullptr;
-        if (locator.IsNull())
+        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
+        std::vector<CBlock> vHeaders;
+        std::vector<CBlockHeader> compressed_headers;
+        Optional<CSharedNetMsg> cached_msg;
+        Optional<std::pair<HeadersCacheKey, int>> cache_entry;
         {
-            // If locator is null, return the hashStop block
-            pindex = LookupBlockIndex(hashStop);
-            if (!pindex) {
+            LOCK(cs_main);
+            if (::ChainstateActive().IsInitialBlockDownload() && !pfrom.HasPermission(PF_DOWNLOAD)) {
+                LogPrint(BCLog::NET, "Ignoring %s from peer=%d because node is in initial block download\n", msg_type, pfrom.GetId());
                 return;
             }
 
-            if (!BlockRequestAllowed(pindex, m_chainparams.GetConsensus())) {
-                LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block header that isn't in the main chain\n", __func__, pfrom.GetId());
-                return;
+            CNodeState *nodestate = State(pfrom.GetId());
+            const CBlockIndex* pindex = nullptr;
+            if (locator.IsNull())
+            {
+                // If locator is null, return the hashStop block
+                pindex = LookupBlockIndex(hashStop);
+                if (!pindex) {
+                    return;
+                }
+
+                if (!BlockRequestAllowed(pindex, m_chainparams.GetConsensus())) {
+                    LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block header that isn't in the main chain\n", __func__, pfrom.GetId());
+                    return;
+                }
+            }
+            else
+            {
+                // Find the last block the caller has in the main chain
+                pindex = FindForkInGlobalIndex(::ChainActive(), locator);
+                if (pindex)
+                    pindex = ::ChainActive().Next(pindex);
             }
-        }
-        else
-        {
-            // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(::ChainActive(), locator);
-            if (pindex)
-                pindex = ::ChainActive().Next(pindex);
-        }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        std::vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
-        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom.GetId());
-        for (; pindex; pindex = ::ChainActive().Next(pindex))
-        {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                break;
+            int nLimit = compressed ? MAX_HEADERS2_RESULTS : MAX_HEADERS_RESULTS;
+            LogPrint(BCLog::NET, "%s %d to %s from peer=%d\n", msg_type, (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom.GetId());
+            // A full batch below the tip, as requested by peers syncing from us, is
+            // served from the headers cache.
+            const CBlockIndex* last = pindex && !locator.IsNull() ? ::ChainActive()[pindex->nHeight + nLimit - 1] : nullptr;
+            if (last && (hashStop.IsNull() || hashStop == last->GetBlockHash())) {
+                const HeadersCacheKey key{compressed, pindex->nHeight, last->GetBlockHash()};
+                cached_msg = m_headers_cache.Get(key);
+                if (cached_msg) pindex = last;
+                cache_entry.emplace(key, last->nHeight);
+            }
+            for (; pindex && !cached_msg; pindex = ::ChainActive().Next(pindex))
+            {
+                if (compressed) {
+                    compressed_headers.push_back(pindex->GetBlockHeader());
+                } else {
+                    vHeaders.push_back(pindex->GetBlockHeader());
+                }
+                if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
+                    break;
+            }
+            // pindex can be nullptr either if we sent ::ChainActive().Tip() OR
+            // if our peer has ::ChainActive().Tip() (and thus we are sending an empty
+            // headers message). In both cases it's safe to update
+            // pindexBestHeaderSent to be our tip.
+            //
+            // It is important that we simply reset the BestHeaderSent value here,
+            // and not max(BestHeaderSent, newHeaderSent). We might have announced
+            // the currently-being-connected tip using a compact block, which
+            // resulted in the peer sending a headers request, which we respond to
+            // without the new block. By resetting the BestHeaderSent, we ensure we
+            // will re-announce the new block via headers (or compact blocks again)
+            // in the SendMessages logic.
+            nodestate->pindexBestHeaderSent = pindex ? pindex : ::ChainActive().Tip();
+        }
+
+        // Serializing the headers does not need cs_main.
+        if (cached_msg) {
+            m_connman.PushMessage(&pfrom, *cached_msg);
+            return;
+        }
+        CSerializedNetMsg msg = compressed ? msgMaker.Make(NetMsgType::HEADERS2, Using<VectorFormatter<CompressedHeaderFormatter>>(compressed_headers)) :
+                                             msgMaker.Make(NetMsgType::HEADERS, vHeaders);
+        if (cache_entry) {
+            CSharedNetMsg shared_msg(std::move(msg));
+            m_headers_cache.Add(cache_entry->first, cache_entry->second, shared_msg);
+            m_connman.PushMessage(&pfrom, shared_msg);
+        } else {
+            m_connman.PushMessage(&pfrom, std::move(msg));
         }
-        // pindex can be nullptr either if we sent ::ChainActive().Tip() OR
-        // if our peer has ::ChainActive().Tip() (and thus we are sending an empty
-        // headers message). In both cases it's safe to update
-        // pindexBestHeaderSent to be our tip.
-        //
-        // It is important that we simply reset the BestHeaderSent value here,
-        // and not max(BestHeaderSent, newHeaderSent). We might have announced
-        // the currently-being-connected tip using a compact block, which
-        // resulted in the peer sending a headers request, which we respond to
-        // without the new block. By resetting the BestHeaderSent, we ensure we
-        // will re-announce the new block via headers (or compact blocks again)
-        // in the SendMessages logic.
-        nodestate->pindexBestHeaderSent = pindex ? pindex : ::ChainActive().Tip();
-        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
         return;
     }
 
@@ -3304,12 +3851,23 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         const uint256& txid = ptx->GetHash();
         const uint256& wtxid = ptx->GetWitnessHash();
 
+        // Verify the signatures and rangeproofs of a new transaction on the
+        // prevalidation threads, so that cs_main is only held for the
+        // contextual checks of AcceptToMemoryPool() below
+        if (!WITH_LOCK(cs_main, return AlreadyHaveTx(GenTxid(/* is_wtxid=*/true, wtxid), m_mempool))) {
+            PrevalidateTransactions(m_mempool, {ptx});
+        }
+
+        m_txrequest.ReceivedResponse(pfrom.GetId(), txid);
+        if (tx.HasWitness()) m_txrequest.ReceivedResponse(pfrom.GetId(), wtxid);
+
         LOCK2(cs_main, g_cs_orphans);
 
         CNodeState* nodestate = State(pfrom.GetId());
 
         const uint256& hash = nodestate->m_wtxid_relay ? wtxid : txid;
         pfrom.AddKnownTx(hash);
+        if (m_txreconciliation) m_txreconciliation->TryRemovingFromSet(pfrom.GetId(), wtxid);
         if (nodestate->m_wtxid_relay && txid != wtxid) {
             // Insert txid into filterInventoryKnown, even for
             // wtxidrelay peers. This prevents re-adding of
@@ -3319,9 +3877,6 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             pfrom.AddKnownTx(txid);
         }
 
-        m_txrequest.ReceivedResponse(pfrom.GetId(), txid);
-        if (tx.HasWitness()) m_txrequest.ReceivedResponse(pfrom.GetId(), wtxid);
-
         // We do the AlreadyHaveTx() check using wtxid, rather than txid - in the
         // absence of witness malleation, this is strictly better, because the
         // recent rejects filter may contain the wtxid but rarely contains
@@ -3346,6 +3901,14 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
                     RelayTransaction(tx.GetHash(), tx.GetWitnessHash(), m_connman);
                 }
             }
+            // A transaction which failed only on its feerate may now have
+            // an orphan child to pay for it
+            if (g_recent_rejects_reconsiderable->contains(wtxid) && !AlreadyHaveTx(GenTxid(/* is_wtxid=*/true, wtxid), m_mempool, /* include_reconsiderable */ false)) {
+                if (const Optional<Package> package = Find1P1CPackage(ptx, pfrom.GetId())) {
+                    ProcessPackageResult(*package, ProcessNewPackage(m_mempool, *package, /* test_accept */ false), peer->m_orphan_work_set);
+                    ProcessOrphanTx(peer->m_orphan_work_set);
+                }
+            }
             return;
         }
 
@@ -3413,7 +3976,9 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
                     // protocol for getting all unconfirmed parents.
                     const GenTxid gtxid{/* is_wtxid=*/false, parent_txid};
                     pfrom.AddKnownTx(parent_txid);
-                    if (!AlreadyHaveTx(gtxid, m_mempool)) AddTxAnnouncement(pfrom, gtxid, current_time);
+                    // Parents which failed on their feerate alone are
+                    // requested again, to be evaluated with this child
+                    if (!AlreadyHaveTx(gtxid, m_mempool, /* include_reconsiderable */ false)) AddTxAnnouncement(pfrom, gtxid, nodestate->fPreferredDownload, current_time);
                 }
                 AddOrphanTx(ptx, pfrom.GetId());
 
@@ -3440,6 +4005,19 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
                 m_txrequest.ForgetTxHash(tx.GetHash());
                 m_txrequest.ForgetTxHash(tx.GetWitnessHash());
             }
+        } else if (state.GetResult() == TxValidationResult::TX_RECONSIDERABLE) {
+            // The transaction may still be accepted in a package with a child
+            // paying for it, so keep it out of recentRejects
+            g_recent_rejects_reconsiderable->insert(tx.GetWitnessHash());
+            m_txrequest.ForgetTxHash(tx.GetHash());
+            m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+            if (const Optional<Package> package = Find1P1CPackage(ptx, pfrom.GetId())) {
+                ProcessPackageResult(*package, ProcessNewPackage(m_mempool, *package, /* test_accept */ false), peer->m_orphan_work_set);
+                ProcessOrphanTx(peer->m_orphan_work_set);
+            }
         } else {
             if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
                 // We can add the wtxid of this transaction to our reject filter.
@@ -3502,6 +4080,51 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         return;
     }
 
+    if (msg_type == NetMsgType::PKGTXNS) {
+        if ((!g_relay_txes && !pfrom.HasPermission(PF_RELAY)) || (pfrom.m_tx_relay == nullptr) ||
+            !WITH_LOCK(cs_main, return State(pfrom.GetId())->m_package_relay)) {
+            LogPrint(BCLog::NET, "package sent in violation of protocol peer=%d\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+
+        Package package;
+        vRecv >> package;
+        if (package.empty() || package.size() > MAX_PACKAGE_COUNT) {
+            Misbehaving(pfrom.GetId(), 20, strprintf("pkgtxns message size = %u", package.size()));
+            return;
+        }
+
+        // Verify the signatures of the transactions on the prevalidation
+        // threads, as for a tx message
+        PrevalidateTransactions(m_mempool, package);
+
+        for (const CTransactionRef& tx : package) {
+            m_txrequest.ReceivedResponse(pfrom.GetId(), tx->GetHash());
+            if (tx->HasWitness()) m_txrequest.ReceivedResponse(pfrom.GetId(), tx->GetWitnessHash());
+        }
+
+        LOCK2(cs_main, g_cs_orphans);
+
+        CNodeState* nodestate = State(pfrom.GetId());
+        bool all_known = true;
+        for (const CTransactionRef& tx : package) {
+            pfrom.AddKnownTx(nodestate->m_wtxid_relay ? tx->GetWitnessHash() : tx->GetHash());
+            pfrom.AddKnownTx(tx->GetHash());
+            all_known &= AlreadyHaveTx(GenTxid(/* is_wtxid=*/true, tx->GetWitnessHash()), m_mempool, /* include_reconsiderable */ false);
+        }
+        if (all_known || g_recent_rejects_reconsiderable->contains(GetPackageHash(package))) return;
+
+        const PackageMempoolAcceptResult result = ProcessNewPackage(m_mempool, package, /* test_accept */ false);
+        if (!result.m_accepted.empty()) pfrom.nLastTXTime = GetTime();
+        ProcessPackageResult(package, result, peer->m_orphan_work_set);
+        for (const auto& tx_result : result.m_tx_results) {
+            if (tx_result.second.IsInvalid()) MaybePunishNodeForTx(pfrom.GetId(), tx_result.second);
+        }
+        ProcessOrphanTx(peer->m_orphan_work_set);
+        return;
+    }
+
     if (msg_type == NetMsgType::CMPCTBLOCK)
     {
         // Ignore cmpctblock received while importing
@@ -3517,6 +4140,9 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             if (!State(pfrom.GetId())->fWantsCmpctMWEB) {
                 vRecv.SetVersion(vRecv.GetVersion() | SERIALIZE_NO_MWEB);
             }
+            if (State(pfrom.GetId())->fWantsCmpctMWEBShortIDs) {
+                vRecv.SetVersion(vRecv.GetVersion() | SERIALIZE_MWEB_SHORT_IDS);
+            }
         }
 
         CBlockHeaderAndShortTxIDs cmpctblock;
@@ -3530,7 +4156,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         if (!LookupBlockIndex(cmpctblock.header.hashPrevBlock)) {
             // Doesn't connect (or is genesis), instead of DoSing in AcceptBlockHeader, request deeper headers
             if (!::ChainstateActive().IsInitialBlockDownload())
-                m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexBestHeader), uint256()));
+                SendGetHeaders(pfrom, ::ChainActive().GetLocator(pindexBestHeader), uint256());
             return;
         }
 
@@ -3615,7 +4241,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         // We want to be a bit conservative just to be extra careful about DoS
         // possibilities in compact block processing...
         if (pindex->nHeight <= ::ChainActive().Height() + 2) {
-            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < nodestate->m_block_download.GetTargetInFlight()) ||
                  (fAlreadyInFlight && blockInFlightIt->second.first == pfrom.GetId())) {
                 std::list<QueuedBlock>::iterator* queuedBlockIt = nullptr;
                 if (!MarkBlockAsInFlight(m_mempool, pfrom.GetId(), pindex->GetBlockHash(), pindex, &queuedBlockIt)) {
@@ -3647,15 +4273,19 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
                     if (!partialBlock.IsTxAvailable(i))
                         req.indexes.push_back(i);
                 }
-                if (req.indexes.empty()) {
+                partialBlock.GetMissingMWEB(req);
+                if (req.IsEmpty()) {
                     // Dirty hack to jump to BLOCKTXN code (TODO: move message handling into their own functions)
                     BlockTransactions txn;
                     txn.blockhash = cmpctblock.header.GetHash();
+                    if (nodestate->fWantsCmpctMWEBShortIDs) {
+                        blockTxnMsg.SetVersion(blockTxnMsg.GetVersion() | SERIALIZE_MWEB_SHORT_IDS);
+                    }
                     blockTxnMsg << txn;
                     fProcessBLOCKTXN = true;
                 } else {
                     req.blockhash = pindex->GetBlockHash();
-                    m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+                    m_connman.PushMessage(&pfrom, msgMaker.Make(nodestate->fWantsCmpctMWEBShortIDs ? SERIALIZE_MWEB_SHORT_IDS : 0, NetMsgType::GETBLOCKTXN, req));
                 }
             } else {
                 // This block is either already in flight from a different
@@ -3700,7 +4330,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             // the peer if the header turns out to be for an invalid block.
             // Note that if a peer tries to build on an invalid chain, that
             // will be detected and the peer will be disconnected/discouraged.
-            return ProcessHeadersMessage(pfrom, {cmpctblock.header}, /*via_compact_block=*/true);
+            return ProcessHeadersMessage(pfrom, {cmpctblock.header}, /*via_compact_block=*/true, /*compressed=*/false);
         }
 
         if (fBlockReconstructed) {
@@ -3747,6 +4377,9 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             return;
         }
 
+        if (WITH_LOCK(cs_main, return State(pfrom.GetId())->fWantsCmpctMWEBShortIDs)) {
+            vRecv.SetVersion(vRecv.GetVersion() | SERIALIZE_MWEB_SHORT_IDS);
+        }
         BlockTransactions resp;
         vRecv >> resp;
 
@@ -3763,7 +4396,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             }
 
             PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
-            ReadStatus status = partialBlock.FillBlock(*pblock, resp.txn);
+            ReadStatus status = partialBlock.FillBlock(*pblock, resp.txn, resp.mweb_body);
             if (status == READ_STATUS_INVALID) {
                 MarkBlockAsReceived(resp.blockhash, pfrom.GetId()); // Reset in-flight state in case Misbehaving does not result in a disconnect
                 Misbehaving(pfrom.GetId(), 100, "invalid compact block/non-matching block transactions");
@@ -3843,7 +4476,30 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        return ProcessHeadersMessage(pfrom, headers, /*via_compact_block=*/false);
+        return ProcessHeadersMessage(pfrom, headers, /*via_compact_block=*/false, /*compressed=*/false);
+    }
+
+    if (msg_type == NetMsgType::HEADERS2)
+    {
+        // Ignore headers received while importing
+        if (fImporting || fReindex) {
+            LogPrint(BCLog::NET, "Unexpected headers2 message received from peer %d\n", pfrom.GetId());
+            return;
+        }
+
+        std::vector<CBlockHeader> headers;
+        unsigned int nCount = ReadCompactSize(vRecv);
+        if (nCount > MAX_HEADERS2_RESULTS) {
+            Misbehaving(pfrom.GetId(), 20, strprintf("headers2 message size = %u", nCount));
+            return;
+        }
+        headers.resize(nCount);
+        CompressedHeaderFormatter formatter;
+        for (unsigned int n = 0; n < nCount; n++) {
+            formatter.Unser(vRecv, headers[n]);
+        }
+
+        return ProcessHeadersMessage(pfrom, headers, /*via_compact_block=*/false, /*compressed=*/true);
     }
 
     if (msg_type == NetMsgType::BLOCK)
@@ -3854,6 +4510,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             return;
         }
 
+        const size_t block_bytes = vRecv.size();
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         vRecv >> *pblock;
 
@@ -3865,7 +4522,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
-            forceProcessing |= MarkBlockAsReceived(hash, pfrom.GetId());
+            forceProcessing |= MarkBlockAsReceived(hash, pfrom.GetId(), block_bytes);
             // mapBlockSource is only used for punishing peers and setting
             // which peers send us compact blocks, so the race between here and
             // cs_main in ProcessNewBlock is fine.
@@ -3901,7 +4558,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         }
         pfrom.fSentAddr = true;
 
-        pfrom.vAddrToSend.clear();
+        WITH_LOCK(pfrom.m_addr_send_mutex, pfrom.vAddrToSend.clear());
         std::vector<CAddress> vAddr;
         if (pfrom.HasPermission(PF_ADDR)) {
             vAddr = m_connman.GetAddresses(MAX_ADDR_TO_SEND, MAX_PCT_ADDR_TO_SEND);
@@ -4114,7 +4771,6 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         std::vector<CInv> vInv;
         vRecv >> vInv;
         if (vInv.size() <= MAX_PEER_TX_ANNOUNCEMENTS + MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-            LOCK(::cs_main);
             for (CInv &inv : vInv) {
                 if (inv.IsGenTxMsg()) {
                     // If we receive a NOTFOUND message for a tx we requested, mark the announcement for it as
@@ -4126,6 +4782,50 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         return;
     }
 
+    if (msg_type == NetMsgType::REQRECON) {
+        if (!m_txreconciliation) return;
+        uint16_t remote_set_size, remote_q;
+        vRecv >> remote_set_size >> remote_q;
+        std::vector<unsigned char> skdata;
+        if (!m_txreconciliation->HandleReconciliationRequest(pfrom.GetId(), remote_set_size, remote_q, GetTime<std::chrono::microseconds>(), skdata)) {
+            LogPrint(BCLog::NET, "reqrecon protocol violation from peer=%d; disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::SKETCH, skdata));
+        return;
+    }
+
+    if (msg_type == NetMsgType::SKETCH) {
+        if (!m_txreconciliation) return;
+        std::vector<unsigned char> skdata;
+        vRecv >> skdata;
+        ReconciliationOutcome outcome;
+        if (!m_txreconciliation->HandleSketch(pfrom.GetId(), skdata, outcome)) {
+            LogPrint(BCLog::NET, "sketch protocol violation from peer=%d; disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+        AnnounceReconciledTxs(pfrom, outcome.announce, m_connman);
+        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, uint8_t{outcome.success}, outcome.ask_shortids));
+        return;
+    }
+
+    if (msg_type == NetMsgType::RECONCILDIFF) {
+        if (!m_txreconciliation) return;
+        uint8_t success;
+        std::vector<uint32_t> ask_shortids;
+        vRecv >> success >> ask_shortids;
+        std::vector<uint256> announce;
+        if (!m_txreconciliation->HandleReconciliationDifference(pfrom.GetId(), success, ask_shortids, announce)) {
+            LogPrint(BCLog::NET, "reconcildiff protocol violation from peer=%d; disconnecting\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+        AnnounceReconciledTxs(pfrom, announce, m_connman);
+        return;
+    }
+
     if (msg_type == NetMsgType::GETMWEBUTXOS) {
         GetMWEBUTXOsMsg get_utxos;
         vRecv >> get_utxos;
@@ -4260,7 +4960,6 @@ void PeerManager::ConsiderEviction(CNode& pto, int64_t time_in_seconds)
     AssertLockHeld(cs_main);
 
     CNodeState &state = *State(pto.GetId());
-    const CNetMsgMaker msgMaker(pto.GetCommonVersion());
 
     if (!state.m_chain_sync.m_protect && pto.IsOutboundOrBlockRelayConn() && state.fSyncStarted) {
         // This is an outbound peer subject to disconnection if they don't
@@ -4294,7 +4993,7 @@ void PeerManager::ConsiderEviction(CNode& pto, int64_t time_in_seconds)
             } else {
                 assert(state.m_chain_sync.m_work_header);
                 LogPrint(BCLog::NET, "sending getheaders to outbound peer=%d to verify chain work (current best known block:%s, benchmark blockhash: %s)\n", pto.GetId(), state.pindexBestKnownBlock != nullptr ? state.pindexBestKnownBlock->GetBlockHash().ToString() : "<none>", state.m_chain_sync.m_work_header->GetBlockHash().ToString());
-                m_connman.PushMessage(&pto, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(state.m_chain_sync.m_work_header->pprev), uint256()));
+                SendGetHeaders(pto, ::ChainActive().GetLocator(state.m_chain_sync.m_work_header->pprev), uint256());
                 state.m_chain_sync.m_sent_getheaders = true;
                 constexpr int64_t HEADERS_RESPONSE_TIME = 120; // 2 minutes
                 // Bump the timeout to allow a response, which could clear the timeout
@@ -4453,14 +5152,15 @@ bool PeerManager::SendMessages(CNode* pto)
         }
     }
 
+    auto current_time = GetTime<std::chrono::microseconds>();
+    // Transactions to request are added after the block requests, once cs_main is released
+    std::vector<CInv> vGetData;
     {
         LOCK(cs_main);
 
         CNodeState &state = *State(pto->GetId());
 
         // Address refresh broadcast
-        auto current_time = GetTime<std::chrono::microseconds>();
-
         if (pto->RelayAddrsWithConn() && !::ChainstateActive().IsInitialBlockDownload() && pto->m_next_local_addr_send < current_time) {
             AdvertiseLocal(pto);
             pto->m_next_local_addr_send = PoissonNextSend(current_time, AVG_LOCAL_ADDRESS_BROADCAST_INTERVAL);
@@ -4472,8 +5172,23 @@ bool PeerManager::SendMessages(CNode* pto)
         if (pto->RelayAddrsWithConn() && pto->m_next_addr_send < current_time) {
             pto->m_next_addr_send = PoissonNextSend(current_time, AVG_ADDRESS_BROADCAST_INTERVAL);
             std::vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            assert(pto->m_addr_known);
+            {
+                LOCK(pto->m_addr_send_mutex);
+                assert(pto->m_addr_known);
+                vAddr.reserve(pto->vAddrToSend.size());
+                for (const CAddress& addr : pto->vAddrToSend)
+                {
+                    if (!pto->m_addr_known->contains(addr.GetKey()))
+                    {
+                        pto->m_addr_known->insert(addr.GetKey());
+                        vAddr.push_back(addr);
+                    }
+                }
+                pto->vAddrToSend.clear();
+                // we only send the big addr message once
+                if (pto->vAddrToSend.capacity() > 40)
+                    pto->vAddrToSend.shrink_to_fit();
+            }
 
             const char* msg_type;
             int make_flags;
@@ -4485,26 +5200,11 @@ bool PeerManager::SendMessages(CNode* pto)
                 make_flags = 0;
             }
 
-            for (const CAddress& addr : pto->vAddrToSend)
-            {
-                if (!pto->m_addr_known->contains(addr.GetKey()))
-                {
-                    pto->m_addr_known->insert(addr.GetKey());
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than MAX_ADDR_TO_SEND
-                    if (vAddr.size() >= MAX_ADDR_TO_SEND)
-                    {
-                        m_connman.PushMessage(pto, msgMaker.Make(make_flags, msg_type, vAddr));
-                        vAddr.clear();
-                    }
-                }
+            // receiver rejects addr messages larger than MAX_ADDR_TO_SEND
+            for (size_t i = 0; i < vAddr.size(); i += MAX_ADDR_TO_SEND) {
+                const auto end = vAddr.begin() + std::min(vAddr.size(), i + MAX_ADDR_TO_SEND);
+                m_connman.PushMessage(pto, msgMaker.Make(make_flags, msg_type, std::vector<CAddress>(vAddr.begin() + i, end)));
             }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                m_connman.PushMessage(pto, msgMaker.Make(make_flags, msg_type, vAddr));
-            // we only send the big addr message once
-            if (pto->vAddrToSend.capacity() > 40)
-                pto->vAddrToSend.shrink_to_fit();
         }
 
         // Start block sync
@@ -4528,7 +5228,7 @@ bool PeerManager::SendMessages(CNode* pto)
                 if (pindexStart->pprev)
                     pindexStart = pindexStart->pprev;
                 LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->GetId(), pto->nStartingHeight);
-                m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexStart), uint256()));
+                SendGetHeaders(*pto, ::ChainActive().GetLocator(pindexStart), uint256());
             }
         }
 
@@ -4607,13 +5307,17 @@ bool PeerManager::SendMessages(CNode* pto)
 
                     int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
                     nSendFlags |= state.fWantsCmpctMWEB ? 0 : SERIALIZE_NO_MWEB;
+                    nSendFlags |= state.fWantsCmpctMWEBShortIDs ? SERIALIZE_MWEB_SHORT_IDS : 0;
 
                     bool fGotBlockFromCache = false;
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                m_connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+                            const std::vector<size_t> prefill = GetCompactBlockPrefill(*pto, *most_recent_block);
+                            if (!prefill.empty())
+                                m_connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *MakeCompactBlock(*most_recent_block, state.fWantsCmpctWitness, prefill)));
+                            else if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
+                                m_connman.PushMessage(pto, MakeCompactBlockMsg(*most_recent_compact_block, nSendFlags));
                             else {
                                 CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
                                 m_connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -4625,8 +5329,8 @@ bool PeerManager::SendMessages(CNode* pto)
                         CBlock block;
                         bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
                         assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
-                        m_connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                        const auto cmpctblock = MakeCompactBlock(block, state.fWantsCmpctWitness, GetCompactBlockPrefill(*pto, block));
+                        m_connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *cmpctblock));
                     }
                     state.pindexBestHeaderSent = pBestIndex;
                 } else if (state.fPreferHeaders) {
@@ -4744,8 +5448,14 @@ bool PeerManager::SendMessages(CNode* pto)
                     pto->m_tx_relay->m_last_mempool_req = GetTime<std::chrono::seconds>();
                 }
 
+                // Reconciling peers learn about transactions in the next
+                // reconciliation instead, unless we still flood to them. That
+                // has a delay of its own, so they go into its set right away;
+                // the ones that cannot be reconciled wait for the trickle.
+                const bool reconcile = m_txreconciliation && state.m_wtxid_relay && !m_txreconciliation->ShouldFloodTo(pto->GetId());
+
                 // Determine transactions to relay
-                if (fSendTrickle) {
+                if (fSendTrickle || reconcile) {
                     // Produce a vector with all candidates for sending
                     std::vector<std::set<uint256>::iterator> vInvTx;
                     vInvTx.reserve(pto->m_tx_relay->setInventoryTxToSend.size());
@@ -4764,6 +5474,7 @@ bool PeerManager::SendMessages(CNode* pto)
                     // No reason to drain out at many times the network's capacity,
                     // especially since we have many peers and some will draw much shorter delays.
                     unsigned int nRelayedTransactions = 0;
+                    std::vector<uint256> to_trickle;
                     LOCK(pto->m_tx_relay->cs_filter);
                     size_t broadcast_max{INVENTORY_BROADCAST_MAX + (pto->m_tx_relay->setInventoryTxToSend.size()/1000)*5};
                     broadcast_max = std::min<size_t>(1000, broadcast_max);
@@ -4792,10 +5503,17 @@ bool PeerManager::SendMessages(CNode* pto)
                             continue;
                         }
                         if (pto->m_tx_relay->pfilter && !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
-                        // Send
-                        State(pto->GetId())->m_recently_announced_invs.insert(hash);
-                        vInv.push_back(inv);
-                        nRelayedTransactions++;
+                        // Keep it for reconciliation, or send it
+                        if (reconcile && m_txreconciliation->AddToSet(pto->GetId(), *txinfo.tx)) {
+                            // Announced, and marked as such, by the reconciliation
+                        } else if (!fSendTrickle) {
+                            to_trickle.push_back(hash);
+                            continue;
+                        } else {
+                            State(pto->GetId())->m_recently_announced_invs.insert(hash);
+                            vInv.push_back(inv);
+                            nRelayedTransactions++;
+                        }
                         {
                             // Expire old relay messages
                             while (!vRelayExpiration.empty() && vRelayExpiration.front().first < count_microseconds(current_time))
@@ -4828,12 +5546,20 @@ bool PeerManager::SendMessages(CNode* pto)
                             pto->m_tx_relay->filterInventoryKnown.insert(txid);
                         }
                     }
+                    pto->m_tx_relay->setInventoryTxToSend.insert(to_trickle.begin(), to_trickle.end());
                 }
             }
         }
         if (!vInv.empty())
             m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        if (m_txreconciliation) {
+            AnnounceReconciledTxs(*pto, m_txreconciliation->ExpireReconciliation(pto->GetId(), current_time), m_connman);
+            if (const auto request = m_txreconciliation->MaybeRequestReconciliation(pto->GetId(), current_time)) {
+                m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, request->first, request->second));
+            }
+        }
+
         // Detect whether we're stalling
         current_time = GetTime<std::chrono::microseconds>();
         if (state.nStallingSince && state.nStallingSince < count_microseconds(current_time) - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -4898,11 +5624,10 @@ bool PeerManager::SendMessages(CNode* pto)
         //
         // Message: getdata (blocks)
         //
-        std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.m_block_download.ShouldRequest(state.nBlocksInFlight)) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), state.m_block_download.GetTargetInFlight() - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(*pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -4918,36 +5643,6 @@ bool PeerManager::SendMessages(CNode* pto)
             }
         }
 
-        //
-        // Message: getdata (non-blocks)
-        //
-        std::vector<std::pair<NodeId, GenTxid>> expired;
-        auto requestable = m_txrequest.GetRequestable(pto->GetId(), current_time, &expired);
-        for (const auto& entry : expired) {
-            LogPrint(BCLog::NET, "timeout of inflight %s %s from peer=%d\n", entry.second.IsWtxid() ? "wtx" : "tx",
-                entry.second.GetHash().ToString(), entry.first);
-        }
-        for (const GenTxid& gtxid : requestable) {
-            if (!AlreadyHaveTx(gtxid, m_mempool)) {
-                LogPrint(BCLog::NET, "Requesting %s %s peer=%d\n", gtxid.IsWtxid() ? "wtx" : "tx",
-                    gtxid.GetHash().ToString(), pto->GetId());
-                vGetData.emplace_back(gtxid.IsWtxid() ? MSG_WTX : (MSG_TX | GetFetchFlags(*pto)), gtxid.GetHash());
-                if (vGetData.size() >= MAX_GETDATA_SZ) {
-                    m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
-                    vGetData.clear();
-                }
-                m_txrequest.RequestedTx(pto->GetId(), gtxid.GetHash(), current_time + GETDATA_TX_INTERVAL);
-            } else {
-                // We have already seen this transaction, no need to download. This is just a belt-and-suspenders, as
-                // this should already be called whenever a transaction becomes AlreadyHaveTx().
-                m_txrequest.ForgetTxHash(gtxid.GetHash());
-            }
-        }
-
-
-        if (!vGetData.empty())
-            m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
-
         //
         // Message: feefilter
         //
@@ -4986,6 +5681,48 @@ bool PeerManager::SendMessages(CNode* pto)
             }
         }
     } // release cs_main
+
+    //
+    // Message: getdata (non-blocks)
+    //
+    // The tracker does its own locking; cs_main is only taken to check which of
+    // the requestable transactions we already have.
+    std::vector<std::pair<NodeId, GenTxid>> expired;
+    auto requestable = m_txrequest.GetRequestable(pto->GetId(), current_time, &expired);
+    for (const auto& entry : expired) {
+        LogPrint(BCLog::NET, "timeout of inflight %s %s from peer=%d\n", entry.second.IsWtxid() ? "wtx" : "tx",
+            entry.second.GetHash().ToString(), entry.first);
+    }
+    std::vector<CInv> tx_getdata;
+    std::vector<uint256> already_have;
+    if (!requestable.empty()) {
+        LOCK(cs_main);
+        for (const GenTxid& gtxid : requestable) {
+            if (!AlreadyHaveTx(gtxid, m_mempool)) {
+                LogPrint(BCLog::NET, "Requesting %s %s peer=%d\n", gtxid.IsWtxid() ? "wtx" : "tx",
+                    gtxid.GetHash().ToString(), pto->GetId());
+                tx_getdata.emplace_back(gtxid.IsWtxid() ? MSG_WTX : (MSG_TX | GetFetchFlags(*pto)), gtxid.GetHash());
+            } else {
+                // We have already seen this transaction, no need to download. This is just a belt-and-suspenders, as
+                // this should already be called whenever a transaction becomes AlreadyHaveTx().
+                already_have.push_back(gtxid.GetHash());
+            }
+        }
+    }
+    for (const uint256& txhash : already_have) {
+        m_txrequest.ForgetTxHash(txhash);
+    }
+    for (const CInv& inv : tx_getdata) {
+        vGetData.push_back(inv);
+        if (vGetData.size() >= MAX_GETDATA_SZ) {
+            m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+            vGetData.clear();
+        }
+        m_txrequest.RequestedTx(pto->GetId(), inv.hash, current_time + GETDATA_TX_INTERVAL);
+    }
+
+    if (!vGetData.empty())
+        m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
     return true;
 }
 
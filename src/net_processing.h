@@ -7,8 +7,12 @@
 #define BITCOIN_NET_PROCESSING_H
 
 #include <consensus/params.h>
+#include <headerscache.h>
 #include <net.h>
+#include <optional.h>
+#include <policy/packages.h>
 #include <sync.h>
+#include <txreconciliation.h>
 #include <txrequest.h>
 #include <validationinterface.h>
 
@@ -19,6 +23,7 @@ class CChainParams;
 class CTxMemPool;
 class ChainstateManager;
 class TxValidationState;
+struct PackageMempoolAcceptResult;
 
 extern RecursiveMutex cs_main;
 extern RecursiveMutex g_cs_orphans;
@@ -123,16 +128,34 @@ private:
     bool MaybeDiscourageAndDisconnect(CNode& pnode);
 
     void ProcessOrphanTx(std::set<uint256>& orphan_work_set) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
-    /** Process a single headers message from a peer. */
-    void ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHeader>& headers, bool via_compact_block);
+
+    /**
+     * Look for an orphan child of a transaction which failed on its own
+     * feerate, to evaluate the two together as a package. Children received
+     * from the same peer are preferred, and packages which have already
+     * failed are skipped.
+     */
+    Optional<Package> Find1P1CPackage(const CTransactionRef& ptx, NodeId nodeid) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
+
+    /**
+     * Relay the transactions a package added to the mempool, and remember the
+     * package or its invalid transactions if it failed.
+     *
+     * @param[in/out]  orphan_work_set  Orphans spending from the accepted transactions are added to it.
+     */
+    void ProcessPackageResult(const Package& package, const PackageMempoolAcceptResult& result, std::set<uint256>& orphan_work_set) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
+    /** Process a single headers message (or headers2, if compressed) from a peer. */
+    void ProcessHeadersMessage(CNode& pfrom, const std::vector<CBlockHeader>& headers, bool via_compact_block, bool compressed);
+    /** Ask a peer for headers, with getheaders2 if it supports compressed headers. */
+    void SendGetHeaders(CNode& pto, const CBlockLocator& locator, const uint256& hash_stop) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     void SendBlockTransactions(CNode& pfrom, const CBlock& block, const BlockTransactionsRequest& req);
 
     /** Register with TxRequestTracker that an INV has been received from a
      *  peer. The announcement parameters are decided in PeerManager and then
-     *  passed to TxRequestTracker. */
-    void AddTxAnnouncement(const CNode& node, const GenTxid& gtxid, std::chrono::microseconds current_time)
-        EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+     *  passed to TxRequestTracker. Does not need cs_main: preferred is the
+     *  peer's fPreferredDownload, read by the caller. */
+    void AddTxAnnouncement(const CNode& node, const GenTxid& gtxid, bool preferred, std::chrono::microseconds current_time);
 
     const CChainParams& m_chainparams;
     CConnman& m_connman;
@@ -140,7 +163,14 @@ private:
     BanMan* const m_banman;
     ChainstateManager& m_chainman;
     CTxMemPool& m_mempool;
-    TxRequestTracker m_txrequest GUARDED_BY(::cs_main);
+    /** Thread-safe. Announcements, responses and requests are passed to it
+     *  outside cs_main; only ForgetTxHash, which locks a single shard, and
+     *  the orphan parent requests still run under cs_main. */
+    TxRequestTracker m_txrequest;
+    /** Transaction reconciliation with peers, if enabled with -txreconciliation */
+    std::unique_ptr<TxReconciliationTracker> m_txreconciliation;
+    /** Full headers and headers2 responses, shared between the peers syncing from us */
+    HeadersCache m_headers_cache;
 
     int64_t m_stale_tip_check_time; //!< Next time to check for stale tip
 };
@@ -7,8 +7,10 @@
 
 #include <crypto/common.h>
 #include <crypto/sha3.h>
+#include <crypto/siphash.h>
 #include <hash.h>
 #include <prevector.h>
+#include <random.h>
 #include <tinyformat.h>
 #include <util/asmap.h>
 #include <util/strencodings.h>
@@ -19,6 +21,7 @@
 #include <cstdint>
 #include <ios>
 #include <iterator>
+#include <limits>
 #include <tuple>
 
 constexpr size_t CNetAddr::V1_SERIALIZATION_SIZE;
@@ -592,6 +595,13 @@ bool operator<(const CNetAddr& a, const CNetAddr& b)
     return std::tie(a.m_net, a.m_addr) < std::tie(b.m_net, b.m_addr);
 }
 
+CNetAddrHash::CNetAddrHash() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t CNetAddrHash::operator()(const CNetAddr& addr) const
+{
+    return CSipHasher(k0, k1).Write(addr.m_net).Write(addr.m_addr.data(), addr.m_addr.size()).Finalize();
+}
+
 /**
  * Try to get our IPv4 address.
  *
@@ -245,6 +245,7 @@ class CNetAddr
             }
         }
 
+        friend class CNetAddrHash;
         friend class CSubNet;
 
     private:
@@ -449,6 +450,18 @@ class CNetAddr
         }
 };
 
+/** Salted hasher for CNetAddr, for use as the hash of an unordered map keyed by address. */
+class CNetAddrHash
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    CNetAddrHash();
+    size_t operator()(const CNetAddr& addr) const;
+};
+
 class CSubNet
 {
     protected:
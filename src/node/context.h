@@ -12,11 +12,13 @@
 
 class ArgsManager;
 class BanMan;
+class BlockTemplateCache;
 class CConnman;
 class CScheduler;
 class CTxMemPool;
 class ChainstateManager;
 class PeerManager;
+class PowSearcher;
 namespace interfaces {
 class Chain;
 class ChainClient;
@@ -37,6 +39,8 @@ struct NodeContext {
     std::unique_ptr<CConnman> connman;
     std::unique_ptr<CTxMemPool> mempool;
     std::unique_ptr<PeerManager> peerman;
+    std::unique_ptr<BlockTemplateCache> block_template_cache;
+    std::unique_ptr<PowSearcher> pow_searcher;
     ChainstateManager* chainman{nullptr}; // Currently a raw pointer because the memory is not managed by this struct
     std::unique_ptr<BanMan> banman;
     ArgsManager* args{nullptr}; // Currently a raw pointer because the memory is not managed by this struct
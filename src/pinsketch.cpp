@@ -0,0 +1,261 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <crypto/common.h>
+
+#include <array>
+#include <assert.h>
+
+namespace {
+
+//! GF(2^32) as polynomials over GF(2) modulo x^32 + x^7 + x^3 + x^2 + 1
+constexpr uint32_t MODULUS = 0x8d;
+
+/** Reduce a carry-less product of two field elements, using x^32 = x^7 + x^3 + x^2 + 1. */
+uint32_t GFReduce(uint64_t r)
+{
+    for (int i = 0; i < 2; ++i) {
+        const uint64_t high = r >> 32;
+        r = (r & 0xffffffff) ^ high ^ (high << 2) ^ (high << 3) ^ (high << 7);
+    }
+    return r;
+}
+
+/** Multiplication by a fixed element, four bits of the other factor at a time. */
+class GFMultiplier
+{
+    uint64_t m_table[16];
+
+public:
+    explicit GFMultiplier(uint32_t a)
+    {
+        m_table[0] = 0;
+        m_table[1] = a;
+        for (int i = 2; i < 16; i += 2) {
+            m_table[i] = m_table[i / 2] << 1;
+            m_table[i + 1] = m_table[i] ^ a;
+        }
+    }
+
+    uint32_t operator()(uint32_t b) const
+    {
+        uint64_t r = 0;
+        for (int shift = 28; shift >= 0; shift -= 4) r = (r << 4) ^ m_table[(b >> shift) & 15];
+        return GFReduce(r);
+    }
+};
+
+uint32_t GFMul(uint32_t a, uint32_t b)
+{
+    return GFMultiplier(a)(b);
+}
+
+/** Squaring is linear in characteristic 2, so it is a lookup per byte. */
+uint32_t GFSqr(uint32_t a)
+{
+    static const std::array<std::array<uint32_t, 256>, 4> TABLES = [] {
+        std::array<std::array<uint32_t, 256>, 4> tables;
+        for (int byte = 0; byte < 4; ++byte) {
+            for (uint32_t value = 0; value < 256; ++value) {
+                // Squaring spreads the bits out: bit i goes to bit 2i.
+                uint64_t spread = 0;
+                for (int bit = 0; bit < 8; ++bit) {
+                    if (value >> bit & 1) spread |= uint64_t{1} << (2 * (8 * byte + bit));
+                }
+                tables[byte][value] = GFReduce(spread);
+            }
+        }
+        return tables;
+    }();
+    return TABLES[0][a & 0xff] ^ TABLES[1][(a >> 8) & 0xff] ^ TABLES[2][(a >> 16) & 0xff] ^ TABLES[3][a >> 24];
+}
+
+uint32_t GFInv(uint32_t a)
+{
+    // a^(2^32 - 2)
+    uint32_t r = 1;
+    for (uint32_t e = 0xfffffffe; e; e >>= 1) {
+        if (e & 1) r = GFMul(r, a);
+        a = GFSqr(a);
+    }
+    return r;
+}
+
+//! Polynomial over GF(2^32), with the coefficient of z^i at index i
+using Poly = std::vector<uint32_t>;
+
+void Trim(Poly& p)
+{
+    while (!p.empty() && p.back() == 0) p.pop_back();
+}
+
+void MakeMonic(Poly& p)
+{
+    const GFMultiplier mul_inv(GFInv(p.back()));
+    for (uint32_t& coef : p) coef = mul_inv(coef);
+}
+
+//! Reduce a modulo the monic polynomial m, returning the quotient if requested
+void PolyMod(Poly& a, const Poly& m, Poly* quotient = nullptr)
+{
+    Trim(a);
+    const size_t deg = m.size() - 1;
+    if (quotient) quotient->assign(a.size() > deg ? a.size() - deg : 0, 0);
+    while (a.size() > deg) {
+        const uint32_t lead = a.back();
+        const size_t shift = a.size() - 1 - deg;
+        if (quotient) (*quotient)[shift] = lead;
+        if (lead != 0) {
+            const GFMultiplier mul_lead(lead);
+            for (size_t i = 0; i < deg; ++i) a[shift + i] ^= mul_lead(m[i]);
+        }
+        a.pop_back();
+        Trim(a);
+    }
+}
+
+//! p^2 modulo the monic polynomial m; squaring is linear in characteristic 2
+Poly PolySqrMod(const Poly& p, const Poly& m)
+{
+    Poly r(p.empty() ? 0 : 2 * p.size() - 1);
+    for (size_t i = 0; i < p.size(); ++i) r[2 * i] = GFSqr(p[i]);
+    PolyMod(r, m);
+    return r;
+}
+
+//! Monic greatest common divisor
+Poly PolyGCD(Poly a, Poly b)
+{
+    Trim(a);
+    Trim(b);
+    while (!b.empty()) {
+        MakeMonic(b);
+        PolyMod(a, b);
+        std::swap(a, b);
+    }
+    if (!a.empty()) MakeMonic(a);
+    return a;
+}
+
+/**
+ * Append the roots of the monic polynomial f, which is a product of distinct
+ * linear factors, splitting it with gcd(f, Tr(beta * z)) for the basis
+ * elements beta = 2^k. Two distinct roots differ in the trace of some beta
+ * times them, so one of the 32 basis elements always splits f.
+ */
+void SplitRoots(const Poly& f, int k, std::vector<uint32_t>& roots)
+{
+    if (f.size() == 2) {
+        roots.push_back(f[0]);
+        return;
+    }
+    for (;; k = (k + 1) % 32) {
+        Poly power{0, uint32_t{1} << k};
+        PolyMod(power, f);
+        Poly trace = power;
+        for (int i = 1; i < 32; ++i) {
+            power = PolySqrMod(power, f);
+            if (trace.size() < power.size()) trace.resize(power.size(), 0);
+            for (size_t j = 0; j < power.size(); ++j) trace[j] ^= power[j];
+        }
+        Poly factor = PolyGCD(f, trace);
+        if (factor.size() > 1 && factor.size() < f.size()) {
+            Poly rest = f, cofactor;
+            PolyMod(rest, factor, &cofactor);
+            SplitRoots(factor, (k + 1) % 32, roots);
+            SplitRoots(cofactor, (k + 1) % 32, roots);
+            return;
+        }
+    }
+}
+
+} // namespace
+
+void PinSketch::Add(uint32_t element)
+{
+    assert(element != 0);
+    const GFMultiplier mul_square(GFSqr(element));
+    uint32_t power = element;
+    for (uint32_t& syndrome : m_syndromes) {
+        syndrome ^= power;
+        power = mul_square(power);
+    }
+}
+
+void PinSketch::Merge(const PinSketch& other)
+{
+    assert(other.m_syndromes.size() == m_syndromes.size());
+    for (size_t i = 0; i < m_syndromes.size(); ++i) m_syndromes[i] ^= other.m_syndromes[i];
+}
+
+std::vector<unsigned char> PinSketch::Serialize() const
+{
+    std::vector<unsigned char> data(m_syndromes.size() * BYTES_PER_CAPACITY);
+    for (size_t i = 0; i < m_syndromes.size(); ++i) WriteLE32(data.data() + i * BYTES_PER_CAPACITY, m_syndromes[i]);
+    return data;
+}
+
+Optional<PinSketch> PinSketch::Deserialize(Span<const unsigned char> data)
+{
+    if (data.size() % BYTES_PER_CAPACITY != 0) return nullopt;
+    PinSketch sketch(data.size() / BYTES_PER_CAPACITY);
+    for (size_t i = 0; i < sketch.m_syndromes.size(); ++i) sketch.m_syndromes[i] = ReadLE32(data.data() + i * BYTES_PER_CAPACITY);
+    return sketch;
+}
+
+Optional<std::vector<uint32_t>> PinSketch::Decode(size_t max_elements) const
+{
+    const size_t capacity = m_syndromes.size();
+    // The power sums S_1..S_2c (S_(n+1) at index n), as S_2i = S_i^2.
+    std::vector<uint32_t> sums(2 * capacity);
+    for (size_t i = 0; i < capacity; ++i) sums[2 * i] = m_syndromes[i];
+    for (size_t n = 1; n < sums.size(); n += 2) sums[n] = GFSqr(sums[n / 2]);
+
+    // Berlekamp-Massey: the shortest C(z) = 1 + c_1 z + ... + c_L z^L
+    // generating the power sums, which is prod(1 - x_i z) over the elements.
+    Poly conn{1}, prev{1};
+    size_t len = 0, shift = 1;
+    uint32_t prev_discrepancy = 1;
+    for (size_t n = 0; n < sums.size(); ++n) {
+        uint32_t discrepancy = sums[n];
+        for (size_t i = 1; i <= len && i < conn.size(); ++i) discrepancy ^= GFMul(conn[i], sums[n - i]);
+        if (discrepancy == 0) {
+            ++shift;
+            continue;
+        }
+        const GFMultiplier mul_coef(GFMul(discrepancy, GFInv(prev_discrepancy)));
+        Poly old_conn = conn;
+        if (conn.size() < prev.size() + shift) conn.resize(prev.size() + shift, 0);
+        for (size_t i = 0; i < prev.size(); ++i) conn[i + shift] ^= mul_coef(prev[i]);
+        if (2 * len <= n) {
+            len = n + 1 - len;
+            prev = std::move(old_conn);
+            prev_discrepancy = discrepancy;
+            shift = 1;
+        } else {
+            ++shift;
+        }
+    }
+    Trim(conn);
+    if (len > max_elements || len > capacity) return nullopt;
+    // Elements are non-zero, so C(z) must have degree L exactly.
+    if (conn.size() != len + 1) return nullopt;
+    std::vector<uint32_t> elements;
+    if (len == 0) return elements;
+
+    // The elements are the roots of the reverse of C(z), which is monic.
+    const Poly f(conn.rbegin(), conn.rend());
+    // It has to split into distinct linear factors, i.e. divide z^(2^32) - z.
+    Poly z{0, 1};
+    PolyMod(z, f);
+    Poly frobenius = z;
+    for (int i = 0; i < 32; ++i) frobenius = PolySqrMod(frobenius, f);
+    if (frobenius != z) return nullopt;
+
+    SplitRoots(f, 0, elements);
+    assert(elements.size() == len);
+    return elements;
+}
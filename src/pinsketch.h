@@ -0,0 +1,54 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PINSKETCH_H
+#define BITCOIN_PINSKETCH_H
+
+#include <optional.h>
+#include <span.h>
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A PinSketch of a set of non-zero 32-bit elements, as used by minisketch
+ * for set reconciliation (BIP330).
+ *
+ * A sketch with capacity c holds the odd power sums x, x^3, ..., x^(2c-1) of
+ * its elements over GF(2^32), in 4 bytes per unit of capacity. Adding an
+ * element twice removes it again, so merging the sketches of two sets gives
+ * the sketch of their symmetric difference, which can be decoded as long as
+ * it has at most c elements.
+ */
+class PinSketch
+{
+public:
+    //! Serialized size of one unit of capacity
+    static constexpr size_t BYTES_PER_CAPACITY = 4;
+
+    explicit PinSketch(size_t capacity) : m_syndromes(capacity) {}
+
+    size_t GetCapacity() const { return m_syndromes.size(); }
+
+    /** Add an element, or remove it if it was added before. Zero is not a valid element. */
+    void Add(uint32_t element);
+    /** Merge another sketch of the same capacity into this one, giving the sketch of the symmetric difference. */
+    void Merge(const PinSketch& other);
+
+    std::vector<unsigned char> Serialize() const;
+    /** Parse a serialized sketch; its capacity follows from the size. Returns nullopt if the size is invalid. */
+    static Optional<PinSketch> Deserialize(Span<const unsigned char> data);
+
+    /**
+     * Recover the elements of the sketch, if there are at most max_elements
+     * of them (and no more than the capacity). Returns nullopt if decoding
+     * fails, which means that the set was larger than that.
+     */
+    Optional<std::vector<uint32_t>> Decode(size_t max_elements) const;
+
+private:
+    std::vector<uint32_t> m_syndromes;
+};
+
+#endif // BITCOIN_PINSKETCH_H
@@ -10,8 +10,30 @@
 #include <txmempool.h>
 #include <util/system.h>
 
+#include <cmath>
+
 static constexpr double INF_FEERATE = 1e99;
 
+/** Track confirm delays up to 5 minutes for short horizon */
+static constexpr std::chrono::seconds SHORT_HORIZON{5 * 60};
+/** Track confirm delays up to 1 hour for medium horizon */
+static constexpr std::chrono::seconds MED_HORIZON{60 * 60};
+/** Track confirm delays up to 1 day for long horizon */
+static constexpr std::chrono::seconds LONG_HORIZON{24 * 60 * 60};
+/** Historical estimates that are older than this aren't valid */
+static constexpr std::chrono::seconds OLDEST_ESTIMATE_HISTORY{6 * LONG_HORIZON};
+
+/** Half-life of 30 minutes for the short horizon's history */
+static constexpr std::chrono::seconds SHORT_HALF_LIFE{30 * 60};
+/** Half-life of 4 hours for the medium horizon's history */
+static constexpr std::chrono::seconds MED_HALF_LIFE{4 * 60 * 60};
+/** Half-life of 1 day for the long horizon's history */
+static constexpr std::chrono::seconds LONG_HALF_LIFE{24 * 60 * 60};
+
+/** Version required to read the estimates file, which is bumped when the
+ * horizons change meaning */
+static constexpr int FEE_ESTIMATES_FILE_VERSION = 210400;
+
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
         {FeeEstimateHorizon::SHORT_HALFLIFE, "short"},
@@ -65,15 +87,27 @@ private:
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
+    // The moving averages above are stored divided by the decay they have
+    // accumulated since they were last normalized, so that decaying them all
+    // is a single multiplication of this factor. Their actual values are
+    // their stored values times this factor.
+    double m_decay_factor{1};
+
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
-    // that are unconfirmed for each possible confirmation value Y
+    // that are unconfirmed for each possible number of periods Y
     std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Apply the accumulated decay to the stored moving averages */
+    void NormalizeMovingAverages();
+
+    /** Return a moving average with the accumulated decay applied */
+    std::vector<double> Decayed(const std::vector<double>& avg) const;
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -85,7 +119,7 @@ public:
     TxConfirmStats(const std::vector<double>& defaultBuckets, const std::map<double, unsigned int>& defaultBucketMap,
                    unsigned int maxPeriods, double decay, unsigned int scale);
 
-    /** Roll the circular buffer for unconfirmed txs*/
+    /** Roll the circular buffer for unconfirmed txs when a new period starts */
     void ClearCurrent(unsigned int nBlockHeight);
 
     /**
@@ -104,7 +138,8 @@ public:
                   unsigned int bucketIndex, bool inBlock);
 
     /** Update our estimates by decaying our historical moving average and updating
-        with the data gathered from the current block */
+        with the data gathered from the current block. This is O(1), except
+        when the stored averages are due to be normalized. */
     void UpdateMovingAverages();
 
     /**
@@ -155,7 +190,9 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
 
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
-    unconfTxs.resize(GetMaxConfirms());
+    // Outstanding transactions are counted per period rather than per block,
+    // so that long horizons of short blocks don't need a row per block
+    unconfTxs.resize(confAvg.size());
     for (unsigned int i = 0; i < unconfTxs.size(); i++) {
         unconfTxs[i].resize(newbuckets);
     }
@@ -165,9 +202,11 @@ void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
 // Roll the unconfirmed txs circular buffer
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
+    if (nBlockHeight % scale != 0) return;
+    std::vector<int>& current = unconfTxs[nBlockHeight / scale % unconfTxs.size()];
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight % unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
+        oldUnconfTxs[j] += current[j];
+        current[j] = 0;
     }
 }
 
@@ -179,24 +218,43 @@ void TxConfirmStats::Record(int blocksToConfirm, double feerate)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1) / scale;
     unsigned int bucketindex = bucketMap.lower_bound(feerate)->second;
+    const double weight = 1 / m_decay_factor;
     for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+        confAvg[i - 1][bucketindex] += weight;
     }
-    txCtAvg[bucketindex]++;
-    m_feerate_avg[bucketindex] += feerate;
+    txCtAvg[bucketindex] += weight;
+    m_feerate_avg[bucketindex] += feerate * weight;
 }
 
 void TxConfirmStats::UpdateMovingAverages()
+{
+    m_decay_factor *= decay;
+    // Keep the stored averages, which grow as the factor shrinks, well within
+    // the range of a double
+    if (m_decay_factor < 1e-100) NormalizeMovingAverages();
+}
+
+void TxConfirmStats::NormalizeMovingAverages()
 {
     assert(confAvg.size() == failAvg.size());
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++) {
-            confAvg[i][j] *= decay;
-            failAvg[i][j] *= decay;
-        }
-        m_feerate_avg[j] *= decay;
-        txCtAvg[j] *= decay;
+    const double factor = m_decay_factor;
+    const auto normalize = [factor](std::vector<double>& avg) {
+        for (double& val : avg) val *= factor;
+    };
+    for (unsigned int i = 0; i < confAvg.size(); i++) {
+        normalize(confAvg[i]);
+        normalize(failAvg[i]);
     }
+    normalize(m_feerate_avg);
+    normalize(txCtAvg);
+    m_decay_factor = 1;
+}
+
+std::vector<double> TxConfirmStats::Decayed(const std::vector<double>& avg) const
+{
+    std::vector<double> decayed(avg);
+    for (double& val : decayed) val *= m_decay_factor;
+    return decayed;
 }
 
 // returns -1 on error conditions
@@ -210,6 +268,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     int extraNum = 0;  // Number of tx's still in mempool for confTarget or longer
     double failNum = 0; // Number of tx's that were never confirmed but removed from the mempool after confTarget
     const int periodTarget = (confTarget + scale - 1) / scale;
+    const unsigned int currentPeriod = nBlockHeight / scale;
     const int maxbucketindex = buckets.size() - 1;
 
     // We'll combine buckets until we have enough samples.
@@ -236,11 +295,11 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct) % bins][bucket];
+        nConf += confAvg[periodTarget - 1][bucket] * m_decay_factor;
+        totalNum += txCtAvg[bucket] * m_decay_factor;
+        failNum += failAvg[periodTarget - 1][bucket] * m_decay_factor;
+        for (unsigned int periods = periodTarget; periods < bins; periods++)
+            extraNum += unconfTxs[(currentPeriod + bins - periods) % bins][bucket];
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -357,10 +416,16 @@ void TxConfirmStats::Write(CAutoFile& fileout) const
 {
     fileout << decay;
     fileout << scale;
-    fileout << m_feerate_avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << Decayed(m_feerate_avg);
+    fileout << Decayed(txCtAvg);
+    std::vector<std::vector<double>> decayed_conf_avg;
+    std::vector<std::vector<double>> decayed_fail_avg;
+    for (unsigned int i = 0; i < confAvg.size(); i++) {
+        decayed_conf_avg.push_back(Decayed(confAvg[i]));
+        decayed_fail_avg.push_back(Decayed(failAvg[i]));
+    }
+    fileout << decayed_conf_avg;
+    fileout << decayed_fail_avg;
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -369,6 +434,9 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     // buckets and bucketMap are not updated yet, so don't access them
     // If there is a read failure, we'll just discard this entire object anyway
     size_t maxConfirms, maxPeriods;
+    const double expected_decay = decay;
+    const unsigned int expected_scale = scale;
+    const size_t expected_periods = confAvg.size();
 
     // The current version will store the decay with each individual TxConfirmStats and also keep a scale factor
     filein >> decay;
@@ -379,6 +447,10 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (scale == 0) {
         throw std::runtime_error("Corrupt estimates file. Scale must be non-zero");
     }
+    // The file must have been written for the same horizons and block spacing
+    if (std::abs(decay - expected_decay) > 1e-12 || scale != expected_scale) {
+        throw std::runtime_error("Estimates file was written for different time horizons");
+    }
 
     filein >> m_feerate_avg;
     if (m_feerate_avg.size() != numBuckets) {
@@ -392,8 +464,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     maxPeriods = confAvg.size();
     maxConfirms = scale * maxPeriods;
 
-    if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
-        throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
+    if (maxPeriods != expected_periods) {
+        throw std::runtime_error("Estimates file was written for different time horizons");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
         if (confAvg[i].size() != numBuckets) {
@@ -414,6 +486,7 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
+    m_decay_factor = 1;
 
     LogPrint(BCLog::ESTIMATEFEE, "Reading estimates: %u buckets counting confirms up to %u blocks\n",
              numBuckets, maxConfirms);
@@ -422,8 +495,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-    unconfTxs[blockIndex][bucketindex]++;
+    unsigned int periodIndex = nBlockHeight / scale % unconfTxs.size();
+    unconfTxs[periodIndex][bucketindex]++;
     return bucketindex;
 }
 
@@ -438,28 +511,31 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
-    if (blocksAgo >= (int)unconfTxs.size()) {
+    // Outstanding transactions are counted in the period they entered in
+    const unsigned int entryPeriodsAgo = nBestSeenHeight == 0 ? 0 : nBestSeenHeight / scale - entryHeight / scale;
+    if (entryPeriodsAgo >= unconfTxs.size()) {
         if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
         } else {
-            LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from >25 blocks,bucketIndex=%u already\n",
-                     bucketindex);
+            LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from >%u periods,bucketIndex=%u already\n",
+                     unconfTxs.size(), bucketindex);
         }
     }
     else {
-        unsigned int blockIndex = entryHeight % unconfTxs.size();
-        if (unconfTxs[blockIndex][bucketindex] > 0) {
-            unconfTxs[blockIndex][bucketindex]--;
+        unsigned int periodIndex = entryHeight / scale % unconfTxs.size();
+        if (unconfTxs[periodIndex][bucketindex] > 0) {
+            unconfTxs[periodIndex][bucketindex]--;
         } else {
-            LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
-                     blockIndex, bucketindex);
+            LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from periodIndex=%u,bucketIndex=%u already\n",
+                     periodIndex, bucketindex);
         }
     }
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
+        const double weight = 1 / m_decay_factor;
         for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+            failAvg[i][bucketindex] += weight;
         }
     }
 }
@@ -484,8 +560,27 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     }
 }
 
-CBlockPolicyEstimator::CBlockPolicyEstimator()
-    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
+CBlockPolicyEstimator::HorizonParams CBlockPolicyEstimator::GetHorizonParams(std::chrono::seconds horizon, unsigned int periods, std::chrono::seconds half_life, std::chrono::seconds block_spacing)
+{
+    assert(block_spacing.count() > 0);
+    HorizonParams params;
+    params.periods = periods;
+    params.scale = std::max<int64_t>(1, horizon.count() / (block_spacing.count() * periods));
+    params.decay = std::pow(0.5, double(block_spacing.count()) / half_life.count());
+    return params;
+}
+
+std::unique_ptr<TxConfirmStats> CBlockPolicyEstimator::MakeStats(const HorizonParams& params) const
+{
+    return std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, params.periods, params.decay, params.scale));
+}
+
+CBlockPolicyEstimator::CBlockPolicyEstimator(std::chrono::seconds block_spacing)
+    : m_short_params(GetHorizonParams(SHORT_HORIZON, SHORT_BLOCK_PERIODS, SHORT_HALF_LIFE, block_spacing)),
+      m_med_params(GetHorizonParams(MED_HORIZON, MED_BLOCK_PERIODS, MED_HALF_LIFE, block_spacing)),
+      m_long_params(GetHorizonParams(LONG_HORIZON, LONG_BLOCK_PERIODS, LONG_HALF_LIFE, block_spacing)),
+      m_oldest_estimate_history(OLDEST_ESTIMATE_HISTORY / block_spacing),
+      nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
 {
     static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
     size_t bucketIndex = 0;
@@ -497,9 +592,10 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     bucketMap[INF_FEERATE] = bucketIndex;
     assert(bucketMap.size() == buckets.size());
 
-    feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
-    shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
-    longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+    LOCK(m_cs_fee_estimator);
+    feeStats = MakeStats(m_med_params);
+    shortStats = MakeStats(m_short_params);
+    longStats = MakeStats(m_long_params);
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
@@ -700,7 +796,7 @@ unsigned int CBlockPolicyEstimator::HistoricalBlockSpan() const
     if (historicalFirst == 0) return 0;
     assert(historicalBest >= historicalFirst);
 
-    if (nBestSeenHeight - historicalBest > OLDEST_ESTIMATE_HISTORY) return 0;
+    if (nBestSeenHeight - historicalBest > m_oldest_estimate_history) return 0;
 
     return historicalBest - historicalFirst;
 }
@@ -861,7 +957,7 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
     try {
         LOCK(m_cs_fee_estimator);
-        fileout << 149900; // version required to read: 0.14.99 or later
+        fileout << FEE_ESTIMATES_FILE_VERSION; // version required to read
         fileout << CLIENT_VERSION; // version that wrote the file
         fileout << nBestSeenHeight;
         if (BlockSpan() > HistoricalBlockSpan()/2) {
@@ -896,9 +992,9 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
         unsigned int nFileBestSeenHeight;
         filein >> nFileBestSeenHeight;
 
-        if (nVersionRequired < 149900) {
+        if (nVersionRequired < FEE_ESTIMATES_FILE_VERSION) {
             LogPrintf("%s: incompatible old fee estimation data (non-fatal). Version: %d\n", __func__, nVersionRequired);
-        } else { // New format introduced in 149900
+        } else { // Time based horizons introduced in 210400
             unsigned int nFileHistoricalFirst, nFileHistoricalBest;
             filein >> nFileHistoricalFirst >> nFileHistoricalBest;
             if (nFileHistoricalFirst > nFileHistoricalBest || nFileHistoricalBest > nFileBestSeenHeight) {
@@ -910,9 +1006,9 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             if (numBuckets <= 1 || numBuckets > 1000)
                 throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 feerate buckets");
 
-            std::unique_ptr<TxConfirmStats> fileFeeStats(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
-            std::unique_ptr<TxConfirmStats> fileShortStats(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
-            std::unique_ptr<TxConfirmStats> fileLongStats(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+            std::unique_ptr<TxConfirmStats> fileFeeStats = MakeStats(m_med_params);
+            std::unique_ptr<TxConfirmStats> fileShortStats = MakeStats(m_short_params);
+            std::unique_ptr<TxConfirmStats> fileLongStats = MakeStats(m_long_params);
             fileFeeStats->Read(filein, nVersionThatWrote, numBuckets);
             fileShortStats->Read(filein, nVersionThatWrote, numBuckets);
             fileLongStats->Read(filein, nVersionThatWrote, numBuckets);
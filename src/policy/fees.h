@@ -11,6 +11,7 @@
 #include <random.h>
 #include <sync.h>
 
+#include <chrono>
 #include <map>
 #include <memory>
 #include <string>
@@ -22,6 +23,10 @@ class CTxMemPoolEntry;
 class CTxMemPool;
 class TxConfirmStats;
 
+/** Target spacing of the blocks the fee estimator is configured for, unless
+ * given another (consensus nPowTargetSpacing of all networks) */
+static constexpr std::chrono::seconds DEFAULT_ESTIMATOR_BLOCK_SPACING{10};
+
 /* Identifier for each of the 3 different TxConfirmStats which will track
  * history over different time horizons. */
 enum class FeeEstimateHorizon {
@@ -112,11 +117,19 @@ struct FeeCalculation
  * done for a different decay in each of the 3 data sets to keep relevant data
  * from different time horizons.  Furthermore we also keep track of the number
  * unmined (in mempool or left mempool without being included in a block)
- * transactions in each bucket and for how many blocks they have been
+ * transactions in each bucket and for how many periods they have been
  * outstanding and use both of these numbers to increase the number of transactions
  * we've seen in that feerate bucket when calculating an estimate for any number
  * of confirmations below the number of blocks they've been outstanding.
  *
+ * The time horizons, and how quickly their history decays, are defined in
+ * time rather than in blocks. The number of blocks per period and the decay
+ * per block are derived from them for the block spacing of the chain, so that
+ * with 10 second blocks the short horizon still resolves single blocks while
+ * the long horizon spans a day in a bounded number of periods. The moving
+ * averages are decayed lazily, so that a block costs the same however many
+ * buckets and periods are tracked.
+ *
  *  We want to be able to estimate feerates that are needed on tx's to be included in
  * a certain number of blocks.  Every time a block is added to the best chain, this class records
  * stats on the transactions included in that block
@@ -124,24 +137,11 @@ struct FeeCalculation
 class CBlockPolicyEstimator
 {
 private:
-    /** Track confirm delays up to 12 blocks for short horizon */
-    static constexpr unsigned int SHORT_BLOCK_PERIODS = 12;
-    static constexpr unsigned int SHORT_SCALE = 1;
-    /** Track confirm delays up to 48 blocks for medium horizon */
+    /** Number of periods each horizon tracks confirm delays for. The time
+     * spanned by the periods, and their decay, are in policy/fees.cpp */
+    static constexpr unsigned int SHORT_BLOCK_PERIODS = 30;
     static constexpr unsigned int MED_BLOCK_PERIODS = 24;
-    static constexpr unsigned int MED_SCALE = 2;
-    /** Track confirm delays up to 1008 blocks for long horizon */
-    static constexpr unsigned int LONG_BLOCK_PERIODS = 42;
-    static constexpr unsigned int LONG_SCALE = 24;
-    /** Historical estimates that are older than this aren't valid */
-    static const unsigned int OLDEST_ESTIMATE_HISTORY = 6 * 1008;
-
-    /** Decay of .962 is a half-life of 18 blocks or about 3 hours */
-    static constexpr double SHORT_DECAY = .962;
-    /** Decay of .9952 is a half-life of 144 blocks or about 1 day */
-    static constexpr double MED_DECAY = .9952;
-    /** Decay of .99931 is a half-life of 1008 blocks or about 1 week */
-    static constexpr double LONG_DECAY = .99931;
+    static constexpr unsigned int LONG_BLOCK_PERIODS = 48;
 
     /** Require greater than 60% of X feerate transactions to be confirmed within Y/2 blocks*/
     static constexpr double HALF_SUCCESS_PCT = .6;
@@ -173,8 +173,9 @@ private:
     static constexpr double FEE_SPACING = 1.05;
 
 public:
-    /** Create new BlockPolicyEstimator and initialize stats tracking classes with default values */
-    CBlockPolicyEstimator();
+    /** Create new BlockPolicyEstimator and initialize stats tracking classes
+     * with the horizons scaled to the given block spacing */
+    explicit CBlockPolicyEstimator(std::chrono::seconds block_spacing = DEFAULT_ESTIMATOR_BLOCK_SPACING);
     ~CBlockPolicyEstimator();
 
     /** Process all the transactions that have been included in a block */
@@ -216,6 +217,25 @@ public:
     unsigned int HighestTargetTracked(FeeEstimateHorizon horizon) const;
 
 private:
+    /** How a horizon tracks confirmations at the configured block spacing */
+    struct HorizonParams {
+        //! Number of periods confirmations are tracked for
+        unsigned int periods;
+        //! Number of blocks per period
+        unsigned int scale;
+        //! Decay of the moving averages per block
+        double decay;
+    };
+
+    static HorizonParams GetHorizonParams(std::chrono::seconds horizon, unsigned int periods, std::chrono::seconds half_life, std::chrono::seconds block_spacing);
+    std::unique_ptr<TxConfirmStats> MakeStats(const HorizonParams& params) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+
+    const HorizonParams m_short_params;
+    const HorizonParams m_med_params;
+    const HorizonParams m_long_params;
+    /** OLDEST_ESTIMATE_HISTORY in blocks */
+    const unsigned int m_oldest_estimate_history;
+
     mutable RecursiveMutex m_cs_fee_estimator;
 
     unsigned int nBestSeenHeight GUARDED_BY(m_cs_fee_estimator);
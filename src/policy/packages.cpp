@@ -0,0 +1,109 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <policy/packages.h>
+
+#include <hash.h>
+#include <policy/policy.h>
+
+#include <algorithm>
+#include <set>
+#include <utility>
+
+bool CheckPackage(const Package& txns, PackageValidationState& state)
+{
+    if (txns.size() > MAX_PACKAGE_COUNT) {
+        return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-too-many-transactions");
+    }
+
+    int64_t total_size = 0;
+    for (const CTransactionRef& tx : txns) {
+        total_size += GetVirtualTransactionSize(*tx);
+    }
+    if (total_size > MAX_PACKAGE_SIZE * 1000) {
+        return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-too-large");
+    }
+
+    // Walking the package in order, no transaction may spend from one that
+    // is still to come
+    std::set<uint256> later_txids;
+    std::set<mw::Hash> later_mweb_outputs;
+    for (const CTransactionRef& tx : txns) {
+        if (!later_txids.insert(tx->GetHash()).second) {
+            return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-contains-duplicates");
+        }
+        for (const CTxOutput& output : tx->GetOutputs()) {
+            if (output.IsMWEB()) later_mweb_outputs.insert(output.ToMWEB());
+        }
+    }
+
+    std::set<COutPoint> spent;
+    std::set<mw::Hash> spent_mweb;
+    for (const CTransactionRef& tx : txns) {
+        later_txids.erase(tx->GetHash());
+        for (const CTxOutput& output : tx->GetOutputs()) {
+            if (output.IsMWEB()) later_mweb_outputs.erase(output.ToMWEB());
+        }
+
+        for (const CTxInput& input : tx->GetInputs()) {
+            if (input.IsMWEB()) {
+                if (later_mweb_outputs.count(input.ToMWEB())) {
+                    return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-not-sorted");
+                }
+                if (!spent_mweb.insert(input.ToMWEB()).second) {
+                    return state.Invalid(PackageValidationResult::PCKG_POLICY, "conflict-in-package");
+                }
+            } else {
+                const COutPoint& prevout = input.GetTxIn().prevout;
+                if (later_txids.count(prevout.hash)) {
+                    return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-not-sorted");
+                }
+                if (!spent.insert(prevout).second) {
+                    return state.Invalid(PackageValidationResult::PCKG_POLICY, "conflict-in-package");
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool IsChildWithParents(const Package& package)
+{
+    if (package.size() < 2) return false;
+
+    const CTransaction& child = *package.back();
+    std::set<uint256> parent_txids;
+    for (const CTxIn& txin : child.vin) {
+        parent_txids.insert(txin.prevout.hash);
+    }
+    std::set<mw::Hash> spent_mweb_outputs;
+    for (const CTxInput& input : child.GetInputs()) {
+        if (input.IsMWEB()) spent_mweb_outputs.insert(input.ToMWEB());
+    }
+
+    return std::all_of(package.cbegin(), package.cend() - 1, [&](const CTransactionRef& tx) {
+        if (parent_txids.count(tx->GetHash())) return true;
+        for (const CTxOutput& output : tx->GetOutputs()) {
+            if (output.IsMWEB() && spent_mweb_outputs.count(output.ToMWEB())) return true;
+        }
+        return false;
+    });
+}
+
+uint256 GetPackageHash(const Package& package)
+{
+    // The wtxid does not commit to the MWEB data, so add the MWEB transaction hash
+    std::vector<std::pair<uint256, uint256>> tx_hashes;
+    for (const CTransactionRef& tx : package) {
+        const uint256 mweb_hash = tx->HasMWEBTx() ? uint256(tx->mweb_tx.m_transaction->GetHash().vec()) : uint256();
+        tx_hashes.emplace_back(tx->GetWitnessHash(), mweb_hash);
+    }
+    std::sort(tx_hashes.begin(), tx_hashes.end());
+
+    CHashWriter hasher(SER_GETHASH, 0);
+    for (const auto& tx_hash : tx_hashes) {
+        hasher << tx_hash.first << tx_hash.second;
+    }
+    return hasher.GetHash();
+}
@@ -0,0 +1,51 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POLICY_PACKAGES_H
+#define BITCOIN_POLICY_PACKAGES_H
+
+#include <consensus/validation.h>
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+#include <vector>
+
+/** Default maximum number of transactions in a package. */
+static const unsigned int MAX_PACKAGE_COUNT = 25;
+/** Default maximum total virtual size of transactions in a package in KvB. */
+static const unsigned int MAX_PACKAGE_SIZE = 101;
+
+/** A "reason" why a package was invalid. */
+enum class PackageValidationResult {
+    PCKG_RESULT_UNSET = 0,        //!< Initial value. The package has not yet been rejected.
+    PCKG_POLICY,                  //!< The package itself is invalid (e.g. too many transactions).
+    PCKG_TX,                      //!< At least one tx is invalid.
+};
+
+/**
+ * A package is an ordered list of transactions. The transactions cannot
+ * conflict with (spend the same inputs as) one another, and every transaction
+ * comes after the transactions it spends from.
+ */
+using Package = std::vector<CTransactionRef>;
+
+class PackageValidationState : public ValidationState<PackageValidationResult> {};
+
+/**
+ * Context-free package policy checks: the package is small enough, sorted
+ * topologically, and its transactions are distinct and spend distinct
+ * canonical and MWEB outputs.
+ */
+bool CheckPackage(const Package& txns, PackageValidationState& state);
+
+/**
+ * Whether the package consists of one child and (some of) its parents: every
+ * transaction but the last one is spent by the last one.
+ */
+bool IsChildWithParents(const Package& package);
+
+/** A hash committing to the set of transactions in the package, regardless of their order. */
+uint256 GetPackageHash(const Package& package);
+
+#endif // BITCOIN_POLICY_PACKAGES_H
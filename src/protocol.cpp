@@ -50,6 +50,15 @@ const char *MWEBHEADER="mwebheader";
 const char *MWEBLEAFSET="mwebleafset";
 const char *GETMWEBUTXOS="getmwebutxos";
 const char *MWEBUTXOS="mwebutxos";
+const char *SENDPACKAGES="sendpackages";
+const char *PKGTXNS="pkgtxns";
+const char *SENDTXRCNCL="sendtxrcncl";
+const char *REQRECON="reqrecon";
+const char *SKETCH="sketch";
+const char *RECONCILDIFF="reconcildiff";
+const char *SENDHEADERS2="sendheaders2";
+const char *GETHEADERS2="getheaders2";
+const char *HEADERS2="headers2";
 } // namespace NetMsgType
 
 /** All known message types. Keep this in the same order as the list of
@@ -94,6 +103,15 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::MWEBLEAFSET,
     NetMsgType::GETMWEBUTXOS,
     NetMsgType::MWEBUTXOS,
+    NetMsgType::SENDPACKAGES,
+    NetMsgType::PKGTXNS,
+    NetMsgType::SENDTXRCNCL,
+    NetMsgType::REQRECON,
+    NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF,
+    NetMsgType::SENDHEADERS2,
+    NetMsgType::GETHEADERS2,
+    NetMsgType::HEADERS2,
 };
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes, allNetMessageTypes+ARRAYLEN(allNetMessageTypes));
 
@@ -221,6 +239,7 @@ static std::string serviceFlagToStr(size_t bit)
     case NODE_WITNESS:           return "WITNESS";
     case NODE_COMPACT_FILTERS:   return "COMPACT_FILTERS";
     case NODE_NETWORK_LIMITED:   return "NETWORK_LIMITED";
+    case NODE_P2P_V2:            return "P2P_V2";
     case NODE_MWEB:              return "MWEB";
     case NODE_MWEB_LIGHT_CLIENT: return "MWEB_LIGHT_CLIENT";
     // Not using default, so we get warned when a case is missing
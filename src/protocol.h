@@ -286,6 +286,58 @@ extern const char* GETMWEBUTXOS;
  * @since protocol version 70017 as described by LIP-0006
  */
 extern const char* MWEBUTXOS;
+/**
+ * Indicates that a node accepts packages of transactions in pkgtxns
+ * messages. Like wtxidrelay, it must be sent between VERSION and VERACK.
+ * @since protocol version 70018.
+ */
+extern const char* SENDPACKAGES;
+/**
+ * Contains a package of transactions, sorted so that parents come before
+ * their children, which is to be evaluated as a whole. Sent in response to a
+ * getdata for a transaction whose unconfirmed ancestors pay a feerate below
+ * the peer's fee filter.
+ * @since protocol version 70018.
+ */
+extern const char* PKGTXNS;
+/**
+ * Indicates that a node supports transaction reconciliation (BIP330), with
+ * its version and salt for short IDs. It must be sent between VERSION and
+ * VERACK, and only to peers that relay transactions by wtxid.
+ */
+extern const char* SENDTXRCNCL;
+/**
+ * Asks the peer for a sketch of the transactions it would announce to us,
+ * with the size of our own set and the expected difference q.
+ */
+extern const char* REQRECON;
+/**
+ * Contains a sketch of the short IDs of the transactions a node would
+ * announce, in response to a reqrecon message.
+ */
+extern const char* SKETCH;
+/**
+ * Concludes a reconciliation: whether the set difference was decoded, and
+ * the short IDs of the transactions the sender is missing.
+ */
+extern const char* RECONCILDIFF;
+/**
+ * Indicates that a node supports getheaders2 and headers2 messages. It must
+ * be sent between VERSION and VERACK.
+ * @since protocol version 70019.
+ */
+extern const char* SENDHEADERS2;
+/**
+ * Like getheaders, but asks for a headers2 message in response.
+ * @since protocol version 70019.
+ */
+extern const char* GETHEADERS2;
+/**
+ * Contains up to 8000 block headers in a compressed encoding (see
+ * CompressedHeaderFormatter), in response to a getheaders2 message.
+ * @since protocol version 70019.
+ */
+extern const char* HEADERS2;
 }; // namespace NetMsgType
 
 /* Get a vector of all valid message types (see above) */
@@ -317,6 +369,9 @@ enum ServiceFlags : uint64_t {
     // serving the last 288 (2 day) blocks
     // See BIP159 for details on how this is implemented.
     NODE_NETWORK_LIMITED = (1 << 10),
+    // NODE_P2P_V2 means the node accepts connections using the encrypted v2 transport
+    // (see V2Transport in net.h).
+    NODE_P2P_V2 = (1 << 11),
     // NODE_MWEB_LIGHT_CLIENT indicates that a node can be asked for MWEB light client data.
     NODE_MWEB_LIGHT_CLIENT = (1 << 23),
     // NODE_MWEB indicates that a node can be asked for blocks and transactions including
@@ -205,6 +205,9 @@ public:
 
     //! Derive BIP32 child pubkey.
     bool Derive(CPubKey& pubkeyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
+
+    //! Multiply this public key by a 32-byte scalar, giving a compressed public key.
+    bool Multiply(Span<const unsigned char> scalar, CPubKey& result) const;
 };
 
 class XOnlyPubKey
@@ -10,10 +10,12 @@
 #include <index/txindex.h>
 #include <key_io.h>
 #include <merkleblock.h>
+#include <net_processing.h>
 #include <node/coin.h>
 #include <node/context.h>
 #include <node/psbt.h>
 #include <node/transaction.h>
+#include <policy/packages.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/transaction.h>
@@ -873,6 +875,79 @@ static RPCHelpMan sendrawtransaction()
     };
 }
 
+static Package DecodePackage(const UniValue& raw_transactions)
+{
+    Package package;
+    package.reserve(raw_transactions.size());
+    for (const UniValue& raw_transaction : raw_transactions.getValues()) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, raw_transaction.get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
+                               "TX decode failed: " + raw_transaction.get_str() + " Make sure the tx has at least one input.");
+        }
+        package.emplace_back(MakeTransactionRef(std::move(mtx)));
+    }
+    return package;
+}
+
+static UniValue PackageTxResultToJSON(const CTransactionRef& tx, const PackageMempoolAcceptResult& result, bool allowed)
+{
+    const uint256& wtxid = tx->GetWitnessHash();
+    UniValue result_inner(UniValue::VOBJ);
+    result_inner.pushKV("txid", tx->GetHash().GetHex());
+    result_inner.pushKV("wtxid", wtxid.GetHex());
+    if (result.m_state.GetResult() == PackageValidationResult::PCKG_POLICY) {
+        result_inner.pushKV("package-error", result.m_state.GetRejectReason());
+    }
+    const auto it = result.m_tx_results.find(wtxid);
+    if (it == result.m_tx_results.end()) return result_inner;
+
+    const TxValidationState& state = it->second;
+    if (state.IsInvalid()) {
+        result_inner.pushKV("allowed", false);
+        if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
+            result_inner.pushKV("reject-reason", "missing-inputs");
+        } else {
+            result_inner.pushKV("reject-reason", state.GetRejectReason());
+        }
+    } else if (allowed) {
+        result_inner.pushKV("allowed", true);
+        result_inner.pushKV("vsize", GetVirtualTransactionSize(*tx));
+        const auto fee_it = result.m_tx_fees.find(wtxid);
+        if (fee_it != result.m_tx_fees.end()) {
+            UniValue fees(UniValue::VOBJ);
+            fees.pushKV("base", ValueFromAmount(fee_it->second));
+            result_inner.pushKV("fees", fees);
+        }
+    }
+    return result_inner;
+}
+
+static UniValue TestPackageAccept(CTxMemPool& mempool, const Package& package, const CFeeRate& max_raw_tx_fee_rate)
+{
+    PackageMempoolAcceptResult result;
+    {
+        LOCK(cs_main);
+        result = ProcessNewPackage(mempool, package, /* test_accept */ true);
+    }
+    const bool package_allowed = result.m_state.IsValid();
+
+    UniValue rpc_result(UniValue::VARR);
+    for (const CTransactionRef& tx : package) {
+        UniValue result_inner = PackageTxResultToJSON(tx, result, package_allowed);
+        const auto fee_it = result.m_tx_fees.find(tx->GetWitnessHash());
+        if (package_allowed && fee_it != result.m_tx_fees.end()) {
+            const CAmount max_raw_tx_fee = max_raw_tx_fee_rate.GetTotalFee(GetVirtualTransactionSize(*tx), tx->mweb_tx.GetMWEBWeight());
+            if (max_raw_tx_fee && fee_it->second > max_raw_tx_fee) {
+                result_inner.pushKV("allowed", false);
+                result_inner.pushKV("reject-reason", "max-fee-exceeded");
+            }
+        }
+        rpc_result.push_back(std::move(result_inner));
+    }
+    return rpc_result;
+}
+
 static RPCHelpMan testmempoolaccept()
 {
     return RPCHelpMan{"testmempoolaccept",
@@ -881,7 +956,8 @@ static RPCHelpMan testmempoolaccept()
                 "\nSee sendrawtransaction call.\n",
                 {
                     {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions.\n"
-            "                                        Length must be one for now.",
+            "                                        More than one is tested as a package, which must be sorted so that parents come before their children,\n"
+            "                                        and contain at most " + ToString(MAX_PACKAGE_COUNT) + " transactions.",
                         {
                             {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
                         },
@@ -890,11 +966,13 @@ static RPCHelpMan testmempoolaccept()
                 },
                 RPCResult{
                     RPCResult::Type::ARR, "", "The result of the mempool acceptance test for each raw transaction in the input array.\n"
-                        "Length is exactly one for now.",
+                        "When testing a package, transactions which are not tested because another fails have neither 'allowed' nor 'reject-reason'.",
                     {
                         {RPCResult::Type::OBJ, "", "",
                         {
                             {RPCResult::Type::STR_HEX, "txid", "The transaction hash in hex"},
+                            {RPCResult::Type::STR_HEX, "wtxid", "The transaction witness hash in hex"},
+                            {RPCResult::Type::STR, "package-error", /* optional */ true, "Package validation error, if any (only present when testing a package)"},
                             {RPCResult::Type::BOOL, "allowed", "If the mempool allows this tx to be inserted"},
                             {RPCResult::Type::NUM, "vsize", "Virtual transaction size as defined in BIP 141. This is different from actual serialized size for witness transactions as witness data is discounted (only present when 'allowed' is true)"},
                             {RPCResult::Type::OBJ, "fees", "Transaction fees (only present if 'allowed' is true)",
@@ -922,8 +1000,17 @@ static RPCHelpMan testmempoolaccept()
         UniValueType(), // VNUM or VSTR, checked inside AmountFromValue()
     });
 
-    if (request.params[0].get_array().size() != 1) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Array must contain exactly one raw transaction for now");
+    const UniValue& raw_transactions = request.params[0].get_array();
+    if (raw_transactions.size() < 1 || raw_transactions.size() > MAX_PACKAGE_COUNT) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Array must contain between 1 and " + ToString(MAX_PACKAGE_COUNT) + " transactions.");
+    }
+
+    const CFeeRate max_raw_tx_fee_rate_package = request.params[1].isNull() ?
+                                             DEFAULT_MAX_RAW_TX_FEE_RATE :
+                                             CFeeRate(AmountFromValue(request.params[1]));
+    if (raw_transactions.size() > 1) {
+        return TestPackageAccept(EnsureMemPool(request.context), DecodePackage(raw_transactions), max_raw_tx_fee_rate_package);
     }
 
     CMutableTransaction mtx;
@@ -932,10 +1019,7 @@ static RPCHelpMan testmempoolaccept()
     }
     CTransactionRef tx(MakeTransactionRef(std::move(mtx)));
     const uint256& tx_hash = tx->GetHash();
-
-    const CFeeRate max_raw_tx_fee_rate = request.params[1].isNull() ?
-                                             DEFAULT_MAX_RAW_TX_FEE_RATE :
-                                             CFeeRate(AmountFromValue(request.params[1]));
+    const CFeeRate& max_raw_tx_fee_rate = max_raw_tx_fee_rate_package;
 
     CTxMemPool& mempool = EnsureMemPool(request.context);
     int64_t virtual_size = GetVirtualTransactionSize(*tx);
@@ -944,6 +1028,7 @@ static RPCHelpMan testmempoolaccept()
     UniValue result(UniValue::VARR);
     UniValue result_0(UniValue::VOBJ);
     result_0.pushKV("txid", tx_hash.GetHex());
+    result_0.pushKV("wtxid", tx->GetWitnessHash().GetHex());
 
     TxValidationState state;
     bool test_accept_res;
@@ -988,6 +1073,83 @@ static RPCHelpMan testmempoolaccept()
     };
 }
 
+static RPCHelpMan submitpackage()
+{
+    return RPCHelpMan{"submitpackage",
+                "\nSubmit a package of raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nThe package is accepted to the mempool as a whole, so a child may pay for parents whose\n"
+                "feerate is too low to be accepted on their own. Transactions already in the mempool are skipped.\n",
+                {
+                    {"package", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of raw transactions, sorted so that parents come before their children.\n"
+            "                                        It may contain at most " + ToString(MAX_PACKAGE_COUNT) + " transactions.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::STR, "package-msg", "\"success\", or the reason the package was not accepted"},
+                        {RPCResult::Type::STR_AMOUNT, "package-feerate", /* optional */ true, "The feerate of the transactions evaluated together, in " + CURRENCY_UNIT + "/kB"},
+                        {RPCResult::Type::ARR, "tx-results", "The result for each transaction of the package",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "txid", "The transaction hash in hex"},
+                                {RPCResult::Type::STR_HEX, "wtxid", "The transaction witness hash in hex"},
+                                {RPCResult::Type::BOOL, "allowed", /* optional */ true, "Whether the transaction is in the mempool"},
+                                {RPCResult::Type::STR, "reject-reason", /* optional */ true, "Rejection string"},
+                            }},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("submitpackage", R"('["rawtx1", "rawtx2"]')") +
+                    HelpExampleRpc("submitpackage", R"(["rawtx1", "rawtx2"])")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    RPCTypeCheck(request.params, {UniValue::VARR});
+
+    const UniValue& raw_transactions = request.params[0].get_array();
+    if (raw_transactions.size() < 1 || raw_transactions.size() > MAX_PACKAGE_COUNT) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Array must contain between 1 and " + ToString(MAX_PACKAGE_COUNT) + " transactions.");
+    }
+    const Package package = DecodePackage(raw_transactions);
+
+    NodeContext& node = EnsureNodeContext(request.context);
+    CTxMemPool& mempool = EnsureMemPool(request.context);
+    PackageMempoolAcceptResult result;
+    {
+        LOCK(cs_main);
+        result = ProcessNewPackage(mempool, package, /* test_accept */ false);
+    }
+
+    if (node.connman) {
+        for (const CTransactionRef& tx : result.m_accepted) {
+            RelayTransaction(tx->GetHash(), tx->GetWitnessHash(), *node.connman);
+        }
+    }
+
+    UniValue rpc_result(UniValue::VOBJ);
+    rpc_result.pushKV("package-msg", result.m_state.IsValid() ? "success" : result.m_state.GetRejectReason());
+    if (result.m_package_feerate) {
+        rpc_result.pushKV("package-feerate", ValueFromAmount(result.m_package_feerate->GetFeePerK()));
+    }
+    UniValue tx_results(UniValue::VARR);
+    for (const CTransactionRef& tx : package) {
+        UniValue tx_result = PackageTxResultToJSON(tx, result, /* allowed */ false);
+        tx_result.pushKV("allowed", WITH_LOCK(mempool.cs, return mempool.exists(tx->GetHash())));
+        tx_results.push_back(std::move(tx_result));
+    }
+    rpc_result.pushKV("tx-results", std::move(tx_results));
+    return rpc_result;
+},
+    };
+}
+
 static RPCHelpMan decodepsbt()
 {
     return RPCHelpMan{"decodepsbt",
@@ -1869,6 +2031,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
     { "rawtransactions",    "testmempoolaccept",            &testmempoolaccept,         {"rawtxs","maxfeerate"} },
+    { "rawtransactions",    "submitpackage",                &submitpackage,             {"package"} },
     { "rawtransactions",    "decodepsbt",                   &decodepsbt,                {"psbt"} },
     { "rawtransactions",    "combinepsbt",                  &combinepsbt,               {"txs"} },
     { "rawtransactions",    "finalizepsbt",                 &finalizepsbt,              {"psbt", "extract"} },
@@ -70,6 +70,20 @@ public:
         return std::pair<int, int>(-1, -1);
     }
 
+    // Number of positions in the new table holding this address
+    int CountNewReferences(const CAddress& addr)
+    {
+        LOCK(cs);
+        int nId = mapAddr[addr];
+        int count = 0;
+        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; ++bucket) {
+            for (int entry = 0; entry < ADDRMAN_BUCKET_SIZE; ++entry) {
+                if (nId == vvNew[bucket][entry]) ++count;
+            }
+        }
+        return count;
+    }
+
     // Simulates connection failure so that we can test eviction of offline nodes
     void SimConnFail(CService& addr)
     {
@@ -253,7 +267,7 @@ BOOST_AUTO_TEST_CASE(addrman_select)
 
     // Test: Select pulls from new and tried regardless of port number.
     std::set<uint16_t> ports;
-    for (int i = 0; i < 20; ++i) {
+    for (int i = 0; i < 40; ++i) {
         ports.insert(addrman.Select().GetPort());
     }
     BOOST_CHECK_EQUAL(ports.size(), 3U);
@@ -782,6 +796,63 @@ BOOST_AUTO_TEST_CASE(addrman_serialization)
     BOOST_CHECK(bucketAndEntry_asmap1_deser_addr1.second != bucketAndEntry_asmap1_deser_addr2.second);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_serialization_references)
+{
+    CAddrManTest addrman;
+    CAddrManTest addrman_deser;
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+
+    // Announce an address from many groups, so that it gets several references in the new table.
+    CAddress addr = CAddress(ResolveService("250.1.1.1", 8333), NODE_NONE);
+    addr.nTime = GetAdjustedTime() - 100 * 60 * 60;
+    for (int i = 0; i < 100; ++i) {
+        addr.nTime += 60 * 60;
+        addrman.Add(addr, ResolveIP(strprintf("%i.%i.1.1", 1 + i / 8, 1 + i % 8)));
+    }
+    const int references = addrman.CountNewReferences(addr);
+    BOOST_CHECK(references > 1);
+
+    // All of them are restored.
+    stream << addrman;
+    stream >> addrman_deser;
+    BOOST_CHECK_EQUAL(addrman_deser.size(), 1U);
+    BOOST_CHECK_EQUAL(addrman_deser.CountNewReferences(addr), references);
+
+    // An entry claiming more buckets than an address can be in is rejected.
+    CDataStream corrupt(SER_DISK, CLIENT_VERSION | ADDRV2_FORMAT);
+    corrupt << uint8_t{4} << uint8_t{32 + 4} << uint256() << 1 << 0 << (ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30));
+    corrupt << CAddrInfo(addr, ResolveIP("252.2.2.2"));
+    corrupt << std::vector<int>(ADDRMAN_NEW_BUCKETS_PER_ADDRESS + 1, 0);
+    BOOST_CHECK_THROW(corrupt >> addrman_deser, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_serialization_v3)
+{
+    CAddrManTest addrman;
+    CAddress addr = CAddress(ResolveService("250.1.1.1", 8333), NODE_NONE);
+    CAddrInfo info(addr, ResolveIP("252.2.2.2"));
+
+    // A file written before the buckets were stored with each entry, listing the
+    // entry in another bucket than the one its source maps to.
+    const int bucket = (info.GetNewBucket(uint256(), std::vector<bool>()) + 1) % ADDRMAN_NEW_BUCKET_COUNT;
+    CDataStream stream(SER_DISK, CLIENT_VERSION | ADDRV2_FORMAT);
+    stream << uint8_t{3} << uint8_t{32 + 3} << uint256() << 1 << 0 << (ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30));
+    stream << info;
+    for (int b = 0; b < ADDRMAN_NEW_BUCKET_COUNT; ++b) {
+        if (b == bucket) {
+            stream << 1 << 0;
+        } else {
+            stream << 0;
+        }
+    }
+    stream << uint256();
+
+    stream >> addrman;
+    BOOST_CHECK_EQUAL(addrman.size(), 1U);
+    BOOST_CHECK_EQUAL(addrman.GetBucketAndEntry(addr).first, bucket);
+    BOOST_CHECK_EQUAL(addrman.CountNewReferences(addr), 1);
+}
+
 
 BOOST_AUTO_TEST_CASE(addrman_selecttriedcollision)
 {
@@ -0,0 +1,132 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bip324.h>
+#include <chainparams.h>
+#include <key.h>
+#include <protocol.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <string>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(bip324_tests, BasicTestingSetup)
+
+static void Handshake(BIP324Session& initiator, BIP324Session& responder)
+{
+    CKey initiator_key, responder_key;
+    initiator_key.MakeNewKey(true);
+    responder_key.MakeNewKey(true);
+    const auto& magic = Params().MessageStart();
+    BOOST_REQUIRE(BIP324Handshake(initiator_key, responder_key.GetPubKey(), /*initiator=*/true, magic, initiator));
+    BOOST_REQUIRE(BIP324Handshake(responder_key, initiator_key.GetPubKey(), /*initiator=*/false, magic, responder));
+}
+
+BOOST_AUTO_TEST_CASE(message_ids)
+{
+    BOOST_CHECK_EQUAL(GetV2MessageID(NetMsgType::ADDR), 1);
+    BOOST_CHECK_EQUAL(GetV2MessageID(NetMsgType::INV), 14);
+    BOOST_CHECK_EQUAL(GetV2MessageID(NetMsgType::ADDRV2), 28);
+    BOOST_CHECK_EQUAL(GetV2MessageID(NetMsgType::VERSION), 0);
+    BOOST_CHECK_EQUAL(GetV2MessageID(""), 0);
+
+    const std::set<std::string> unique(V2_MESSAGE_IDS.begin(), V2_MESSAGE_IDS.end());
+    BOOST_CHECK_EQUAL(unique.size(), V2_MESSAGE_IDS.size());
+    const std::vector<std::string>& all_types = getAllNetMessageTypes();
+    for (size_t id = 1; id < V2_MESSAGE_IDS.size(); ++id) {
+        BOOST_CHECK(std::find(all_types.begin(), all_types.end(), V2_MESSAGE_IDS[id]) != all_types.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(handshake)
+{
+    BIP324Session initiator, responder;
+    Handshake(initiator, responder);
+    BOOST_CHECK(initiator.session_id == responder.session_id);
+
+    // Every session has its own keys.
+    BIP324Session initiator2, responder2;
+    Handshake(initiator2, responder2);
+    BOOST_CHECK(initiator.session_id != initiator2.session_id);
+
+    // A public key that is not on the curve is refused.
+    CKey key;
+    key.MakeNewKey(true);
+    std::vector<unsigned char> bad_pubkey(CPubKey::COMPRESSED_SIZE, 0xff);
+    bad_pubkey[0] = 0x02;
+    BIP324Session session;
+    BOOST_CHECK(!BIP324Handshake(key, CPubKey(bad_pubkey.begin(), bad_pubkey.end()), /*initiator=*/true, Params().MessageStart(), session));
+}
+
+BOOST_AUTO_TEST_CASE(packets)
+{
+    BIP324Session initiator, responder;
+    Handshake(initiator, responder);
+
+    // More packets than share one keystream block for their lengths, in both directions
+    for (int i = 0; i < 3 * AAD_PACKAGES_PER_ROUND; ++i) {
+        const bool from_initiator = i % 3 != 0;
+        BIP324Cipher& sender = *(from_initiator ? initiator : responder).send_cipher;
+        BIP324Cipher& receiver = *(from_initiator ? responder : initiator).recv_cipher;
+
+        const std::vector<unsigned char> contents = g_insecure_rand_ctx.randbytes(i * 37);
+        std::vector<unsigned char> packet;
+        sender.Encrypt(contents, packet);
+        BOOST_CHECK_EQUAL(packet.size(), contents.size() + BIP324Cipher::EXPANSION);
+
+        BOOST_CHECK_EQUAL(receiver.DecryptLength(packet), contents.size());
+        BOOST_REQUIRE(receiver.Decrypt(packet));
+        BOOST_CHECK(std::equal(contents.begin(), contents.end(), packet.begin() + BIP324Cipher::LENGTH_LEN));
+    }
+
+    // A modified packet is not authentic, and leaves the receiver where it was.
+    std::vector<unsigned char> packet;
+    initiator.send_cipher->Encrypt(std::vector<unsigned char>(100, 0x42), packet);
+    std::vector<unsigned char> modified = packet;
+    modified[BIP324Cipher::LENGTH_LEN + 10] ^= 1;
+    BOOST_CHECK(!responder.recv_cipher->Decrypt(modified));
+    BOOST_CHECK(responder.recv_cipher->Decrypt(packet));
+
+    // A packet that is skipped breaks the stream.
+    packet.clear();
+    initiator.send_cipher->Encrypt(std::vector<unsigned char>(10, 1), packet);
+    packet.clear();
+    initiator.send_cipher->Encrypt(std::vector<unsigned char>(10, 2), packet);
+    BOOST_CHECK(!responder.recv_cipher->Decrypt(packet));
+}
+
+BOOST_AUTO_TEST_CASE(message_encoding)
+{
+    BIP324Session initiator, responder;
+    Handshake(initiator, responder);
+
+    const std::vector<unsigned char> payload{1, 2, 3};
+    std::vector<unsigned char> packets;
+    BOOST_CHECK(initiator.send_cipher->EncryptMessage(NetMsgType::INV, payload, packets));
+    BOOST_CHECK(initiator.send_cipher->EncryptMessage(NetMsgType::VERSION, payload, packets));
+    BOOST_CHECK_EQUAL(packets.size(), 1 + 3 + 1 + CMessageHeader::COMMAND_SIZE + 3 + 2 * BIP324Cipher::EXPANSION);
+
+    // A short ID
+    const size_t first_size = 1 + 3 + BIP324Cipher::EXPANSION;
+    std::vector<unsigned char> first(packets.begin(), packets.begin() + first_size);
+    BOOST_REQUIRE(responder.recv_cipher->Decrypt(first));
+    BOOST_CHECK_EQUAL(first[BIP324Cipher::LENGTH_LEN], GetV2MessageID(NetMsgType::INV));
+
+    // A null padded message type
+    std::vector<unsigned char> second(packets.begin() + first_size, packets.end());
+    BOOST_REQUIRE(responder.recv_cipher->Decrypt(second));
+    const unsigned char* contents = second.data() + BIP324Cipher::LENGTH_LEN;
+    BOOST_CHECK_EQUAL(contents[0], 0);
+    BOOST_CHECK_EQUAL(std::string(reinterpret_cast<const char*>(contents + 1)), NetMsgType::VERSION);
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(), contents + 1 + CMessageHeader::COMMAND_SIZE));
+
+    // Message types longer than the V1 header allows are refused.
+    BOOST_CHECK(!initiator.send_cipher->EncryptMessage("thirteenchars", payload, packets));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
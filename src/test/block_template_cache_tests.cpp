@@ -0,0 +1,124 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <miner.h>
+#include <script/interpreter.h>
+#include <txmempool.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(block_template_cache_tests, TestChain100Setup)
+
+static bool TemplateHasTx(const CBlockTemplate& block_template, const CTransactionRef& tx)
+{
+    for (const CTransactionRef& block_tx : block_template.block.vtx) {
+        if (block_tx->GetHash() == tx->GetHash()) return true;
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(block_template_cache)
+{
+    BlockTemplateCache cache(*m_node.mempool, Params());
+    RegisterValidationInterface(&cache);
+
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto spend = [&](const CTransactionRef& prev, CAmount value) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(prev->GetHash(), 0);
+        tx.vout.emplace_back(value, script_pub_key);
+        std::vector<unsigned char> sig;
+        const uint256 hash = SignatureHash(script_pub_key, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << sig;
+        return MakeTransactionRef(tx);
+    };
+    const auto to_mempool = [&](const CTransactionRef& tx) {
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(*m_node.mempool, state, tx, nullptr /* plTxnReplaced */, true /* bypass_limits */));
+    };
+    const auto get_template = [&] {
+        LOCK(cs_main);
+        std::shared_ptr<const CBlockTemplate> block_template = cache.GetBlockTemplate();
+        // The appended-to template is still a valid block
+        BlockValidationState state;
+        BOOST_CHECK(TestBlockValidity(state, Params(), block_template->block, ::ChainActive().Tip(), false, false));
+        BOOST_CHECK_EQUAL(block_template->block.vtx.size(), block_template->vTxFees.size());
+        BOOST_CHECK_EQUAL(block_template->block.vtx.size(), block_template->vTxSigOpsCost.size());
+        return block_template;
+    };
+
+    const std::shared_ptr<const CBlockTemplate> empty_template = get_template();
+    const CAmount empty_value = empty_template->block.vtx[0]->vout[0].nValue;
+
+    // Requests between two changes share the template
+    uint64_t empty_sequence;
+    BOOST_CHECK(WITH_LOCK(cs_main, return cache.GetBlockTemplate(&empty_sequence)) == empty_template);
+
+    // Transactions entering the mempool are appended, parents before children
+    const CAmount coinbase_value = m_coinbase_txns[0]->vout[0].nValue;
+    const CTransactionRef parent = spend(m_coinbase_txns[0], coinbase_value - 1000);
+    const CTransactionRef child = spend(parent, coinbase_value - 2000);
+    to_mempool(parent);
+    to_mempool(child);
+    SyncWithValidationInterfaceQueue();
+    // A waiter past its deadline for transactions is woken up by them
+    cache.WaitForUpdate(empty_template->block.hashPrevBlock, empty_sequence, std::chrono::steady_clock::now());
+    {
+        uint64_t sequence;
+        const std::shared_ptr<const CBlockTemplate> appended_template = WITH_LOCK(cs_main, return cache.GetBlockTemplate(&sequence));
+        BOOST_CHECK(appended_template != empty_template);
+        // Checking the appended-to template with TestBlockValidity did not rebuild it
+        BOOST_CHECK_EQUAL(sequence, empty_sequence + 2);
+        const std::shared_ptr<const CBlockTemplate> block_template = get_template();
+        BOOST_CHECK(block_template == appended_template);
+        BOOST_CHECK(TemplateHasTx(*block_template, parent));
+        BOOST_CHECK(TemplateHasTx(*block_template, child));
+        const CAmount fees = 2000;
+        BOOST_CHECK_EQUAL(block_template->block.vtx[0]->vout[0].nValue, empty_value + fees);
+        BOOST_CHECK_EQUAL(block_template->vTxFees[0], empty_template->vTxFees[0] - fees);
+    }
+
+    // A transaction leaving the mempool unmined forces a rebuild
+    {
+        LOCK2(cs_main, m_node.mempool->cs);
+        m_node.mempool->removeRecursive(*parent, MemPoolRemovalReason::CONFLICT);
+    }
+    SyncWithValidationInterfaceQueue();
+    {
+        const std::shared_ptr<const CBlockTemplate> block_template = get_template();
+        BOOST_CHECK(!TemplateHasTx(*block_template, parent));
+        BOOST_CHECK(!TemplateHasTx(*block_template, child));
+    }
+
+    // A new tip gets a new template, and wakes up waiters on the old one
+    const uint256 old_tip = WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash());
+    uint64_t old_sequence;
+    WITH_LOCK(cs_main, cache.GetBlockTemplate(&old_sequence));
+    CreateAndProcessBlock({}, script_pub_key);
+    SyncWithValidationInterfaceQueue();
+    cache.WaitForUpdate(old_tip, old_sequence, std::chrono::steady_clock::time_point::max());
+    {
+        const std::shared_ptr<const CBlockTemplate> block_template = get_template();
+        BOOST_CHECK(block_template->block.hashPrevBlock == WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()));
+    }
+
+    // Once interrupted, nobody waits
+    uint64_t sequence;
+    const uint256 tip = WITH_LOCK(cs_main, return cache.GetBlockTemplate(&sequence)->block.hashPrevBlock);
+    cache.Interrupt();
+    cache.WaitForUpdate(tip, sequence, std::chrono::steady_clock::time_point::max());
+
+    UnregisterValidationInterface(&cache);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdownload.h>
+#include <test/util/blockdownload.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+/** Request `count` blocks of `bytes` at `start` from a peer that answers after `latency` and then sends one block per `transfer`. */
+std::chrono::microseconds Download(BlockDownloadRate& rate, int count, size_t bytes, std::chrono::microseconds start, std::chrono::microseconds latency, std::chrono::microseconds transfer)
+{
+    std::chrono::microseconds now = start + latency;
+    for (int i = 0; i < count; ++i) {
+        rate.BlockReceived(bytes, start, now);
+        now += transfer;
+    }
+    return now;
+}
+
+/** The target is rounded up from an estimate that is not exact. */
+void CheckTarget(const BlockDownloadRate& rate, int expected)
+{
+    BOOST_CHECK_GE(rate.GetTargetInFlight(), expected);
+    BOOST_CHECK_LE(rate.GetTargetInFlight(), expected + 1);
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(blockdownload_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(target_in_flight)
+{
+    BlockDownloadRate rate;
+    BOOST_CHECK_EQUAL(rate.GetTargetInFlight(), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // 1000 byte blocks, 100ms latency, 1 MB/s: 100 blocks per round trip
+    std::chrono::microseconds now = std::chrono::seconds{1};
+    for (int i = 0; i < 20; ++i) {
+        now = Download(rate, 16, 1000, now, std::chrono::milliseconds{100}, std::chrono::milliseconds{1});
+    }
+    CheckTarget(rate, 200);
+
+    // The peer slows down to 100 kB/s.
+    for (int i = 0; i < 20; ++i) {
+        now = Download(rate, 16, 1000, now, std::chrono::milliseconds{100}, std::chrono::milliseconds{10});
+    }
+    CheckTarget(rate, 20);
+
+    // Large blocks: no fewer blocks in flight than at the start
+    for (int i = 0; i < 40; ++i) {
+        now = Download(rate, 16, 1000000, now, std::chrono::milliseconds{100}, std::chrono::seconds{1});
+    }
+    BOOST_CHECK_EQUAL(rate.GetTargetInFlight(), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // Tiny blocks on a fast link with a long round trip
+    for (int i = 0; i < 40; ++i) {
+        now = Download(rate, 16, 100, now, std::chrono::seconds{1}, std::chrono::microseconds{10});
+    }
+    BOOST_CHECK_EQUAL(rate.GetTargetInFlight(), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+BOOST_AUTO_TEST_CASE(request_batching)
+{
+    BlockDownloadRate rate;
+    BOOST_CHECK(rate.ShouldRequest(0));
+    BOOST_CHECK(rate.ShouldRequest(MIN_BLOCKS_IN_TRANSIT_PER_PEER - 2));
+    BOOST_CHECK(!rate.ShouldRequest(MIN_BLOCKS_IN_TRANSIT_PER_PEER - 1));
+    BOOST_CHECK(!rate.ShouldRequest(MIN_BLOCKS_IN_TRANSIT_PER_PEER));
+
+    std::chrono::microseconds now = std::chrono::seconds{1};
+    for (int i = 0; i < 20; ++i) {
+        now = Download(rate, 16, 1000, now, std::chrono::milliseconds{100}, std::chrono::milliseconds{1});
+    }
+    const int target = rate.GetTargetInFlight();
+    BOOST_CHECK(rate.ShouldRequest(1));
+    BOOST_CHECK(rate.ShouldRequest(target - target / 8));
+    BOOST_CHECK(!rate.ShouldRequest(target - target / 8 + 1));
+}
+
+BOOST_AUTO_TEST_CASE(download_window)
+{
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(0), MIN_BLOCK_DOWNLOAD_WINDOW);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(8 * MIN_BLOCKS_IN_TRANSIT_PER_PEER), MIN_BLOCK_DOWNLOAD_WINDOW);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(3000), 6000);
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(125 * MAX_BLOCKS_IN_TRANSIT_PER_PEER), MAX_BLOCK_DOWNLOAD_WINDOW);
+}
+
+BOOST_AUTO_TEST_CASE(simulated_ibd)
+{
+    // Small blocks from peers with a 200ms round trip: with 16 blocks in flight
+    // per peer the download is bound by round trips, not by validation.
+    BlockDownloadSimulationOptions options;
+    for (BlockDownloadSimulationPeer& peer : options.peers) peer.round_trip = std::chrono::milliseconds{200};
+    const BlockDownloadSimulationResult fixed = SimulateBlockDownload(options);
+    options.adaptive = true;
+    const BlockDownloadSimulationResult adaptive = SimulateBlockDownload(options);
+    BOOST_CHECK_LT(adaptive.duration.count(), fixed.duration.count() / 2);
+    // Validation is what bounds it now.
+    BOOST_CHECK_LT(adaptive.duration.count(), options.num_blocks * options.validation_time.count() * 11 / 10);
+    BOOST_CHECK_LT(adaptive.getdata_messages, fixed.getdata_messages / 10);
+
+    // Large blocks on slow links: bandwidth bound either way
+    options.block_bytes = 20000;
+    for (BlockDownloadSimulationPeer& peer : options.peers) peer.bytes_per_second = 200000;
+    options.num_blocks = 5000;
+    options.adaptive = false;
+    const BlockDownloadSimulationResult slow_fixed = SimulateBlockDownload(options);
+    options.adaptive = true;
+    const BlockDownloadSimulationResult slow_adaptive = SimulateBlockDownload(options);
+    BOOST_CHECK_LE(slow_adaptive.duration.count(), slow_fixed.duration.count() * 101 / 100);
+    BOOST_CHECK_EQUAL(slow_adaptive.max_in_flight, 8 * MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,219 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <fs.h>
+#include <miner.h>
+#include <pow.h>
+#include <script/script.h>
+#include <streams.h>
+#include <sync.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <uint256.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockmanager_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockmanager_block_index_chunks)
+{
+    BlockManager blockman;
+    LOCK(cs_main);
+
+    // Fill more than one chunk of block index storage
+    std::vector<CBlockIndex*> entries;
+    for (size_t i = 0; i < BLOCK_INDEX_CHUNK_SIZE + 10; ++i) {
+        entries.push_back(blockman.InsertBlockIndex(InsecureRand256()));
+    }
+    const std::set<CBlockIndex*> unique_entries(entries.begin(), entries.end());
+    BOOST_CHECK_EQUAL(unique_entries.size(), entries.size());
+    BOOST_CHECK_EQUAL(blockman.m_block_index.size(), entries.size());
+
+    // Entries did not move when later chunks were allocated
+    for (const CBlockIndex* pindex : entries) {
+        BOOST_CHECK_EQUAL(blockman.m_block_index.at(pindex->GetBlockHash()), pindex);
+        BOOST_CHECK_EQUAL(pindex->nHeight, 0);
+        BOOST_CHECK(pindex->pprev == nullptr);
+    }
+    BOOST_CHECK_EQUAL(blockman.InsertBlockIndex(entries.front()->GetBlockHash()), entries.front());
+    BOOST_CHECK(blockman.InsertBlockIndex(uint256()) == nullptr);
+
+    blockman.Unload();
+    BOOST_CHECK(blockman.m_block_index.empty());
+}
+
+BOOST_AUTO_TEST_CASE(block_index_snapshot)
+{
+    CBlockTreeDB blocktree(1 << 20, /* fMemory */ true);
+    const fs::path path = GetDataDir() / "index_snapshot.dat";
+
+    std::vector<uint256> hashes(200);
+    std::vector<CBlockIndex> chain(hashes.size());
+    std::vector<const CBlockIndex*> entries;
+    for (size_t i = 0; i < chain.size(); ++i) {
+        hashes[i] = InsecureRand256();
+        CBlockIndex& index = chain[i];
+        index.phashBlock = &hashes[i];
+        index.pprev = i > 0 ? &chain[i - 1] : nullptr;
+        index.nHeight = i;
+        index.nTime = 1600000000 + 10 * i;
+        index.nBits = 0x207fffff;
+        index.nNonce = InsecureRand32();
+        index.nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO;
+        index.nDataPos = 1000 * i;
+        index.nUndoPos = 100 * i;
+        index.nTx = 1 + InsecureRandRange(10);
+        entries.push_back(&index);
+    }
+    BOOST_REQUIRE(blocktree.WriteBatchSync({}, 0, entries));
+
+    using LoadedIndex = std::map<uint256, std::unique_ptr<CBlockIndex>>;
+    const uint256 best_block = hashes.back();
+    const auto load = [&](LoadedIndex& index, const uint256& chainstate_best_block) {
+        return blocktree.LoadBlockIndexSnapshot(path, chainstate_best_block, [&](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull()) return nullptr;
+            auto it = index.emplace(hash, nullptr).first;
+            if (!it->second) {
+                it->second = MakeUnique<CBlockIndex>();
+                it->second->phashBlock = &it->first;
+            }
+            return it->second.get();
+        });
+    };
+
+    // Nothing is loaded without a snapshot
+    LoadedIndex loaded;
+    BOOST_CHECK(!load(loaded, best_block));
+    BOOST_CHECK(loaded.empty());
+
+    BOOST_REQUIRE(blocktree.WriteBlockIndexSnapshot(path, best_block, entries));
+    BOOST_REQUIRE(load(loaded, best_block));
+    BOOST_REQUIRE_EQUAL(loaded.size(), chain.size());
+    for (const CBlockIndex& expected : chain) {
+        const CBlockIndex& actual = *loaded.at(expected.GetBlockHash());
+        BOOST_CHECK_EQUAL(actual.nHeight, expected.nHeight);
+        BOOST_CHECK_EQUAL(actual.nStatus, expected.nStatus);
+        BOOST_CHECK_EQUAL(actual.nDataPos, expected.nDataPos);
+        BOOST_CHECK_EQUAL(actual.nUndoPos, expected.nUndoPos);
+        BOOST_CHECK_EQUAL(actual.nTx, expected.nTx);
+        BOOST_CHECK_EQUAL(actual.nNonce, expected.nNonce);
+        BOOST_CHECK_EQUAL(actual.GetBlockTime(), expected.GetBlockTime());
+        if (expected.pprev) {
+            BOOST_CHECK_EQUAL(actual.pprev->GetBlockHash(), expected.pprev->GetBlockHash());
+        } else {
+            BOOST_CHECK(actual.pprev == nullptr);
+        }
+    }
+
+    // A chainstate database at another block, or changed block file
+    // information, invalidates the snapshot
+    LoadedIndex reloaded;
+    BOOST_CHECK(!load(reloaded, hashes.front()));
+    BOOST_CHECK(reloaded.empty());
+    CBlockFileInfo info;
+    info.AddBlock(0, 0);
+    BOOST_REQUIRE(blocktree.WriteBatchSync({{0, &info}}, 0, {}));
+    BOOST_CHECK(!load(reloaded, best_block));
+    BOOST_CHECK(reloaded.empty());
+    BOOST_REQUIRE(blocktree.WriteBlockIndexSnapshot(path, best_block, entries));
+    BOOST_CHECK(load(reloaded, best_block));
+    reloaded.clear();
+
+    // Writing block index entries to the database invalidates the snapshot
+    BOOST_REQUIRE(blocktree.WriteBatchSync({}, 0, {entries.back()}));
+    BOOST_CHECK(!load(reloaded, best_block));
+    BOOST_CHECK(reloaded.empty());
+
+    // A truncated snapshot is rejected
+    BOOST_REQUIRE(blocktree.WriteBlockIndexSnapshot(path, best_block, entries));
+    fs::resize_file(path, fs::file_size(path) - 1);
+    BOOST_CHECK(!load(reloaded, best_block));
+    BOOST_CHECK(reloaded.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfile_writer_read_after_write, TestChain100Setup)
+{
+    // TestingSetup runs the block file writer, so block and undo data of new
+    // blocks may still be queued when they are read back.
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 5; ++i) {
+        const CBlock block = CreateAndProcessBlock({}, script_pub_key);
+        const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+        BOOST_CHECK_EQUAL(tip->GetBlockHash(), block.GetHash());
+
+        CBlock block_read;
+        BOOST_CHECK(ReadBlockFromDisk(block_read, tip, Params().GetConsensus()));
+        BOOST_CHECK_EQUAL(block_read.GetHash(), block.GetHash());
+
+        std::vector<uint8_t> raw_block;
+        BOOST_CHECK(ReadRawBlockFromDisk(raw_block, tip, Params().MessageStart()));
+        BOOST_CHECK_EQUAL(raw_block.size(), ::GetSerializeSize(block, PROTOCOL_VERSION));
+
+        CBlockUndo undo;
+        BOOST_CHECK(WITH_LOCK(cs_main, return UndoReadFromDisk(undo, tip)));
+        BOOST_CHECK_EQUAL(undo.vtxundo.size(), block.vtx.size() - 1);
+    }
+
+    // Records written directly after the writer thread stopped are readable too
+    StopBlockFileWriter();
+    const CBlock block = CreateAndProcessBlock({}, script_pub_key);
+    CBlock block_read;
+    BOOST_CHECK(ReadBlockFromDisk(block_read, WITH_LOCK(cs_main, return ::ChainActive().Tip()), Params().GetConsensus()));
+    BOOST_CHECK_EQUAL(block_read.GetHash(), block.GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfile_writer_flush_earlier_file, TestChain100Setup)
+{
+    // Connect a block stored in an earlier file than the last block file, as
+    // when the tip lags behind the incoming blocks, so its undo data is queued
+    // for a file that FlushBlockFile() does not wait for.
+    const CChainParams& chainparams = Params();
+    const auto create_block = [&](const CScript& script_pub_key) {
+        CTxMemPool empty_pool;
+        CBlock block = BlockAssembler(empty_pool, chainparams).CreateNewBlock(script_pub_key)->block;
+        RegenerateCommitments(block);
+        while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+        return std::make_shared<const CBlock>(block);
+    };
+    const auto block = create_block(CScript() << OP_TRUE);
+    const auto sibling = create_block(CScript() << OP_FALSE);
+
+    CBlockIndex* pindex = nullptr;
+    {
+        LOCK(cs_main);
+        BlockValidationState state;
+        BOOST_REQUIRE(::ChainstateActive().AcceptBlock(block, state, chainparams, &pindex, true, nullptr, nullptr));
+        // The sibling is never connected, so its data need not be in the file
+        const FlatFilePos sibling_pos(pindex->nFile + 1, 0);
+        BOOST_REQUIRE(::ChainstateActive().AcceptBlock(sibling, state, chainparams, nullptr, true, &sibling_pos, nullptr));
+    }
+
+    BlockValidationState state;
+    BOOST_REQUIRE(::ChainstateActive().ActivateBestChain(state, chainparams, block));
+    BOOST_REQUIRE_EQUAL(WITH_LOCK(cs_main, return ::ChainActive().Tip()), pindex);
+    WITH_LOCK(cs_main, ::ChainstateActive().ForceFlushStateToDisk());
+
+    // The undo data was written before the block index that refers to it
+    const FlatFilePos undo_pos = WITH_LOCK(cs_main, return pindex->GetUndoPos());
+    CAutoFile file(fsbridge::fopen(GetBlocksDir() / strprintf("rev%05u.dat", undo_pos.nFile), "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    BOOST_REQUIRE_EQUAL(fseek(file.Get(), undo_pos.nPos - 4, SEEK_SET), 0);
+    unsigned int undo_size = 0;
+    file >> undo_size;
+    BOOST_CHECK(undo_size > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,76 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockencodings.h>
+#include <consensus/validation.h>
+#include <streams.h>
+#include <txmempool.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cmpctblock_prefill_tests, RegTestingSetup)
+
+static CBlock BuildBlockTestCase(size_t num_txs, bool hogex)
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    for (size_t i = 0; i < num_txs; i++) {
+        tx.vin[0].prevout.hash = InsecureRand256();
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    if (hogex) {
+        tx.m_hogEx = true;
+        tx.vin[0].prevout.hash = InsecureRand256();
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.hashPrevBlock = InsecureRand256();
+    return block;
+}
+
+static bool CheckBlockMock(const CBlock&, BlockValidationState&, const Consensus::Params&, bool, bool)
+{
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(cmpctblock_prefill)
+{
+    for (const bool hogex : {false, true}) {
+        const CBlock block = BuildBlockTestCase(6, hogex);
+        const std::set<uint256> prefill{block.vtx[2]->GetHash(), block.vtx[3]->GetHash(), block.vtx[6]->GetHash()};
+        const CBlockHeaderAndShortTxIDs cmpctblock(block, true, [&](const CTransaction& tx) { return prefill.count(tx.GetHash()) > 0; });
+        BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << cmpctblock;
+        CBlockHeaderAndShortTxIDs cmpctblock2;
+        stream >> cmpctblock2;
+
+        // With an empty mempool, exactly the prefilled transactions are available
+        CTxMemPool pool;
+        PartiallyDownloadedBlock partial_block(&pool, MWEB::Block());
+        partial_block.m_check_block_mock = CheckBlockMock;
+        BOOST_CHECK(partial_block.InitData(cmpctblock2, {}) == READ_STATUS_OK);
+        std::vector<CTransactionRef> missing;
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const bool prefilled = i == 0 || prefill.count(block.vtx[i]->GetHash()) || block.vtx[i]->IsHogEx();
+            BOOST_CHECK_EQUAL(partial_block.IsTxAvailable(i), prefilled);
+            if (!prefilled) missing.push_back(block.vtx[i]);
+        }
+
+        CBlock block2;
+        BOOST_CHECK(partial_block.FillBlock(block2, missing) == READ_STATUS_OK);
+        BOOST_REQUIRE_EQUAL(block2.vtx.size(), block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            BOOST_CHECK(block2.vtx[i]->GetWitnessHash() == block.vtx[i]->GetWitnessHash());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
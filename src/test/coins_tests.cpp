@@ -568,6 +568,55 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     }
 }
 
+BOOST_AUTO_TEST_CASE(block_undo_columnar_serialization)
+{
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(20);
+    for (CTxUndo& txundo : blockundo.vtxundo) {
+        txundo.vprevout.resize(1 + InsecureRandRange(4));
+        for (Coin& coin : txundo.vprevout) {
+            // Mostly recent coins, with the occasional old one to exercise negative deltas
+            coin.nHeight = InsecureRandBool() ? 500000 - InsecureRandRange(100) : InsecureRandRange(500000);
+            coin.fCoinBase = InsecureRandBool();
+            coin.out.nValue = InsecureRandRange(MAX_MONEY);
+            coin.out.scriptPubKey = GetScriptForDestination(WitnessV0KeyHash(uint160(g_insecure_rand_ctx.randbytes(20))));
+        }
+    }
+    blockundo.vtxundo.front().vprevout.front().nHeight = 0;
+    blockundo.vtxundo.back().vprevout.back().nHeight = std::numeric_limits<int32_t>::max();
+
+    CDataStream legacy(SER_DISK, CLIENT_VERSION);
+    legacy << blockundo;
+    CDataStream columnar(SER_DISK, CLIENT_VERSION);
+    columnar << Using<BlockUndoColumnarFormatter>(blockundo);
+    BOOST_CHECK_LT(columnar.size(), legacy.size());
+    BOOST_CHECK_EQUAL(columnar.size(), GetSerializeSize(Using<BlockUndoColumnarFormatter>(blockundo), CLIENT_VERSION));
+
+    CBlockUndo read;
+    columnar >> Using<BlockUndoColumnarFormatter>(read);
+    BOOST_CHECK(columnar.empty());
+    BOOST_CHECK(read.mwundo == nullptr);
+    BOOST_REQUIRE_EQUAL(read.vtxundo.size(), blockundo.vtxundo.size());
+    for (size_t i = 0; i < blockundo.vtxundo.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(read.vtxundo[i].vprevout.size(), blockundo.vtxundo[i].vprevout.size());
+        for (size_t j = 0; j < blockundo.vtxundo[i].vprevout.size(); ++j) {
+            const Coin& expected = blockundo.vtxundo[i].vprevout[j];
+            const Coin& actual = read.vtxundo[i].vprevout[j];
+            BOOST_CHECK_EQUAL(actual.nHeight, expected.nHeight);
+            BOOST_CHECK_EQUAL(actual.fCoinBase, expected.fCoinBase);
+            BOOST_CHECK(actual.out == expected.out);
+        }
+    }
+
+    // A height delta which leaves the valid range is rejected
+    CDataStream bad(SER_DISK, CLIENT_VERSION);
+    WriteCompactSize(bad, 1);
+    WriteCompactSize(bad, 1);
+    bad << VARINT(BlockUndoColumnarFormatter::ZigZagEncode(-1) * 2);
+    CBlockUndo bad_read;
+    BOOST_CHECK_THROW(bad >> Using<BlockUndoColumnarFormatter>(bad_read), std::ios_base::failure);
+}
+
 const static COutPoint OUTPOINT;
 const static CAmount SPENT = -1;
 const static CAmount ABSENT = -2;
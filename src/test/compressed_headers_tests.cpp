@@ -0,0 +1,110 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockencodings.h>
+#include <streams.h>
+#include <version.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(compressed_headers_tests, BasicTestingSetup)
+
+static std::vector<CBlockHeader> BuildHeaderChain(size_t count)
+{
+    std::vector<CBlockHeader> headers(count);
+    for (size_t i = 0; i < count; ++i) {
+        CBlockHeader& header = headers[i];
+        header.nVersion = i < count / 2 ? 0x20000000 : 0x20000004;
+        header.hashPrevBlock = i == 0 ? InsecureRand256() : headers[i - 1].GetHash();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1600000000 + 10 * i;
+        header.nBits = i < count / 4 ? 0x1e0ffff0 : 0x1e0fff00;
+        header.nNonce = InsecureRand32();
+    }
+    return headers;
+}
+
+static std::vector<unsigned char> SerializeCompressed(const std::vector<CBlockHeader>& headers)
+{
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0) << Using<VectorFormatter<CompressedHeaderFormatter>>(headers);
+    return data;
+}
+
+static std::vector<CBlockHeader> DeserializeCompressed(const std::vector<unsigned char>& data)
+{
+    std::vector<CBlockHeader> headers;
+    CDataStream stream(data, SER_NETWORK, PROTOCOL_VERSION);
+    stream >> Using<VectorFormatter<CompressedHeaderFormatter>>(headers);
+    return headers;
+}
+
+static bool HeadersEqual(const std::vector<CBlockHeader>& a, const std::vector<CBlockHeader>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].GetHash() != b[i].GetHash()) return false;
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(roundtrip)
+{
+    std::vector<CBlockHeader> headers = BuildHeaderChain(2000);
+    std::vector<unsigned char> data = SerializeCompressed(headers);
+    BOOST_CHECK(HeadersEqual(DeserializeCompressed(data), headers));
+    // A full first header, two new versions, a change of bits; 39 bytes for all other headers
+    // instead of 81 in a headers message.
+    BOOST_CHECK_EQUAL(data.size(), 3 + 81 + 1999 * 39 + 4 + 4);
+
+    // Timestamps that go backwards, or jump further than a 2 byte difference reaches
+    headers[10].nTime = headers[9].nTime - 3000;
+    headers[11].nTime = headers[10].nTime + 100000;
+    headers[12].nTime = headers[11].nTime - 40000;
+    // More versions than are remembered, and ones seen before
+    for (size_t i = 20; i < 40; ++i) {
+        headers[i].nVersion = 0x20000000 + (i % 9);
+    }
+    // A header that does not build on the previous one
+    headers[50].hashPrevBlock = InsecureRand256();
+    for (size_t i = 1; i < headers.size(); ++i) {
+        if (i != 50) headers[i].hashPrevBlock = headers[i - 1].GetHash();
+    }
+    BOOST_CHECK(HeadersEqual(DeserializeCompressed(SerializeCompressed(headers)), headers));
+
+    BOOST_CHECK(DeserializeCompressed(SerializeCompressed({})).empty());
+}
+
+BOOST_AUTO_TEST_CASE(invalid)
+{
+    const std::vector<unsigned char> data = SerializeCompressed(BuildHeaderChain(10));
+    BOOST_REQUIRE_EQUAL(data[1], 0x38); // flags of the first header: everything included
+
+    // The first header must be complete.
+    for (uint8_t flags : {0x30, 0x28, 0x18, 0x39}) {
+        std::vector<unsigned char> invalid = data;
+        invalid[1] = flags;
+        BOOST_CHECK_THROW(DeserializeCompressed(invalid), std::ios_base::failure);
+    }
+
+    // Unknown flags
+    std::vector<unsigned char> invalid = data;
+    invalid[1] |= 0x40;
+    BOOST_CHECK_THROW(DeserializeCompressed(invalid), std::ios_base::failure);
+
+    // The second header refers to the only version seen so far; 2 is beyond that.
+    invalid = data;
+    BOOST_REQUIRE_EQUAL(invalid[1 + 81] & 0x07, 1);
+    invalid[1 + 81] = (invalid[1 + 81] & ~0x07) | 2;
+    BOOST_CHECK_THROW(DeserializeCompressed(invalid), std::ios_base::failure);
+
+    // Truncated
+    invalid = data;
+    invalid.pop_back();
+    BOOST_CHECK_THROW(DeserializeCompressed(invalid), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
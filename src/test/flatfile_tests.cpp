@@ -123,4 +123,47 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1U);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_map)
+{
+    const auto data_dir = GetDataDir();
+    FlatFileSeq seq(data_dir, "a", 100);
+
+    // Missing files cannot be mapped
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0)));
+    BOOST_CHECK(!seq.Map(FlatFilePos()));
+
+    const std::string line1("A purely peer-to-peer version of electronic cash would allow online "
+                            "payments to be sent directly from one party to another without going "
+                            "through a financial institution.");
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line1, 256);
+    }
+
+    std::shared_ptr<const FlatFileMapping> mapping = seq.Map(FlatFilePos(0, 0));
+#if defined(WIN32)
+    BOOST_CHECK(!mapping);
+#else
+    if (sizeof(void*) < 8) {
+        BOOST_CHECK(!mapping);
+        return;
+    }
+    BOOST_REQUIRE(mapping);
+    BOOST_CHECK_EQUAL(mapping->size(), fs::file_size(seq.FileName(FlatFilePos(0, 0))));
+
+    std::string read_line;
+    VectorReader(SER_DISK, CLIENT_VERSION, std::vector<unsigned char>(mapping->data(), mapping->data() + mapping->size()), 0, LIMITED_STRING(read_line, 256));
+    BOOST_CHECK_EQUAL(read_line, line1);
+
+    // Data appended later is only covered by a new mapping
+    const size_t old_size = mapping->size();
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, old_size)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line1, 256);
+    }
+    BOOST_CHECK_EQUAL(mapping->size(), old_size);
+    BOOST_CHECK_EQUAL(seq.Map(FlatFilePos(0, 0))->size(), 2 * old_size);
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <headerscache.h>
+#include <protocol.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+CSharedNetMsg MakeResponse(size_t bytes)
+{
+    return CSharedNetMsg(NetMsgType::HEADERS, std::make_shared<const std::vector<unsigned char>>(bytes));
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(headerscache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(get_add)
+{
+    HeadersCache cache;
+    const HeadersCacheKey key{false, 1, InsecureRand256()};
+    BOOST_CHECK(!cache.Get(key));
+
+    const CSharedNetMsg msg = MakeResponse(100);
+    cache.Add(key, 2000, msg);
+    const Optional<CSharedNetMsg> cached = cache.Get(key);
+    BOOST_REQUIRE(cached);
+    // The payload is shared, not copied.
+    BOOST_CHECK(cached->data == msg.data);
+    BOOST_CHECK(cached->m_hash == msg.m_hash);
+
+    // Any part of the key not matching is another response.
+    BOOST_CHECK(!cache.Get(HeadersCacheKey{true, 1, key.last_hash}));
+    BOOST_CHECK(!cache.Get(HeadersCacheKey{false, 2, key.last_hash}));
+    BOOST_CHECK(!cache.Get(HeadersCacheKey{false, 1, InsecureRand256()}));
+
+    // Adding a response twice keeps the first.
+    cache.Add(key, 2000, MakeResponse(100));
+    BOOST_CHECK_EQUAL(cache.Count(), 1U);
+    BOOST_CHECK(cache.Get(key)->data == msg.data);
+}
+
+BOOST_AUTO_TEST_CASE(eviction)
+{
+    HeadersCache cache(1000);
+    std::vector<HeadersCacheKey> keys;
+    for (int i = 0; i < 4; ++i) {
+        keys.push_back(HeadersCacheKey{false, 1 + 2000 * i, InsecureRand256()});
+        cache.Add(keys.back(), 2000 * (i + 1), MakeResponse(300));
+    }
+    BOOST_CHECK_EQUAL(cache.Count(), 3U);
+    BOOST_CHECK_EQUAL(cache.Bytes(), 900U);
+    BOOST_CHECK(!cache.Get(keys[0]));
+
+    // Using an entry makes it the last to be evicted.
+    BOOST_CHECK(cache.Get(keys[1]));
+    cache.Add(HeadersCacheKey{false, 8001, InsecureRand256()}, 10000, MakeResponse(300));
+    BOOST_CHECK(cache.Get(keys[1]));
+    BOOST_CHECK(!cache.Get(keys[2]));
+    BOOST_CHECK(cache.Get(keys[3]));
+
+    // A response larger than the whole cache is not cached.
+    const HeadersCacheKey large{true, 1, InsecureRand256()};
+    cache.Add(large, 8000, MakeResponse(1001));
+    BOOST_CHECK(!cache.Get(large));
+    BOOST_CHECK_EQUAL(cache.Count(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(block_disconnected)
+{
+    HeadersCache cache;
+    std::vector<HeadersCacheKey> keys;
+    for (int i = 0; i < 3; ++i) {
+        keys.push_back(HeadersCacheKey{false, 1 + 2000 * i, InsecureRand256()});
+        cache.Add(keys.back(), 2000 * (i + 1), MakeResponse(100));
+    }
+    keys.push_back(HeadersCacheKey{true, 1, InsecureRand256()});
+    cache.Add(keys.back(), 8000, MakeResponse(100));
+
+    // Responses ending below the disconnected block stay valid.
+    cache.BlockDisconnected(4000);
+    BOOST_CHECK(cache.Get(keys[0]));
+    BOOST_CHECK(!cache.Get(keys[1]));
+    BOOST_CHECK(!cache.Get(keys[2]));
+    BOOST_CHECK(!cache.Get(keys[3]));
+    BOOST_CHECK_EQUAL(cache.Count(), 1U);
+    BOOST_CHECK_EQUAL(cache.Bytes(), 100U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
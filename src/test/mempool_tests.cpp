@@ -7,8 +7,10 @@
 #include <txmempool.h>
 #include <util/system.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <test/util/setup_common.h>
+#include <test_framework/models/Tx.h>
 
 #include <boost/test/unit_test.hpp>
 #include <vector>
@@ -593,6 +595,118 @@ inline CTransactionRef make_tx(std::vector<CAmount>&& output_values, std::vector
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolClusterTest)
+{
+    CTxMemPool pool;
+    pool.SetClusterMode(true, DEFAULT_CLUSTER_LIMIT);
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    const auto make_tx = [](const std::vector<COutPoint>& prevouts, opcodetype op) {
+        CMutableTransaction tx;
+        for (const COutPoint& prevout : prevouts) {
+            tx.vin.emplace_back(prevout);
+            tx.vin.back().scriptSig = CScript() << op;
+        }
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << op << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        return tx;
+    };
+
+    /* On its own */
+    const CMutableTransaction tx1 = make_tx({}, OP_1);
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx1));
+    /* Free parent with a child paying for both (CPFP) */
+    const CMutableTransaction tx2 = make_tx({}, OP_2);
+    pool.addUnchecked(entry.Fee(0LL).FromTx(tx2));
+    const CMutableTransaction tx3 = make_tx({COutPoint(tx2.GetHash(), 0)}, OP_3);
+    pool.addUnchecked(entry.Fee(100000LL).FromTx(tx3));
+    /* Parent with a free child, paying a lower feerate than the CPFP package */
+    const CMutableTransaction tx4 = make_tx({}, OP_4);
+    pool.addUnchecked(entry.Fee(20000LL).FromTx(tx4));
+    const CMutableTransaction tx5 = make_tx({COutPoint(tx4.GetHash(), 0)}, OP_5);
+    pool.addUnchecked(entry.Fee(0LL).FromTx(tx5));
+    /* Same fee as tx1, but the MWEB weight counts towards its size */
+    CMutableTransaction tx6 = make_tx({}, OP_6);
+    tx6.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(COIN, 100).GetTransaction());
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx6));
+
+    BOOST_CHECK_EQUAL(pool.CalculateCluster({pool.mapTx.find(tx3.GetHash())}).size(), 2U);
+    BOOST_CHECK_EQUAL(pool.CalculateCluster({pool.mapTx.find(tx1.GetHash()), pool.mapTx.find(tx5.GetHash())}).size(), 3U);
+    // Gives up once the limit is exceeded
+    BOOST_CHECK_EQUAL(pool.CalculateCluster({pool.mapTx.find(tx4.GetHash())}, 0).size(), 1U);
+
+    const std::vector<CTxMemPool::Chunk> chunks = pool.GetChunks();
+    std::vector<std::vector<uint256>> chunk_txids;
+    for (const CTxMemPool::Chunk& chunk : chunks) {
+        chunk_txids.emplace_back();
+        for (CTxMemPool::txiter it : chunk.txs) {
+            chunk_txids.back().push_back(it->GetTx().GetHash());
+        }
+    }
+    const std::vector<std::vector<uint256>> expected{
+        {tx2.GetHash(), tx3.GetHash()},
+        {tx4.GetHash()},
+        {tx1.GetHash()},
+        {tx6.GetHash()},
+        {tx5.GetHash()},
+    };
+    BOOST_CHECK(chunk_txids == expected);
+    BOOST_CHECK_EQUAL(chunks[0].fee, 100000);
+    BOOST_CHECK_EQUAL(chunks[0].size, GetVirtualTransactionSize(CTransaction(tx2)) + GetVirtualTransactionSize(CTransaction(tx3)));
+    BOOST_CHECK_EQUAL(chunks[1].cluster, chunks[4].cluster);
+    BOOST_CHECK(chunks[0].cluster != chunks[1].cluster);
+    BOOST_CHECK(chunks[3].mweb_weight > 0);
+
+    BOOST_CHECK_EQUAL(pool.GetChunk(pool.mapTx.find(tx2.GetHash())).fee, 100000);
+    BOOST_CHECK_EQUAL(pool.GetChunk(pool.mapTx.find(tx5.GetHash())).txs.size(), 1U);
+
+    // Eviction starts at the worst chunk, even though it has an ancestor left
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(tx5.GetHash()));
+    BOOST_CHECK(pool.exists(tx4.GetHash()));
+    BOOST_CHECK(pool.exists(tx6.GetHash()));
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(tx6.GetHash()));
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 4U);
+
+    // The cached chunks of a cluster are recomputed once it changes
+    BOOST_CHECK_EQUAL(pool.GetChunk(pool.mapTx.find(tx2.GetHash())).fee, 100000);
+    pool.PrioritiseTransaction(tx3.GetHash(), 5000);
+    BOOST_CHECK_EQUAL(pool.GetChunk(pool.mapTx.find(tx2.GetHash())).fee, 105000);
+    const CMutableTransaction tx7 = make_tx({COutPoint(tx3.GetHash(), 0)}, OP_7);
+    pool.addUnchecked(entry.Fee(200000LL).FromTx(tx7));
+    BOOST_CHECK_EQUAL(pool.GetChunk(pool.mapTx.find(tx2.GetHash())).txs.size(), 3U);
+    BOOST_CHECK_EQUAL(pool.GetChunks().size(), 3U);
+
+    // Clusters above the limit, which can be re-added from disconnected
+    // blocks, are ordered by ancestor score instead of being linearized:
+    // tx9 has a better ancestor score than tx10, but tx10 and its ancestors
+    // have the best feerate together.
+    CTxMemPool large_pool;
+    large_pool.SetClusterMode(true, 2);
+    LOCK(large_pool.cs);
+    CMutableTransaction tx8 = make_tx({}, OP_8);
+    tx8.vout.push_back(tx8.vout[0]);
+    large_pool.addUnchecked(entry.Fee(0LL).FromTx(tx8));
+    const CMutableTransaction tx9 = make_tx({COutPoint(tx8.GetHash(), 0)}, OP_9);
+    large_pool.addUnchecked(entry.Fee(50000LL).FromTx(tx9));
+    const CMutableTransaction tx10_parent = make_tx({COutPoint(tx8.GetHash(), 1)}, OP_10);
+    large_pool.addUnchecked(entry.Fee(1000LL).FromTx(tx10_parent));
+    const CMutableTransaction tx10 = make_tx({COutPoint(tx10_parent.GetHash(), 0)}, OP_11);
+    large_pool.addUnchecked(entry.Fee(100000LL).FromTx(tx10));
+    const std::vector<CTxMemPool::Chunk> large_chunks = large_pool.GetChunks();
+    BOOST_REQUIRE_EQUAL(large_chunks.size(), 1U);
+    std::vector<uint256> large_txids;
+    for (CTxMemPool::txiter it : large_chunks[0].txs) {
+        large_txids.push_back(it->GetTx().GetHash());
+    }
+    BOOST_CHECK(large_txids == std::vector<uint256>({tx8.GetHash(), tx9.GetHash(), tx10_parent.GetHash(), tx10.GetHash()}));
+    BOOST_CHECK_EQUAL(large_chunks[0].fee, 151000);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
 {
     size_t ancestors, descendants;
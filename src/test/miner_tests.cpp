@@ -515,4 +515,36 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(knapsack_selection)
+{
+    const auto make_item = [](CAmount fee, uint64_t weight, uint64_t mweb_weight, size_t cluster) {
+        SelectionItem item;
+        item.fee = fee;
+        item.weight = weight;
+        item.mweb_weight = mweb_weight;
+        item.cluster = cluster;
+        return item;
+    };
+    SelectionLimits limits;
+    limits.weight = 1000;
+    limits.mweb_weight = 100;
+    limits.sigops = 1000;
+
+    // The item paying the most per weight takes up the whole MWEB block, and
+    // leaves no room for the two that together pay more
+    const std::vector<SelectionItem> items{make_item(100, 100, 100, 0), make_item(60, 100, 60, 1), make_item(60, 100, 40, 2)};
+    BOOST_CHECK(SelectItemsGreedy(items, limits) == std::vector<size_t>({0}));
+    BOOST_CHECK(SelectItemsKnapsack(items, limits, std::chrono::seconds{10}) == std::vector<size_t>({1, 2}));
+    // Out of time, it is no worse than the greedy selection
+    BOOST_CHECK(SelectItemsKnapsack(items, limits, std::chrono::microseconds{0}) == std::vector<size_t>({0}));
+
+    // Later items of a cluster are only selected along with the earlier ones
+    const std::vector<SelectionItem> chain{make_item(1, 10, 0, 7), make_item(500, 10, 0, 7), make_item(20, 10, 0, 8)};
+    BOOST_CHECK(SelectItemsGreedy(chain, limits) == std::vector<size_t>({0, 1, 2}));
+    BOOST_CHECK(SelectItemsKnapsack(chain, limits, std::chrono::seconds{10}) == std::vector<size_t>({0, 1, 2}));
+    const std::vector<SelectionItem> too_large{make_item(1, 2000, 0, 7), make_item(500, 10, 0, 7), make_item(20, 10, 0, 8)};
+    BOOST_CHECK(SelectItemsGreedy(too_large, limits) == std::vector<size_t>({2}));
+    BOOST_CHECK(SelectItemsKnapsack(too_large, limits, std::chrono::seconds{10}) == std::vector<size_t>({2}));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,239 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockencodings.h>
+#include <consensus/validation.h>
+#include <streams.h>
+#include <txmempool.h>
+
+#include <mw/consensus/Aggregation.h>
+#include <mw/mmr/MMR.h>
+#include <test_framework/models/Tx.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+static const std::vector<std::pair<uint256, CTransactionRef>> no_extra_txn;
+
+CTransactionRef MakeMWEBTx(const test::Tx& mweb_tx)
+{
+    CMutableTransaction tx;
+    tx.mweb_tx = MWEB::Tx(mweb_tx.GetTransaction());
+    return MakeTransactionRef(tx);
+}
+
+/** Build a block whose MWEB body aggregates the given MWEB transactions. */
+CBlock BuildMWEBBlock(const std::vector<test::Tx>& mweb_txs)
+{
+    std::vector<mw::Transaction::CPtr> transactions;
+    for (const test::Tx& mweb_tx : mweb_txs) {
+        transactions.push_back(mweb_tx.GetTransaction());
+    }
+    mw::Transaction::CPtr aggregate = Aggregation::Aggregate(transactions);
+
+    MemMMR kernel_mmr;
+    for (const Kernel& kernel : aggregate->GetKernels()) {
+        kernel_mmr.Add(kernel);
+    }
+    mw::Header::CPtr mweb_header = std::make_shared<mw::Header>(
+        100,
+        mw::Hash::FromHex(InsecureRand256().GetHex()),
+        kernel_mmr.Root(),
+        mw::Hash::FromHex(InsecureRand256().GetHex()),
+        BlindingFactor(aggregate->GetKernelOffset()),
+        BlindingFactor(aggregate->GetStealthOffset()),
+        aggregate->GetOutputs().size(),
+        aggregate->GetKernels().size());
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 42;
+    CMutableTransaction hogex;
+    hogex.m_hogEx = true;
+    hogex.vin.resize(1);
+    hogex.vin[0].prevout.hash = InsecureRand256();
+    hogex.vout.resize(1);
+    block.vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(hogex)};
+    block.hashPrevBlock = InsecureRand256();
+    block.mweb_block = MWEB::Block(std::make_shared<mw::Block>(mweb_header, aggregate->GetBody()));
+    return block;
+}
+
+CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_MWEB_SHORT_IDS);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblock2;
+    stream >> cmpctblock2;
+    return cmpctblock2;
+}
+
+/** Answer a getblocktxn request for the MWEB pieces of block, as the sending peer would. */
+TxBody GetMWEBPieces(const CBlock& block, const BlockTransactionsRequest& req)
+{
+    const mw::Block::CPtr& mw_block = block.mweb_block.m_block;
+    std::vector<Input> inputs;
+    std::vector<Output> outputs;
+    std::vector<Kernel> kernels;
+    for (const uint32_t index : req.mweb_input_indexes) inputs.push_back(mw_block->GetInputs()[index]);
+    for (const uint32_t index : req.mweb_output_indexes) outputs.push_back(mw_block->GetOutputs()[index]);
+    for (const uint32_t index : req.mweb_kernel_indexes) kernels.push_back(mw_block->GetKernels()[index]);
+    return TxBody(inputs, outputs, kernels);
+}
+
+bool CheckBlockMock(const CBlock&, BlockValidationState&, const Consensus::Params&, bool, bool)
+{
+    return true;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(mweb_cmpctblock_tests, RegTestingSetup)
+
+BOOST_AUTO_TEST_CASE(mweb_short_ids_serialization)
+{
+    const CBlock block = BuildMWEBBlock({test::Tx::CreatePegIn(1000), test::Tx::CreatePegIn(2000)});
+    const CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    BOOST_CHECK_EQUAL(cmpctblock.mweb_short_ids.output_ids.size(), 2U);
+    BOOST_CHECK_EQUAL(cmpctblock.mweb_short_ids.kernel_ids.size(), 2U);
+
+    const CBlockHeaderAndShortTxIDs cmpctblock2 = RoundTrip(cmpctblock);
+    BOOST_CHECK(cmpctblock2.mweb_block.IsNull());
+    BOOST_CHECK(!cmpctblock2.mweb_short_ids.IsNull());
+    BOOST_CHECK(cmpctblock2.mweb_short_ids.header->GetHash() == block.mweb_block.GetMWEBHeader()->GetHash());
+    BOOST_CHECK(cmpctblock2.mweb_short_ids.output_ids == cmpctblock.mweb_short_ids.output_ids);
+    BOOST_CHECK(cmpctblock2.mweb_short_ids.kernel_ids == cmpctblock.mweb_short_ids.kernel_ids);
+
+    // The short ID form is much smaller than the full MWEB block
+    BOOST_CHECK_LT(GetSerializeSize(cmpctblock, PROTOCOL_VERSION | SERIALIZE_MWEB_SHORT_IDS), GetSerializeSize(cmpctblock, PROTOCOL_VERSION) / 4);
+
+    // Without the flag, the full MWEB block is still sent
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblock3;
+    stream >> cmpctblock3;
+    BOOST_CHECK(!cmpctblock3.mweb_block.IsNull());
+    BOOST_CHECK(cmpctblock3.mweb_short_ids.IsNull());
+
+    BlockTransactionsRequest req;
+    req.blockhash = InsecureRand256();
+    req.indexes = {1};
+    req.mweb_output_indexes = {0, 5};
+    req.mweb_kernel_indexes = {3};
+    CDataStream req_stream(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_MWEB_SHORT_IDS);
+    req_stream << req;
+    BlockTransactionsRequest req2;
+    req_stream >> req2;
+    BOOST_CHECK(req2.indexes == req.indexes);
+    BOOST_CHECK(req2.mweb_input_indexes.empty());
+    BOOST_CHECK(req2.mweb_output_indexes == req.mweb_output_indexes);
+    BOOST_CHECK(req2.mweb_kernel_indexes == req.mweb_kernel_indexes);
+}
+
+BOOST_AUTO_TEST_CASE(mweb_short_ids_reconstruct)
+{
+    const test::Tx tx1 = test::Tx::CreatePegIn(1000);
+    const test::Tx tx2 = test::Tx::CreatePegIn(2000);
+    const CBlock block = BuildMWEBBlock({tx1, tx2});
+
+    // Only tx1 is in the mempool
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.FromTx(MakeMWEBTx(tx1)));
+    }
+
+    const CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block, true));
+    PartiallyDownloadedBlock partial_block(&pool, cmpctblock.mweb_block);
+    partial_block.m_check_block_mock = CheckBlockMock;
+    BOOST_CHECK(partial_block.InitData(cmpctblock, no_extra_txn) == READ_STATUS_OK);
+
+    BlockTransactionsRequest req;
+    partial_block.GetMissingMWEB(req);
+    BOOST_CHECK(req.indexes.empty());
+    BOOST_CHECK(req.mweb_input_indexes.empty());
+    BOOST_CHECK_EQUAL(req.mweb_output_indexes.size(), 1U);
+    BOOST_CHECK_EQUAL(req.mweb_kernel_indexes.size(), 1U);
+    BOOST_CHECK(block.mweb_block.m_block->GetKernels()[req.mweb_kernel_indexes[0]].GetKernelID() == tx2.GetKernels().front().GetKernelID());
+
+    CBlock block2;
+    BOOST_CHECK(partial_block.FillBlock(block2, {}, GetMWEBPieces(block, req)) == READ_STATUS_OK);
+    BOOST_CHECK(!block2.mweb_block.IsNull());
+    BOOST_CHECK(block2.mweb_block.m_block->GetHash() == block.mweb_block.m_block->GetHash());
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+
+    // With everything in the mempool, nothing needs to be requested
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.FromTx(MakeMWEBTx(tx2)));
+    }
+    PartiallyDownloadedBlock partial_block2(&pool, cmpctblock.mweb_block);
+    partial_block2.m_check_block_mock = CheckBlockMock;
+    BOOST_CHECK(partial_block2.InitData(cmpctblock, no_extra_txn) == READ_STATUS_OK);
+    BlockTransactionsRequest req2;
+    partial_block2.GetMissingMWEB(req2);
+    BOOST_CHECK(req2.IsEmpty());
+    CBlock block3;
+    BOOST_CHECK(partial_block2.FillBlock(block3, {}) == READ_STATUS_OK);
+    BOOST_CHECK(block3.mweb_block.m_block->GetHash() == block.mweb_block.m_block->GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(mweb_short_ids_bad_pieces)
+{
+    const test::Tx tx1 = test::Tx::CreatePegIn(1000);
+    const CBlock block = BuildMWEBBlock({tx1, test::Tx::CreatePegIn(2000)});
+    CTxMemPool pool;
+    const CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block, true));
+
+    // The wrong kernel doesn't match the kernel root in the MWEB header
+    {
+        PartiallyDownloadedBlock partial_block(&pool, cmpctblock.mweb_block);
+        partial_block.m_check_block_mock = CheckBlockMock;
+        BOOST_CHECK(partial_block.InitData(cmpctblock, no_extra_txn) == READ_STATUS_OK);
+        BlockTransactionsRequest req;
+        partial_block.GetMissingMWEB(req);
+        BOOST_CHECK_EQUAL(req.mweb_kernel_indexes.size(), 2U);
+        TxBody pieces = GetMWEBPieces(block, req);
+        std::vector<Kernel> kernels = pieces.GetKernels();
+        kernels[0] = test::Tx::CreatePegIn(3000).GetKernels().front();
+        CBlock block2;
+        BOOST_CHECK(partial_block.FillBlock(block2, {}, TxBody(pieces.GetInputs(), pieces.GetOutputs(), kernels)) == READ_STATUS_FAILED);
+    }
+
+    // Too few pieces
+    {
+        PartiallyDownloadedBlock partial_block(&pool, cmpctblock.mweb_block);
+        partial_block.m_check_block_mock = CheckBlockMock;
+        BOOST_CHECK(partial_block.InitData(cmpctblock, no_extra_txn) == READ_STATUS_OK);
+        BlockTransactionsRequest req;
+        partial_block.GetMissingMWEB(req);
+        req.mweb_output_indexes.pop_back();
+        CBlock block2;
+        BOOST_CHECK(partial_block.FillBlock(block2, {}, GetMWEBPieces(block, req)) == READ_STATUS_INVALID);
+    }
+
+    // A kernel count that doesn't match the MWEB header
+    {
+        CBlockHeaderAndShortTxIDs bad_cmpctblock = cmpctblock;
+        bad_cmpctblock.mweb_short_ids.kernel_ids.pop_back();
+        PartiallyDownloadedBlock partial_block(&pool, bad_cmpctblock.mweb_block);
+        BOOST_CHECK(partial_block.InitData(bad_cmpctblock, no_extra_txn) == READ_STATUS_INVALID);
+    }
+
+    // Duplicate short IDs
+    {
+        CBlockHeaderAndShortTxIDs bad_cmpctblock = cmpctblock;
+        bad_cmpctblock.mweb_short_ids.output_ids[1] = bad_cmpctblock.mweb_short_ids.output_ids[0];
+        PartiallyDownloadedBlock partial_block(&pool, bad_cmpctblock.mweb_block);
+        BOOST_CHECK(partial_block.InitData(bad_cmpctblock, no_extra_txn) == READ_STATUS_FAILED);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
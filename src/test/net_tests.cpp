@@ -9,9 +9,11 @@
 #include <cstdint>
 #include <net.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <serialize.h>
 #include <span.h>
 #include <streams.h>
+#include <test/util/net.h>
 #include <test/util/setup_common.h>
 #include <util/memory.h>
 #include <util/strencodings.h>
@@ -754,6 +756,275 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
     BOOST_CHECK_EQUAL(IsLocal(addr), false);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(socket_events)
+{
+    for (const std::string mode_str : {"select", "poll", "epoll"}) {
+        SocketEventsMode mode;
+        if (!ParseSocketEventsMode(mode_str, mode)) continue;
+        BOOST_CHECK_EQUAL(SocketEventsModeToString(mode), mode_str);
+
+        ConnmanTestMsg connman{0x1337, 0x1337};
+        CConnman::Options options;
+        options.nReceiveFloodSize = DEFAULT_MAXRECEIVEBUFFER * 1000;
+        options.socket_events_mode = mode;
+        connman.Init(options);
+        connman.StartSocketEvents();
+        BOOST_CHECK(connman.GetSocketEventsMode() == mode);
+
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        CNode* node = new CNode(/* id */ 0, NODE_NETWORK, /* height */ 0, fds[0], CAddress(), /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress(), "", ConnectionType::OUTBOUND_FULL_RELAY);
+        connman.AddTestNode(*node);
+
+        // A message larger than one read from the socket, so that getting all
+        // of it takes more than the one edge-triggered epoll event
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::PING;
+        msg.data.resize(150000);
+        std::vector<unsigned char> header;
+        node->m_serializer->prepareForTransport(msg, header);
+        header.insert(header.end(), msg.data.begin(), msg.data.end());
+        BOOST_REQUIRE_EQUAL(write(fds[1], header.data(), header.size()), (ssize_t)header.size());
+
+        for (int i = 0; i < 10 && WITH_LOCK(node->cs_vProcessMsg, return node->vProcessMsg.empty()); ++i) {
+            connman.SocketHandlerOnce();
+        }
+        BOOST_CHECK_EQUAL(WITH_LOCK(node->cs_vProcessMsg, return node->vProcessMsg.size()), 1U);
+        BOOST_CHECK_EQUAL(WITH_LOCK(node->cs_vRecv, return node->nRecvBytes), header.size());
+        // The message handler is woken up for just this node
+        BOOST_CHECK(connman.TakeMessageHandlerReadyNodes() == std::set<NodeId>{node->GetId()});
+
+        BOOST_CHECK(!node->fDisconnect);
+        connman.ClearTestNodes();
+        close(fds[1]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(shared_message_send)
+{
+    ConnmanTestMsg connman{0x1337, 0x1337};
+    connman.Init(CConnman::Options{});
+
+    // A payload larger than the socket buffers, so that it stays queued
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::BLOCK;
+    msg.data.resize(1000000);
+    for (size_t i = 0; i < msg.data.size(); ++i) {
+        msg.data[i] = i * 7;
+    }
+    CSerializedNetMsg msg_copy;
+    msg_copy.m_type = msg.m_type;
+    msg_copy.data = msg.data;
+    const CSharedNetMsg shared_msg(std::move(msg));
+
+    std::vector<CNode*> nodes;
+    std::vector<int> peer_fds;
+    for (NodeId id = 0; id < 2; ++id) {
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        nodes.push_back(new CNode(id, NODE_NETWORK, /* height */ 0, fds[0], CAddress(), /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress(), "", ConnectionType::OUTBOUND_FULL_RELAY));
+        peer_fds.push_back(fds[1]);
+        connman.AddTestNode(*nodes.back());
+    }
+
+    std::vector<unsigned char> expected;
+    nodes[0]->m_serializer->prepareForTransport(msg_copy, expected);
+    expected.insert(expected.end(), msg_copy.data.begin(), msg_copy.data.end());
+    CSerializedNetMsg ping = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::PING, uint64_t{42});
+    std::vector<unsigned char> ping_bytes;
+    nodes[0]->m_serializer->prepareForTransport(ping, ping_bytes);
+    ping_bytes.insert(ping_bytes.end(), ping.data.begin(), ping.data.end());
+    expected.insert(expected.end(), ping_bytes.begin(), ping_bytes.end());
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        connman.PushMessage(nodes[i], shared_msg);
+        connman.PushMessage(nodes[i], CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::PING, uint64_t{42}));
+        // The payload is queued without being copied
+        BOOST_CHECK(WITH_LOCK(nodes[i]->cs_vSend, return nodes[i]->vSendMsg.front().payload) == shared_msg.data);
+    }
+
+    // Every peer gets the same bytes as if the message was sent to it alone
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        std::vector<unsigned char> received;
+        for (int iterations = 0; received.size() < expected.size() && iterations < 1000; ++iterations) {
+            unsigned char buf[65536];
+            const ssize_t n = recv(peer_fds[i], buf, sizeof(buf), MSG_DONTWAIT);
+            if (n > 0) received.insert(received.end(), buf, buf + n);
+            connman.SendQueuedData(*nodes[i]);
+        }
+        BOOST_CHECK(received == expected);
+        BOOST_CHECK(WITH_LOCK(nodes[i]->cs_vSend, return nodes[i]->vSendMsg.empty()));
+        BOOST_CHECK_EQUAL(nodes[i]->nSendSize, 0U);
+        BOOST_CHECK_EQUAL(WITH_LOCK(nodes[i]->cs_vSend, return nodes[i]->nSendBytes), expected.size());
+        close(peer_fds[i]);
+    }
+    connman.ClearTestNodes();
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(message_handler_shards)
+{
+    ConnmanTestMsg connman{0x1337, 0x1337};
+    CConnman::Options options;
+    options.m_msghand_threads = 3;
+    connman.Init(options);
+    BOOST_CHECK_EQUAL(connman.GetMessageHandlerThreads(), 3U);
+
+    // Each node is served by one thread, chosen by its id
+    for (NodeId id = 0; id < 7; ++id) {
+        connman.WakeMessageHandlerForNode(id);
+    }
+    BOOST_CHECK(connman.TakeMessageHandlerReadyNodes(0) == std::set<NodeId>({0, 3, 6}));
+    BOOST_CHECK(connman.TakeMessageHandlerReadyNodes(1) == std::set<NodeId>({1, 4}));
+    BOOST_CHECK(connman.TakeMessageHandlerReadyNodes(2) == std::set<NodeId>({2, 5}));
+    BOOST_CHECK(connman.TakeMessageHandlerReadyNodes().empty());
+
+    options.m_msghand_threads = 0;
+    connman.Init(options);
+    BOOST_CHECK_EQUAL(connman.GetMessageHandlerThreads(), 1U);
+    options.m_msghand_threads = MAX_MSGHAND_THREADS + 1;
+    connman.Init(options);
+    BOOST_CHECK_EQUAL(connman.GetMessageHandlerThreads(), size_t(MAX_MSGHAND_THREADS));
+}
+
+/** Feed bytes to a deserializer like CNode::ReceiveMsgBytes, collecting the messages. Returns false on failure. */
+static bool ReadMessages(TransportDeserializer& deserializer, Span<const unsigned char> bytes, std::vector<CNetMessage>& messages)
+{
+    while (!bytes.empty()) {
+        const int handled = deserializer.Read(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (handled < 0) return false;
+        bytes = bytes.subspan(handled);
+        if (deserializer.Complete()) {
+            uint32_t err_raw_size{0};
+            Optional<CNetMessage> msg = deserializer.GetMessage(GetTime<std::chrono::microseconds>(), err_raw_size);
+            if (!msg) return false;
+            messages.push_back(std::move(*msg));
+        }
+    }
+    return true;
+}
+
+static std::string PayloadOf(const CNetMessage& msg)
+{
+    return std::string(msg.m_recv.begin(), msg.m_recv.end());
+}
+
+BOOST_AUTO_TEST_CASE(v2_transport)
+{
+    auto initiator = std::make_shared<V2Transport>(Params(), 0, /*initiator=*/true, SER_NETWORK, INIT_PROTO_VERSION);
+    auto responder = std::make_shared<V2Transport>(Params(), 1, /*initiator=*/false, SER_NETWORK, INIT_PROTO_VERSION);
+    V2TransportSerializer initiator_out{initiator}, responder_out{responder};
+    V2TransportDeserializer initiator_in{initiator}, responder_in{responder};
+    std::vector<CNetMessage> received;
+    // Until the responder proves to speak V2, the initiator would retry with V1.
+    BOOST_CHECK(initiator_in.ShouldReconnectV1());
+    BOOST_CHECK(!responder_in.ShouldReconnectV1());
+
+    // The initiator sends its public key; the version message waits for the session keys.
+    CSerializedNetMsg version = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERSION, std::string("version payload"));
+    std::vector<unsigned char> wire;
+    initiator_out.prepareForTransport(version, wire);
+    BOOST_CHECK(version.data.empty());
+    BOOST_CHECK_EQUAL(wire.size(), CPubKey::COMPRESSED_SIZE);
+    initiator_out.prepareTransportData(wire);
+    BOOST_CHECK_EQUAL(wire.size(), CPubKey::COMPRESSED_SIZE);
+
+    // The responder answers with its public key.
+    BOOST_CHECK(ReadMessages(responder_in, wire, received));
+    BOOST_CHECK(received.empty());
+    wire.clear();
+    responder_out.prepareTransportData(wire);
+    BOOST_CHECK_EQUAL(wire.size(), CPubKey::COMPRESSED_SIZE);
+
+    // Now the initiator can send the version message.
+    BOOST_CHECK(ReadMessages(initiator_in, wire, received));
+    wire.clear();
+    initiator_out.prepareTransportData(wire);
+    BOOST_CHECK(ReadMessages(responder_in, wire, received));
+    BOOST_REQUIRE_EQUAL(received.size(), 1U);
+    BOOST_CHECK_EQUAL(received[0].m_command, NetMsgType::VERSION);
+    BOOST_CHECK_EQUAL(received[0].m_raw_message_size, wire.size());
+
+    // Messages with and without a short ID, delivered a byte at a time
+    const CSharedNetMsg inv(CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::INV, std::string(10000, 'i')));
+    wire.clear();
+    BOOST_CHECK(!responder_out.prepareForTransport(inv, wire));
+    CSerializedNetMsg wtxidrelay = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::WTXIDRELAY);
+    responder_out.prepareForTransport(wtxidrelay, wire);
+    BOOST_CHECK_EQUAL(wire.size(), 1 + 3 + 10000 + 1 + CMessageHeader::COMMAND_SIZE + 2 * BIP324Cipher::EXPANSION);
+    received.clear();
+    for (const unsigned char c : wire) {
+        BOOST_REQUIRE(ReadMessages(initiator_in, Span<const unsigned char>(&c, 1), received));
+    }
+    BOOST_REQUIRE_EQUAL(received.size(), 2U);
+    BOOST_CHECK_EQUAL(received[0].m_command, NetMsgType::INV);
+    BOOST_CHECK_EQUAL(received[0].m_message_size, 10000 + 3U);
+    BOOST_CHECK(PayloadOf(received[0]).substr(3) == std::string(10000, 'i'));
+    BOOST_CHECK_EQUAL(received[1].m_command, NetMsgType::WTXIDRELAY);
+    BOOST_CHECK_EQUAL(received[1].m_message_size, 0U);
+    BOOST_CHECK(!initiator_in.ShouldReconnectV1());
+
+    // A modified packet fails the connection.
+    CSerializedNetMsg ping = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::PING, uint64_t{42});
+    wire.clear();
+    initiator_out.prepareForTransport(ping, wire);
+    wire.back() ^= 1;
+    BOOST_CHECK(!ReadMessages(responder_in, wire, received));
+
+    // The largest message we accept is delivered, while a packet claiming to
+    // be larger fails the connection as soon as its length is read.
+    CSerializedNetMsg largest;
+    largest.m_type = "largest";
+    largest.data.assign(MAX_PROTOCOL_MESSAGE_LENGTH, 'l');
+    wire.clear();
+    responder_out.prepareForTransport(largest, wire);
+    BOOST_CHECK_EQUAL(wire.size(), MAX_PROTOCOL_MESSAGE_LENGTH + 1 + CMessageHeader::COMMAND_SIZE + BIP324Cipher::EXPANSION);
+    received.clear();
+    BOOST_CHECK(ReadMessages(initiator_in, wire, received));
+    BOOST_REQUIRE_EQUAL(received.size(), 1U);
+    BOOST_CHECK_EQUAL(received[0].m_command, "largest");
+    BOOST_CHECK_EQUAL(received[0].m_message_size, MAX_PROTOCOL_MESSAGE_LENGTH);
+    CSerializedNetMsg oversized;
+    oversized.m_type = "oversized";
+    oversized.data.assign(MAX_PROTOCOL_MESSAGE_LENGTH + 1, 'o');
+    wire.clear();
+    responder_out.prepareForTransport(oversized, wire);
+    BOOST_CHECK(!ReadMessages(initiator_in, Span<const unsigned char>(wire.data(), BIP324Cipher::LENGTH_LEN), received));
+}
+
+BOOST_AUTO_TEST_CASE(v2_transport_v1_peer)
+{
+    auto responder = std::make_shared<V2Transport>(Params(), 1, /*initiator=*/false, SER_NETWORK, INIT_PROTO_VERSION);
+    V2TransportSerializer responder_out{responder};
+    V2TransportDeserializer responder_in{responder};
+    V1TransportSerializer v1_out;
+    V1TransportDeserializer v1_in{Params(), 0, SER_NETWORK, INIT_PROTO_VERSION};
+    std::vector<CNetMessage> received;
+
+    // A V1 peer is recognized by its version message...
+    CSerializedNetMsg version = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERSION, std::string("version payload"));
+    std::vector<unsigned char> wire;
+    v1_out.prepareForTransport(version, wire);
+    wire.insert(wire.end(), version.data.begin(), version.data.end());
+    BOOST_CHECK(ReadMessages(responder_in, wire, received));
+    BOOST_REQUIRE_EQUAL(received.size(), 1U);
+    BOOST_CHECK_EQUAL(received[0].m_command, NetMsgType::VERSION);
+    BOOST_CHECK(PayloadOf(received[0]).substr(1) == "version payload");
+
+    // ...and answered in the V1 format, with the payload after the header.
+    wire.clear();
+    responder_out.prepareTransportData(wire);
+    BOOST_CHECK(wire.empty());
+    const CSharedNetMsg verack(CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERACK));
+    BOOST_CHECK(responder_out.prepareForTransport(verack, wire));
+    BOOST_CHECK_EQUAL(wire.size(), CMessageHeader::HEADER_SIZE);
+    received.clear();
+    BOOST_CHECK(ReadMessages(v1_in, wire, received));
+    BOOST_REQUIRE_EQUAL(received.size(), 1U);
+    BOOST_CHECK_EQUAL(received[0].m_command, NetMsgType::VERACK);
+}
+
 BOOST_AUTO_TEST_CASE(PoissonNextSend)
 {
     g_mock_deterministic_tests = true;
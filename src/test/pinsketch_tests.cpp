@@ -0,0 +1,110 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(pinsketch_tests, BasicTestingSetup)
+
+static uint32_t RandomElement()
+{
+    uint32_t element;
+    do {
+        element = InsecureRand32();
+    } while (element == 0);
+    return element;
+}
+
+static std::set<uint32_t> Decoded(const PinSketch& sketch)
+{
+    const Optional<std::vector<uint32_t>> elements = sketch.Decode(sketch.GetCapacity());
+    BOOST_REQUIRE(elements);
+    return std::set<uint32_t>(elements->begin(), elements->end());
+}
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+    BOOST_CHECK(Decoded(PinSketch(10)).empty());
+
+    // Adding an element twice removes it.
+    PinSketch sketch(10);
+    sketch.Add(42);
+    sketch.Add(42);
+    BOOST_CHECK(Decoded(sketch).empty());
+}
+
+BOOST_AUTO_TEST_CASE(set_difference)
+{
+    for (size_t capacity : {1, 2, 5, 20, 64}) {
+        for (size_t diff_size = 0; diff_size <= capacity; diff_size += std::max<size_t>(1, capacity / 4)) {
+            // Two sets with many elements in common
+            PinSketch a(capacity), b(capacity);
+            for (int i = 0; i < 100; ++i) {
+                const uint32_t element = RandomElement();
+                a.Add(element);
+                b.Add(element);
+            }
+            std::set<uint32_t> difference;
+            while (difference.size() < diff_size) {
+                const uint32_t element = RandomElement();
+                if (!difference.insert(element).second) continue;
+                (InsecureRandBool() ? a : b).Add(element);
+            }
+            a.Merge(b);
+            BOOST_CHECK(Decoded(a) == difference);
+        }
+    }
+
+    // The extremes of the field
+    PinSketch sketch(3);
+    for (uint32_t element : {uint32_t{1}, uint32_t{2}, uint32_t{0xffffffff}}) sketch.Add(element);
+    BOOST_CHECK(Decoded(sketch) == std::set<uint32_t>({1, 2, 0xffffffff}));
+}
+
+BOOST_AUTO_TEST_CASE(too_many_elements)
+{
+    // A random syndrome passes for a set of at most c elements about once in
+    // c! tries, so overflowing small sketches is not reliably detected.
+    for (size_t capacity : {12, 16, 32}) {
+        for (int i = 0; i < 20; ++i) {
+            PinSketch sketch(capacity);
+            for (size_t n = 0; n < capacity + 1 + InsecureRandRange(capacity); ++n) sketch.Add(RandomElement());
+            BOOST_CHECK(!sketch.Decode(capacity));
+        }
+    }
+
+    // Decoding can be limited to fewer elements than the capacity.
+    PinSketch sketch(8);
+    for (int i = 0; i < 5; ++i) sketch.Add(RandomElement());
+    BOOST_CHECK(!sketch.Decode(4));
+    BOOST_CHECK_EQUAL(sketch.Decode(5)->size(), 5U);
+}
+
+BOOST_AUTO_TEST_CASE(serialization)
+{
+    PinSketch sketch(7);
+    std::set<uint32_t> elements;
+    for (int i = 0; i < 5; ++i) {
+        elements.insert(RandomElement());
+    }
+    for (uint32_t element : elements) sketch.Add(element);
+
+    const std::vector<unsigned char> data = sketch.Serialize();
+    BOOST_CHECK_EQUAL(data.size(), 7 * PinSketch::BYTES_PER_CAPACITY);
+    const Optional<PinSketch> parsed = PinSketch::Deserialize(data);
+    BOOST_REQUIRE(parsed);
+    BOOST_CHECK_EQUAL(parsed->GetCapacity(), 7U);
+    BOOST_CHECK(Decoded(*parsed) == elements);
+
+    BOOST_CHECK(!PinSketch::Deserialize(Span<const unsigned char>(data.data(), data.size() - 1)));
+    BOOST_CHECK_EQUAL(PinSketch::Deserialize(Span<const unsigned char>())->GetCapacity(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
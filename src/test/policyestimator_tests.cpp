@@ -12,11 +12,14 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <cmath>
+
 BOOST_FIXTURE_TEST_SUITE(policyestimator_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
 {
-    CBlockPolicyEstimator feeEst;
+    // At 75 second blocks the medium horizon tracks 48 blocks at scale 2
+    CBlockPolicyEstimator feeEst{std::chrono::seconds{75}};
     CTxMemPool mpool(&feeEst);
     LOCK2(cs_main, mpool.cs);
     TestMemPoolEntryHelper entry;
@@ -51,7 +54,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     int blocknum = 0;
 
     // Loop through 200 blocks
-    // At a decay .9952 and 4 fee transactions per block
+    // At a decay .9964 and 4 fee transactions per block
     // This makes the tx count about 2.5 per bucket, well above the 0.1 threshold
     while (blocknum < 200) {
         for (int j = 0; j < 10; j++) { // For each fee
@@ -77,7 +80,7 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
         mpool.removeForBlock(block, ++blocknum, nullptr);
         block.vtx.clear();
         // Check after just a few txs that combining buckets works as expected
-        if (blocknum == 3) {
+        if (blocknum == 4) {
             // At this point we should need to combine 3 buckets to get enough data points
             // So estimateFee(1) should fail and estimateFee(2) should return somewhere around
             // 9*baserate.  estimateFee(2) %'s are 100,100,90 = average 97%
@@ -180,4 +183,26 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(TimeBasedHorizons)
+{
+    for (const int64_t spacing : {10, 75, 150}) {
+        const CBlockPolicyEstimator feeEst{std::chrono::seconds{spacing}};
+
+        // Each horizon covers the same wall-clock time whatever the block spacing
+        BOOST_CHECK_EQUAL(feeEst.HighestTargetTracked(FeeEstimateHorizon::MED_HALFLIFE) * spacing, 3600);
+        BOOST_CHECK_EQUAL(feeEst.HighestTargetTracked(FeeEstimateHorizon::LONG_HALFLIFE) * spacing, 86400);
+
+        // and its data halves in weight over the same time
+        EstimationResult result;
+        feeEst.estimateRawFee(1, 0.95, FeeEstimateHorizon::MED_HALFLIFE, &result);
+        BOOST_CHECK_CLOSE(std::pow(result.decay, 4 * 3600 / spacing), 0.5, 0.0001);
+        feeEst.estimateRawFee(1, 0.95, FeeEstimateHorizon::LONG_HALFLIFE, &result);
+        BOOST_CHECK_CLOSE(std::pow(result.decay, 86400 / spacing), 0.5, 0.0001);
+    }
+
+    // At 10 second blocks the long horizon tracks a full day
+    const CBlockPolicyEstimator feeEst;
+    BOOST_CHECK_EQUAL(feeEst.HighestTargetTracked(FeeEstimateHorizon::LONG_HALFLIFE), 8640U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <miner.h>
 #include <pow.h>
 #include <test/util/setup_common.h>
 
@@ -184,4 +185,51 @@ BOOST_AUTO_TEST_CASE(ChainParams_SIGNET_sanity)
     sanity_check_chainparams(*m_node.args, CBaseChainParams::SIGNET);
 }
 
+BOOST_AUTO_TEST_CASE(pow_searcher)
+{
+    const auto chainParams = CreateChainParams(*m_node.args, CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.nTime = 1600000000;
+    // About one hash in sixteen meets this, so searches run over several batches
+    header.nBits = 0x200fffff;
+
+    PowSearcher searcher(4);
+    PowSearcher single_searcher(1);
+    for (int i = 0; i < 8; ++i, ++header.nTime) {
+        // The lowest nonce found is the one a search on one thread finds
+        CBlockHeader expected = header;
+        expected.nNonce = 0;
+        while (!CheckProofOfWork(expected.GetPoWHash(), expected.nBits, consensus)) ++expected.nNonce;
+        for (PowSearcher* s : {&searcher, &single_searcher}) {
+            CBlockHeader found = header;
+            found.nNonce = 0;
+            uint64_t max_tries = 1000;
+            BOOST_CHECK(s->Search(found, max_tries, consensus) == PowSearcher::Result::FOUND);
+            BOOST_CHECK_EQUAL(found.nNonce, expected.nNonce);
+            BOOST_CHECK_EQUAL(max_tries, 1000U - expected.nNonce);
+        }
+        if (expected.nNonce == 0) continue;
+        CBlockHeader found = header;
+        found.nNonce = 0;
+        uint64_t max_tries = expected.nNonce;
+        BOOST_CHECK(searcher.Search(found, max_tries, consensus) == PowSearcher::Result::OUT_OF_TRIES);
+        BOOST_CHECK_EQUAL(max_tries, 0U);
+    }
+    BOOST_CHECK(searcher.GetHashRate() > 0);
+
+    // The last nonce is never tried
+    header.nNonce = std::numeric_limits<uint32_t>::max() - 1;
+    while (CheckProofOfWork(header.GetPoWHash(), header.nBits, consensus)) ++header.nTime;
+    uint64_t max_tries = 10;
+    BOOST_CHECK(searcher.Search(header, max_tries, consensus) == PowSearcher::Result::NONCES_EXHAUSTED);
+    BOOST_CHECK_EQUAL(header.nNonce, std::numeric_limits<uint32_t>::max());
+    BOOST_CHECK_EQUAL(max_tries, 9U);
+
+    searcher.Interrupt();
+    header.nNonce = 0;
+    BOOST_CHECK(searcher.Search(header, max_tries, consensus) == PowSearcher::Result::INTERRUPTED);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #include <boost/test/unit_test.hpp>
 
+#include <crypto/common.h>
 #include <crypto/scrypt.h>
 #include <uint256.h>
 #include <util/strencodings.h>
@@ -31,4 +32,22 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_batch)
+{
+    // Hashes of a batch of nonces match those of each header on its own
+    const std::vector<unsigned char> header = ParseHex("020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659");
+    const uint32_t first_nonce = 0xfffffff8;
+    const size_t count = 7;
+    char hashes[32 * count];
+    std::vector<char> scratchpad(SCRYPT_SCRATCHPAD_SIZE);
+    scrypt_1024_1_1_256_sp_batch((const char*)header.data(), first_nonce, count, hashes, scratchpad.data());
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<unsigned char> input = header;
+        WriteLE32(&input[76], first_nonce + i);
+        uint256 expected;
+        scrypt_1024_1_1_256_sp_generic((const char*)input.data(), BEGIN(expected), scratchpad.data());
+        BOOST_CHECK(memcmp(hashes + 32 * i, expected.begin(), 32) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
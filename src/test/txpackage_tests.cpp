@@ -0,0 +1,148 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <consensus/validation.h>
+#include <key.h>
+#include <policy/packages.h>
+#include <policy/policy.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <util/string.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txpackage_tests)
+
+static CMutableTransaction CreateSpend(const CTransactionRef& prev, CAmount value, const CKey& key, const CScript& script_pub_key)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prev->GetHash(), 0);
+    tx.vout.emplace_back(value, script_pub_key);
+    std::vector<unsigned char> sig;
+    const uint256 hash = SignatureHash(script_pub_key, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(key.Sign(hash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << sig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(package_sanitization, TestChain100Setup)
+{
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CTransactionRef parent = MakeTransactionRef(CreateSpend(m_coinbase_txns[0], 49 * COIN, coinbaseKey, script_pub_key));
+    const CTransactionRef child = MakeTransactionRef(CreateSpend(parent, 48 * COIN, coinbaseKey, script_pub_key));
+    const CTransactionRef conflict = MakeTransactionRef(CreateSpend(m_coinbase_txns[0], 47 * COIN, coinbaseKey, script_pub_key));
+
+    PackageValidationState state;
+    BOOST_CHECK(CheckPackage({parent, child}, state));
+    BOOST_CHECK(IsChildWithParents({parent, child}));
+    BOOST_CHECK(!IsChildWithParents({parent, conflict}));
+
+    BOOST_CHECK(!CheckPackage({child, parent}, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package-not-sorted");
+
+    state = PackageValidationState();
+    BOOST_CHECK(!CheckPackage({parent, parent}, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package-contains-duplicates");
+
+    state = PackageValidationState();
+    BOOST_CHECK(!CheckPackage({parent, conflict}, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "conflict-in-package");
+
+    Package too_many;
+    for (size_t i = 0; i <= MAX_PACKAGE_COUNT; ++i) {
+        too_many.push_back(MakeTransactionRef(CreateSpend(m_coinbase_txns[i], 49 * COIN, coinbaseKey, script_pub_key)));
+    }
+    state = PackageValidationState();
+    BOOST_CHECK(!CheckPackage(too_many, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package-too-many-transactions");
+
+    // The package hash does not depend on the order of the transactions
+    BOOST_CHECK(GetPackageHash({parent, child}) == GetPackageHash({child, parent}));
+    BOOST_CHECK(GetPackageHash({parent, child}) != GetPackageHash({parent, conflict}));
+}
+
+BOOST_FIXTURE_TEST_CASE(package_cpfp, TestChain100Setup)
+{
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CAmount coinbase_value = m_coinbase_txns[0]->vout[0].nValue;
+    // Mature the second and third coinbase too, they are spent below
+    for (int i = 0; i < 2; ++i) CreateAndProcessBlock({}, script_pub_key);
+
+    // The parent pays no fee at all, so it is not accepted on its own
+    const CTransactionRef parent = MakeTransactionRef(CreateSpend(m_coinbase_txns[0], coinbase_value, coinbaseKey, script_pub_key));
+    {
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(*m_node.mempool, state, parent, nullptr /* plTxnReplaced */, false /* bypass_limits */));
+        BOOST_CHECK_EQUAL(state.GetResult(), TxValidationResult::TX_RECONSIDERABLE);
+    }
+
+    // Nor with a child which pays nothing either
+    const CTransactionRef free_child = MakeTransactionRef(CreateSpend(parent, coinbase_value, coinbaseKey, script_pub_key));
+    {
+        LOCK(cs_main);
+        const PackageMempoolAcceptResult result = ProcessNewPackage(*m_node.mempool, {parent, free_child}, /* test_accept */ false);
+        BOOST_CHECK_EQUAL(result.m_state.GetResult(), PackageValidationResult::PCKG_POLICY);
+        BOOST_CHECK_EQUAL(result.m_state.GetRejectReason(), "package-fee-too-low");
+        BOOST_CHECK(result.m_accepted.empty());
+        BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+    }
+
+    // A child paying for both is accepted together with it
+    const CTransactionRef child = MakeTransactionRef(CreateSpend(parent, coinbase_value - CENT, coinbaseKey, script_pub_key));
+    {
+        LOCK(cs_main);
+        const PackageMempoolAcceptResult test_result = ProcessNewPackage(*m_node.mempool, {parent, child}, /* test_accept */ true);
+        BOOST_CHECK(test_result.m_state.IsValid());
+        BOOST_CHECK(test_result.m_package_feerate);
+        BOOST_CHECK_EQUAL(test_result.m_tx_fees.at(child->GetWitnessHash()), CENT);
+        BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+
+        const PackageMempoolAcceptResult result = ProcessNewPackage(*m_node.mempool, {parent, child}, /* test_accept */ false);
+        BOOST_CHECK(result.m_state.IsValid());
+        BOOST_CHECK_EQUAL(result.m_accepted.size(), 2U);
+        BOOST_CHECK(m_node.mempool->exists(parent->GetHash()));
+        BOOST_CHECK(m_node.mempool->exists(child->GetHash()));
+    }
+
+    // Transactions which pay for themselves are accepted on their own first
+    const CTransactionRef paying_parent = MakeTransactionRef(CreateSpend(m_coinbase_txns[1], coinbase_value - CENT, coinbaseKey, script_pub_key));
+    const CTransactionRef paying_child = MakeTransactionRef(CreateSpend(paying_parent, coinbase_value - 2 * CENT, coinbaseKey, script_pub_key));
+    {
+        LOCK(cs_main);
+        const PackageMempoolAcceptResult result = ProcessNewPackage(*m_node.mempool, {paying_parent, paying_child}, /* test_accept */ false);
+        BOOST_CHECK(result.m_state.IsValid());
+        BOOST_CHECK_EQUAL(result.m_accepted.size(), 2U);
+        BOOST_CHECK(!result.m_package_feerate);
+        BOOST_CHECK_EQUAL(m_node.mempool->size(), 4U);
+    }
+
+    // A package is turned down if it is trimmed from a full mempool, even
+    // partly, and then below the minimum feerate of the mempool
+    const CTransactionRef trimmed_parent = MakeTransactionRef(CreateSpend(m_coinbase_txns[2], coinbase_value, coinbaseKey, script_pub_key));
+    const CTransactionRef trimmed_child = MakeTransactionRef(CreateSpend(trimmed_parent, coinbase_value - CENT, coinbaseKey, script_pub_key));
+    {
+        LOCK(cs_main);
+        gArgs.ForceSetArg("-maxmempool", "0");
+        PackageMempoolAcceptResult result = ProcessNewPackage(*m_node.mempool, {trimmed_parent, trimmed_child}, /* test_accept */ false);
+        gArgs.ForceSetArg("-maxmempool", ToString(DEFAULT_MAX_MEMPOOL_SIZE));
+        BOOST_CHECK_EQUAL(result.m_state.GetResult(), PackageValidationResult::PCKG_POLICY);
+        BOOST_CHECK_EQUAL(result.m_state.GetRejectReason(), "mempool full");
+        BOOST_CHECK_EQUAL(result.m_tx_results.at(trimmed_child->GetWitnessHash()).GetRejectReason(), "mempool full");
+        BOOST_CHECK(result.m_accepted.empty());
+        BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+
+        result = ProcessNewPackage(*m_node.mempool, {trimmed_parent, trimmed_child}, /* test_accept */ false);
+        BOOST_CHECK_EQUAL(result.m_state.GetRejectReason(), "package-fee-too-low");
+        BOOST_CHECK(result.m_accepted.empty());
+        BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
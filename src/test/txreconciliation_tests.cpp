@@ -0,0 +1,323 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <pinsketch.h>
+#include <primitives/transaction.h>
+#include <test/util/setup_common.h>
+#include <test/util/txrelay.h>
+#include <test_framework/models/Tx.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+namespace {
+
+constexpr NodeId INITIATOR{0};
+constexpr NodeId RESPONDER{1};
+
+CTransactionRef MakeTx()
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    tx.vout.emplace_back(1000, CScript());
+    return MakeTransactionRef(std::move(tx));
+}
+
+/** Two trackers, the first of which made an outbound connection to the second. */
+struct TrackerPair {
+    TxReconciliationTracker initiator;
+    TxReconciliationTracker responder;
+
+    TrackerPair()
+    {
+        const uint64_t initiator_salt = initiator.PreRegisterPeer(RESPONDER);
+        const uint64_t responder_salt = responder.PreRegisterPeer(INITIATOR);
+        BOOST_CHECK(initiator.RegisterPeer(RESPONDER, /*is_peer_inbound=*/false, TXRECONCILIATION_VERSION, responder_salt) == ReconciliationRegisterResult::SUCCESS);
+        BOOST_CHECK(responder.RegisterPeer(INITIATOR, /*is_peer_inbound=*/true, TXRECONCILIATION_VERSION, initiator_salt) == ReconciliationRegisterResult::SUCCESS);
+    }
+
+    /** Run a reconciliation; returns what each side announces to the other. */
+    bool Reconcile(std::set<uint256>& initiator_announces, std::set<uint256>& responder_announces)
+    {
+        // The first request is scheduled at a random point within the interval.
+        BOOST_CHECK(!initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{1}));
+        const auto request = initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{10});
+        BOOST_REQUIRE(request);
+        BOOST_CHECK(!initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{20}));
+
+        std::vector<unsigned char> skdata;
+        BOOST_REQUIRE(responder.HandleReconciliationRequest(INITIATOR, request->first, request->second, std::chrono::seconds{10}, skdata));
+        ReconciliationOutcome outcome;
+        BOOST_REQUIRE(initiator.HandleSketch(RESPONDER, skdata, outcome));
+        std::vector<uint256> announce;
+        BOOST_REQUIRE(responder.HandleReconciliationDifference(INITIATOR, outcome.success, outcome.ask_shortids, announce));
+
+        initiator_announces = std::set<uint256>(outcome.announce.begin(), outcome.announce.end());
+        responder_announces = std::set<uint256>(announce.begin(), announce.end());
+        BOOST_CHECK_EQUAL(initiator_announces.size(), outcome.announce.size());
+        BOOST_CHECK_EQUAL(responder_announces.size(), announce.size());
+        return outcome.success;
+    }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(register_peer)
+{
+    TxReconciliationTracker tracker;
+    BOOST_CHECK(tracker.RegisterPeer(0, true, 1, 1) == ReconciliationRegisterResult::NOT_FOUND);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+
+    tracker.PreRegisterPeer(0);
+    BOOST_CHECK(tracker.RegisterPeer(0, true, 0, 1) == ReconciliationRegisterResult::PROTOCOL_VIOLATION);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+
+    tracker.PreRegisterPeer(1);
+    BOOST_CHECK(tracker.RegisterPeer(1, true, 1, 1) == ReconciliationRegisterResult::SUCCESS);
+    BOOST_CHECK(tracker.IsPeerRegistered(1));
+    BOOST_CHECK(tracker.RegisterPeer(1, true, 1, 1) == ReconciliationRegisterResult::ALREADY_REGISTERED);
+
+    // A newer version of the peer is fine; the lower of the two is used.
+    tracker.PreRegisterPeer(2);
+    BOOST_CHECK(tracker.RegisterPeer(2, true, 2, 1) == ReconciliationRegisterResult::SUCCESS);
+
+    tracker.ForgetPeer(1);
+    BOOST_CHECK(!tracker.IsPeerRegistered(1));
+    BOOST_CHECK(tracker.RegisterPeer(1, true, 1, 1) == ReconciliationRegisterResult::NOT_FOUND);
+}
+
+BOOST_AUTO_TEST_CASE(flood_to)
+{
+    TxReconciliationTracker tracker;
+    // Peers that do not reconcile get everything flooded to them.
+    BOOST_CHECK(tracker.ShouldFloodTo(100));
+
+    for (NodeId peer = 0; peer < 4; ++peer) {
+        tracker.PreRegisterPeer(peer);
+        BOOST_CHECK(tracker.RegisterPeer(peer, /*is_peer_inbound=*/peer % 2 == 1, 1, 1) == ReconciliationRegisterResult::SUCCESS);
+    }
+    BOOST_CHECK(tracker.ShouldFloodTo(0));
+    BOOST_CHECK(!tracker.ShouldFloodTo(1));
+    BOOST_CHECK(tracker.ShouldFloodTo(2));
+    BOOST_CHECK(!tracker.ShouldFloodTo(3));
+
+    // No more than MAX_OUTBOUND_FLOOD_TO outbound peers are flooded to...
+    tracker.PreRegisterPeer(4);
+    tracker.RegisterPeer(4, /*is_peer_inbound=*/false, 1, 1);
+    BOOST_CHECK(!tracker.ShouldFloodTo(4));
+
+    // ...until one of them goes away.
+    tracker.ForgetPeer(0);
+    tracker.PreRegisterPeer(5);
+    tracker.RegisterPeer(5, /*is_peer_inbound=*/false, 1, 1);
+    BOOST_CHECK(tracker.ShouldFloodTo(5));
+}
+
+BOOST_AUTO_TEST_CASE(set_management)
+{
+    TrackerPair peers;
+    BOOST_CHECK(!peers.initiator.AddToSet(RESPONDER + 1, *MakeTx()));
+
+    const CTransactionRef tx1 = MakeTx(), tx2 = MakeTx();
+    BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, *tx1));
+    BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, *tx1));
+    BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, *tx2));
+    BOOST_CHECK_EQUAL(peers.initiator.GetSetSize(RESPONDER), 2U);
+
+    // The peer announced a transaction to us, so it has it already.
+    peers.initiator.TryRemovingFromSet(RESPONDER, tx1->GetWitnessHash());
+    peers.initiator.TryRemovingFromSet(RESPONDER, MakeTx()->GetWitnessHash());
+    BOOST_CHECK_EQUAL(peers.initiator.GetSetSize(RESPONDER), 1U);
+
+    peers.initiator.ForgetPeer(RESPONDER);
+    BOOST_CHECK_EQUAL(peers.initiator.GetSetSize(RESPONDER), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(reconcile)
+{
+    TrackerPair peers;
+    std::set<uint256> only_initiator, only_responder;
+    for (int i = 0; i < 100; ++i) {
+        const CTransactionRef tx = MakeTx();
+        BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, *tx));
+        BOOST_CHECK(peers.responder.AddToSet(INITIATOR, *tx));
+    }
+    for (int i = 0; i < 10; ++i) {
+        const CTransactionRef tx = MakeTx();
+        BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, *tx));
+        only_initiator.insert(tx->GetWitnessHash());
+    }
+    for (int i = 0; i < 15; ++i) {
+        const CTransactionRef tx = MakeTx();
+        BOOST_CHECK(peers.responder.AddToSet(INITIATOR, *tx));
+        only_responder.insert(tx->GetWitnessHash());
+    }
+
+    std::set<uint256> initiator_announces, responder_announces;
+    BOOST_CHECK(peers.Reconcile(initiator_announces, responder_announces));
+    BOOST_CHECK(initiator_announces == only_initiator);
+    BOOST_CHECK(responder_announces == only_responder);
+
+    // The sets were used up by the reconciliation.
+    BOOST_CHECK_EQUAL(peers.initiator.GetSetSize(RESPONDER), 0U);
+    BOOST_CHECK_EQUAL(peers.responder.GetSetSize(INITIATOR), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(reconcile_failure)
+{
+    // A difference far larger than the sketch: both sides announce everything.
+    TrackerPair peers;
+    std::set<uint256> initiator_txs, responder_txs;
+    for (int i = 0; i < 300; ++i) {
+        const CTransactionRef tx = MakeTx();
+        BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, *tx));
+        initiator_txs.insert(tx->GetWitnessHash());
+    }
+    const CTransactionRef tx = MakeTx();
+    BOOST_CHECK(peers.responder.AddToSet(INITIATOR, *tx));
+    responder_txs.insert(tx->GetWitnessHash());
+
+    std::set<uint256> initiator_announces, responder_announces;
+    BOOST_CHECK(!peers.Reconcile(initiator_announces, responder_announces));
+    BOOST_CHECK(initiator_announces == initiator_txs);
+    BOOST_CHECK(responder_announces == responder_txs);
+}
+
+BOOST_AUTO_TEST_CASE(protocol_violations)
+{
+    TrackerPair peers;
+    std::vector<unsigned char> skdata;
+    ReconciliationOutcome outcome;
+    std::vector<uint256> announce;
+
+    // Messages for the wrong role, or out of order
+    BOOST_CHECK(!peers.initiator.HandleReconciliationRequest(RESPONDER, 0, 0, std::chrono::seconds{10}, skdata));
+    BOOST_CHECK(!peers.responder.HandleSketch(INITIATOR, skdata, outcome));
+    BOOST_CHECK(!peers.initiator.HandleSketch(RESPONDER, skdata, outcome));
+    BOOST_CHECK(!peers.responder.HandleReconciliationDifference(INITIATOR, true, {}, announce));
+    BOOST_CHECK(!peers.responder.MaybeRequestReconciliation(INITIATOR, std::chrono::seconds{10}));
+
+    BOOST_CHECK(!peers.initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{1}));
+    BOOST_REQUIRE(peers.initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{10}));
+    BOOST_CHECK(peers.responder.HandleReconciliationRequest(INITIATOR, 0, 0, std::chrono::seconds{10}, skdata));
+    BOOST_CHECK(!peers.responder.HandleReconciliationRequest(INITIATOR, 0, 0, std::chrono::seconds{10}, skdata));
+
+    // Sketches that do not parse or are too large
+    BOOST_CHECK(!peers.initiator.HandleSketch(RESPONDER, std::vector<unsigned char>(3), outcome));
+    BOOST_CHECK(!peers.initiator.HandleSketch(RESPONDER, std::vector<unsigned char>((MAX_SKETCH_CAPACITY + 1) * PinSketch::BYTES_PER_CAPACITY), outcome));
+    BOOST_CHECK(peers.initiator.HandleSketch(RESPONDER, skdata, outcome));
+    BOOST_CHECK(peers.responder.HandleReconciliationDifference(INITIATOR, outcome.success, outcome.ask_shortids, announce));
+    BOOST_CHECK(!peers.responder.HandleReconciliationDifference(INITIATOR, outcome.success, outcome.ask_shortids, announce));
+}
+
+BOOST_AUTO_TEST_CASE(reconcile_timeout)
+{
+    TrackerPair peers;
+    std::set<uint256> initiator_txs, responder_txs;
+    for (int i = 0; i < 5; ++i) {
+        const CTransactionRef tx = MakeTx();
+        BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, *tx));
+        initiator_txs.insert(tx->GetWitnessHash());
+    }
+    const CTransactionRef tx = MakeTx();
+    BOOST_CHECK(peers.responder.AddToSet(INITIATOR, *tx));
+    responder_txs.insert(tx->GetWitnessHash());
+
+    // The initiator gives up waiting for the sketch and announces its snapshot.
+    BOOST_CHECK(!peers.initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{1}));
+    const auto request = peers.initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{10});
+    BOOST_REQUIRE(request);
+    BOOST_CHECK(peers.initiator.ExpireReconciliation(RESPONDER, std::chrono::seconds{10} + RECON_RESPONSE_TIMEOUT - std::chrono::seconds{1}).empty());
+    std::vector<uint256> expired = peers.initiator.ExpireReconciliation(RESPONDER, std::chrono::seconds{10} + RECON_RESPONSE_TIMEOUT);
+    BOOST_CHECK(std::set<uint256>(expired.begin(), expired.end()) == initiator_txs);
+    BOOST_CHECK_EQUAL(peers.initiator.GetSetSize(RESPONDER), 0U);
+
+    // Until the late sketch arrives, transactions are announced instead and no new reconciliation starts.
+    BOOST_CHECK(!peers.initiator.AddToSet(RESPONDER, *MakeTx()));
+    BOOST_CHECK(!peers.initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{60}));
+
+    // The late sketch is answered as a failure, so that the responder announces its snapshot.
+    std::vector<unsigned char> skdata;
+    BOOST_REQUIRE(peers.responder.HandleReconciliationRequest(INITIATOR, request->first, request->second, std::chrono::seconds{30}, skdata));
+    ReconciliationOutcome outcome;
+    BOOST_REQUIRE(peers.initiator.HandleSketch(RESPONDER, skdata, outcome));
+    BOOST_CHECK(!outcome.success);
+    BOOST_CHECK(outcome.announce.empty());
+    std::vector<uint256> announce;
+    BOOST_REQUIRE(peers.responder.HandleReconciliationDifference(INITIATOR, outcome.success, outcome.ask_shortids, announce));
+    BOOST_CHECK(std::set<uint256>(announce.begin(), announce.end()) == responder_txs);
+    BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, *MakeTx()));
+    BOOST_CHECK(peers.initiator.MaybeRequestReconciliation(RESPONDER, std::chrono::seconds{60}));
+
+    // A responder that gives up announces its snapshot and ignores the late RECONCILDIFF.
+    const CTransactionRef tx2 = MakeTx();
+    BOOST_CHECK(peers.responder.AddToSet(INITIATOR, *tx2));
+    BOOST_REQUIRE(peers.responder.HandleReconciliationRequest(INITIATOR, 1, 0, std::chrono::seconds{60}, skdata));
+    expired = peers.responder.ExpireReconciliation(INITIATOR, std::chrono::seconds{60} + RECON_RESPONSE_TIMEOUT);
+    BOOST_REQUIRE_EQUAL(expired.size(), 1U);
+    BOOST_CHECK(expired[0] == tx2->GetWitnessHash());
+    BOOST_CHECK(!peers.responder.HandleReconciliationRequest(INITIATOR, 1, 0, std::chrono::seconds{80}, skdata));
+    BOOST_REQUIRE(peers.initiator.HandleSketch(RESPONDER, skdata, outcome));
+    BOOST_CHECK(peers.responder.HandleReconciliationDifference(INITIATOR, outcome.success, outcome.ask_shortids, announce));
+    BOOST_CHECK(announce.empty());
+    BOOST_CHECK(!peers.responder.HandleReconciliationDifference(INITIATOR, outcome.success, outcome.ask_shortids, announce));
+}
+
+BOOST_AUTO_TEST_CASE(mweb_short_ids)
+{
+    // The wtxid does not commit to the MWEB part of a transaction.
+    const CTransactionRef canonical = MakeTx();
+    CMutableTransaction mtx1(*canonical), mtx2(*canonical);
+    mtx1.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(1000).GetTransaction());
+    mtx2.mweb_tx = MWEB::Tx(test::Tx::CreatePegIn(2000).GetTransaction());
+    const CTransaction tx1(mtx1), tx2(mtx2);
+    BOOST_CHECK(tx1.GetWitnessHash() == tx2.GetWitnessHash());
+
+    // Both are reconciled, as different transactions.
+    TrackerPair peers;
+    BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, tx1));
+    BOOST_CHECK(peers.initiator.AddToSet(RESPONDER, tx2));
+    BOOST_CHECK_EQUAL(peers.initiator.GetSetSize(RESPONDER), 2U);
+
+    // The peer having one of them does not hide that it lacks the other.
+    BOOST_CHECK(peers.responder.AddToSet(INITIATOR, tx1));
+    std::set<uint256> initiator_announces, responder_announces;
+    BOOST_CHECK(peers.Reconcile(initiator_announces, responder_announces));
+    BOOST_CHECK(initiator_announces == std::set<uint256>({tx2.GetWitnessHash()}));
+    BOOST_CHECK(responder_announces.empty());
+}
+
+BOOST_AUTO_TEST_CASE(estimate_sketch_capacity)
+{
+    // Never below the difference in set sizes
+    BOOST_CHECK_GE(EstimateSketchCapacity(100, 30, 0), 70U);
+    BOOST_CHECK_GE(EstimateSketchCapacity(30, 100, 0), 70U);
+    // and growing with q
+    BOOST_CHECK_GT(EstimateSketchCapacity(100, 100, Q_PRECISION), EstimateSketchCapacity(100, 100, Q_PRECISION / 4));
+}
+
+BOOST_AUTO_TEST_CASE(simulation)
+{
+    TxRelaySimulationOptions options;
+    options.num_nodes = 30;
+    options.num_txs = 200;
+    const TxRelaySimulationResult flooding = SimulateTxRelay(options);
+    options.reconciliation = true;
+    const TxRelaySimulationResult reconciliation = SimulateTxRelay(options);
+
+    BOOST_CHECK(flooding.complete);
+    BOOST_CHECK(reconciliation.complete);
+    // Reconciliation spends far less on announcements, without slowing propagation down much.
+    BOOST_CHECK_LT(reconciliation.announcement_bytes, flooding.announcement_bytes * 7 / 10);
+    BOOST_CHECK_LE(reconciliation.propagation_seconds, flooding.propagation_seconds + 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
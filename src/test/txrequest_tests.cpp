@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <thread>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -32,6 +33,8 @@ using Action = std::pair<std::chrono::microseconds, std::function<void()>>;
  */
 struct Runner
 {
+    explicit Runner(size_t num_shards) : txrequest(/* deterministic */ false, num_shards) {}
+
     /** The TxRequestTracker being tested. */
     TxRequestTracker txrequest;
 
@@ -680,7 +683,7 @@ void BuildWeirdRequestsTest(Scenario& scenario)
     scenario.Check(peer2, {}, 0, 0, 0, "q23");
 }
 
-void TestInterleavedScenarios()
+void TestInterleavedScenarios(size_t num_shards)
 {
     // Create a list of functions which add tests to scenarios.
     std::vector<std::function<void(Scenario&)>> builders;
@@ -697,7 +700,7 @@ void TestInterleavedScenarios()
     // Randomly shuffle all those functions.
     Shuffle(builders.begin(), builders.end(), g_insecure_rand_ctx);
 
-    Runner runner;
+    Runner runner(num_shards);
     auto starttime = RandomTime1y();
     // Construct many scenarios, and run (up to) 10 randomly-chosen tests consecutively in each.
     while (builders.size()) {
@@ -731,8 +734,59 @@ void TestInterleavedScenarios()
 BOOST_AUTO_TEST_CASE(TxRequestTest)
 {
     for (int i = 0; i < 5; ++i) {
-        TestInterleavedScenarios();
+        // The rules apply per txhash, so sharding by txhash must not change the outcome.
+        TestInterleavedScenarios(i % 2 ? 1 : DEFAULT_TXREQUEST_SHARDS);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TxRequestConcurrencyTest)
+{
+    // Several threads, each handling its own peers like the message handlers do, process the announcements
+    // of the same transactions by all of them.
+    constexpr int NUM_THREADS = 4;
+    constexpr int PEERS_PER_THREAD = 8;
+    constexpr int NUM_TXHASHES = 500;
+    TxRequestTracker txrequest;
+    std::vector<uint256> txhashes;
+    for (int i = 0; i < NUM_TXHASHES; ++i) txhashes.push_back(InsecureRand256());
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&txrequest, &txhashes, t] {
+            FastRandomContext rng;
+            std::chrono::microseconds now{1000000};
+            for (const uint256& txhash : txhashes) {
+                for (NodeId peer = t * PEERS_PER_THREAD; peer < (t + 1) * PEERS_PER_THREAD; ++peer) {
+                    txrequest.ReceivedInv(peer, GenTxid{true, txhash}, rng.randbool(), now);
+                }
+            }
+            for (int round = 0; round < 20; ++round) {
+                now += std::chrono::microseconds{1 + rng.randrange(1000)};
+                for (NodeId peer = t * PEERS_PER_THREAD; peer < (t + 1) * PEERS_PER_THREAD; ++peer) {
+                    for (const GenTxid& gtxid : txrequest.GetRequestable(peer, now)) {
+                        txrequest.RequestedTx(peer, gtxid.GetHash(), now + std::chrono::microseconds{1 + rng.randrange(2000)});
+                        // Most requests are answered with the transaction, some with a NOTFOUND and some not at all.
+                        const uint64_t outcome = rng.randrange(4);
+                        if (outcome == 0) {
+                            txrequest.ReceivedResponse(peer, gtxid.GetHash());
+                        } else if (outcome != 1) {
+                            txrequest.ForgetTxHash(gtxid.GetHash());
+                        }
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    txrequest.SanityCheck();
+
+    for (NodeId peer = 0; peer < NUM_THREADS * PEERS_PER_THREAD; ++peer) {
+        BOOST_CHECK(txrequest.Count(peer) <= size_t(NUM_TXHASHES));
+        BOOST_CHECK(txrequest.CountInFlight(peer) + txrequest.CountCandidates(peer) <= txrequest.Count(peer));
+        txrequest.DisconnectedPeer(peer);
     }
+    txrequest.SanityCheck();
+    BOOST_CHECK_EQUAL(txrequest.Size(), 0U);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,8 @@
 
 #include <consensus/validation.h>
 #include <key.h>
+#include <policy/policy.h>
+#include <mweb/mweb_node.h>
 #include <script/sign.h>
 #include <script/signingprovider.h>
 #include <script/standard.h>
@@ -11,6 +13,8 @@
 #include <txmempool.h>
 #include <validation.h>
 
+#include <test_framework/models/Tx.h>
+
 #include <boost/test/unit_test.hpp>
 
 bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks);
@@ -371,4 +375,76 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(prevalidated_mempool_acceptance, TestChain100Setup)
+{
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto spend = [&](const CTransactionRef& prev, CAmount value) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(prev->GetHash(), 0);
+        tx.vout.emplace_back(value, script_pub_key);
+        std::vector<unsigned char> sig;
+        const uint256 hash = SignatureHash(script_pub_key, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << sig;
+        return tx;
+    };
+    const auto to_mempool = [&](const CTransactionRef& tx, TxValidationState& state) {
+        LOCK(cs_main);
+        return AcceptToMemoryPool(*m_node.mempool, state, tx, nullptr /* plTxnReplaced */, true /* bypass_limits */);
+    };
+
+    // Mature the second and third coinbase too, they are spent below
+    for (int i = 0; i < 2; ++i) CreateAndProcessBlock({}, script_pub_key);
+
+    // A child is verified against the outputs of its parent in the same batch
+    const CTransactionRef parent = MakeTransactionRef(spend(m_coinbase_txns[0], 11 * CENT));
+    const CTransactionRef child = MakeTransactionRef(spend(parent, 10 * CENT));
+    CMutableTransaction bad_sig = spend(m_coinbase_txns[1], 11 * CENT);
+    bad_sig.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1);
+    const CTransactionRef bad = MakeTransactionRef(bad_sig);
+    CMutableTransaction no_fee_tx = spend(m_coinbase_txns[2], m_coinbase_txns[2]->vout[0].nValue);
+    const CTransactionRef no_fee = MakeTransactionRef(no_fee_tx);
+    PrevalidateTransactions(*m_node.mempool, {parent, child, bad});
+    PrevalidateTransactions(*m_node.mempool, {no_fee});
+
+    // The input scripts of valid transactions were verified, while those of
+    // transactions that pay too little fee were not
+    const auto scripts_cached = [&](const CTransactionRef& tx) {
+        LOCK(cs_main);
+        TxValidationState state;
+        PrecomputedTransactionData txdata;
+        std::vector<CScriptCheck> deferred_checks;
+        CCoinsViewCache view(&::ChainstateActive().CoinsTip());
+        // Without a cache entry, the checks are deferred, which needs the coins
+        if (!view.HaveInputs(*tx)) return false;
+        BOOST_CHECK(CheckInputScripts(*tx, state, view, STANDARD_SCRIPT_VERIFY_FLAGS, true, /* cacheFullScriptStore */ true, txdata, &deferred_checks));
+        return deferred_checks.empty();
+    };
+    BOOST_CHECK(scripts_cached(parent));
+    BOOST_CHECK(!scripts_cached(bad));
+    BOOST_CHECK(!scripts_cached(no_fee));
+
+    // Prevalidation accepts and rejects nothing by itself
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+    TxValidationState state;
+    BOOST_CHECK(to_mempool(parent, state));
+    BOOST_CHECK(to_mempool(child, state));
+    BOOST_CHECK(!to_mempool(bad, state));
+    BOOST_CHECK_EQUAL(state.GetResult(), TxValidationResult::TX_CONSENSUS);
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 2U);
+
+    // A cached MWEB transaction skips only its own verification, not the
+    // checks against the canonical transaction carrying it
+    const test::Tx pegin = test::Tx::CreatePegIn(COIN);
+    CMutableTransaction pegin_tx;
+    pegin_tx.mweb_tx = MWEB::Tx(pegin.GetTransaction());
+    pegin_tx.vout.emplace_back(COIN, GetScriptForPegin(pegin_tx.mweb_tx.GetPegIns().front().GetKernelID()));
+    TxValidationState pegin_state;
+    BOOST_CHECK(MWEB::Node::CheckTransaction(CTransaction(pegin_tx), pegin_state, /* cache_store */ true));
+    pegin_tx.vout[0].nValue = 2 * COIN;
+    BOOST_CHECK(!MWEB::Node::CheckTransaction(CTransaction(pegin_tx), pegin_state));
+    BOOST_CHECK_EQUAL(pegin_state.GetRejectReason(), "pegin-mismatch");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
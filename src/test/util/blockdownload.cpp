@@ -0,0 +1,123 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/util/blockdownload.h>
+
+#include <blockdownload.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <tuple>
+
+namespace {
+
+class BlockDownloadSimulation
+{
+    struct Peer {
+        BlockDownloadSimulationPeer link;
+        BlockDownloadRate rate;
+        //! When the peer is done sending what it was asked for so far
+        std::chrono::microseconds busy_until{0};
+        int in_flight{0};
+    };
+
+    //! (time, height, peer) of a block arriving; peer -1 for a block done validating
+    using Event = std::tuple<std::chrono::microseconds, int, int>;
+
+    const BlockDownloadSimulationOptions m_options;
+    std::vector<Peer> m_peers;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> m_events;
+    std::chrono::microseconds m_now{0};
+    std::vector<bool> m_received;
+    std::vector<std::chrono::microseconds> m_requested;
+    //! Blocks are never requested twice, so they are requested in order.
+    int m_next_request{0};
+    //! Number of blocks received without gaps, which is where the download window starts
+    int m_common{0};
+    int m_validated{0};
+    bool m_validating{false};
+    BlockDownloadSimulationResult m_result;
+
+    int Target(const Peer& peer) const
+    {
+        return m_options.adaptive ? peer.rate.GetTargetInFlight() : MIN_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+
+    int Window() const
+    {
+        if (!m_options.adaptive) return MIN_BLOCK_DOWNLOAD_WINDOW;
+        int total_target{0};
+        for (const Peer& peer : m_peers) total_target += peer.rate.GetTargetInFlight();
+        return GetBlockDownloadWindow(total_target);
+    }
+
+    void Request()
+    {
+        const int window_end = std::min(m_common + Window(), m_options.num_blocks);
+        for (size_t i = 0; i < m_peers.size(); ++i) {
+            Peer& peer = m_peers[i];
+            const bool request = m_options.adaptive ? peer.rate.ShouldRequest(peer.in_flight) : peer.in_flight < Target(peer);
+            if (!request || m_next_request >= window_end) continue;
+            ++m_result.getdata_messages;
+            const auto one_way = std::chrono::duration_cast<std::chrono::microseconds>(peer.link.round_trip) / 2;
+            const std::chrono::microseconds transfer{int64_t(m_options.block_bytes * 1000000 / peer.link.bytes_per_second)};
+            for (; peer.in_flight < Target(peer) && m_next_request < window_end; ++peer.in_flight, ++m_next_request) {
+                peer.busy_until = std::max(peer.busy_until, m_now + one_way) + transfer;
+                m_requested[m_next_request] = m_now;
+                m_events.emplace(peer.busy_until + one_way, m_next_request, i);
+            }
+        }
+        int in_flight{0};
+        for (const Peer& peer : m_peers) in_flight += peer.in_flight;
+        m_result.max_in_flight = std::max(m_result.max_in_flight, in_flight);
+    }
+
+    void Validate()
+    {
+        if (m_validating || m_validated == m_options.num_blocks || !m_received[m_validated]) return;
+        m_validating = true;
+        m_events.emplace(m_now + m_options.validation_time, m_validated, -1);
+    }
+
+public:
+    explicit BlockDownloadSimulation(const BlockDownloadSimulationOptions& options)
+        : m_options(options), m_received(options.num_blocks), m_requested(options.num_blocks)
+    {
+        for (const BlockDownloadSimulationPeer& link : options.peers) {
+            m_peers.emplace_back();
+            m_peers.back().link = link;
+        }
+    }
+
+    BlockDownloadSimulationResult Run()
+    {
+        Request();
+        while (!m_events.empty()) {
+            int height, peer;
+            std::tie(m_now, height, peer) = m_events.top();
+            m_events.pop();
+            if (peer < 0) {
+                m_validating = false;
+                if (++m_validated == m_options.num_blocks) break;
+            } else {
+                m_received[height] = true;
+                --m_peers[peer].in_flight;
+                m_peers[peer].rate.BlockReceived(m_options.block_bytes, m_requested[height], m_now);
+                while (m_common < m_options.num_blocks && m_received[m_common]) ++m_common;
+            }
+            Validate();
+            Request();
+        }
+        m_result.duration = m_now;
+        return m_result;
+    }
+};
+
+} // namespace
+
+BlockDownloadSimulationResult SimulateBlockDownload(const BlockDownloadSimulationOptions& options)
+{
+    return BlockDownloadSimulation(options).Run();
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TEST_UTIL_BLOCKDOWNLOAD_H
+#define BITCOIN_TEST_UTIL_BLOCKDOWNLOAD_H
+
+#include <chrono>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct BlockDownloadSimulationPeer {
+    uint64_t bytes_per_second{1000000};
+    std::chrono::milliseconds round_trip{100};
+};
+
+struct BlockDownloadSimulationOptions {
+    std::vector<BlockDownloadSimulationPeer> peers{8};
+    int num_blocks{20000};
+    size_t block_bytes{1000};
+    //! Time the validation of a block takes, once its parent is validated
+    std::chrono::microseconds validation_time{500};
+    //! Size the blocks in flight by BlockDownloadRate, rather than keeping MIN_BLOCKS_IN_TRANSIT_PER_PEER in
+    //! flight from each peer within a MIN_BLOCK_DOWNLOAD_WINDOW window
+    bool adaptive{false};
+};
+
+struct BlockDownloadSimulationResult {
+    //! Time until the last block was validated
+    std::chrono::microseconds duration{0};
+    //! Most blocks that were in flight from all peers together
+    int max_in_flight{0};
+    //! Number of GETDATA messages sent
+    int getdata_messages{0};
+};
+
+/**
+ * Simulate an initial block download from peers that each send the blocks
+ * requested from them in order, at their bandwidth and after their round
+ * trip time, and a validation that connects them in order. Blocks are
+ * requested like net_processing does: the lowest heights not yet in flight
+ * within the block download window.
+ */
+BlockDownloadSimulationResult SimulateBlockDownload(const BlockDownloadSimulationOptions& options);
+
+#endif // BITCOIN_TEST_UTIL_BLOCKDOWNLOAD_H
@@ -37,3 +37,33 @@ bool ConnmanTestMsg::ReceiveMsgFrom(CNode& node, CSerializedNetMsg& ser_msg) con
     NodeReceiveMsgBytes(node, (const char*)ser_msg.data.data(), ser_msg.data.size(), complete);
     return complete;
 }
+
+void ConnmanTestMsg::SocketHandlerOnce()
+{
+#ifdef USE_EPOLL
+    if (m_socket_events_mode == SocketEventsMode::EPOLL) {
+        SocketHandlerEpoll();
+        return;
+    }
+#endif
+    SocketHandler();
+}
+
+std::set<NodeId> ConnmanTestMsg::TakeMessageHandlerReadyNodes()
+{
+    std::set<NodeId> ready_nodes;
+    for (size_t i = 0; i < m_msghand_shards.size(); ++i) {
+        const std::set<NodeId> shard_ready_nodes = TakeMessageHandlerReadyNodes(i);
+        ready_nodes.insert(shard_ready_nodes.begin(), shard_ready_nodes.end());
+    }
+    return ready_nodes;
+}
+
+std::set<NodeId> ConnmanTestMsg::TakeMessageHandlerReadyNodes(size_t shard_index)
+{
+    MessageHandlerShard& shard = *m_msghand_shards.at(shard_index);
+    LOCK(shard.mutexMsgProc);
+    std::set<NodeId> ready_nodes;
+    ready_nodes.swap(shard.m_ready_nodes);
+    return ready_nodes;
+}
@@ -11,6 +11,7 @@ struct ConnmanTestMsg : public CConnman {
     using CConnman::CConnman;
     void AddTestNode(CNode& node)
     {
+        RegisterSocketEvents(&node);
         LOCK(cs_vNodes);
         vNodes.push_back(&node);
     }
@@ -25,6 +26,23 @@ struct ConnmanTestMsg : public CConnman {
 
     void ProcessMessagesOnce(CNode& node) { m_msgproc->ProcessMessages(&node, flagInterruptMsgProc); }
 
+    /** Set up socket events as Start() does, for the mode given by Init() */
+    void StartSocketEvents() { CConnman::StartSocketEvents(); }
+    SocketEventsMode GetSocketEventsMode() const { return m_socket_events_mode; }
+    /** One pass of the socket handler thread */
+    void SocketHandlerOnce();
+    /** Send as much of the queued messages of a node as its socket takes */
+    size_t SendQueuedData(CNode& node)
+    {
+        LOCK(node.cs_vSend);
+        return SocketSendData(&node);
+    }
+    /** Nodes the message handler was woken up for since the last call */
+    std::set<NodeId> TakeMessageHandlerReadyNodes();
+    /** Same, for just one of the message handler threads */
+    std::set<NodeId> TakeMessageHandlerReadyNodes(size_t shard_index);
+    size_t GetMessageHandlerThreads() const { return m_msghand_shards.size(); }
+
     void NodeReceiveMsgBytes(CNode& node, const char* pch, unsigned int nBytes, bool& complete) const;
 
     bool ReceiveMsgFrom(CNode& node, CSerializedNetMsg& ser_msg) const;
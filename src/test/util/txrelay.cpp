@@ -0,0 +1,221 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/util/txrelay.h>
+
+#include <primitives/transaction.h>
+#include <protocol.h>
+#include <random.h>
+#include <serialize.h>
+#include <txreconciliation.h>
+#include <util/memory.h>
+#include <version.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+//! Resolution of the simulation
+constexpr std::chrono::milliseconds TICK{100};
+//! How often a node announces what it learned
+constexpr std::chrono::seconds RELAY_INTERVAL{1};
+
+template <typename... Args>
+uint64_t MessageSize(const Args&... args)
+{
+    return CMessageHeader::HEADER_SIZE + GetSerializeSizeMany(PROTOCOL_VERSION, args...);
+}
+
+class TxRelaySimulation
+{
+    struct Node {
+        std::vector<size_t> peers;
+        //! Peers we made the connection to
+        std::set<size_t> outbound;
+        std::unique_ptr<TxReconciliationTracker> tracker;
+        //! Tick within RELAY_INTERVAL at which the node announces
+        int64_t relay_phase;
+        std::vector<bool> has_tx;
+        //! Transactions to announce in the next second
+        std::vector<size_t> to_relay;
+        //! (peer, transaction) pairs the peer knows of, or that we took care of already
+        std::set<std::pair<size_t, size_t>> known;
+    };
+
+    const TxRelaySimulationOptions m_options;
+    FastRandomContext m_rng{/* fDeterministic */ true};
+    std::vector<Node> m_nodes;
+    std::vector<CTransactionRef> m_txs;
+    std::map<uint256, size_t> m_tx_index;
+    TxRelaySimulationResult m_result;
+    size_t m_missing;
+
+    void Learn(size_t node, size_t tx)
+    {
+        if (m_nodes[node].has_tx[tx]) return;
+        m_nodes[node].has_tx[tx] = true;
+        m_nodes[node].to_relay.push_back(tx);
+        --m_missing;
+    }
+
+    void SendInv(size_t from, size_t to, const std::vector<size_t>& txs)
+    {
+        if (txs.empty()) return;
+        std::vector<CInv> invs;
+        for (const size_t tx : txs) invs.emplace_back(MSG_WTX, m_txs[tx]->GetWitnessHash());
+        m_result.announcement_bytes += MessageSize(invs);
+        for (const size_t tx : txs) {
+            m_nodes[to].known.emplace(from, tx);
+            if (m_nodes[to].tracker) m_nodes[to].tracker->TryRemovingFromSet(from, m_txs[tx]->GetWitnessHash());
+            Learn(to, tx);
+        }
+    }
+
+    std::vector<size_t> Indexes(const std::vector<uint256>& wtxids) const
+    {
+        std::vector<size_t> txs;
+        for (const uint256& wtxid : wtxids) txs.push_back(m_tx_index.at(wtxid));
+        return txs;
+    }
+
+    void Connect(size_t from, size_t to)
+    {
+        m_nodes[from].peers.push_back(to);
+        m_nodes[from].outbound.insert(to);
+        m_nodes[to].peers.push_back(from);
+        if (!m_options.reconciliation) return;
+        const uint64_t from_salt = m_nodes[from].tracker->PreRegisterPeer(to);
+        const uint64_t to_salt = m_nodes[to].tracker->PreRegisterPeer(from);
+        m_nodes[from].tracker->RegisterPeer(to, /*is_peer_inbound=*/false, TXRECONCILIATION_VERSION, to_salt);
+        m_nodes[to].tracker->RegisterPeer(from, /*is_peer_inbound=*/true, TXRECONCILIATION_VERSION, from_salt);
+    }
+
+    void Relay(int64_t tick)
+    {
+        // Everything is sent at once, so that nothing propagates further within the same tick.
+        std::vector<std::pair<std::pair<size_t, size_t>, std::vector<size_t>>> invs;
+        for (size_t node = 0; node < m_nodes.size(); ++node) {
+            Node& sender = m_nodes[node];
+            // Announcements wait for the relay tick; reconciliation sets are not observable until the next
+            // reconciliation, so transactions are added to them right away.
+            const bool announce = tick % (RELAY_INTERVAL / TICK) == sender.relay_phase;
+            std::vector<size_t> to_relay;
+            to_relay.swap(sender.to_relay);
+            for (const size_t peer : sender.peers) {
+                const bool flood = !sender.tracker || sender.tracker->ShouldFloodTo(peer);
+                std::vector<size_t> txs;
+                for (const size_t tx : to_relay) {
+                    if ((flood && !announce) || !sender.known.emplace(peer, tx).second) continue;
+                    if (flood || !sender.tracker->AddToSet(peer, *m_txs[tx])) txs.push_back(tx);
+                }
+                invs.emplace_back(std::make_pair(node, peer), std::move(txs));
+            }
+            if (!announce) sender.to_relay = std::move(to_relay);
+        }
+        for (const auto& inv : invs) SendInv(inv.first.first, inv.first.second, inv.second);
+    }
+
+    void Reconcile(std::chrono::microseconds now)
+    {
+        for (size_t node = 0; node < m_nodes.size(); ++node) {
+            Node& initiator = m_nodes[node];
+            for (const size_t peer : initiator.outbound) {
+                Node& responder = m_nodes[peer];
+                const auto request = initiator.tracker->MaybeRequestReconciliation(peer, now);
+                if (!request) continue;
+                m_result.announcement_bytes += MessageSize(request->first, request->second);
+
+                std::vector<unsigned char> skdata;
+                bool ok = responder.tracker->HandleReconciliationRequest(node, request->first, request->second, now, skdata);
+                assert(ok);
+                m_result.announcement_bytes += MessageSize(skdata);
+
+                ReconciliationOutcome outcome;
+                ok = initiator.tracker->HandleSketch(peer, skdata, outcome);
+                assert(ok);
+                SendInv(node, peer, Indexes(outcome.announce));
+                m_result.announcement_bytes += MessageSize(uint8_t{outcome.success}, outcome.ask_shortids);
+
+                std::vector<uint256> announce;
+                ok = responder.tracker->HandleReconciliationDifference(node, outcome.success, outcome.ask_shortids, announce);
+                assert(ok);
+                SendInv(peer, node, Indexes(announce));
+            }
+        }
+    }
+
+    bool Idle() const
+    {
+        for (size_t node = 0; node < m_nodes.size(); ++node) {
+            if (!m_nodes[node].to_relay.empty()) return false;
+            if (!m_nodes[node].tracker) continue;
+            for (const size_t peer : m_nodes[node].peers) {
+                if (m_nodes[node].tracker->GetSetSize(peer) != 0) return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    explicit TxRelaySimulation(const TxRelaySimulationOptions& options)
+        : m_options(options), m_nodes(options.num_nodes), m_missing(options.num_nodes * options.num_txs)
+    {
+        for (Node& node : m_nodes) {
+            if (options.reconciliation) node.tracker = MakeUnique<TxReconciliationTracker>();
+            node.relay_phase = m_rng.randrange(RELAY_INTERVAL / TICK);
+            node.has_tx.resize(options.num_txs);
+        }
+        for (size_t node = 0; node < m_nodes.size(); ++node) {
+            for (size_t i = 0; i < options.outbound_per_node; ++i) {
+                const size_t peer = m_rng.randrange(m_nodes.size());
+                const auto& peers = m_nodes[node].peers;
+                if (peer == node || std::find(peers.begin(), peers.end(), peer) != peers.end()) continue;
+                Connect(node, peer);
+            }
+        }
+        for (size_t tx = 0; tx < options.num_txs; ++tx) {
+            CMutableTransaction mtx;
+            mtx.vin.emplace_back(COutPoint(m_rng.rand256(), 0));
+            mtx.vout.emplace_back(1000, CScript());
+            m_txs.push_back(MakeTransactionRef(std::move(mtx)));
+            m_tx_index.emplace(m_txs.back()->GetWitnessHash(), tx);
+        }
+    }
+
+    TxRelaySimulationResult Run()
+    {
+        const int64_t broadcast_ticks = std::chrono::seconds{m_options.broadcast_seconds} / TICK;
+        // Give up eventually, should a transaction not reach everyone.
+        const int64_t max_ticks = broadcast_ticks + std::chrono::minutes{10} / TICK;
+        size_t next_tx = 0;
+        for (int64_t tick = 0; tick < max_ticks; ++tick) {
+            // Transactions appear evenly over the broadcast period.
+            while (next_tx < m_txs.size() && int64_t(next_tx) * broadcast_ticks <= tick * int64_t(m_txs.size())) {
+                Learn(m_rng.randrange(m_nodes.size()), next_tx++);
+            }
+            Relay(tick);
+            if (m_options.reconciliation) Reconcile((tick + 1) * TICK);
+            if (m_missing == 0 && !m_result.complete) {
+                m_result.complete = true;
+                m_result.propagation_seconds = std::chrono::duration_cast<std::chrono::seconds>((tick + 1) * TICK).count();
+            }
+            if (next_tx == m_txs.size() && Idle()) break;
+        }
+        return m_result;
+    }
+};
+
+} // namespace
+
+TxRelaySimulationResult SimulateTxRelay(const TxRelaySimulationOptions& options)
+{
+    return TxRelaySimulation(options).Run();
+}
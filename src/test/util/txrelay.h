@@ -0,0 +1,39 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TEST_UTIL_TXRELAY_H
+#define BITCOIN_TEST_UTIL_TXRELAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct TxRelaySimulationOptions {
+    size_t num_nodes{50};
+    size_t outbound_per_node{8};
+    size_t num_txs{300};
+    //! Transactions are created at random nodes over this many seconds
+    int broadcast_seconds{20};
+    //! Relay by reconciliation (TxReconciliationTracker) rather than announcing every transaction to every peer
+    bool reconciliation{false};
+};
+
+struct TxRelaySimulationResult {
+    //! Bytes of INV, REQRECON, SKETCH and RECONCILDIFF messages, headers included
+    uint64_t announcement_bytes{0};
+    //! Seconds until every node had every transaction
+    int propagation_seconds{0};
+    //! Whether every node got every transaction
+    bool complete{false};
+};
+
+/**
+ * Simulate the announcement of transactions in a random network, second by
+ * second, and count the bytes spent on it. Transactions themselves and the
+ * GETDATA for them cost the same either way and are not counted; a node
+ * that hears of a transaction gets it right away and announces it from the
+ * next second on.
+ */
+TxRelaySimulationResult SimulateTxRelay(const TxRelaySimulationOptions& options);
+
+#endif // BITCOIN_TEST_UTIL_TXRELAY_H
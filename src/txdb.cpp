@@ -5,6 +5,9 @@
 
 #include <txdb.h>
 
+#include <clientversion.h>
+#include <hash.h>
+#include <streams.h>
 #include <node/ui_interface.h>
 #include <pow.h>
 #include <mweb/mweb_db.h>
@@ -28,6 +31,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_INDEX_SNAPSHOT = 'S';
 
 namespace {
 
@@ -248,6 +252,10 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    if (!blockinfo.empty()) {
+        // The block index snapshot no longer matches the database
+        batch.Erase(DB_BLOCK_INDEX_SNAPSHOT);
+    }
     return WriteBatch(batch, true);
 }
 
@@ -263,6 +271,27 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+/** Construct the block index object for a database or snapshot entry. */
+static void InsertDiskBlockIndex(const uint256& hash, const CDiskBlockIndex& diskindex, const std::function<CBlockIndex*(const uint256&)>& insertBlockIndex)
+{
+    CBlockIndex* pindexNew = insertBlockIndex(hash);
+    pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+    pindexNew->nHeight        = diskindex.nHeight;
+    pindexNew->nFile          = diskindex.nFile;
+    pindexNew->nDataPos       = diskindex.nDataPos;
+    pindexNew->nUndoPos       = diskindex.nUndoPos;
+    pindexNew->nVersion       = diskindex.nVersion;
+    pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+    pindexNew->nTime          = diskindex.nTime;
+    pindexNew->nBits          = diskindex.nBits;
+    pindexNew->nNonce         = diskindex.nNonce;
+    pindexNew->nStatus        = diskindex.nStatus;
+    pindexNew->nTx            = diskindex.nTx;
+    pindexNew->mweb_header    = diskindex.mweb_header;
+    pindexNew->hogex_hash     = diskindex.hogex_hash;
+    pindexNew->mweb_amount    = diskindex.mweb_amount;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -277,22 +306,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
                 // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->mweb_header    = diskindex.mweb_header;
-                pindexNew->hogex_hash     = diskindex.hogex_hash;
-                pindexNew->mweb_amount    = diskindex.mweb_amount;
+                InsertDiskBlockIndex(diskindex.GetBlockHash(), diskindex, insertBlockIndex);
 
                 // Litecoin: Disable PoW Sanity check while loading block index from disk.
                 // We use the sha256 hash for the block index for performance reasons, which is recorded for later use.
@@ -315,6 +329,134 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
     return true;
 }
 
+bool CBlockTreeDB::HashBlockFileInfo(uint256& hash)
+{
+    CHashWriter hasher(SER_GETHASH, 0);
+    int nLastFile = 0;
+    ReadLastBlockFile(nLastFile);
+    hasher << nLastFile;
+    for (int nFile = 0; nFile <= nLastFile; nFile++) {
+        CBlockFileInfo info;
+        if (!ReadBlockFileInfo(nFile, info)) {
+            // A fresh database has no block files yet
+            if (nFile == 0) break;
+            return false;
+        }
+        hasher << info;
+    }
+    hash = hasher.GetHash();
+    return true;
+}
+
+/**
+ * Block index snapshot file format:
+ * - 64-bit snapshot id, also stored in the database under DB_BLOCK_INDEX_SNAPSHOT
+ * - best block of the chainstate database when the snapshot was written
+ * - hash of the block file information (see HashBlockFileInfo)
+ * - number of entries (CompactSize), which must match the database's count
+ *   stored under DB_BLOCK_INDEX_SNAPSHOT
+ * - for each entry: block hash, CDiskBlockIndex
+ * - the snapshot id again, to detect truncated files
+ */
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const fs::path& path, const uint256& best_block, const std::vector<const CBlockIndex*>& blockinfo)
+{
+    const uint64_t snapshot_id = GetRand(std::numeric_limits<uint64_t>::max());
+    uint256 file_info_hash;
+    if (!HashBlockFileInfo(file_info_hash)) {
+        return error("%s: failed to read block file information", __func__);
+    }
+    const fs::path path_tmp = path.string() + ".new";
+    CAutoFile fileout(fsbridge::fopen(path_tmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        return error("%s: failed to open %s", __func__, path_tmp.string());
+    }
+    try {
+        fileout << snapshot_id << best_block << file_info_hash;
+        WriteCompactSize(fileout, blockinfo.size());
+        for (const CBlockIndex* pindex : blockinfo) {
+            fileout << pindex->GetBlockHash() << CDiskBlockIndex(pindex);
+        }
+        fileout << snapshot_id;
+    } catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+    if (!FileCommit(fileout.Get())) {
+        return error("%s: failed to commit %s", __func__, path_tmp.string());
+    }
+    fileout.fclose();
+    if (!RenameOver(path_tmp, path)) {
+        return error("%s: rename to %s failed", __func__, path.string());
+    }
+    return Write(DB_BLOCK_INDEX_SNAPSHOT, std::make_pair(snapshot_id, (uint64_t)blockinfo.size()), true);
+}
+
+bool CBlockTreeDB::LoadBlockIndexSnapshot(const fs::path& path, const uint256& best_block, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+{
+    // Snapshot id and number of entries
+    std::pair<uint64_t, uint64_t> snapshot_info;
+    if (!Read(DB_BLOCK_INDEX_SNAPSHOT, snapshot_info)) return false;
+    const uint64_t snapshot_id = snapshot_info.first;
+    uint256 file_info_hash;
+    if (!HashBlockFileInfo(file_info_hash)) return false;
+
+    // Read the whole file at once; deserializing from memory is much cheaper than from the FILE*.
+    std::vector<unsigned char> data;
+    {
+        CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("%s: failed to open %s", __func__, path.string());
+        }
+        if (fseek(filein.Get(), 0, SEEK_END) != 0) return false;
+        const long file_size = ftell(filein.Get());
+        if (file_size < 0 || fseek(filein.Get(), 0, SEEK_SET) != 0) return false;
+        data.resize(file_size);
+        try {
+            filein.read((char*)data.data(), data.size());
+        } catch (const std::exception& e) {
+            return error("%s: I/O error - %s", __func__, e.what());
+        }
+    }
+
+    std::vector<std::pair<uint256, CDiskBlockIndex>> entries;
+    try {
+        VectorReader reader(SER_DISK, CLIENT_VERSION, data, 0);
+        uint64_t header_id, trailer_id;
+        uint256 snapshot_best_block, snapshot_file_info_hash;
+        reader >> header_id >> snapshot_best_block >> snapshot_file_info_hash;
+        const uint64_t num_entries = ReadCompactSize(reader, /* range_check */ false);
+        // Versions without snapshot support, and the block file writer of any
+        // version, leave the snapshot id alone but change the chainstate or the
+        // block file information.
+        if (header_id != snapshot_id || num_entries != snapshot_info.second ||
+            snapshot_best_block != best_block || snapshot_file_info_hash != file_info_hash) {
+            LogPrintf("Block index snapshot %s does not match the block index database, ignoring it\n", path.string());
+            return false;
+        }
+        // Every entry holds at least a block hash and an 80 byte header
+        if (num_entries > data.size() / (32 + 80)) {
+            return error("%s: snapshot %s is corrupt", __func__, path.string());
+        }
+        entries.resize(num_entries);
+        for (auto& entry : entries) {
+            reader >> entry.first >> entry.second;
+        }
+        reader >> trailer_id;
+        if (trailer_id != snapshot_id) {
+            return error("%s: snapshot %s is truncated", __func__, path.string());
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    std::vector<unsigned char>().swap(data);
+
+    // Only insert once the whole snapshot is known to be good, so the caller can fall back to the database.
+    for (const auto& entry : entries) {
+        InsertDiskBlockIndex(entry.first, entry.second, insertBlockIndex);
+    }
+    LogPrintf("Loaded %u block index entries from snapshot %s\n", entries.size(), path.string());
+    return true;
+}
+
 namespace {
 
 //! Legacy class to deserialize pre-pertxout database entries without reindex.
@@ -112,6 +112,24 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /**
+     * Write the given block index entries to a flat snapshot file at path, and
+     * mark it as current in the database. Any later block index write through
+     * WriteBatchSync invalidates the snapshot. best_block is the best block of
+     * the chainstate database the entries belong to.
+     */
+    bool WriteBlockIndexSnapshot(const fs::path& path, const uint256& best_block, const std::vector<const CBlockIndex*>& blockinfo);
+    /**
+     * Load the block index from the snapshot file at path, which is much faster
+     * than walking the database with LoadBlockIndexGuts. Returns false, without
+     * inserting anything, if there is no snapshot matching the database, the
+     * block file information, and the chainstate database best block.
+     */
+    bool LoadBlockIndexSnapshot(const fs::path& path, const uint256& best_block, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+
+private:
+    /** Hash the last block file number and the information of all block files. */
+    bool HashBlockFileInfo(uint256& hash);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -19,6 +19,8 @@
 #include <util/time.h>
 #include <validationinterface.h>
 
+#include <queue>
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
@@ -438,6 +440,8 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
+    InvalidateClusterChunks(it);
+
     // We increment mempool sequence value no matter removal reason
     // even if not directly reported below.
     uint64_t mempool_sequence = GetAndIncrementSequence();
@@ -926,6 +930,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(delta));
+            InvalidateClusterChunks(it);
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -1031,6 +1036,11 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
             return false;
         }
     }
+    auto it = m_temp_added.find(outpoint);
+    if (it != m_temp_added.end()) {
+        coin = it->second;
+        return true;
+    }
     return base->GetCoin(outpoint, coin);
 }
 
@@ -1046,10 +1056,13 @@ bool CCoinsViewMemPool::HaveCoin(const OutputIndex& index) const
             assert(mempool.mapTx.count(iter->second->GetHash()) > 0);
             return true;
         }
+        if (m_temp_added_mweb.count(boost::get<mw::Hash>(index))) {
+            return true;
+        }
 
         return GetMWEBView()->HasCoin(boost::get<mw::Hash>(index));
     } else {
-        return base->HaveCoin(index);
+        return m_temp_added.count(boost::get<COutPoint>(index)) || base->HaveCoin(index);
     }
 }
 
@@ -1066,6 +1079,11 @@ bool CCoinsViewMemPool::GetMWEBCoin(const mw::Hash& output_id, Output& coin) con
         return iter->second->mweb_tx.GetOutput(output_id, coin);
     }
 
+    auto temp_iter = m_temp_added_mweb.find(output_id);
+    if (temp_iter != m_temp_added_mweb.end()) {
+        return temp_iter->second->mweb_tx.GetOutput(output_id, coin);
+    }
+
     UTXO::CPtr pUTXO = GetMWEBView()->GetUTXO(output_id);
     if (pUTXO) {
         coin = pUTXO->GetOutput();
@@ -1075,6 +1093,16 @@ bool CCoinsViewMemPool::GetMWEBCoin(const mw::Hash& output_id, Output& coin) con
     return false;
 }
 
+void CCoinsViewMemPool::PackageAddTransaction(const CTransactionRef& tx)
+{
+    for (unsigned int n = 0; n < tx->vout.size(); ++n) {
+        m_temp_added.emplace(COutPoint(tx->GetHash(), n), Coin(tx->vout[n], MEMPOOL_HEIGHT, false, tx->mweb_tx.HasPegOut()));
+    }
+    for (const mw::Hash& output_id : tx->mweb_tx.GetOutputIDs()) {
+        m_temp_added_mweb.emplace(output_id, tx);
+    }
+}
+
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
@@ -1127,6 +1155,8 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimat
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
     AssertLockHeld(cs);
+    InvalidateClusterChunks(entry);
+    InvalidateClusterChunks(child);
     CTxMemPoolEntry::Children s;
     if (add && entry->GetMemPoolChildren().insert(*child).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
@@ -1138,6 +1168,8 @@ void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
     AssertLockHeld(cs);
+    InvalidateClusterChunks(entry);
+    InvalidateClusterChunks(parent);
     CTxMemPoolEntry::Parents s;
     if (add && entry->GetMemPoolParents().insert(*parent).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
@@ -1183,20 +1215,36 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
 
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
+    std::vector<Chunk> chunks;
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        setEntries stage;
+        CFeeRate removed;
+        if (m_cluster_mode) {
+            // The worst chunk is the last one of its cluster, so none of its
+            // transactions have descendants outside of it.
+            if (chunks.empty()) chunks = GetChunks();
+            const Chunk chunk = std::move(chunks.back());
+            chunks.pop_back();
+            for (txiter it : chunk.txs) {
+                CalculateDescendants(it, stage);
+            }
+            // Don't keep chunks around that may refer to removed entries
+            if (stage.size() != chunk.txs.size()) chunks.clear();
+            removed = CFeeRate(chunk.fee, chunk.size, chunk.mweb_weight);
+        } else {
+            indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+            CalculateDescendants(mapTx.project<0>(it), stage);
+            removed = CFeeRate(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants(), it->GetMWEBWeightWithDescendants());
+        }
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants(), it->GetMWEBWeightWithDescendants());
         removed += incrementalRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1243,6 +1291,235 @@ uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
     return maximum;
 }
 
+// Virtual bytes that a unit of MWEB weight counts for when comparing chunk
+// feerates, such that a full MWEB block weighs as much as a full block.
+static constexpr int64_t CHUNK_MWEB_WEIGHT_VSIZE = int64_t(MAX_BLOCK_WEIGHT / WITNESS_SCALE_FACTOR) / int64_t(mw::MAX_MINE_WEIGHT);
+
+static int64_t GetChunkSize(uint64_t size, uint64_t mweb_weight)
+{
+    return int64_t(size) + int64_t(mweb_weight) * CHUNK_MWEB_WEIGHT_VSIZE;
+}
+
+// Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+static bool HigherFeerate(CAmount fee_a, int64_t size_a, CAmount fee_b, int64_t size_b)
+{
+    return double(fee_a) * size_b > double(fee_b) * size_a;
+}
+
+static bool HigherFeerate(const CTxMemPool::Chunk& a, const CTxMemPool::Chunk& b)
+{
+    return HigherFeerate(a.fee, GetChunkSize(a.size, a.mweb_weight), b.fee, GetChunkSize(b.size, b.mweb_weight));
+}
+
+/** The chunks of a linearized cluster, shared by all of its entries. */
+struct CachedClusterChunks {
+    std::vector<CTxMemPool::Chunk> chunks;
+    //! Cleared once the cluster changes; entries may still point to it until it is recomputed
+    bool valid{true};
+};
+
+void CTxMemPool::InvalidateClusterChunks(txiter entry) const
+{
+    if (entry->m_cluster_chunks) {
+        entry->m_cluster_chunks->valid = false;
+        entry->m_cluster_chunks.reset();
+    }
+}
+
+void CTxMemPool::WalkCluster(std::vector<txiter>& cluster, size_t limit) const
+{
+    for (size_t i = 0; i < cluster.size() && cluster.size() <= limit; ++i) {
+        for (const CTxMemPoolEntry& parent : cluster[i]->GetMemPoolParentsConst()) {
+            const txiter parent_it = mapTx.iterator_to(parent);
+            if (!visited(parent_it)) cluster.push_back(parent_it);
+        }
+        for (const CTxMemPoolEntry& child : cluster[i]->GetMemPoolChildrenConst()) {
+            const txiter child_it = mapTx.iterator_to(child);
+            if (!visited(child_it)) cluster.push_back(child_it);
+        }
+    }
+}
+
+std::vector<CTxMemPool::txiter> CTxMemPool::CalculateCluster(const std::vector<txiter>& entries, size_t limit) const
+{
+    AssertLockHeld(cs);
+    std::vector<txiter> cluster;
+    const auto epoch = GetFreshEpoch();
+    for (txiter it : entries) {
+        if (!visited(it)) cluster.push_back(it);
+    }
+    WalkCluster(cluster, limit);
+    return cluster;
+}
+
+void CTxMemPool::LinearizeCluster(std::vector<txiter> cluster, size_t cluster_id, std::vector<Chunk>& chunks) const
+{
+    // A transaction has more ancestors than any of its parents, so this puts
+    // parents before their children.
+    std::sort(cluster.begin(), cluster.end(), [](txiter a, txiter b) {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    });
+    const size_t n = cluster.size();
+    std::map<txiter, size_t, CompareIteratorByHash> positions;
+    for (size_t i = 0; i < n; ++i) {
+        positions.emplace(cluster[i], i);
+    }
+
+    std::vector<size_t> linearization;
+    linearization.reserve(n);
+    if (n > m_cluster_limit) {
+        // Take the transaction with the best ancestor score among those whose
+        // parents were all taken.
+        const auto worse_score = [&](size_t a, size_t b) {
+            return HigherFeerate(cluster[b]->GetModFeesWithAncestors(), GetChunkSize(cluster[b]->GetSizeWithAncestors(), cluster[b]->GetMWEBWeightWithAncestors()),
+                                 cluster[a]->GetModFeesWithAncestors(), GetChunkSize(cluster[a]->GetSizeWithAncestors(), cluster[a]->GetMWEBWeightWithAncestors()));
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(worse_score)> ready(worse_score);
+        std::vector<size_t> missing_parents(n);
+        for (size_t i = 0; i < n; ++i) {
+            missing_parents[i] = cluster[i]->GetMemPoolParentsConst().size();
+            if (missing_parents[i] == 0) ready.push(i);
+        }
+        while (!ready.empty()) {
+            const size_t i = ready.top();
+            ready.pop();
+            linearization.push_back(i);
+            for (const CTxMemPoolEntry& child : cluster[i]->GetMemPoolChildrenConst()) {
+                const size_t j = positions.at(mapTx.iterator_to(child));
+                if (--missing_parents[j] == 0) ready.push(j);
+            }
+        }
+    } else {
+        // ancestors[i][j] is set if cluster[j] is cluster[i] or one of its ancestors
+        std::vector<std::vector<bool>> ancestors(n, std::vector<bool>(n, false));
+        std::vector<int64_t> tx_sizes(n);
+        std::vector<CAmount> anc_fees(n, 0);
+        std::vector<int64_t> anc_sizes(n, 0);
+        for (size_t i = 0; i < n; ++i) {
+            ancestors[i][i] = true;
+            for (const CTxMemPoolEntry& parent : cluster[i]->GetMemPoolParentsConst()) {
+                const std::vector<bool>& parent_ancestors = ancestors[positions.at(mapTx.iterator_to(parent))];
+                for (size_t j = 0; j < i; ++j) {
+                    if (parent_ancestors[j]) ancestors[i][j] = true;
+                }
+            }
+            tx_sizes[i] = GetChunkSize(cluster[i]->GetTxSize(), cluster[i]->GetMWEBWeight());
+            for (size_t j = 0; j <= i; ++j) {
+                if (!ancestors[i][j]) continue;
+                anc_fees[i] += cluster[j]->GetModifiedFee();
+                anc_sizes[i] += tx_sizes[j];
+            }
+        }
+
+        // Keep picking the transaction with the best feerate including its not yet
+        // picked ancestors, and pick those along with it.
+        std::vector<bool> picked(n, false);
+        while (linearization.size() < n) {
+            size_t best = n;
+            for (size_t i = 0; i < n; ++i) {
+                if (picked[i]) continue;
+                if (best == n || HigherFeerate(anc_fees[i], anc_sizes[i], anc_fees[best], anc_sizes[best])) best = i;
+            }
+            const size_t first_new = linearization.size();
+            for (size_t j = 0; j <= best; ++j) {
+                if (picked[j] || !ancestors[best][j]) continue;
+                picked[j] = true;
+                linearization.push_back(j);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                if (picked[i]) continue;
+                for (size_t k = first_new; k < linearization.size(); ++k) {
+                    const size_t j = linearization[k];
+                    if (!ancestors[i][j]) continue;
+                    anc_fees[i] -= cluster[j]->GetModifiedFee();
+                    anc_sizes[i] -= tx_sizes[j];
+                }
+            }
+        }
+    }
+
+    // Merge each transaction into the chunks before it for as long as that
+    // raises their feerate, leaving chunks of decreasing feerate.
+    const size_t first_chunk = chunks.size();
+    for (size_t i : linearization) {
+        Chunk chunk;
+        chunk.txs.push_back(cluster[i]);
+        chunk.fee = cluster[i]->GetModifiedFee();
+        chunk.size = cluster[i]->GetTxSize();
+        chunk.mweb_weight = cluster[i]->GetMWEBWeight();
+        chunk.sigops = cluster[i]->GetSigOpCost();
+        chunk.cluster = cluster_id;
+        chunks.push_back(std::move(chunk));
+        while (chunks.size() > first_chunk + 1 && HigherFeerate(chunks.back(), chunks[chunks.size() - 2])) {
+            Chunk& prev = chunks[chunks.size() - 2];
+            const Chunk& last = chunks.back();
+            prev.txs.insert(prev.txs.end(), last.txs.begin(), last.txs.end());
+            prev.fee += last.fee;
+            prev.size += last.size;
+            prev.mweb_weight += last.mweb_weight;
+            prev.sigops += last.sigops;
+            chunks.pop_back();
+        }
+    }
+}
+
+std::vector<CTxMemPool::Chunk> CTxMemPool::GetChunks() const
+{
+    AssertLockHeld(cs);
+    std::vector<Chunk> chunks;
+    chunks.reserve(mapTx.size());
+    size_t cluster_id = 0;
+    const auto epoch = GetFreshEpoch();
+    for (txiter it = mapTx.begin(); it != mapTx.end(); ++it) {
+        if (visited(it)) continue;
+        if (!it->m_cluster_chunks || !it->m_cluster_chunks->valid) {
+            std::vector<txiter> cluster(1, it);
+            WalkCluster(cluster, std::numeric_limits<size_t>::max());
+            auto cached = std::make_shared<CachedClusterChunks>();
+            LinearizeCluster(cluster, 0, cached->chunks);
+            for (txiter member : cluster) {
+                member->m_cluster_chunks = cached;
+            }
+        } else {
+            for (const Chunk& chunk : it->m_cluster_chunks->chunks) {
+                for (txiter member : chunk.txs) {
+                    visited(member);
+                }
+            }
+        }
+        for (const Chunk& chunk : it->m_cluster_chunks->chunks) {
+            chunks.push_back(chunk);
+            chunks.back().cluster = cluster_id;
+        }
+        ++cluster_id;
+    }
+    // Chunks of a cluster already have decreasing feerates, and a stable sort
+    // keeps those with equal ones in order.
+    std::stable_sort(chunks.begin(), chunks.end(), [](const Chunk& a, const Chunk& b) {
+        return HigherFeerate(a, b);
+    });
+    return chunks;
+}
+
+CTxMemPool::Chunk CTxMemPool::GetChunk(txiter it) const
+{
+    AssertLockHeld(cs);
+    if (!it->m_cluster_chunks || !it->m_cluster_chunks->valid) {
+        const std::vector<txiter> cluster = CalculateCluster({it});
+        auto cached = std::make_shared<CachedClusterChunks>();
+        LinearizeCluster(cluster, 0, cached->chunks);
+        for (txiter member : cluster) {
+            member->m_cluster_chunks = cached;
+        }
+    }
+    const std::vector<Chunk>& chunks = it->m_cluster_chunks->chunks;
+    const auto chunk = std::find_if(chunks.begin(), chunks.end(), [&](const Chunk& c) {
+        return std::find(c.txs.begin(), c.txs.end(), it) != c.txs.end();
+    });
+    assert(chunk != chunks.end());
+    return *chunk;
+}
+
 void CTxMemPool::GetTransactionAncestry(const uint256& txid, size_t& ancestors, size_t& descendants) const {
     LOCK(cs);
     auto it = mapTx.find(txid);
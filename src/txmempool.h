@@ -7,7 +7,9 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <atomic>
+#include <limits>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
@@ -40,6 +42,9 @@ static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
 /** Default size of CMemPool's recentTxsByKernel cache */
 static const unsigned int DEFAULT_MEMPOOL_MWEB_CACHE_SIZE = 1000;
 
+/** Default for -mempoolcluster, whether mining, eviction and replacement are driven by cluster chunks */
+static const bool DEFAULT_MEMPOOL_CLUSTER = false;
+
 struct LockPoints
 {
     // Will be set to the blockchain height and median time past
@@ -81,6 +86,8 @@ struct CompareIteratorByHash {
  *
  */
 
+struct CachedClusterChunks;
+
 class CTxMemPoolEntry
 {
 public:
@@ -168,6 +175,7 @@ public:
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
     mutable uint64_t m_epoch; //!< epoch when last touched, useful for graph algorithms
+    mutable std::shared_ptr<CachedClusterChunks> m_cluster_chunks; //!< Chunks of this entry's cluster, shared by all of its entries
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -413,6 +421,7 @@ enum class MemPoolRemovalReason {
     BLOCK,       //!< Removed for block
     CONFLICT,    //!< Removed for conflict with in-block transaction
     REPLACED,    //!< Removed for replacement
+    PACKAGE,     //!< Removed with the rest of a package that was rejected
 };
 
 class SaltedTxidHasher
@@ -526,6 +535,9 @@ private:
     void trackPackageRemoved(const CFeeRate& rate) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     bool m_is_loaded GUARDED_BY(cs){false};
+    bool m_cluster_mode GUARDED_BY(cs){false};
+    //! Clusters larger than this are ordered by ancestor score rather than linearized
+    size_t m_cluster_limit GUARDED_BY(cs){0};
 
 public:
 
@@ -726,6 +738,48 @@ public:
      *  already in it.  */
     void CalculateDescendants(txiter it, setEntries& setDescendants) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** A set of transactions from one cluster (a connected component of the
+     *  in-mempool dependency graph) that is mined or evicted as a unit.
+     *  Chunk feerates count MWEB weight as well as virtual size. */
+    struct Chunk {
+        std::vector<txiter> txs; //!< In an order in which they can be included in a block
+        CAmount fee{0};          //!< Sum of modified fees
+        uint64_t size{0};        //!< Sum of virtual sizes
+        uint64_t mweb_weight{0}; //!< Sum of MWEB weights
+        int64_t sigops{0};       //!< Sum of sigop costs
+        size_t cluster{0};       //!< The same for all chunks of a cluster
+    };
+
+    /** Calculate the clusters of the given entries. Stops once more than
+     *  limit transactions were found. */
+    std::vector<txiter> CalculateCluster(const std::vector<txiter>& entries, size_t limit = std::numeric_limits<size_t>::max()) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Linearize every cluster and return the chunks of all of them, highest
+     *  feerate first. The chunks of a cluster keep their relative order, so
+     *  including chunks in this order never includes a child before its parent.
+     *  The chunks of each cluster are cached until one of its transactions is
+     *  added, removed, linked to another one or prioritised. */
+    std::vector<Chunk> GetChunks() const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** The chunk of its cluster that the given entry belongs to */
+    Chunk GetChunk(txiter it) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Whether mining, eviction and replacement are driven by cluster chunks
+     *  rather than ancestor and descendant scores */
+    bool IsClusterMode() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        AssertLockHeld(cs);
+        return m_cluster_mode;
+    }
+    /** Set whether to use cluster chunks, and the cluster size that
+     *  transactions are accepted up to (see -limitclustercount). */
+    void SetClusterMode(bool cluster_mode, size_t cluster_limit)
+    {
+        LOCK(cs);
+        m_cluster_mode = cluster_mode;
+        m_cluster_limit = cluster_limit;
+    }
+
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
       *  The incrementalRelayFee policy variable is used to bound the time it
@@ -862,6 +916,19 @@ private:
     void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Drop the cached chunks of the cluster of an entry that is changed */
+    void InvalidateClusterChunks(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Extend cluster, whose entries must have been visited in the current
+     *  epoch, with all unvisited entries connected to it, or until it has more
+     *  than limit entries. */
+    void WalkCluster(std::vector<txiter>& cluster, size_t limit) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Order a cluster by repeatedly picking the remaining transaction with
+     *  the highest feerate including its remaining ancestors, then merge
+     *  the result into chunks of decreasing feerate and append those.
+     *  Clusters larger than m_cluster_limit, which can only be re-added from
+     *  disconnected blocks, are ordered by ancestor score instead, as picking
+     *  is quadratic in the cluster size. */
+    void LinearizeCluster(std::vector<txiter> cluster, size_t cluster_id, std::vector<Chunk>& chunks) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     /** Before calling removeUnchecked for a given transaction,
      *  UpdateForRemoveFromMempool must be called on the entire (dependent) set
@@ -939,12 +1006,17 @@ class CCoinsViewMemPool : public CCoinsViewBacked
 {
 protected:
     const CTxMemPool& mempool;
+    /** Outputs of package transactions which are being validated but are not in the mempool yet. */
+    std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> m_temp_added;
+    std::map<mw::Hash, CTransactionRef> m_temp_added_mweb;
 
 public:
     CCoinsViewMemPool(CCoinsView* baseIn, const CTxMemPool& mempoolIn);
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const OutputIndex& index) const override;
     bool GetMWEBCoin(const mw::Hash& output_id, Output& coin) const override;
+    /** Make the outputs of a package transaction available to the package transactions after it. */
+    void PackageAddTransaction(const CTransactionRef& tx);
 };
 
 /**
@@ -0,0 +1,386 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <crypto/siphash.h>
+#include <hash.h>
+#include <logging.h>
+#include <pinsketch.h>
+#include <random.h>
+#include <sync.h>
+#include <util/memory.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+
+/** Static salt component used to compute short txids for reconciliation. */
+const std::string RECON_STATIC_SALT = "Tx Relay Salting";
+
+/** Largest q that fits in the uint16_t of REQRECON */
+constexpr double MAX_RECON_Q{double(std::numeric_limits<uint16_t>::max()) / Q_PRECISION};
+
+using ReconSet = std::unordered_map<uint32_t, uint256>;
+
+/** Reconciliation state of one registered peer. */
+struct ReconciliationState {
+    //! SipHash keys for short IDs, from both salts
+    uint64_t m_k0, m_k1;
+    //! Whether we initiate reconciliations with this peer (it is an outbound peer)
+    bool m_we_initiate;
+    //! Whether we flood transactions to this peer anyway
+    bool m_flood_to;
+    //! Transactions to reconcile next time, by short ID
+    ReconSet m_local_set;
+    //! Short IDs of m_local_set by wtxid
+    std::map<uint256, uint32_t> m_local_short_ids;
+    //! The set being reconciled right now, if m_pending
+    ReconSet m_snapshot;
+    //! Initiator: REQRECON sent without a SKETCH yet. Responder: SKETCH sent without a RECONCILDIFF yet.
+    bool m_pending{false};
+    //! When to give up on the pending reconciliation
+    std::chrono::microseconds m_pending_deadline{0};
+    //! The pending reconciliation timed out, and the message that ends it is still to come
+    bool m_expired{false};
+    //! Initiator: when to request the next reconciliation
+    std::chrono::microseconds m_next_request{0};
+    //! Initiator: the set difference we expect, relative to the smaller set
+    double m_q{DEFAULT_RECON_Q};
+
+    ReconciliationState(uint64_t k0, uint64_t k1, bool we_initiate, bool flood_to)
+        : m_k0(k0), m_k1(k1), m_we_initiate(we_initiate), m_flood_to(flood_to) {}
+
+    uint32_t ComputeShortID(const CTransaction& tx) const
+    {
+        CSipHasher hasher(m_k0, m_k1);
+        const uint256& wtxid = tx.GetWitnessHash();
+        hasher.Write(wtxid.begin(), wtxid.size());
+        if (tx.HasMWEBTx()) {
+            const mw::Hash& mweb_hash = tx.mweb_tx.m_transaction->GetHash();
+            hasher.Write(mweb_hash.data(), mweb_hash.size());
+        }
+        // Zero is not a valid sketch element.
+        const uint32_t short_id = hasher.Finalize() & 0xffffffff;
+        return short_id == 0 ? 1 : short_id;
+    }
+
+    PinSketch ComputeSketch(const ReconSet& set, size_t capacity) const
+    {
+        PinSketch sketch(capacity);
+        for (const auto& entry : set) sketch.Add(entry.first);
+        return sketch;
+    }
+};
+
+std::vector<uint256> AllWtxids(const ReconSet& set)
+{
+    std::vector<uint256> wtxids;
+    wtxids.reserve(set.size());
+    for (const auto& entry : set) wtxids.push_back(entry.second);
+    return wtxids;
+}
+
+} // namespace
+
+size_t EstimateSketchCapacity(size_t local_set_size, size_t remote_set_size, uint16_t q)
+{
+    const size_t set_size_diff = std::max(local_set_size, remote_set_size) - std::min(local_set_size, remote_set_size);
+    const size_t min_size = std::min(local_set_size, remote_set_size);
+    const double weighted_min = double(q) / Q_PRECISION * min_size;
+    // q is what the difference was last time, and it varies from one
+    // reconciliation to the next: leave room for half as much again, and a
+    // few more elements. Decoding failures cost a lot more than capacity.
+    return set_size_diff + static_cast<size_t>(weighted_min * 1.5) + 4;
+}
+
+class TxReconciliationTracker::Impl
+{
+    mutable Mutex m_mutex;
+
+    //! The version we announce in SENDTXRCNCL
+    const uint32_t m_recon_version;
+
+    //! Salts we sent to peers that did not send theirs yet
+    std::unordered_map<NodeId, uint64_t> m_pre_registered GUARDED_BY(m_mutex);
+
+    std::unordered_map<NodeId, ReconciliationState> m_states GUARDED_BY(m_mutex);
+
+    //! Number of registered outbound peers with m_flood_to
+    size_t m_outbound_flooders GUARDED_BY(m_mutex){0};
+
+    ReconciliationState* GetState(NodeId peer_id) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        const auto it = m_states.find(peer_id);
+        return it == m_states.end() ? nullptr : &it->second;
+    }
+
+public:
+    explicit Impl(uint32_t recon_version) : m_recon_version(recon_version) {}
+
+    uint64_t PreRegisterPeer(NodeId peer_id)
+    {
+        const uint64_t local_salt{GetRand(std::numeric_limits<uint64_t>::max())};
+        LOCK(m_mutex);
+        m_pre_registered[peer_id] = local_salt;
+        return local_salt;
+    }
+
+    ReconciliationRegisterResult RegisterPeer(NodeId peer_id, bool is_peer_inbound, uint32_t peer_recon_version, uint64_t remote_salt)
+    {
+        LOCK(m_mutex);
+        if (m_states.count(peer_id)) return ReconciliationRegisterResult::ALREADY_REGISTERED;
+        const auto it = m_pre_registered.find(peer_id);
+        if (it == m_pre_registered.end()) return ReconciliationRegisterResult::NOT_FOUND;
+        const uint64_t local_salt = it->second;
+        m_pre_registered.erase(it);
+
+        // Both sides use the lowest version either of them supports.
+        const uint32_t recon_version = std::min(peer_recon_version, m_recon_version);
+        if (recon_version < 1) return ReconciliationRegisterResult::PROTOCOL_VIOLATION;
+
+        // The salts are hashed in ascending order, so both sides get the same keys.
+        const uint256 full_salt = (TaggedHash(RECON_STATIC_SALT) << std::min(local_salt, remote_salt) << std::max(local_salt, remote_salt)).GetSHA256();
+        const bool flood_to = !is_peer_inbound && m_outbound_flooders < MAX_OUTBOUND_FLOOD_TO;
+        if (flood_to) ++m_outbound_flooders;
+        m_states.emplace(std::piecewise_construct, std::forward_as_tuple(peer_id),
+                         std::forward_as_tuple(full_salt.GetUint64(0), full_salt.GetUint64(1), /*we_initiate=*/!is_peer_inbound, flood_to));
+        LogPrint(BCLog::NET, "Registered peer=%d for transaction reconciliation (we initiate: %d, flooding: %d)\n", peer_id, !is_peer_inbound, flood_to);
+        return ReconciliationRegisterResult::SUCCESS;
+    }
+
+    void ForgetPeer(NodeId peer_id)
+    {
+        LOCK(m_mutex);
+        m_pre_registered.erase(peer_id);
+        const auto it = m_states.find(peer_id);
+        if (it == m_states.end()) return;
+        if (it->second.m_flood_to && it->second.m_we_initiate) --m_outbound_flooders;
+        m_states.erase(it);
+    }
+
+    bool IsPeerRegistered(NodeId peer_id) const
+    {
+        LOCK(m_mutex);
+        return m_states.count(peer_id);
+    }
+
+    bool ShouldFloodTo(NodeId peer_id) const
+    {
+        LOCK(m_mutex);
+        const auto it = m_states.find(peer_id);
+        return it == m_states.end() || it->second.m_flood_to;
+    }
+
+    bool AddToSet(NodeId peer_id, const CTransaction& tx)
+    {
+        LOCK(m_mutex);
+        ReconciliationState* state = GetState(peer_id);
+        if (!state || state->m_expired || state->m_local_set.size() >= MAX_RECON_SET_SIZE) return false;
+        const uint256& wtxid = tx.GetWitnessHash();
+        const uint32_t short_id = state->ComputeShortID(tx);
+        const auto ret = state->m_local_set.emplace(short_id, wtxid);
+        if (!ret.second) return ret.first->second == wtxid;
+        state->m_local_short_ids.emplace(wtxid, short_id);
+        return true;
+    }
+
+    void TryRemovingFromSet(NodeId peer_id, const uint256& wtxid)
+    {
+        LOCK(m_mutex);
+        ReconciliationState* state = GetState(peer_id);
+        if (!state) return;
+        const auto it = state->m_local_short_ids.find(wtxid);
+        if (it == state->m_local_short_ids.end()) return;
+        state->m_local_set.erase(it->second);
+        state->m_local_short_ids.erase(it);
+    }
+
+    size_t GetSetSize(NodeId peer_id) const
+    {
+        LOCK(m_mutex);
+        const auto it = m_states.find(peer_id);
+        return it == m_states.end() ? 0 : it->second.m_local_set.size() + it->second.m_snapshot.size();
+    }
+
+    Optional<std::pair<uint16_t, uint16_t>> MaybeRequestReconciliation(NodeId peer_id, std::chrono::microseconds now)
+    {
+        LOCK(m_mutex);
+        ReconciliationState* state = GetState(peer_id);
+        if (!state || !state->m_we_initiate || state->m_pending || state->m_expired) return nullopt;
+        if (state->m_next_request == std::chrono::microseconds{0}) {
+            // Spread the reconciliations with different peers out over the interval, so
+            // that what we learn from one of them is not announced to us by the next.
+            state->m_next_request = now + std::chrono::microseconds{GetRand(count_microseconds(RECON_REQUEST_INTERVAL))};
+        }
+        if (now < state->m_next_request) return nullopt;
+        state->m_next_request = now + RECON_REQUEST_INTERVAL;
+        state->m_snapshot.swap(state->m_local_set);
+        state->m_local_set.clear();
+        state->m_local_short_ids.clear();
+        state->m_pending = true;
+        state->m_pending_deadline = now + RECON_RESPONSE_TIMEOUT;
+        return std::make_pair(static_cast<uint16_t>(state->m_snapshot.size()), static_cast<uint16_t>(state->m_q * Q_PRECISION));
+    }
+
+    std::vector<uint256> ExpireReconciliation(NodeId peer_id, std::chrono::microseconds now)
+    {
+        LOCK(m_mutex);
+        ReconciliationState* state = GetState(peer_id);
+        if (!state || !state->m_pending || now < state->m_pending_deadline) return {};
+        LogPrint(BCLog::NET, "Reconciliation with peer=%d timed out: %d to announce\n", peer_id, state->m_snapshot.size());
+        std::vector<uint256> announce = AllWtxids(state->m_snapshot);
+        state->m_snapshot.clear();
+        state->m_pending = false;
+        state->m_expired = true;
+        return announce;
+    }
+
+    bool HandleReconciliationRequest(NodeId peer_id, uint16_t remote_set_size, uint16_t remote_q, std::chrono::microseconds now, std::vector<unsigned char>& skdata)
+    {
+        LOCK(m_mutex);
+        ReconciliationState* state = GetState(peer_id);
+        if (!state || state->m_we_initiate || state->m_pending || state->m_expired) return false;
+        state->m_snapshot.swap(state->m_local_set);
+        state->m_local_set.clear();
+        state->m_local_short_ids.clear();
+        state->m_pending = true;
+        state->m_pending_deadline = now + RECON_RESPONSE_TIMEOUT;
+
+        // A sketch too large to be worth it is sent empty, which makes the
+        // initiator fall back to announcing everything.
+        const size_t capacity = EstimateSketchCapacity(state->m_snapshot.size(), remote_set_size, remote_q);
+        skdata = capacity > MAX_SKETCH_CAPACITY ? std::vector<unsigned char>{} : state->ComputeSketch(state->m_snapshot, capacity).Serialize();
+        return true;
+    }
+
+    bool HandleSketch(NodeId peer_id, Span<const unsigned char> skdata, ReconciliationOutcome& outcome)
+    {
+        LOCK(m_mutex);
+        ReconciliationState* state = GetState(peer_id);
+        if (!state || !state->m_we_initiate) return false;
+        if (state->m_expired) {
+            // We announced our snapshot already; make the peer announce its own.
+            state->m_expired = false;
+            outcome = ReconciliationOutcome{};
+            return true;
+        }
+        if (!state->m_pending) return false;
+        Optional<PinSketch> remote_sketch = PinSketch::Deserialize(skdata);
+        if (!remote_sketch || remote_sketch->GetCapacity() > MAX_SKETCH_CAPACITY) return false;
+
+        outcome = ReconciliationOutcome{};
+        Optional<std::vector<uint32_t>> difference;
+        if (remote_sketch->GetCapacity() > 0) {
+            remote_sketch->Merge(state->ComputeSketch(state->m_snapshot, remote_sketch->GetCapacity()));
+            difference = remote_sketch->Decode(remote_sketch->GetCapacity());
+        }
+        if (difference) {
+            outcome.success = true;
+            for (const uint32_t short_id : *difference) {
+                const auto it = state->m_snapshot.find(short_id);
+                if (it != state->m_snapshot.end()) {
+                    outcome.announce.push_back(it->second);
+                } else {
+                    outcome.ask_shortids.push_back(short_id);
+                }
+            }
+            // What the difference turned out to be, relative to the smaller set
+            const size_t local_size = state->m_snapshot.size();
+            const size_t remote_size = local_size - outcome.announce.size() + outcome.ask_shortids.size();
+            const size_t min_size = std::min(local_size, remote_size);
+            if (min_size > 0) {
+                const size_t set_size_diff = std::max(local_size, remote_size) - min_size;
+                const size_t extra = difference->size() > set_size_diff ? difference->size() - set_size_diff : 0;
+                state->m_q = std::min(double(extra) / min_size, MAX_RECON_Q);
+            }
+        } else {
+            outcome.announce = AllWtxids(state->m_snapshot);
+            // The difference was larger than we expected; expect more next time.
+            state->m_q = std::min(std::max(2 * state->m_q, DEFAULT_RECON_Q), MAX_RECON_Q);
+        }
+        LogPrint(BCLog::NET, "Reconciliation with peer=%d %s: %d to announce, %d to ask for\n", peer_id,
+                 outcome.success ? "succeeded" : "failed", outcome.announce.size(), outcome.ask_shortids.size());
+        state->m_snapshot.clear();
+        state->m_pending = false;
+        return true;
+    }
+
+    bool HandleReconciliationDifference(NodeId peer_id, bool success, const std::vector<uint32_t>& ask_shortids, std::vector<uint256>& announce)
+    {
+        LOCK(m_mutex);
+        ReconciliationState* state = GetState(peer_id);
+        if (!state || state->m_we_initiate) return false;
+        announce.clear();
+        if (state->m_expired) {
+            // We announced our snapshot already.
+            state->m_expired = false;
+            return true;
+        }
+        if (!state->m_pending) return false;
+        if (success) {
+            for (const uint32_t short_id : ask_shortids) {
+                const auto it = state->m_snapshot.find(short_id);
+                if (it != state->m_snapshot.end()) announce.push_back(it->second);
+            }
+        } else {
+            announce = AllWtxids(state->m_snapshot);
+        }
+        state->m_snapshot.clear();
+        state->m_pending = false;
+        return true;
+    }
+};
+
+TxReconciliationTracker::TxReconciliationTracker(uint32_t recon_version) : m_impl{MakeUnique<TxReconciliationTracker::Impl>(recon_version)} {}
+
+TxReconciliationTracker::~TxReconciliationTracker() = default;
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer_id) { return m_impl->PreRegisterPeer(peer_id); }
+
+ReconciliationRegisterResult TxReconciliationTracker::RegisterPeer(NodeId peer_id, bool is_peer_inbound, uint32_t peer_recon_version, uint64_t remote_salt)
+{
+    return m_impl->RegisterPeer(peer_id, is_peer_inbound, peer_recon_version, remote_salt);
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer_id) { m_impl->ForgetPeer(peer_id); }
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer_id) const { return m_impl->IsPeerRegistered(peer_id); }
+
+bool TxReconciliationTracker::ShouldFloodTo(NodeId peer_id) const { return m_impl->ShouldFloodTo(peer_id); }
+
+bool TxReconciliationTracker::AddToSet(NodeId peer_id, const CTransaction& tx) { return m_impl->AddToSet(peer_id, tx); }
+
+void TxReconciliationTracker::TryRemovingFromSet(NodeId peer_id, const uint256& wtxid) { m_impl->TryRemovingFromSet(peer_id, wtxid); }
+
+size_t TxReconciliationTracker::GetSetSize(NodeId peer_id) const { return m_impl->GetSetSize(peer_id); }
+
+Optional<std::pair<uint16_t, uint16_t>> TxReconciliationTracker::MaybeRequestReconciliation(NodeId peer_id, std::chrono::microseconds now)
+{
+    return m_impl->MaybeRequestReconciliation(peer_id, now);
+}
+
+std::vector<uint256> TxReconciliationTracker::ExpireReconciliation(NodeId peer_id, std::chrono::microseconds now)
+{
+    return m_impl->ExpireReconciliation(peer_id, now);
+}
+
+bool TxReconciliationTracker::HandleReconciliationRequest(NodeId peer_id, uint16_t remote_set_size, uint16_t remote_q, std::chrono::microseconds now, std::vector<unsigned char>& skdata)
+{
+    return m_impl->HandleReconciliationRequest(peer_id, remote_set_size, remote_q, now, skdata);
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId peer_id, Span<const unsigned char> skdata, ReconciliationOutcome& outcome)
+{
+    return m_impl->HandleSketch(peer_id, skdata, outcome);
+}
+
+bool TxReconciliationTracker::HandleReconciliationDifference(NodeId peer_id, bool success, const std::vector<uint32_t>& ask_shortids, std::vector<uint256>& announce)
+{
+    return m_impl->HandleReconciliationDifference(peer_id, success, ask_shortids, announce);
+}
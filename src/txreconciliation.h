@@ -0,0 +1,162 @@
+// Copyright (c) 2026 The Pussycoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include <net.h> // For NodeId
+#include <optional.h>
+#include <primitives/transaction.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+/** Version of the transaction reconciliation protocol (BIP330) we support */
+static constexpr uint32_t TXRECONCILIATION_VERSION{1};
+/** Default for -txreconciliation */
+static constexpr bool DEFAULT_TXRECONCILIATION_ENABLE{false};
+/** How often we ask each peer we initiate reconciliations with for a sketch */
+static constexpr std::chrono::seconds RECON_REQUEST_INTERVAL{2};
+/** How long a reconciliation may wait for the peer's SKETCH or RECONCILDIFF before we give up on it */
+static constexpr std::chrono::seconds RECON_RESPONSE_TIMEOUT{10};
+/** Number of outbound reconciling peers we keep flooding transactions to, for fast propagation */
+static constexpr size_t MAX_OUTBOUND_FLOOD_TO{2};
+/** Transactions waiting to be reconciled with a peer; beyond that they are flooded to it */
+static constexpr size_t MAX_RECON_SET_SIZE{3000};
+/** Largest sketch capacity we send or accept */
+static constexpr size_t MAX_SKETCH_CAPACITY{256};
+/** Fixed point scale of q, the expected size of a set difference relative to the smaller set */
+static constexpr uint16_t Q_PRECISION{(2 << 14) - 1};
+/** q before the first reconciliation with a peer */
+static constexpr double DEFAULT_RECON_Q{0.25};
+
+enum class ReconciliationRegisterResult {
+    NOT_FOUND,
+    SUCCESS,
+    ALREADY_REGISTERED,
+    PROTOCOL_VIOLATION,
+};
+
+/** What an initiator learned from a peer's sketch. */
+struct ReconciliationOutcome {
+    //! Whether the set difference could be decoded. Otherwise the whole set is announced.
+    bool success{false};
+    //! Transactions the peer is missing, to announce to it
+    std::vector<uint256> announce;
+    //! Short IDs of the transactions we are missing, to ask the peer to announce (RECONCILDIFF)
+    std::vector<uint32_t> ask_shortids;
+};
+
+/**
+ * Transaction reconciliation (Erlay, BIP330): instead of announcing every
+ * transaction to every peer, transactions are collected per peer and the
+ * two sides periodically work out which of them the other one is missing
+ * from PinSketches of 32-bit short IDs. The bandwidth of that is in the
+ * size of the set difference, not in the number of transactions times the
+ * number of peers. A few outbound peers still get transactions flooded to
+ * them so that they keep propagating fast.
+ *
+ * The side that made the connection initiates reconciliations:
+ *
+ * - Initiator: REQRECON(set size, q) snapshots the set of that peer.
+ * - Responder: snapshots its set and answers with a SKETCH of it, with a
+ *   capacity estimated from both set sizes and q.
+ * - Initiator: merges the sketch with one of its own snapshot and decodes
+ *   the difference. It announces the transactions it has that the peer
+ *   lacks, and sends the short IDs of the ones it lacks in RECONCILDIFF, or
+ *   gives up and announces its whole snapshot if decoding failed.
+ * - Responder: announces the transactions asked for, or its whole snapshot
+ *   on failure.
+ *
+ * A side that waits longer than RECON_RESPONSE_TIMEOUT for the next message
+ * announces its snapshot. It answers the late message as if the
+ * reconciliation had failed, and meanwhile transactions for that peer are
+ * announced rather than added to its set.
+ *
+ * Short IDs are salted per connection with the salts both peers send in
+ * SENDTXRCNCL. The wtxid of a transaction does not commit to its MWEB part,
+ * so for transactions with MWEB data the short ID covers the MWEB
+ * transaction hash too: two transactions that only differ in their MWEB
+ * part are different transactions to reconcile.
+ *
+ * This class is thread-safe.
+ */
+class TxReconciliationTracker
+{
+    // Avoid littering this header file with implementation details.
+    class Impl;
+    const std::unique_ptr<Impl> m_impl;
+
+public:
+    explicit TxReconciliationTracker(uint32_t recon_version = TXRECONCILIATION_VERSION);
+    ~TxReconciliationTracker();
+
+    /** Start negotiating reconciliation with a peer. Returns the salt to send it in SENDTXRCNCL. */
+    uint64_t PreRegisterPeer(NodeId peer_id);
+
+    /** Finish the negotiation with the SENDTXRCNCL of a pre-registered peer. */
+    ReconciliationRegisterResult RegisterPeer(NodeId peer_id, bool is_peer_inbound, uint32_t peer_recon_version, uint64_t remote_salt);
+
+    void ForgetPeer(NodeId peer_id);
+
+    bool IsPeerRegistered(NodeId peer_id) const;
+
+    /** Whether transactions should still be flooded to a registered peer. */
+    bool ShouldFloodTo(NodeId peer_id) const;
+
+    /**
+     * Add a transaction to the set of a registered peer, to be reconciled
+     * rather than announced. Returns false if the set is full, the short ID
+     * collides with another transaction or a reconciliation with the peer
+     * timed out; it must be announced then.
+     */
+    bool AddToSet(NodeId peer_id, const CTransaction& tx);
+
+    /** Remove a transaction the peer announced to us from its set, as it has it already. */
+    void TryRemovingFromSet(NodeId peer_id, const uint256& wtxid);
+
+    /** Number of transactions waiting to be reconciled with a peer, in its set and a pending snapshot */
+    size_t GetSetSize(NodeId peer_id) const;
+
+    /**
+     * Initiator: start a reconciliation with a peer if it is time to.
+     * Returns the set size and q to send in REQRECON.
+     */
+    Optional<std::pair<uint16_t, uint16_t>> MaybeRequestReconciliation(NodeId peer_id, std::chrono::microseconds now);
+
+    /**
+     * Give up on a reconciliation the peer did not answer within
+     * RECON_RESPONSE_TIMEOUT. Returns the wtxids of the snapshot, to announce.
+     */
+    std::vector<uint256> ExpireReconciliation(NodeId peer_id, std::chrono::microseconds now);
+
+    /**
+     * Responder: answer a REQRECON with the serialized sketch of our set.
+     * Returns false if the request is a protocol violation.
+     */
+    bool HandleReconciliationRequest(NodeId peer_id, uint16_t remote_set_size, uint16_t remote_q, std::chrono::microseconds now, std::vector<unsigned char>& skdata);
+
+    /**
+     * Initiator: find the set difference from the SKETCH of a peer.
+     * Returns false if the sketch is a protocol violation.
+     */
+    bool HandleSketch(NodeId peer_id, Span<const unsigned char> skdata, ReconciliationOutcome& outcome);
+
+    /**
+     * Responder: the wtxids of the transactions to announce after a
+     * RECONCILDIFF. Returns false if it is a protocol violation.
+     */
+    bool HandleReconciliationDifference(NodeId peer_id, bool success, const std::vector<uint32_t>& ask_shortids, std::vector<uint256>& announce);
+};
+
+/** Sketch capacity for a reconciliation of sets of these sizes, with q scaled by Q_PRECISION. */
+size_t EstimateSketchCapacity(size_t local_set_size, size_t remote_set_size, uint16_t q);
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -8,12 +8,15 @@
 #include <net.h>
 #include <primitives/transaction.h>
 #include <random.h>
+#include <sync.h>
 #include <uint256.h>
 #include <util/memory.h>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <unordered_map>
 #include <utility>
@@ -129,6 +132,12 @@ public:
     {
         return operator()(ann.m_txhash, ann.m_peer, ann.m_preferred);
     }
+
+    /** Which of num_shards shards the announcements for a txhash are in. */
+    size_t Shard(const uint256& txhash, size_t num_shards) const
+    {
+        return SipHashUint256(m_k0, m_k1, txhash) % num_shards;
+    }
 };
 
 // Definitions for the 3 indexes used in the main data structure.
@@ -255,6 +264,75 @@ struct TxHashInfo
     std::vector<NodeId> m_peers;
 };
 
+/** Per-peer statistics of all the shards of a tracker, so that they can be looked up without locking every shard.
+ *
+ * The peers are split over stripes with their own mutex, so that shards updating the statistics of different peers
+ * do not contend on a single lock. */
+class PeerInfoMap {
+    static constexpr size_t NUM_STRIPES = 16;
+
+    struct Stripe {
+        mutable Mutex m_mutex;
+        //! No PeerInfo with m_total==0 is kept.
+        std::unordered_map<NodeId, PeerInfo> m_peerinfo GUARDED_BY(m_mutex);
+    };
+    std::array<Stripe, NUM_STRIPES> m_stripes;
+
+    Stripe& GetStripe(NodeId peer) { return m_stripes[static_cast<uint64_t>(peer) % NUM_STRIPES]; }
+    const Stripe& GetStripe(NodeId peer) const { return m_stripes[static_cast<uint64_t>(peer) % NUM_STRIPES]; }
+
+public:
+    //! Account for a new announcement (which is never COMPLETED or REQUESTED).
+    void Added(NodeId peer)
+    {
+        Stripe& stripe = GetStripe(peer);
+        LOCK(stripe.m_mutex);
+        ++stripe.m_peerinfo[peer].m_total;
+    }
+
+    //! Account for an announcement in state that is deleted.
+    void Erased(NodeId peer, State state)
+    {
+        Stripe& stripe = GetStripe(peer);
+        LOCK(stripe.m_mutex);
+        auto it = stripe.m_peerinfo.find(peer);
+        it->second.m_completed -= state == State::COMPLETED;
+        it->second.m_requested -= state == State::REQUESTED;
+        if (--it->second.m_total == 0) stripe.m_peerinfo.erase(it);
+    }
+
+    //! Account for an announcement that changed from old_state to new_state.
+    void Modified(NodeId peer, State old_state, State new_state)
+    {
+        const int completed = (new_state == State::COMPLETED) - (old_state == State::COMPLETED);
+        const int requested = (new_state == State::REQUESTED) - (old_state == State::REQUESTED);
+        if (completed == 0 && requested == 0) return;
+        Stripe& stripe = GetStripe(peer);
+        LOCK(stripe.m_mutex);
+        PeerInfo& info = stripe.m_peerinfo.find(peer)->second;
+        info.m_completed += completed;
+        info.m_requested += requested;
+    }
+
+    PeerInfo Get(NodeId peer) const
+    {
+        const Stripe& stripe = GetStripe(peer);
+        LOCK(stripe.m_mutex);
+        auto it = stripe.m_peerinfo.find(peer);
+        return it == stripe.m_peerinfo.end() ? PeerInfo{} : it->second;
+    }
+
+    std::unordered_map<NodeId, PeerInfo> GetAll() const
+    {
+        std::unordered_map<NodeId, PeerInfo> ret;
+        for (const Stripe& stripe : m_stripes) {
+            LOCK(stripe.m_mutex);
+            ret.insert(stripe.m_peerinfo.begin(), stripe.m_peerinfo.end());
+        }
+        return ret;
+    }
+};
+
 /** Compare two PeerInfo objects. Only used for sanity checking. */
 bool operator==(const PeerInfo& a, const PeerInfo& b)
 {
@@ -262,17 +340,15 @@ bool operator==(const PeerInfo& a, const PeerInfo& b)
            std::tie(b.m_total, b.m_completed, b.m_requested);
 };
 
-/** (Re)compute the PeerInfo map from the index. Only used for sanity checking. */
-std::unordered_map<NodeId, PeerInfo> RecomputePeerInfo(const Index& index)
+/** (Re)compute the PeerInfo map from an index, adding to ret. Only used for sanity checking. */
+void RecomputePeerInfo(const Index& index, std::unordered_map<NodeId, PeerInfo>& ret)
 {
-    std::unordered_map<NodeId, PeerInfo> ret;
     for (const Announcement& ann : index) {
         PeerInfo& info = ret[ann.m_peer];
         ++info.m_total;
         info.m_requested += (ann.GetState() == State::REQUESTED);
         info.m_completed += (ann.GetState() == State::COMPLETED);
     }
-    return ret;
 }
 
 /** Compute the TxHashInfo map. Only used for sanity checking. */
@@ -304,30 +380,27 @@ GenTxid ToGenTxid(const Announcement& ann)
     return {ann.m_is_wtxid, ann.m_txhash};
 }
 
-}  // namespace
-
-/** Actual implementation for TxRequestTracker's data structure. */
-class TxRequestTracker::Impl {
-    //! The current sequence number. Increases for every announcement. This is used to sort txhashes returned by
-    //! GetRequestable in announcement order.
-    SequenceNumber m_current_sequence{0};
-
-    //! This tracker's priority computer.
-    const PriorityComputer m_computer;
+/** The announcements for the txhashes of one shard of a TxRequestTracker. All the rules of TxRequestTracker apply
+ *  per txhash, so every shard enforces them on its own. Not thread-safe; TxRequestTracker::Impl locks it. */
+class TxRequestShard {
+    //! The priority computer of the tracker.
+    const PriorityComputer& m_computer;
 
     //! This tracker's main data structure. See SanityCheck() for the invariants that apply to it.
     Index m_index;
 
-    //! Map with this tracker's per-peer statistics.
-    std::unordered_map<NodeId, PeerInfo> m_peerinfo;
+    //! The tracker's per-peer statistics, which every shard keeps up to date for its announcements.
+    PeerInfoMap& m_peerinfo;
 
 public:
-    void SanityCheck() const
+    //! Add the per-peer statistics of this shard to peerinfo, for sanity checking.
+    void RecomputePeerInfo(std::unordered_map<NodeId, PeerInfo>& peerinfo) const
     {
-        // Recompute m_peerdata from m_index. This verifies the data in it as it should just be caching statistics
-        // on m_index. It also verifies the invariant that no PeerInfo announcements with m_total==0 exist.
-        assert(m_peerinfo == RecomputePeerInfo(m_index));
+        ::RecomputePeerInfo(m_index, peerinfo);
+    }
 
+    void SanityCheck() const
+    {
         // Calculate per-txhash statistics from m_index, and validate invariants.
         for (auto& item : ComputeTxHashInfo(m_index, m_computer)) {
             TxHashInfo& info = item.second;
@@ -376,10 +449,7 @@ private:
     template<typename Tag>
     Iter<Tag> Erase(Iter<Tag> it)
     {
-        auto peerit = m_peerinfo.find(it->m_peer);
-        peerit->second.m_completed -= it->GetState() == State::COMPLETED;
-        peerit->second.m_requested -= it->GetState() == State::REQUESTED;
-        if (--peerit->second.m_total == 0) m_peerinfo.erase(peerit);
+        m_peerinfo.Erased(it->m_peer, it->GetState());
         return m_index.get<Tag>().erase(it);
     }
 
@@ -387,12 +457,9 @@ private:
     template<typename Tag, typename Modifier>
     void Modify(Iter<Tag> it, Modifier modifier)
     {
-        auto peerit = m_peerinfo.find(it->m_peer);
-        peerit->second.m_completed -= it->GetState() == State::COMPLETED;
-        peerit->second.m_requested -= it->GetState() == State::REQUESTED;
+        const State old_state = it->GetState();
         m_index.get<Tag>().modify(it, std::move(modifier));
-        peerit->second.m_completed += it->GetState() == State::COMPLETED;
-        peerit->second.m_requested += it->GetState() == State::REQUESTED;
+        m_peerinfo.Modified(it->m_peer, old_state, it->GetState());
     }
 
     //! Convert a CANDIDATE_DELAYED announcement into a CANDIDATE_READY. If this makes it the new best
@@ -492,8 +559,6 @@ private:
     //! - CANDIDATE_{READY,BEST} announcements with reqtime > now are turned into CANDIDATE_DELAYED.
     void SetTimePoint(std::chrono::microseconds now, std::vector<std::pair<NodeId, GenTxid>>* expired)
     {
-        if (expired) expired->clear();
-
         // Iterate over all CANDIDATE_DELAYED and REQUESTED from old to new, as long as they're in the past,
         // and convert them to CANDIDATE_READY and COMPLETED respectively.
         while (!m_index.empty()) {
@@ -522,18 +587,19 @@ private:
     }
 
 public:
-    Impl(bool deterministic) :
-        m_computer(deterministic),
+    TxRequestShard(const PriorityComputer& computer, PeerInfoMap& peerinfo) :
+        m_computer(computer),
         // Explicitly initialize m_index as we need to pass a reference to m_computer to ByTxHashViewExtractor.
         m_index(boost::make_tuple(
             boost::make_tuple(ByPeerViewExtractor(), std::less<ByPeerView>()),
             boost::make_tuple(ByTxHashViewExtractor(m_computer), std::less<ByTxHashView>()),
             boost::make_tuple(ByTimeViewExtractor(), std::less<ByTimeView>())
-        )) {}
+        )),
+        m_peerinfo(peerinfo) {}
 
     // Disable copying and assigning (a default copy won't work due the stateful ByTxHashViewExtractor).
-    Impl(const Impl&) = delete;
-    Impl& operator=(const Impl&) = delete;
+    TxRequestShard(const TxRequestShard&) = delete;
+    TxRequestShard& operator=(const TxRequestShard&) = delete;
 
     void DisconnectedPeer(NodeId peer)
     {
@@ -575,7 +641,7 @@ public:
     }
 
     void ReceivedInv(NodeId peer, const GenTxid& gtxid, bool preferred,
-        std::chrono::microseconds reqtime)
+        std::chrono::microseconds reqtime, SequenceNumber sequence)
     {
         // Bail out if we already have a CANDIDATE_BEST announcement for this (txhash, peer) combination. The case
         // where there is a non-CANDIDATE_BEST announcement already will be caught by the uniqueness property of the
@@ -585,42 +651,27 @@ public:
         // Try creating the announcement with CANDIDATE_DELAYED state (which will fail due to the uniqueness
         // of the ByPeer index if a non-CANDIDATE_BEST announcement already exists with the same txhash and peer).
         // Bail out in that case.
-        auto ret = m_index.get<ByPeer>().emplace(gtxid, peer, preferred, reqtime, m_current_sequence);
+        auto ret = m_index.get<ByPeer>().emplace(gtxid, peer, preferred, reqtime, sequence);
         if (!ret.second) return;
 
         // Update accounting metadata.
-        ++m_peerinfo[peer].m_total;
-        ++m_current_sequence;
+        m_peerinfo.Added(peer);
     }
 
-    //! Find the GenTxids to request now from peer.
-    std::vector<GenTxid> GetRequestable(NodeId peer, std::chrono::microseconds now,
-        std::vector<std::pair<NodeId, GenTxid>>* expired)
+    //! Find the GenTxids to request now from peer, and add them to selected with their sequence number.
+    void GetRequestable(NodeId peer, std::chrono::microseconds now,
+        std::vector<std::pair<NodeId, GenTxid>>* expired, std::vector<std::pair<SequenceNumber, GenTxid>>& selected)
     {
         // Move time.
         SetTimePoint(now, expired);
 
         // Find all CANDIDATE_BEST announcements for this peer.
-        std::vector<const Announcement*> selected;
         auto it_peer = m_index.get<ByPeer>().lower_bound(ByPeerView{peer, true, uint256::ZERO});
         while (it_peer != m_index.get<ByPeer>().end() && it_peer->m_peer == peer &&
             it_peer->GetState() == State::CANDIDATE_BEST) {
-            selected.emplace_back(&*it_peer);
+            selected.emplace_back(it_peer->m_sequence, ToGenTxid(*it_peer));
             ++it_peer;
         }
-
-        // Sort by sequence number.
-        std::sort(selected.begin(), selected.end(), [](const Announcement* a, const Announcement* b) {
-            return a->m_sequence < b->m_sequence;
-        });
-
-        // Convert to GenTxid and return.
-        std::vector<GenTxid> ret;
-        ret.reserve(selected.size());
-        std::transform(selected.begin(), selected.end(), std::back_inserter(ret), [](const Announcement* ann) {
-            return ToGenTxid(*ann);
-        });
-        return ret;
     }
 
     void RequestedTx(NodeId peer, const uint256& txhash, std::chrono::microseconds expiry)
@@ -678,40 +729,168 @@ public:
         if (it != m_index.get<ByPeer>().end()) MakeCompleted(m_index.project<ByTxHash>(it));
     }
 
+    //! Count how many announcements are being tracked in total across all peers and transactions.
+    size_t Size() const { return m_index.size(); }
+};
+
+}  // namespace
+
+/** Actual implementation for TxRequestTracker's data structure: the announcements, sharded by txhash. */
+class TxRequestTracker::Impl {
+    //! This tracker's priority computer. Also picks the shard of a txhash, so that peers can't pick it.
+    const PriorityComputer m_computer;
+
+    //! The current sequence number. Increases for every announcement. This is used to sort txhashes returned by
+    //! GetRequestable in announcement order, across shards.
+    std::atomic<SequenceNumber> m_current_sequence{0};
+
+    //! Per-peer statistics across all shards. Locked after a shard's lock, when the shard changes them.
+    PeerInfoMap m_peerinfo;
+
+    struct Shard {
+        mutable Mutex m_mutex;
+        TxRequestShard m_announcements GUARDED_BY(m_mutex);
+
+        Shard(const PriorityComputer& computer, PeerInfoMap& peerinfo) : m_announcements(computer, peerinfo) {}
+    };
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    Shard& GetShard(const uint256& txhash) const { return *m_shards[m_computer.Shard(txhash, m_shards.size())]; }
+
+    //! Sum a statistic over all shards.
+    template<typename Fn>
+    size_t Sum(Fn fn) const
+    {
+        size_t ret = 0;
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            ret += fn(shard->m_announcements);
+        }
+        return ret;
+    }
+
+public:
+    Impl(bool deterministic, size_t num_shards) : m_computer(deterministic)
+    {
+        assert(num_shards > 0);
+        for (size_t i = 0; i < num_shards; ++i) m_shards.push_back(MakeUnique<Shard>(m_computer, m_peerinfo));
+    }
+
+    void SanityCheck() const
+    {
+        // Recompute m_peerinfo from the shards. This verifies the data in it as it should just be caching
+        // statistics on them. It also verifies the invariant that no PeerInfo announcements with m_total==0 exist.
+        std::unordered_map<NodeId, PeerInfo> peerinfo;
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            shard->m_announcements.SanityCheck();
+            shard->m_announcements.RecomputePeerInfo(peerinfo);
+        }
+        assert(m_peerinfo.GetAll() == peerinfo);
+    }
+
+    void PostGetRequestableSanityCheck(std::chrono::microseconds now) const
+    {
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            shard->m_announcements.PostGetRequestableSanityCheck(now);
+        }
+    }
+
+    void DisconnectedPeer(NodeId peer)
+    {
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            shard->m_announcements.DisconnectedPeer(peer);
+        }
+    }
+
+    void ForgetTxHash(const uint256& txhash)
+    {
+        Shard& shard = GetShard(txhash);
+        LOCK(shard.m_mutex);
+        shard.m_announcements.ForgetTxHash(txhash);
+    }
+
+    void ReceivedInv(NodeId peer, const GenTxid& gtxid, bool preferred,
+        std::chrono::microseconds reqtime)
+    {
+        // Sequence numbers skipped by announcements that already existed don't matter, only their order does.
+        const SequenceNumber sequence = m_current_sequence++;
+        Shard& shard = GetShard(gtxid.GetHash());
+        LOCK(shard.m_mutex);
+        shard.m_announcements.ReceivedInv(peer, gtxid, preferred, reqtime, sequence);
+    }
+
+    std::vector<GenTxid> GetRequestable(NodeId peer, std::chrono::microseconds now,
+        std::vector<std::pair<NodeId, GenTxid>>* expired)
+    {
+        if (expired) expired->clear();
+
+        std::vector<std::pair<SequenceNumber, GenTxid>> selected;
+        for (const auto& shard : m_shards) {
+            LOCK(shard->m_mutex);
+            shard->m_announcements.GetRequestable(peer, now, expired, selected);
+        }
+
+        // Sort by sequence number.
+        std::sort(selected.begin(), selected.end(), [](const std::pair<SequenceNumber, GenTxid>& a,
+                                                      const std::pair<SequenceNumber, GenTxid>& b) {
+            return a.first < b.first;
+        });
+
+        // Convert to GenTxid and return.
+        std::vector<GenTxid> ret;
+        ret.reserve(selected.size());
+        std::transform(selected.begin(), selected.end(), std::back_inserter(ret),
+            [](const std::pair<SequenceNumber, GenTxid>& entry) { return entry.second; });
+        return ret;
+    }
+
+    void RequestedTx(NodeId peer, const uint256& txhash, std::chrono::microseconds expiry)
+    {
+        Shard& shard = GetShard(txhash);
+        LOCK(shard.m_mutex);
+        shard.m_announcements.RequestedTx(peer, txhash, expiry);
+    }
+
+    void ReceivedResponse(NodeId peer, const uint256& txhash)
+    {
+        Shard& shard = GetShard(txhash);
+        LOCK(shard.m_mutex);
+        shard.m_announcements.ReceivedResponse(peer, txhash);
+    }
+
     size_t CountInFlight(NodeId peer) const
     {
-        auto it = m_peerinfo.find(peer);
-        if (it != m_peerinfo.end()) return it->second.m_requested;
-        return 0;
+        return m_peerinfo.Get(peer).m_requested;
     }
 
     size_t CountCandidates(NodeId peer) const
     {
-        auto it = m_peerinfo.find(peer);
-        if (it != m_peerinfo.end()) return it->second.m_total - it->second.m_requested - it->second.m_completed;
-        return 0;
+        const PeerInfo info = m_peerinfo.Get(peer);
+        return info.m_total - info.m_requested - info.m_completed;
     }
 
     size_t Count(NodeId peer) const
     {
-        auto it = m_peerinfo.find(peer);
-        if (it != m_peerinfo.end()) return it->second.m_total;
-        return 0;
+        return m_peerinfo.Get(peer).m_total;
     }
 
-    //! Count how many announcements are being tracked in total across all peers and transactions.
-    size_t Size() const { return m_index.size(); }
+    size_t Size() const
+    {
+        return Sum([](const TxRequestShard& announcements) { return announcements.Size(); });
+    }
 
     uint64_t ComputePriority(const uint256& txhash, NodeId peer, bool preferred) const
     {
         // Return Priority as a uint64_t as Priority is internal.
         return uint64_t{m_computer(txhash, peer, preferred)};
     }
-
 };
 
-TxRequestTracker::TxRequestTracker(bool deterministic) :
-    m_impl{MakeUnique<TxRequestTracker::Impl>(deterministic)} {}
+TxRequestTracker::TxRequestTracker(bool deterministic, size_t num_shards) :
+    m_impl{MakeUnique<TxRequestTracker::Impl>(deterministic, num_shards)} {}
 
 TxRequestTracker::~TxRequestTracker() = default;
 
@@ -12,8 +12,12 @@
 #include <chrono>
 #include <vector>
 
+#include <stddef.h>
 #include <stdint.h>
 
+/** Number of shards TxRequestTracker splits the announcements in by default. */
+static constexpr size_t DEFAULT_TXREQUEST_SHARDS{16};
+
 /** Data structure to keep track of, and schedule, transaction downloads from peers.
  *
  * === Specification ===
@@ -91,7 +95,18 @@
  * - Memory usage is proportional to the total number of tracked announcements (Size()) plus the number of
  *   peers with a nonzero number of tracked announcements.
  * - CPU usage is generally logarithmic in the total number of tracked announcements, plus the number of
- *   announcements affected by an operation (amortized O(1) per announcement).
+ *   announcements affected by an operation (amortized O(1) per announcement). DisconnectedPeer and
+ *   GetRequestable also visit every shard, see below; the counts are kept per peer across shards.
+ *
+ * Thread safety:
+ * - The rules above only relate announcements with the same txhash. The announcements are therefore split into
+ *   shards by a salted hash of their txhash, and every shard has its own lock.
+ * - Operations on a txhash lock only its shard, so message handlers for different peers can run them in parallel
+ *   without holding cs_main. Operations on a peer lock the shards one at a time. They see every shard in a
+ *   consistent state, but not all shards at the same moment.
+ * - The per-peer counts are kept outside the shards, striped by peer with a lock per stripe. A shard briefly takes
+ *   the lock of the peer it changes, so that the checks done for every announcement (Count, CountInFlight) do not
+ *   lock every shard, and shards changing different peers rarely contend.
  */
 class TxRequestTracker {
     // Avoid littering this header file with implementation details.
@@ -100,7 +115,7 @@ class TxRequestTracker {
 
 public:
     //! Construct a TxRequestTracker.
-    explicit TxRequestTracker(bool deterministic = false);
+    explicit TxRequestTracker(bool deterministic = false, size_t num_shards = DEFAULT_TXREQUEST_SHARDS);
     ~TxRequestTracker();
 
     // Conceptually, the data structure consists of a collection of "announcements", one for each peer/txhash
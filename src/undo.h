@@ -14,6 +14,8 @@
 #include <serialize.h>
 #include <version.h>
 
+#include <limits>
+
 /** Formatter for undo information for a CTxIn
  *
  *  Contains the prevout's CTxOut being spent, and its metadata as well
@@ -77,6 +79,108 @@ public:
 	}
 };
 
+/** Formatter for undo information for a CBlock in the columnar format
+ *
+ *  Used for undo records of blocks with BLOCK_UNDO_COLUMNAR set. Rather than
+ *  interleaving the fields of every spent coin, all coins of the block are
+ *  written column by column: the number of spent coins per transaction, then
+ *  all heights, then all amounts, then all scripts. Heights are delta-coded
+ *  against the previous coin (coins spent in one block tend to be of similar
+ *  age) with the coinbase flag in the lowest bit, and the version dummy kept by
+ *  TxInUndoFormatter for compatibility is dropped. The presence of MWEB undo
+ *  data is stored explicitly instead of being inferred from the record size.
+ */
+struct BlockUndoColumnarFormatter
+{
+    //! Every spent coin is referenced by a (non-witness) input of at least 41 bytes.
+    static constexpr uint64_t MAX_COINS = MAX_BLOCK_WEIGHT / (WITNESS_SCALE_FACTOR * 41);
+    static constexpr uint64_t MAX_TXS = MAX_BLOCK_WEIGHT / MIN_TRANSACTION_WEIGHT;
+
+    static uint64_t ZigZagEncode(int64_t n) { return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63); }
+    static int64_t ZigZagDecode(uint64_t n) { return static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1); }
+
+    template<typename Stream>
+    void Ser(Stream& s, const CBlockUndo& blockundo)
+    {
+        WriteCompactSize(s, blockundo.vtxundo.size());
+        for (const CTxUndo& txundo : blockundo.vtxundo) {
+            WriteCompactSize(s, txundo.vprevout.size());
+        }
+        int64_t prev_height = 0;
+        for (const CTxUndo& txundo : blockundo.vtxundo) {
+            for (const Coin& coin : txundo.vprevout) {
+                const int64_t height = coin.nHeight;
+                ::Serialize(s, VARINT(ZigZagEncode(height - prev_height) * 2 + coin.fCoinBase));
+                prev_height = height;
+            }
+        }
+        for (const CTxUndo& txundo : blockundo.vtxundo) {
+            for (const Coin& coin : txundo.vprevout) {
+                ::Serialize(s, Using<AmountCompression>(coin.out.nValue));
+            }
+        }
+        for (const CTxUndo& txundo : blockundo.vtxundo) {
+            for (const Coin& coin : txundo.vprevout) {
+                ::Serialize(s, Using<ScriptCompression>(coin.out.scriptPubKey));
+            }
+        }
+        const bool has_mwundo = blockundo.mwundo != nullptr;
+        ::Serialize(s, has_mwundo);
+        if (has_mwundo) {
+            ::Serialize(s, blockundo.mwundo);
+        }
+    }
+
+    template<typename Stream>
+    void Unser(Stream& s, CBlockUndo& blockundo)
+    {
+        const uint64_t num_txs = ::ReadCompactSize(s);
+        if (num_txs > MAX_TXS) {
+            throw std::ios_base::failure("Too many transactions in columnar block undo");
+        }
+        blockundo.vtxundo.assign(num_txs, CTxUndo());
+        uint64_t num_coins = 0;
+        for (CTxUndo& txundo : blockundo.vtxundo) {
+            const uint64_t num_prevouts = ::ReadCompactSize(s);
+            num_coins += num_prevouts;
+            if (num_coins > MAX_COINS) {
+                throw std::ios_base::failure("Too many spent coins in columnar block undo");
+            }
+            txundo.vprevout.resize(num_prevouts);
+        }
+        int64_t prev_height = 0;
+        for (CTxUndo& txundo : blockundo.vtxundo) {
+            for (Coin& coin : txundo.vprevout) {
+                uint64_t code = 0;
+                ::Unserialize(s, VARINT(code));
+                const int64_t height = prev_height + ZigZagDecode(code >> 1);
+                if (height < 0 || height > std::numeric_limits<int32_t>::max()) {
+                    throw std::ios_base::failure("Invalid coin height in columnar block undo");
+                }
+                coin.nHeight = height;
+                coin.fCoinBase = code & 1;
+                prev_height = height;
+            }
+        }
+        for (CTxUndo& txundo : blockundo.vtxundo) {
+            for (Coin& coin : txundo.vprevout) {
+                ::Unserialize(s, Using<AmountCompression>(coin.out.nValue));
+            }
+        }
+        for (CTxUndo& txundo : blockundo.vtxundo) {
+            for (Coin& coin : txundo.vprevout) {
+                ::Unserialize(s, Using<ScriptCompression>(coin.out.scriptPubKey));
+            }
+        }
+        bool has_mwundo = false;
+        ::Unserialize(s, has_mwundo);
+        blockundo.mwundo = nullptr;
+        if (has_mwundo) {
+            ::Unserialize(s, blockundo.mwundo);
+        }
+    }
+};
+
 template <typename Stream>
 inline void UnserializeBlockUndo(CBlockUndo& blockundo, Stream& s, const unsigned int num_bytes)
 {
@@ -15,6 +15,7 @@
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <cuckoocache.h>
 #include <flatfile.h>
 #include <hash.h>
@@ -53,7 +54,11 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <string>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -144,6 +149,7 @@ bool fPruneMode = false;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool g_columnar_undo = DEFAULT_COLUMNAR_UNDO;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -203,9 +209,11 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
 bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
+static void AddScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
+static bool AbortNode(const std::string& strMessage, bilingual_str user_message = bilingual_str());
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
@@ -257,7 +265,7 @@ bool TestLockPointValidity(const LockPoints* lp)
     return true;
 }
 
-bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp, bool useExistingLockPoints)
+bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp, bool useExistingLockPoints, const CCoinsView* coins_view)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(pool.cs);
@@ -284,12 +292,13 @@ bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flag
     else {
         // CoinsTip() contains the UTXO set for ::ChainActive().Tip()
         CCoinsViewMemPool viewMemPool(&::ChainstateActive().CoinsTip(), pool);
+        const CCoinsView& view = coins_view ? *coins_view : viewMemPool;
         std::vector<int> prevheights;
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
             Coin coin;
-            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
+            if (!view.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
             if (coin.nHeight == MEMPOOL_HEIGHT) {
@@ -457,7 +466,8 @@ public:
         m_limit_ancestors(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT)),
         m_limit_ancestor_size(gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000),
         m_limit_descendants(gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT)),
-        m_limit_descendant_size(gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000) {}
+        m_limit_descendant_size(gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000),
+        m_limit_cluster(gArgs.GetArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT)) {}
 
     // We put the arguments we're handed into a struct, so we can pass them
     // around easier.
@@ -477,11 +487,21 @@ public:
         std::vector<OutputIndex>& m_coins_to_uncache;
         const bool m_test_accept;
         CAmount* m_fee_out;
+        /*
+         * Whether the transaction is part of a package whose feerate is
+         * checked as a whole, rather than the feerate of each transaction.
+         */
+        const bool m_package_feerates = false;
     };
 
     // Single transaction acceptance
     bool AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    // Multiple transaction acceptance. The transactions may spend from one
+    // another, and are all accepted or none. args supplies the arguments
+    // shared by all transactions; the results are added to result.
+    bool AcceptMultipleTransactions(const std::vector<CTransactionRef>& txns, ATMPArgs& args, PackageMempoolAcceptResult& result) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -522,16 +542,21 @@ private:
     // limiting is performed, false otherwise.
     bool Finalize(ATMPArgs& args, Workspace& ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
 
+    // Enforce the ancestor limits on the package transactions together, which
+    // PreChecks() could not do while their package ancestors were not in the
+    // mempool yet.
+    bool CheckPackageLimits(const std::vector<Workspace>& workspaces, PackageValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(m_pool.cs);
+
     // Compare a package's feerate against minimum allowed.
     bool CheckFeeRate(size_t package_size, uint64_t mweb_weight, CAmount package_fee, TxValidationState& state)
     {
         CAmount mempoolRejectFee = m_pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetTotalFee(package_size, mweb_weight);
         if (mempoolRejectFee > 0 && package_fee < mempoolRejectFee) {
-            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool min fee not met", strprintf("%d < %d", package_fee, mempoolRejectFee));
+            return state.Invalid(TxValidationResult::TX_RECONSIDERABLE, "mempool min fee not met", strprintf("%d < %d", package_fee, mempoolRejectFee));
         }
 
         if (package_fee < ::minRelayTxFee.GetTotalFee(package_size, mweb_weight)) {
-            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "min relay fee not met", strprintf("%d < %d", package_fee, ::minRelayTxFee.GetTotalFee(package_size, mweb_weight)));
+            return state.Invalid(TxValidationResult::TX_RECONSIDERABLE, "min relay fee not met", strprintf("%d < %d", package_fee, ::minRelayTxFee.GetTotalFee(package_size, mweb_weight)));
         }
         return true;
     }
@@ -549,6 +574,8 @@ private:
     // in-mempool conflicts; see below).
     size_t m_limit_descendants;
     size_t m_limit_descendant_size;
+    // Only enforced when the mempool is in cluster mode.
+    const size_t m_limit_cluster;
 };
 
 bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
@@ -661,6 +688,12 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         }
     }
 
+    // Replacements are evaluated against the feerate of the replacing
+    // transaction alone, which does not apply to packages
+    if (args.m_package_feerates && !setConflicts.empty()) {
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-replacement");
+    }
+
     LockPoints lp;
     m_view.SetBackend(m_viewmempool);
 
@@ -699,8 +732,9 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     // block; we don't want our mempool filled up with transactions that can't
     // be mined yet.
     // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
-    // CoinsViewCache instead of create its own
-    if (!CheckSequenceLocks(m_pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+    // CoinsViewCache instead of create its own. The coins of package
+    // transactions that are not in the mempool yet come from m_viewmempool.
+    if (!CheckSequenceLocks(m_pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp, false, &m_viewmempool))
         return state.Invalid(TxValidationResult::TX_PREMATURE_SPEND, "non-BIP68-final");
 
     CAmount nFees = 0;
@@ -752,7 +786,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
 
     // No transactions are allowed below minRelayTxFee except from disconnected
     // blocks
-    if (!bypass_limits && !CheckFeeRate(nSize, mweb_weight, nModifiedFees, state)) return false;
+    if (!bypass_limits && !args.m_package_feerates && !CheckFeeRate(nSize, mweb_weight, nModifiedFees, state)) return false;
 
     const CTxMemPool::setEntries setIterConflicting = m_pool.GetIterSet(setConflicts);
     // Calculate in-mempool ancestors, up to a limit.
@@ -829,6 +863,22 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         }
     }
 
+    // Linearizing a cluster takes quadratic time in its size, so bound it.
+    // Transactions that are about to be replaced still count towards the
+    // limit, except for those being replaced directly and their descendants.
+    if (m_pool.IsClusterMode()) {
+        size_t limit_cluster = m_limit_cluster;
+        for (CTxMemPool::txiter it : setIterConflicting) {
+            limit_cluster += it->GetCountWithDescendants();
+        }
+        const std::vector<CTxMemPool::txiter> ancestors(setAncestors.begin(), setAncestors.end());
+        const size_t cluster_size = m_pool.CalculateCluster(ancestors, limit_cluster).size() + 1;
+        if (cluster_size > limit_cluster) {
+            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-large-cluster",
+                    strprintf("exceeds cluster limit of %u transactions", m_limit_cluster));
+        }
+    }
+
     // Check if it's economically rational to mine this transaction rather
     // than the ones it replaces.
     nConflictingFees = 0;
@@ -860,6 +910,12 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
             // or not to replace, we do require the replacement to pay more
             // overall fees too, mitigating most cases.
             CFeeRate oldFeeRate(mi->GetModifiedFee(), mi->GetTxSize(), mi->GetMWEBWeight());
+            if (m_pool.IsClusterMode()) {
+                // Compare against the feerate it would be mined at, which
+                // includes the ancestors and descendants it is chunked with.
+                const CTxMemPool::Chunk chunk = m_pool.GetChunk(mi);
+                oldFeeRate = CFeeRate(chunk.fee, chunk.size, chunk.mweb_weight);
+            }
             if (newFeeRate <= oldFeeRate)
             {
                 return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "insufficient fee",
@@ -1049,8 +1105,9 @@ bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
     // Store transaction in memory
     m_pool.addUnchecked(*entry, setAncestors, validForFeeEstimation);
 
-    // trim mempool and check if tx was trimmed
-    if (!bypass_limits) {
+    // trim mempool and check if tx was trimmed; packages are trimmed once
+    // all their transactions are added
+    if (!bypass_limits && !args.m_package_feerates) {
         LimitMempoolSize(m_pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
         if (!m_pool.exists(hash))
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
@@ -1087,6 +1144,155 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
     return true;
 }
 
+bool MemPoolAccept::CheckPackageLimits(const std::vector<Workspace>& workspaces, PackageValidationState& state)
+{
+    AssertLockHeld(m_pool.cs);
+
+    CTxMemPool::setEntries ancestors;
+    for (const Workspace& ws : workspaces) {
+        ancestors.insert(ws.m_ancestors.begin(), ws.m_ancestors.end());
+    }
+
+    uint64_t total_count = workspaces.size() + ancestors.size();
+    uint64_t total_size = 0;
+    for (const Workspace& ws : workspaces) {
+        total_size += ws.m_entry->GetTxSize();
+    }
+    for (CTxMemPool::txiter it : ancestors) {
+        total_size += it->GetTxSize();
+    }
+
+    if (total_count > m_limit_ancestors) {
+        return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-mempool-limits",
+                strprintf("too many unconfirmed ancestors [limit: %u]", m_limit_ancestors));
+    }
+    if (total_size > m_limit_ancestor_size) {
+        return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-mempool-limits",
+                strprintf("exceeds ancestor size limit [limit: %u]", m_limit_ancestor_size));
+    }
+    // Every in-mempool ancestor gains all package transactions as descendants
+    for (CTxMemPool::txiter it : ancestors) {
+        if (it->GetCountWithDescendants() + workspaces.size() > m_limit_descendants) {
+            return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-mempool-limits",
+                    strprintf("too many descendants for tx %s [limit: %u]", it->GetTx().GetHash().ToString(), m_limit_descendants));
+        }
+        if (it->GetSizeWithDescendants() + total_size > m_limit_descendant_size) {
+            return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-mempool-limits",
+                    strprintf("exceeds descendant size limit for tx %s [limit: %u]", it->GetTx().GetHash().ToString(), m_limit_descendant_size));
+        }
+    }
+    if (m_pool.IsClusterMode()) {
+        const std::vector<CTxMemPool::txiter> package_ancestors(ancestors.begin(), ancestors.end());
+        if (m_pool.CalculateCluster(package_ancestors, m_limit_cluster).size() + workspaces.size() > m_limit_cluster) {
+            return state.Invalid(PackageValidationResult::PCKG_POLICY, "package-mempool-limits",
+                    strprintf("exceeds cluster limit of %u transactions", m_limit_cluster));
+        }
+    }
+    return true;
+}
+
+bool MemPoolAccept::AcceptMultipleTransactions(const std::vector<CTransactionRef>& txns, ATMPArgs& args, PackageMempoolAcceptResult& result)
+{
+    AssertLockHeld(cs_main);
+    LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+
+    PackageValidationState& package_state = result.m_state;
+
+    std::vector<Workspace> workspaces;
+    workspaces.reserve(txns.size());
+    std::vector<ATMPArgs> txns_args;
+    txns_args.reserve(txns.size());
+    std::vector<CAmount> fees(txns.size());
+    for (size_t i = 0; i < txns.size(); ++i) {
+        const uint256& wtxid = txns[i]->GetWitnessHash();
+        workspaces.emplace_back(txns[i]);
+        txns_args.push_back(ATMPArgs{args.m_chainparams, result.m_tx_results[wtxid], args.m_accept_time, args.m_replaced_transactions,
+                                     args.m_bypass_limits, args.m_coins_to_uncache, args.m_test_accept, &fees[i], /* m_package_feerates */ true});
+        if (!PreChecks(txns_args[i], workspaces[i])) {
+            return package_state.Invalid(PackageValidationResult::PCKG_TX, "transaction failed");
+        }
+        result.m_tx_fees[wtxid] = workspaces[i].m_modified_fees;
+        // Make its outputs available to the transactions after it
+        m_viewmempool.PackageAddTransaction(txns[i]);
+    }
+
+    if (!CheckPackageLimits(workspaces, package_state)) return false;
+
+    CAmount total_fees = 0;
+    size_t total_size = 0;
+    uint64_t total_mweb_weight = 0;
+    for (const Workspace& ws : workspaces) {
+        total_fees += ws.m_modified_fees;
+        total_size += ws.m_entry->GetTxSize();
+        total_mweb_weight += ws.m_entry->GetMWEBWeight();
+    }
+    result.m_package_feerate = CFeeRate(total_fees, total_size, total_mweb_weight);
+    TxValidationState feerate_state;
+    if (!args.m_bypass_limits && !CheckFeeRate(total_size, total_mweb_weight, total_fees, feerate_state)) {
+        return package_state.Invalid(PackageValidationResult::PCKG_POLICY, "package-fee-too-low", feerate_state.GetDebugMessage());
+    }
+
+    // Script verification comes last, once the cheaper checks of the whole
+    // package have passed
+    std::vector<PrecomputedTransactionData> txdata(txns.size());
+    for (size_t i = 0; i < txns.size(); ++i) {
+        if (!PolicyScriptChecks(txns_args[i], workspaces[i], txdata[i])) {
+            return package_state.Invalid(PackageValidationResult::PCKG_TX, "transaction failed");
+        }
+    }
+
+    if (args.m_test_accept) return true;
+
+    // The package is accepted as a whole or not at all, so a transaction that
+    // fails below takes the ones added before it out of the mempool again
+    const auto remove_added = [&](size_t count) EXCLUSIVE_LOCKS_REQUIRED(m_pool.cs) {
+        for (size_t i = 0; i < count; ++i) {
+            m_pool.removeRecursive(*txns[i], MemPoolRemovalReason::PACKAGE);
+        }
+    };
+    for (size_t i = 0; i < txns.size(); ++i) {
+        // The package transactions it spends from have been added by now
+        if (!ConsensusScriptChecks(txns_args[i], workspaces[i], txdata[i])) {
+            remove_added(i);
+            return package_state.Invalid(PackageValidationResult::PCKG_TX, "transaction failed");
+        }
+
+        // Its package ancestors were not in the mempool when PreChecks()
+        // calculated its ancestors, so do it again without limits; those were
+        // enforced by CheckPackageLimits()
+        const uint64_t no_limit = std::numeric_limits<uint64_t>::max();
+        std::string dummy_err_string;
+        workspaces[i].m_ancestors.clear();
+        m_pool.CalculateMemPoolAncestors(*workspaces[i].m_entry, workspaces[i].m_ancestors, no_limit, no_limit, no_limit, no_limit, dummy_err_string);
+
+        if (!Finalize(txns_args[i], workspaces[i])) {
+            remove_added(i + 1);
+            return package_state.Invalid(PackageValidationResult::PCKG_TX, "transaction failed");
+        }
+    }
+
+    // As for a single transaction, trim the mempool and check that the package
+    // survived. The transactions were only admitted for the feerate of the
+    // whole package, so if any of them was trimmed, none of them stay.
+    if (!args.m_bypass_limits) {
+        LimitMempoolSize(m_pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
+        const bool trimmed = std::any_of(txns.cbegin(), txns.cend(), [&](const CTransactionRef& tx) { return !m_pool.exists(tx->GetHash()); });
+        if (trimmed) {
+            for (size_t i = 0; i < txns.size(); ++i) {
+                m_pool.removeRecursive(*txns[i], MemPoolRemovalReason::SIZELIMIT);
+                txns_args[i].m_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
+            }
+            return package_state.Invalid(PackageValidationResult::PCKG_POLICY, "mempool full");
+        }
+    }
+    for (const CTransactionRef& tx : txns) {
+        result.m_accepted.push_back(tx);
+        GetMainSignals().TransactionAddedToMempool(tx, m_pool.GetAndIncrementSequence());
+    }
+
+    return true;
+}
+
 } // anon namespace
 
 /** (try to) add transaction to memory pool with a specified acceptance time **/
@@ -1120,6 +1326,228 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, test_accept, fee_out);
 }
 
+namespace {
+/**
+ * One piece of the work of PrevalidateTransactions(): either the verification
+ * of the MWEB signatures and rangeproofs of a transaction, or the verification
+ * of one of its input scripts. Valid results end up in the MWEB and signature
+ * caches. Invalid ones are left for AcceptToMemoryPool() to report, so this
+ * never fails the queue.
+ */
+class CTxPrevalidation
+{
+private:
+    const CTransaction* m_tx{nullptr};
+    unsigned int m_input{0};
+    //! The precomputed data of the transaction, or nullptr for the MWEB check
+    PrecomputedTransactionData* m_txdata{nullptr};
+    //! Set when an input script of the transaction fails
+    std::atomic<bool>* m_script_failed{nullptr};
+
+public:
+    CTxPrevalidation() {}
+    explicit CTxPrevalidation(const CTransaction& tx) : m_tx(&tx) {}
+    CTxPrevalidation(const CTransaction& tx, unsigned int input, PrecomputedTransactionData& txdata, std::atomic<bool>& script_failed)
+        : m_tx(&tx), m_input(input), m_txdata(&txdata), m_script_failed(&script_failed) {}
+
+    bool operator()()
+    {
+        if (m_txdata == nullptr) {
+            TxValidationState state;
+            MWEB::Node::CheckTransaction(*m_tx, state, /* cache_store */ true);
+            return true;
+        }
+        if (!CScriptCheck(m_txdata->m_spent_outputs[m_input], *m_tx, m_input, STANDARD_SCRIPT_VERIFY_FLAGS, /* cacheIn */ true, m_txdata)()) {
+            *m_script_failed = true;
+        }
+        return true;
+    }
+
+    void swap(CTxPrevalidation& check)
+    {
+        std::swap(m_tx, check.m_tx);
+        std::swap(m_input, check.m_input);
+        std::swap(m_txdata, check.m_txdata);
+        std::swap(m_script_failed, check.m_script_failed);
+    }
+};
+} // namespace
+
+static CCheckQueue<CTxPrevalidation> txprevalidationqueue(16);
+
+void ThreadTxPrevalidation(int worker_num) {
+    util::ThreadRename(strprintf("txprecheck.%i", worker_num));
+    txprevalidationqueue.Thread();
+}
+
+void PrevalidateTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& txs)
+{
+    if (!g_parallel_script_checks) return;
+
+    std::vector<PrecomputedTransactionData> txsdata(txs.size());
+    std::unique_ptr<std::atomic<bool>[]> script_failed(new std::atomic<bool>[txs.size()]());
+    // The checks of each transaction, and what it pays for which size
+    std::vector<std::vector<CTxPrevalidation>> tx_checks(txs.size());
+    std::vector<CAmount> tx_fees(txs.size(), 0);
+    std::vector<std::pair<size_t, uint64_t>> tx_sizes(txs.size(), {0, 0});
+    CAmount total_fees = 0;
+    size_t total_size = 0;
+    uint64_t total_mweb_weight = 0;
+    CFeeRate min_feerate;
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewCache& coins_tip = ::ChainstateActive().CoinsTip();
+        CCoinsViewMemPool view_mempool(&coins_tip, pool);
+        CCoinsViewCache view(&view_mempool);
+        std::vector<OutputIndex> coins_to_uncache;
+        const bool mweb_enabled = IsMWEBEnabled(::ChainActive().Tip(), Params().GetConsensus());
+        min_feerate = std::max(pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000), ::minRelayTxFee);
+
+        for (size_t i = 0; i < txs.size(); ++i) {
+            const CTransaction& tx = *txs[i];
+            // Only spend time on transactions which AcceptToMemoryPool() would
+            // not reject before verifying them
+            TxValidationState state;
+            std::string reason;
+            if (pool.exists(GenTxid(true, tx.GetWitnessHash())) || tx.IsCoinBase() || tx.IsHogEx() || !CheckTransaction(tx, state)) continue;
+            if (fRequireStandard && !IsStandardTx(tx, reason)) continue;
+
+            // Scripts are verified against a snapshot of the coins they spend,
+            // which may also be created by earlier transactions of the batch
+            std::vector<CTxOut> spent_outputs;
+            CAmount value_in = 0;
+            for (const CTxIn& txin : tx.vin) {
+                if (!coins_tip.HaveCoinInCache(txin.prevout)) {
+                    coins_to_uncache.push_back(txin.prevout);
+                }
+                const Coin& coin = view.AccessCoin(txin.prevout);
+                if (coin.IsSpent()) break;
+                spent_outputs.push_back(coin.out);
+                value_in += coin.out.nValue;
+            }
+            AddCoins(view, tx, MEMPOOL_HEIGHT, /* check_for_overwrite */ true);
+            if (spent_outputs.size() != tx.vin.size()) continue;
+
+            // The fee, as Consensus::CheckTxInputs() computes it, with any
+            // PrioritiseTransaction delta
+            CAmount fee = value_in - tx.GetValueOut() + (tx.HasMWEBTx() ? tx.mweb_tx.GetFee() : 0);
+            if (!MoneyRange(fee)) continue;
+            pool.ApplyDelta(tx.GetHash(), fee);
+            tx_fees[i] = fee;
+            tx_sizes[i] = {GetVirtualTransactionSize(tx), tx.mweb_tx.GetMWEBWeight()};
+            total_fees += fee;
+            total_size += tx_sizes[i].first;
+            total_mweb_weight += tx_sizes[i].second;
+
+            if (tx.HasMWEBTx() && mweb_enabled) {
+                tx_checks[i].emplace_back(tx);
+            }
+            if (tx.vin.empty()) continue;
+            txsdata[i].Init(tx, std::move(spent_outputs));
+            for (unsigned int input = 0; input < tx.vin.size(); ++input) {
+                tx_checks[i].emplace_back(tx, input, txsdata[i], script_failed[i]);
+            }
+        }
+
+        // Leave the coins cache as AcceptToMemoryPool() would find it
+        for (const OutputIndex& index : coins_to_uncache) {
+            coins_tip.Uncache(index);
+        }
+    }
+
+    // Skip transactions that AcceptToMemoryPool() would reject for their fee
+    // before verifying them. Those falling short may still be accepted along
+    // with the rest of a package, so a batch is also checked as a whole.
+    const bool batch_pays = txs.size() > 1 && total_fees >= min_feerate.GetTotalFee(total_size, total_mweb_weight);
+    std::vector<CTxPrevalidation> checks;
+    std::vector<size_t> script_checked;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (!batch_pays && tx_fees[i] < min_feerate.GetTotalFee(tx_sizes[i].first, tx_sizes[i].second)) continue;
+        for (CTxPrevalidation& check : tx_checks[i]) {
+            checks.emplace_back();
+            checks.back().swap(check);
+        }
+        if (txsdata[i].m_spent_outputs_ready) script_checked.push_back(i);
+    }
+
+    if (checks.empty()) return;
+    {
+        CCheckQueueControl<CTxPrevalidation> control(&txprevalidationqueue);
+        control.Add(checks);
+        control.Wait();
+    }
+
+    // Let the policy script checks of AcceptToMemoryPool() skip the
+    // transactions whose input scripts all succeeded
+    LOCK(cs_main);
+    for (size_t i : script_checked) {
+        if (!script_failed[i]) AddScriptExecutionCacheEntry(*txs[i], STANDARD_SCRIPT_VERIFY_FLAGS);
+    }
+}
+
+PackageMempoolAcceptResult ProcessNewPackage(CTxMemPool& pool, const Package& package, bool test_accept, std::list<CTransactionRef>* plTxnReplaced)
+{
+    AssertLockHeld(cs_main);
+
+    const CChainParams& chainparams = Params();
+    const int64_t accept_time = GetTime();
+    PackageMempoolAcceptResult result;
+    if (!CheckPackage(package, result.m_state)) return result;
+
+    // Verify the MWEB signatures and rangeproofs of the package in one batch,
+    // rather than in one per transaction
+    MWEB::Node::BatchVerifyPackage(package);
+
+    // Transactions which pay for themselves are accepted on their own, so
+    // that they cannot be used to pay for the others. Only those which fall
+    // short of the minimum feerate, and what spends from them, are evaluated
+    // together.
+    std::vector<CTransactionRef> txns_package_eval;
+    std::set<uint256> package_eval_txids;
+    for (const CTransactionRef& tx : package) {
+        const uint256& wtxid = tx->GetWitnessHash();
+        if (WITH_LOCK(pool.cs, return pool.exists(tx->GetHash()))) {
+            result.m_tx_results[wtxid];
+            continue;
+        }
+
+        const bool spends_package_eval = std::any_of(tx->vin.cbegin(), tx->vin.cend(), [&](const CTxIn& txin) {
+            return package_eval_txids.count(txin.prevout.hash) > 0;
+        });
+        if (!test_accept && !spends_package_eval) {
+            TxValidationState& state = result.m_tx_results[wtxid];
+            CAmount fee = 0;
+            if (AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, accept_time, plTxnReplaced, false /* bypass_limits */, false /* test_accept */, &fee)) {
+                result.m_tx_fees[wtxid] = fee;
+                result.m_accepted.push_back(tx);
+                continue;
+            }
+            if (state.GetResult() != TxValidationResult::TX_RECONSIDERABLE && state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
+                result.m_state.Invalid(PackageValidationResult::PCKG_TX, "transaction failed");
+                return result;
+            }
+            state = TxValidationState();
+        }
+        txns_package_eval.push_back(tx);
+        package_eval_txids.insert(tx->GetHash());
+    }
+    if (txns_package_eval.empty()) return result;
+
+    std::vector<OutputIndex> coins_to_uncache;
+    TxValidationState state_dummy;
+    MemPoolAccept::ATMPArgs args { chainparams, state_dummy, accept_time, plTxnReplaced, false /* bypass_limits */, coins_to_uncache, test_accept, nullptr /* fee_out */ };
+    const bool res = MemPoolAccept(pool).AcceptMultipleTransactions(txns_package_eval, args, result);
+    if (!res || test_accept) {
+        // Don't let transactions that never enter the mempool grow the coins cache
+        for (const OutputIndex& hashTx : coins_to_uncache) {
+            ::ChainstateActive().CoinsTip().Uncache(hashTx);
+        }
+    }
+    BlockValidationState state_dummy_block;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy_block, FlushStateMode::PERIODIC);
+    return result;
+}
+
 CTransactionRef GetTransaction(const CBlockIndex* const block_index, const CTxMemPool* const mempool, const uint256& hash, const Consensus::Params& consensusParams, uint256& hashBlock)
 {
     LOCK(cs_main);
@@ -1149,26 +1577,213 @@ CTransactionRef GetTransaction(const CBlockIndex* const block_index, const CTxMe
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// CBlock and CBlockIndex
+// Block file writer
 //
 
-static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
+namespace {
+/**
+ * Write-behind queue for block and undo file records.
+ *
+ * AcceptBlock() and ConnectBlock() write block and undo data with cs_main held,
+ * which puts disk latency on the path of every block. While the writer thread is
+ * running, records are queued instead and written in order by that thread. The
+ * position of each record is still assigned up front by FindBlockPos() and
+ * FindUndoPos(), so the block index can refer to a record before it reaches the
+ * file.
+ *
+ * Durability is unchanged: FlushBlockFile() and FlushUndoFile() wait for the
+ * records of the files they commit, and FlushStateToDisk() drains the whole
+ * queue before the block index and chainstate are flushed. Reads from a file
+ * first wait for the records queued for that file. Without the thread, records
+ * are written by the caller.
+ *
+ * A failed queued write aborts the node and is remembered: from then on every
+ * wait reports the failure and no more records are accepted, so that neither
+ * the block index nor a reader trusts data that never reached the file.
+ */
+class BlockFileWriter
+{
+public:
+    enum class FileType { BLOCK, UNDO };
+
+private:
+    struct Record {
+        FileType type;
+        FlatFilePos pos;
+        std::vector<unsigned char> data;
+        uint64_t seq;
+    };
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Record> m_queue GUARDED_BY(m_mutex);
+    //! Total size of the records in m_queue
+    size_t m_queue_bytes GUARDED_BY(m_mutex){0};
+    //! Sequence number of the next record to be queued
+    uint64_t m_next_seq GUARDED_BY(m_mutex){1};
+    //! Sequence number of the last record written to its file
+    uint64_t m_written_seq GUARDED_BY(m_mutex){0};
+    //! Whether writing a queued record has failed
+    bool m_write_failed GUARDED_BY(m_mutex){false};
+    bool m_running GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
+
+    static bool WriteRecord(FileType type, const FlatFilePos& pos, const std::vector<unsigned char>& data)
+    {
+        FILE* file = type == FileType::BLOCK ? OpenBlockFile(pos) : OpenUndoFile(pos);
+        if (!file) {
+            return error("%s: failed to open %s file %d", __func__, type == FileType::BLOCK ? "block" : "undo", pos.nFile);
+        }
+        bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+        ok &= fclose(file) == 0;
+        if (!ok) {
+            return error("%s: failed to write %u bytes to %s file at %s", __func__, data.size(), type == FileType::BLOCK ? "block" : "undo", pos.ToString());
+        }
+        return true;
+    }
+
+    /** Wait until pred returns false */
+    template <typename Pred>
+    void WaitWhile(UniqueLock<Mutex>& lock, Pred pred) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        while (pred()) {
+            m_cond.wait(lock);
+        }
+    }
+
+    void ThreadWrite()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (true) {
+            while (!m_stop && m_queue.empty()) {
+                m_cond.wait(lock);
+            }
+            if (m_queue.empty()) break;
+
+            // Only this thread removes records, so the reference stays valid
+            // while new records are appended during the write.
+            const Record& record = m_queue.front();
+            bool ok;
+            {
+                REVERSE_LOCK(lock);
+                ok = WriteRecord(record.type, record.pos, record.data);
+                if (!ok) {
+                    AbortNode("Failed to write block data to disk. This is likely the result of an I/O error.");
+                }
+            }
+            // Waiters are released either way, and see the failure.
+            if (!ok) m_write_failed = true;
+            m_queue_bytes -= record.data.size();
+            m_written_seq = record.seq;
+            m_queue.pop_front();
+            m_cond.notify_all();
+        }
+    }
+
+public:
+    void Start()
+    {
+        LOCK(m_mutex);
+        assert(!m_running);
+        m_stop = false;
+        m_running = true;
+        m_thread = std::thread(&TraceThread<std::function<void()>>, "blkwrite", [this] { ThreadWrite(); });
+    }
+
+    /** Write out all queued records and stop the thread. Later records are written directly. */
+    void Stop()
+    {
+        {
+            LOCK(m_mutex);
+            if (!m_running) return;
+            m_stop = true;
+            m_cond.notify_all();
+        }
+        m_thread.join();
+        LOCK(m_mutex);
+        m_running = false;
+    }
+
+    /**
+     * Queue a record to be written at pos, or write it directly if the thread is
+     * not running. Returns false if a direct write failed or an earlier queued
+     * write did; failures of queued writes abort the node from the writer thread.
+     */
+    bool Write(FileType type, const FlatFilePos& pos, std::vector<unsigned char>&& data)
+    {
+        {
+            WAIT_LOCK(m_mutex, lock);
+            if (m_write_failed) return false;
+            if (m_running && !m_stop) {
+                // Bound the memory held by queued records. A record larger than the
+                // bound is still accepted once the queue is empty.
+                WaitWhile(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_queue.empty() && m_queue_bytes + data.size() > MAX_BLOCKFILE_WRITE_QUEUE_BYTES; });
+                m_queue_bytes += data.size();
+                m_queue.push_back(Record{type, pos, std::move(data), m_next_seq++});
+                m_cond.notify_all();
+                return true;
+            }
+        }
+        return WriteRecord(type, pos, data);
+    }
+
+    /**
+     * Wait until the records queued so far for the given file have been written.
+     * Returns false if a queued write has failed.
+     */
+    bool WaitForFile(FileType type, int file)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        uint64_t wait_seq = 0;
+        for (const Record& record : m_queue) {
+            if (record.type == type && record.pos.nFile == file) wait_seq = record.seq;
+        }
+        WaitWhile(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_written_seq < wait_seq; });
+        return !m_write_failed;
+    }
+
+    /** Wait until all records queued so far have been written. Returns false if a queued write has failed. */
+    bool Sync()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        const uint64_t wait_seq = m_next_seq - 1;
+        WaitWhile(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_written_seq < wait_seq; });
+        return !m_write_failed;
+    }
+};
+} // namespace
+
+static BlockFileWriter g_blockfile_writer;
+
+void StartBlockFileWriter()
 {
-    // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("WriteBlockToDisk: OpenBlockFile failed");
+    g_blockfile_writer.Start();
+}
 
-    // Write index header
-    unsigned int nSize = GetSerializeSize(block, fileout.GetVersion());
-    fileout << messageStart << nSize;
+void StopBlockFileWriter()
+{
+    g_blockfile_writer.Stop();
+}
 
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("WriteBlockToDisk: ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+//////////////////////////////////////////////////////////////////////////////
+//
+// CBlock and CBlockIndex
+//
+
+static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // Serialize the index header followed by the block
+    std::vector<unsigned char> record;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, record, 0);
+    unsigned int nSize = GetSerializeSize(block, writer.GetVersion());
+    writer << messageStart << nSize;
+    const FlatFilePos record_pos = pos;
+    pos.nPos += record.size();
+    writer << block;
+
+    if (!g_blockfile_writer.Write(BlockFileWriter::FileType::BLOCK, record_pos, std::move(record)))
+        return error("WriteBlockToDisk: failed to write block at %s", record_pos.ToString());
 
     return true;
 }
@@ -1176,6 +1791,8 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
+    if (!g_blockfile_writer.WaitForFile(BlockFileWriter::FileType::BLOCK, pos.nFile))
+        return error("ReadBlockFromDisk: block file %d was not fully written", pos.nFile);
 
     // Open history file to read
     CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
@@ -1219,10 +1836,75 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+/** Maximum number of block files kept mapped for ReadRawBlockFromDisk() */
+static constexpr size_t MAX_MAPPED_BLOCK_FILES = 8;
+
+static Mutex g_block_file_mappings_mutex;
+//! Block files mapped by ReadRawBlockFromDisk(), by path
+static std::map<fs::path, std::shared_ptr<const FlatFileMapping>> g_block_file_mappings GUARDED_BY(g_block_file_mappings_mutex);
+
+/** Return a mapping of the block file at pos covering at least min_size bytes, or nullptr */
+static std::shared_ptr<const FlatFileMapping> GetBlockFileMapping(const FlatFilePos& pos, size_t min_size)
+{
+    const fs::path path = BlockFileSeq().FileName(pos);
+    LOCK(g_block_file_mappings_mutex);
+    auto it = g_block_file_mappings.find(path);
+    if (it != g_block_file_mappings.end() && it->second->size() >= min_size) {
+        return it->second;
+    }
+    // Not mapped yet, or the file has grown since it was mapped
+    std::shared_ptr<const FlatFileMapping> mapping = BlockFileSeq().Map(pos);
+    if (!mapping || mapping->size() < min_size) {
+        return nullptr;
+    }
+    if (it == g_block_file_mappings.end() && g_block_file_mappings.size() >= MAX_MAPPED_BLOCK_FILES) {
+        g_block_file_mappings.erase(g_block_file_mappings.begin());
+    }
+    g_block_file_mappings[path] = mapping;
+    return mapping;
+}
+
+/** Drop all block file mappings, before block files are removed. Readers that
+ *  still hold one keep the removed file's pages readable. */
+static void ForgetBlockFileMappings()
+{
+    LOCK(g_block_file_mappings_mutex);
+    g_block_file_mappings.clear();
+}
+
+/** Drop the mapping of a block file that is about to be truncated. Returns false
+ *  if a reader still holds it, as reading the pages past the new end of the
+ *  file would then raise SIGBUS. No reader can take it while the lock is held. */
+static bool ForgetBlockFileMapping(const FlatFilePos& pos) EXCLUSIVE_LOCKS_REQUIRED(g_block_file_mappings_mutex)
+{
+    auto it = g_block_file_mappings.find(BlockFileSeq().FileName(pos));
+    if (it == g_block_file_mappings.end()) return true;
+    const bool in_use = it->second.use_count() > 1;
+    g_block_file_mappings.erase(it);
+    return !in_use;
+}
+
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
     FlatFilePos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
+    if (!g_blockfile_writer.WaitForFile(BlockFileWriter::FileType::BLOCK, pos.nFile))
+        return error("%s: block file %d was not fully written", __func__, pos.nFile);
+
+    // Copy the block straight out of a mapping of the block file if possible. Any
+    // inconsistency is left to the regular read below to report.
+    std::shared_ptr<const FlatFileMapping> mapping = GetBlockFileMapping(hpos, pos.nPos);
+    if (mapping && memcmp(mapping->data() + hpos.nPos, message_start, CMessageHeader::MESSAGE_START_SIZE) == 0) {
+        const unsigned int blk_size = ReadLE32(mapping->data() + hpos.nPos + CMessageHeader::MESSAGE_START_SIZE);
+        if (blk_size <= MAX_SIZE && mapping->size() - pos.nPos < blk_size) {
+            mapping = GetBlockFileMapping(hpos, size_t{pos.nPos} + blk_size);
+        }
+        if (blk_size <= MAX_SIZE && mapping) {
+            block.assign(mapping->data() + pos.nPos, mapping->data() + pos.nPos + blk_size);
+            return true;
+        }
+    }
+
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
         return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
@@ -1559,6 +2241,21 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+static uint256 GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    CSHA256 hasher = g_scriptExecutionCacheHasher;
+    hasher.Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+/** Record that all input scripts of tx succeed with the given flags */
+static void AddScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    AssertLockHeld(cs_main);
+    g_scriptExecutionCache.insert(GetScriptExecutionCacheEntry(tx, flags));
+}
+
 /**
  * Check whether all of this transaction's input scripts succeed.
  *
@@ -1591,9 +2288,7 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
     // correct (ie that the transaction hash which is in tx's prevouts
     // properly commits to the scriptPubKey in the inputs view of that
     // transaction).
-    uint256 hashCacheEntry;
-    CSHA256 hasher = g_scriptExecutionCacheHasher;
-    hasher.Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    const uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
     AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
     if (g_scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
@@ -1663,29 +2358,45 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
     return true;
 }
 
-static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+/** Serialize undo data in the columnar format (BLOCK_UNDO_COLUMNAR) or the legacy one. */
+template <typename Stream>
+static void SerializeBlockUndo(Stream& s, const CBlockUndo& blockundo, bool columnar)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
+    if (columnar) {
+        s << Using<BlockUndoColumnarFormatter>(blockundo);
+    } else {
+        s << blockundo;
+    }
+}
 
-    // Write index header
-    unsigned int nSize = GetSerializeSize(blockundo, fileout.GetVersion());
-    fileout << messageStart << nSize;
+static unsigned int GetBlockUndoSize(const CBlockUndo& blockundo, bool columnar)
+{
+    CSizeComputer sizer(CLIENT_VERSION);
+    SerializeBlockUndo(sizer, blockundo, columnar);
+    return sizer.size();
+}
+
+static bool UndoWriteToDisk(const CBlockUndo& blockundo, bool columnar, FlatFilePos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // Serialize the index header
+    std::vector<unsigned char> record;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, record, 0);
+    unsigned int nSize = GetBlockUndoSize(blockundo, columnar);
+    writer << messageStart << nSize;
 
-    // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    // Serialize undo data
+    const FlatFilePos record_pos = pos;
+    pos.nPos += record.size();
+    SerializeBlockUndo(writer, blockundo, columnar);
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
-    hasher << blockundo;
-    fileout << hasher.GetHash();
+    SerializeBlockUndo(hasher, blockundo, columnar);
+    writer << hasher.GetHash();
+
+    if (!g_blockfile_writer.Write(BlockFileWriter::FileType::UNDO, record_pos, std::move(record)))
+        return error("%s: failed to write undo data at %s", __func__, record_pos.ToString());
 
     return true;
 }
@@ -1699,6 +2410,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
 
     // Rewind 4 bytes in order to read the size
     pos.nPos -= 4;
+    if (!g_blockfile_writer.WaitForFile(BlockFileWriter::FileType::UNDO, pos.nFile))
+        return error("%s: undo file %d was not fully written", __func__, pos.nFile);
 
     // Open history file to read
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
@@ -1714,7 +2427,11 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
     CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
     try {
         verifier << pindex->pprev->GetBlockHash();
-        UnserializeBlockUndo(blockundo, verifier, undo_size);
+        if (pindex->nStatus & BLOCK_UNDO_COLUMNAR) {
+            verifier >> Using<BlockUndoColumnarFormatter>(blockundo);
+        } else {
+            UnserializeBlockUndo(blockundo, verifier, undo_size);
+        }
         filein >> hashChecksum;
     }
     catch (const std::exception& e) {
@@ -1729,7 +2446,7 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
 }
 
 /** Abort with a message */
-static bool AbortNode(const std::string& strMessage, bilingual_str user_message = bilingual_str())
+static bool AbortNode(const std::string& strMessage, bilingual_str user_message)
 {
     SetMiscWarning(Untranslated(strMessage));
     LogPrintf("*** %s\n", strMessage);
@@ -1850,24 +2567,50 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-static void FlushUndoFile(int block_file, bool finalize = false)
+/** Returns false if the undo file could not be written out in full */
+static bool FlushUndoFile(int block_file, bool finalize = false)
 {
+    if (!g_blockfile_writer.WaitForFile(BlockFileWriter::FileType::UNDO, block_file)) {
+        return false;
+    }
     FlatFilePos undo_pos_old(block_file, vinfoBlockFile[block_file].nUndoSize);
     if (!UndoFileSeq().Flush(undo_pos_old, finalize)) {
         AbortNode("Flushing undo file to disk failed. This is likely the result of an I/O error.");
+        return false;
     }
+    return true;
 }
 
-static void FlushBlockFile(bool fFinalize = false, bool finalize_undo = false)
+/** Returns false if the last block file could not be written out in full */
+static bool FlushBlockFile(bool fFinalize = false, bool finalize_undo = false)
 {
     LOCK(cs_LastBlockFile);
+    if (!g_blockfile_writer.WaitForFile(BlockFileWriter::FileType::BLOCK, nLastBlockFile)) {
+        return false;
+    }
     FlatFilePos block_pos_old(nLastBlockFile, vinfoBlockFile[nLastBlockFile].nSize);
-    if (!BlockFileSeq().Flush(block_pos_old, fFinalize)) {
+    bool flushed;
+    if (fFinalize) {
+        // Hold the lock while truncating, so that no reader maps the file
+        // meanwhile. A file that is still being read keeps its preallocated
+        // size instead.
+        LOCK(g_block_file_mappings_mutex);
+        const bool truncate = ForgetBlockFileMapping(block_pos_old);
+        if (!truncate) {
+            LogPrintf("Block file %05u is still being read, leaving it at its preallocated size\n", nLastBlockFile);
+        }
+        flushed = BlockFileSeq().Flush(block_pos_old, truncate);
+    } else {
+        flushed = BlockFileSeq().Flush(block_pos_old);
+    }
+    if (!flushed) {
         AbortNode("Flushing block file to disk failed. This is likely the result of an I/O error.");
+        return false;
     }
     // we do not always flush the undo file, as the chain tip may be lagging behind the incoming blocks,
     // e.g. during IBD or a sync after a node going offline
-    if (!fFinalize || finalize_undo) FlushUndoFile(nLastBlockFile, finalize_undo);
+    if (!fFinalize || finalize_undo) return FlushUndoFile(nLastBlockFile, finalize_undo);
+    return true;
 }
 
 static bool FindUndoPos(BlockValidationState &state, int nFile, FlatFilePos &pos, unsigned int nAddSize);
@@ -1876,10 +2619,12 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationSt
 {
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
+        // Read once, so that the record and the status flag agree.
+        const bool columnar = g_columnar_undo;
         FlatFilePos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, CLIENT_VERSION) + 40))
+        if (!FindUndoPos(state, pindex->nFile, _pos, GetBlockUndoSize(blockundo, columnar) + 40))
             return error("ConnectBlock(): FindUndoPos failed");
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+        if (!UndoWriteToDisk(blockundo, columnar, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
             return AbortNode(state, "Failed to write undo data");
         // rev files are written in block height order, whereas blk files are written as blocks come in (often out of order)
         // we want to flush the rev (undo) file once we've written the last block, which is indicated by the last height
@@ -1887,12 +2632,15 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationSt
         // with the block writes (usually when a synced up node is getting newly mined blocks) -- this case is caught in
         // the FindBlockPos function
         if (_pos.nFile < nLastBlockFile && static_cast<uint32_t>(pindex->nHeight) == vinfoBlockFile[_pos.nFile].nHeightLast) {
-            FlushUndoFile(_pos.nFile, true);
+            if (!FlushUndoFile(_pos.nFile, true)) {
+                return state.Error("Failed to write undo data");
+            }
         }
 
         // update nUndoPos in block index
         pindex->nUndoPos = _pos.nPos;
         pindex->nStatus |= BLOCK_HAVE_UNDO;
+        if (columnar) pindex->nStatus |= BLOCK_UNDO_COLUMNAR;
         setDirtyBlockIndex.insert(pindex);
     }
 
@@ -1906,6 +2654,71 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+namespace {
+/** A block record read from an external block file by LoadExternalBlockFile. */
+struct CImportedBlock
+{
+    //! Position of the serialized block in the file being imported
+    FlatFilePos pos;
+    //! Where to resume scanning if the record turns out not to be a valid block
+    uint64_t nRewind{0};
+    //! The serialized block, as read from the file
+    std::vector<unsigned char> vchRaw;
+    //! The deserialized block, or nullptr if deserialization failed
+    std::shared_ptr<CBlock> block;
+    uint256 hash;
+    std::string strError;
+};
+
+/**
+ * Deserialize an imported block record and run the context-free CheckBlock()
+ * on it. A block which passes has fChecked set, so that AcceptBlock() later
+ * only performs the contextual checks. Failures are recorded on the record and
+ * re-evaluated by AcceptBlock(), so this never fails the queue.
+ */
+class CBlockImportCheck
+{
+private:
+    CImportedBlock* m_record{nullptr};
+    const Consensus::Params* m_params{nullptr};
+
+public:
+    CBlockImportCheck() {}
+    CBlockImportCheck(CImportedBlock& record, const Consensus::Params& params) : m_record(&record), m_params(&params) {}
+
+    bool operator()()
+    {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        try {
+            VectorReader(SER_DISK, CLIENT_VERSION, m_record->vchRaw, 0, *pblock);
+        } catch (const std::exception& e) {
+            m_record->strError = e.what();
+            return true;
+        }
+        m_record->hash = pblock->GetHash();
+        BlockValidationState state;
+        CheckBlock(*pblock, state, *m_params);
+        m_record->block = std::move(pblock);
+        // The serialized copy is no longer needed
+        std::vector<unsigned char>().swap(m_record->vchRaw);
+        return true;
+    }
+
+    void swap(CBlockImportCheck& check)
+    {
+        std::swap(m_record, check.m_record);
+        std::swap(m_params, check.m_params);
+    }
+};
+} // namespace
+
+static CCheckQueue<CBlockImportCheck> blockimportqueue(16);
+
+void ThreadBlockImportCheck(int worker_num) {
+    util::ThreadRename(strprintf("blkimport.%i", worker_num));
+    blockimportqueue.Thread();
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2427,8 +3240,14 @@ bool CChainState::FlushStateToDisk(
             {
                 LOG_TIME_MILLIS_WITH_CATEGORY("write block and undo data to disk", BCLog::BENCH);
 
-                // First make sure all block and undo data is flushed to disk.
-                FlushBlockFile();
+                // First make sure all block and undo data is flushed to disk. Undo
+                // data of a tip lagging behind the incoming blocks goes to earlier
+                // files than the last one, so wait for the whole queue.
+                // Do not write a block index that refers to data that did not make
+                // it to disk.
+                if (!g_blockfile_writer.Sync() || !FlushBlockFile()) {
+                    return state.Error("Failed to write block and undo data to disk");
+                }
             }
 
             // Then update all block file information (which may refer to block and undo files).
@@ -3324,7 +4143,8 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = NewBlockIndex();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3425,7 +4245,9 @@ static bool FindBlockPos(FlatFilePos &pos, unsigned int nAddSize, unsigned int n
         if (!fKnown) {
             LogPrintf("Leaving block file %i: %s\n", nLastBlockFile, vinfoBlockFile[nLastBlockFile].ToString());
         }
-        FlushBlockFile(!fKnown, finalize_undo);
+        if (!FlushBlockFile(!fKnown, finalize_undo)) {
+            return error("%s: failed to flush block file %d", __func__, nLastBlockFile);
+        }
         nLastBlockFile = nFile;
     }
 
@@ -3781,7 +4603,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3801,7 +4623,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus())) {
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW)) {
             LogPrint(BCLog::VALIDATION, "%s: Consensus::CheckBlockHeader: %s, %s\n", __func__, hash.ToString(), state.ToString());
             return false;
         }
@@ -3927,7 +4749,9 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex);
+    // A block that already passed CheckBlock() had its (scrypt) proof of work
+    // verified there, so don't compute it a second time for the header.
+    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex, /* fCheckPOW */ !block.fChecked);
     CheckBlockIndex(chainparams.GetConsensus());
 
     if (!accepted_header)
@@ -4084,7 +4908,7 @@ void BlockManager::PruneOneBlockFile(const int fileNumber)
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
-            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~(BLOCK_HAVE_UNDO | BLOCK_UNDO_COLUMNAR);
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -4112,6 +4936,8 @@ void BlockManager::PruneOneBlockFile(const int fileNumber)
 
 void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
+    g_blockfile_writer.Sync();
+    ForgetBlockFileMappings();
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         FlatFilePos pos(*it, 0);
         fs::remove(BlockFileSeq().FileName(pos));
@@ -4250,19 +5076,59 @@ CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = NewBlockIndex();
     mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
+CBlockIndex* BlockManager::NewBlockIndex()
+{
+    AssertLockHeld(cs_main);
+    if (m_block_index_chunks.empty() || m_block_index_chunk_used == BLOCK_INDEX_CHUNK_SIZE) {
+        m_block_index_chunks.emplace_back(new CBlockIndex[BLOCK_INDEX_CHUNK_SIZE]);
+        m_block_index_chunk_used = 0;
+    }
+    return &m_block_index_chunks.back()[m_block_index_chunk_used++];
+}
+
+static fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index_snapshot.dat";
+}
+
+bool BlockManager::WriteBlockIndexSnapshot(CBlockTreeDB& blocktree, const uint256& best_block)
+{
+    AssertLockHeld(cs_main);
+    if (!m_block_index_loaded) {
+        return error("%s: block index was not loaded", __func__);
+    }
+    if (!setDirtyBlockIndex.empty()) {
+        return error("%s: block index has unflushed changes", __func__);
+    }
+    int64_t nStart = GetTimeMillis();
+    std::vector<const CBlockIndex*> entries;
+    entries.reserve(m_block_index.size());
+    for (const BlockMap::value_type& entry : m_block_index) {
+        entries.push_back(entry.second);
+    }
+    if (!blocktree.WriteBlockIndexSnapshot(GetBlockIndexSnapshotPath(), best_block, entries)) {
+        return false;
+    }
+    LogPrintf("Wrote block index snapshot with %u entries in %dms\n", entries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
 bool BlockManager::LoadBlockIndex(
     const Consensus::Params& consensus_params,
     CBlockTreeDB& blocktree,
-    std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
+    std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates,
+    const uint256& chainstate_best_block)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+    const auto insert_block_index = [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); };
+    if (!(!chainstate_best_block.IsNull() && blocktree.LoadBlockIndexSnapshot(GetBlockIndexSnapshotPath(), chainstate_best_block, insert_block_index)) &&
+        !blocktree.LoadBlockIndexGuts(consensus_params, insert_block_index))
         return false;
 
     // Calculate nChainWork
@@ -4309,6 +5175,7 @@ bool BlockManager::LoadBlockIndex(
             pindexBestHeader = pindex;
     }
 
+    m_block_index_loaded = true;
     return true;
 }
 
@@ -4316,18 +5183,23 @@ void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
-    }
-
     m_block_index.clear();
+    m_block_index_chunks.clear();
+    m_block_index_chunk_used = 0;
+    m_block_index_loaded = false;
 }
 
 bool static LoadBlockIndexDB(ChainstateManager& chainman, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    // The block index snapshot is only trusted for the chainstate database it
+    // was written with, read through the already opened coins view.
+    uint256 chainstate_best_block;
+    if (gArgs.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT) && ::ChainstateActive().HasCoinsViews()) {
+        chainstate_best_block = ::ChainstateActive().CoinsDB().GetBestBlock();
+    }
     if (!chainman.m_blockman.LoadBlockIndex(
             chainparams.GetConsensus(), *pblocktree,
-            ::ChainstateActive().setBlockIndexCandidates)) {
+            ::ChainstateActive().setBlockIndexCandidates, chainstate_best_block)) {
         return false;
     }
 
@@ -4619,7 +5491,7 @@ void CChainState::EraseBlockData(CBlockIndex* index)
     // Reduce validity
     index->nStatus = std::min<unsigned int>(index->nStatus & BLOCK_VALID_MASK, BLOCK_VALID_TREE) | (index->nStatus & ~BLOCK_VALID_MASK);
     // Remove have-data flags.
-    index->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+    index->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_UNDO_COLUMNAR);
     // Remove storage location.
     index->nFile = 0;
     index->nDataPos = 0;
@@ -4764,6 +5636,8 @@ void UnloadBlockIndex(CTxMemPool* mempool, ChainstateManager& chainman)
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
     if (mempool) mempool->clear();
+    g_blockfile_writer.Sync();
+    ForgetBlockFileMappings();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
     setDirtyBlockIndex.clear();
@@ -4828,123 +5702,223 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return ::ChainstateActive().LoadGenesisBlock(chainparams);
 }
 
+/** Maximum number of block records read into one import batch */
+static constexpr size_t MAX_IMPORT_BATCH_BLOCKS = 128;
+/**
+ * Maximum span of the block file covered by one import batch, unless it holds a
+ * single record larger than that.
+ */
+static constexpr uint64_t MAX_IMPORT_BATCH_BYTES = MAX_BLOCK_SERIALIZED_SIZE_WITH_MWEB / 4;
+/** Maximum span of one block record: the message start, the size and the block */
+static constexpr uint64_t MAX_IMPORT_RECORD_BYTES = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int) + MAX_BLOCK_SERIALIZED_SIZE_WITH_MWEB;
+/**
+ * How far the CBufferedFile must be able to seek back: after a bad record in the
+ * batch being connected, we rescan from it although the following batch has
+ * already been read.
+ */
+static constexpr uint64_t IMPORT_REWIND_BYTES = 2 * std::max(MAX_IMPORT_BATCH_BYTES, MAX_IMPORT_RECORD_BYTES);
+
+/**
+ * Scan blkdat for block records starting at nRewind and append them to batch,
+ * without deserializing them. Returns false once the end of the file is reached.
+ */
+static bool ReadBlockImportBatch(CBufferedFile& blkdat, const CChainParams& chainparams, const FlatFilePos* dbp, uint64_t& nRewind, std::vector<CImportedBlock>& batch)
+{
+    const uint64_t nBatchStart = nRewind;
+    while (batch.size() < MAX_IMPORT_BATCH_BLOCKS && nRewind - nBatchStart < MAX_IMPORT_BATCH_BYTES) {
+        if (blkdat.eof()) return false;
+
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        uint64_t nRecordStart = 0;
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            nRecordStart = blkdat.GetPos();
+            nRewind = nRecordStart + 1;
+            blkdat >> buf;
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE_WITH_MWEB)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            return false;
+        }
+        if (!batch.empty() && blkdat.GetPos() + nSize - nBatchStart > MAX_IMPORT_BATCH_BYTES) {
+            // Leave the record to the next batch, so that this one stays within its span
+            nRewind = nRecordStart;
+            break;
+        }
+        try {
+            // read the serialized block; it is deserialized by the check stage
+            CImportedBlock record;
+            uint64_t nBlockPos = blkdat.GetPos();
+            if (dbp)
+                record.pos = FlatFilePos(dbp->nFile, nBlockPos);
+            record.nRewind = nRewind;
+            blkdat.SetLimit(nBlockPos + nSize);
+            record.vchRaw.resize(nSize);
+            blkdat.read((char*)record.vchRaw.data(), nSize);
+            nRewind = blkdat.GetPos();
+            batch.push_back(std::move(record));
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+    return true;
+}
+
 void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
+    // Time spent by this thread in each stage of the import, in microseconds
+    int64_t nTimeImportRead = 0, nTimeImportCheck = 0, nTimeImportConnect = 0;
+    uint64_t nBlocksRead = 0;
 
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SERIALIZED_SIZE_WITH_MWEB, MAX_BLOCK_SERIALIZED_SIZE_WITH_MWEB + 8, SER_DISK, CLIENT_VERSION);
+        CBufferedFile blkdat(fileIn, IMPORT_REWIND_BYTES + MAX_IMPORT_RECORD_BYTES, IMPORT_REWIND_BYTES, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        // The batch connected by this thread, and the batch after it, which is
+        // deserialized and checked by the block import threads in the meantime.
+        std::vector<CImportedBlock> vConnect, vNext;
+        // Declared after the batches, so that the checks are done before the batches are destroyed.
+        CCheckQueueControl<CBlockImportCheck> control(g_parallel_script_checks ? &blockimportqueue : nullptr);
+        bool fMore = true;
+        bool fAbort = false;
+        while (!fAbort && (fMore || !vConnect.empty())) {
             if (ShutdownRequested()) return;
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE_WITH_MWEB)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            // Read the next batch while the current one is being checked
+            int64_t nTime0 = GetTimeMicros();
+            if (fMore) {
+                fMore = ReadBlockImportBatch(blkdat, chainparams, dbp, nRewind, vNext);
+                nBlocksRead += vNext.size();
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
-                    }
+            int64_t nTime1 = GetTimeMicros(); nTimeImportRead += nTime1 - nTime0;
+
+            // Wait for the current batch, then hand the next one to the workers
+            control.Wait();
+            std::vector<CBlockImportCheck> vChecks;
+            vChecks.reserve(vNext.size());
+            for (CImportedBlock& record : vNext) {
+                vChecks.emplace_back(record, chainparams.GetConsensus());
+            }
+            if (g_parallel_script_checks) {
+                control.Add(vChecks);
+            } else {
+                for (CBlockImportCheck& check : vChecks) {
+                    check();
+                }
+            }
+            int64_t nTime2 = GetTimeMicros(); nTimeImportCheck += nTime2 - nTime1;
+
+            for (CImportedBlock& record : vConnect) {
+                if (!record.block) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, record.strError);
+                    // Rescan from just past the start of the bad record, dropping everything read after it.
+                    control.Wait();
+                    vNext.clear();
+                    nRewind = record.nRewind;
+                    fMore = true;
+                    break;
+                }
+                try {
+                    std::shared_ptr<CBlock> pblock = record.block;
+                    const uint256& hash = record.hash;
+                    FlatFilePos* pos = dbp ? &record.pos : nullptr;
+                    {
+                        LOCK(cs_main);
+                        // detect out of order blocks, and store them for later
+                        if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(pblock->hashPrevBlock)) {
+                            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                                    pblock->hashPrevBlock.ToString());
+                            if (pos)
+                                mapBlocksUnknownParent.insert(std::make_pair(pblock->hashPrevBlock, *pos));
+                            continue;
+                        }
 
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      BlockValidationState state;
-                      if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
-                          nLoaded++;
-                      }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                      LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+                        // process in case the block isn't known yet
+                        CBlockIndex* pindex = LookupBlockIndex(hash);
+                        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+                          BlockValidationState state;
+                          if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, pos, nullptr)) {
+                              nLoaded++;
+                          }
+                          if (state.IsError()) {
+                              fAbort = true;
+                              break;
+                          }
+                        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+                          LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+                        }
                     }
-                }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    BlockValidationState state;
-                    if (!ActivateBestChain(state, chainparams, nullptr)) {
-                        break;
+                    // Activate the genesis block so normal node progress can continue
+                    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                        BlockValidationState state;
+                        if (!ActivateBestChain(state, chainparams, nullptr)) {
+                            fAbort = true;
+                            break;
+                        }
                     }
-                }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            BlockValidationState dummy;
-                            if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                    NotifyHeaderTip();
+
+                    // Recursively process earlier encountered successors of this block
+                    std::deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+                            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
                             {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
+                                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                                        head.ToString());
+                                LOCK(cs_main);
+                                BlockValidationState dummy;
+                                if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                                {
+                                    nLoaded++;
+                                    queue.push_back(pblockrecursive->GetHash());
+                                }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                            NotifyHeaderTip();
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+            int64_t nTime3 = GetTimeMicros(); nTimeImportConnect += nTime3 - nTime2;
+            LogPrint(BCLog::BENCH, "    - Import batch: %u blocks connected, %u read [read %.2fms, check wait %.2fms, connect %.2fms]\n",
+                     vConnect.size(), vNext.size(), MILLI * (nTime1 - nTime0), MILLI * (nTime2 - nTime1), MILLI * (nTime3 - nTime2));
+
+            vConnect = std::move(vNext);
+            vNext.clear();
         }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
     LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    LogPrint(BCLog::REINDEX, "Block import stages: read %u blocks in %.2fs (%.1f blk/s), check wait %.2fs, connect %.2fs (%.1f blk/s)\n",
+             nBlocksRead, nTimeImportRead * MICRO, nTimeImportRead ? nBlocksRead / (nTimeImportRead * MICRO) : 0.0,
+             nTimeImportCheck * MICRO, nTimeImportConnect * MICRO, nTimeImportConnect ? nLoaded / (nTimeImportConnect * MICRO) : 0.0);
 }
 
 void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
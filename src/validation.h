@@ -16,6 +16,7 @@
 #include <fs.h>
 #include <optional.h>
 #include <policy/feerate.h>
+#include <policy/packages.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
 #include <script/script_error.h>
 #include <sync.h>
@@ -62,10 +63,14 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Default for -limitclustercount, max number of transactions in a mempool cluster when -mempoolcluster is set */
+static const unsigned int DEFAULT_CLUSTER_LIMIT = 64;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
+/** The maximum size of block and undo data queued for writing by the block file writer */
+static const size_t MAX_BLOCKFILE_WRITE_QUEUE_BYTES = 64 * 1024 * 1024;
 /** Maximum number of dedicated script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
@@ -73,6 +78,12 @@ static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -columnarundo */
+static const bool DEFAULT_COLUMNAR_UNDO = false;
+/** Default for -blockindexsnapshot */
+static const bool DEFAULT_BLOCK_INDEX_SNAPSHOT = false;
+/** Number of CBlockIndex entries allocated at once by BlockManager */
+static constexpr size_t BLOCK_INDEX_CHUNK_SIZE = 4096;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "1";
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -126,6 +137,8 @@ extern bool g_parallel_script_checks;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Whether new undo data is written in the columnar format, which older versions cannot read */
+extern bool g_columnar_undo;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
@@ -154,7 +167,14 @@ extern const std::vector<std::string> CHECKLEVEL_DOC;
 FILE* OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const FlatFilePos &pos);
-/** Import blocks from an external file */
+/**
+ * Import blocks from an external file.
+ *
+ * Block records are read in batches. If block import worker threads are running
+ * (see ThreadBlockImportCheck), each batch is deserialized and passed through the
+ * context-free CheckBlock() in parallel, while the calling thread connects the
+ * previous batch in file order and reads the next one.
+ */
 void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp = nullptr);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
@@ -162,6 +182,17 @@ bool LoadGenesisBlock(const CChainParams& chainparams);
 void UnloadBlockIndex(CTxMemPool* mempool, ChainstateManager& chainman);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the block import checking thread */
+void ThreadBlockImportCheck(int worker_num);
+/** Run an instance of the transaction prevalidation thread */
+void ThreadTxPrevalidation(int worker_num);
+/**
+ * Start the thread that writes block and undo data behind AcceptBlock() and
+ * ConnectBlock(). Without it, that data is written directly.
+ */
+void StartBlockFileWriter();
+/** Write out queued block and undo data and stop the block file writer thread */
+void StopBlockFileWriter();
 /**
  * Return transaction from the block at block_index.
  * If block_index is not provided, fall back to mempool.
@@ -214,6 +245,49 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, bool test_accept=false, CAmount* fee_out=nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** The result of ProcessNewPackage(). */
+struct PackageMempoolAcceptResult
+{
+    PackageValidationState m_state;
+    /** The validation state of every transaction which was evaluated, by wtxid. */
+    std::map<uint256, TxValidationState> m_tx_results;
+    /** The modified fees of the transactions which passed the fee calculation, by wtxid. */
+    std::map<uint256, CAmount> m_tx_fees;
+    /** The transactions which entered the mempool, in package order. */
+    std::vector<CTransactionRef> m_accepted;
+    /** The feerate of the transactions which were evaluated together, if any. */
+    Optional<CFeeRate> m_package_feerate;
+};
+
+/**
+ * Try to add a package of transactions to the mempool. Transactions which are
+ * already in the mempool are skipped and the others are first tried one by
+ * one. Those which fall short of the minimum feerate on their own, and their
+ * descendants, are then evaluated together: their feerate checks apply to the
+ * package as a whole, so that children can pay for their parents, and either
+ * all of them are accepted or none. The MWEB signatures and rangeproofs of the
+ * package are verified in one batch.
+ * With test_accept, nothing is added and all transactions not in the mempool
+ * are evaluated together.
+ * plTxnReplaced will be appended to with all transactions replaced from mempool.
+ */
+PackageMempoolAcceptResult ProcessNewPackage(CTxMemPool& pool, const Package& package, bool test_accept,
+                                             std::list<CTransactionRef>* plTxnReplaced = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ * Verify the MWEB signatures and rangeproofs and the input scripts of the given
+ * transactions on the transaction prevalidation threads (see
+ * ThreadTxPrevalidation), without holding cs_main while doing so. The input
+ * scripts are checked against a snapshot of the coins they spend. Transactions
+ * that AcceptToMemoryPool() would turn down before verifying them, such as
+ * those paying less than the mempool minimum fee, are skipped. Nothing is
+ * accepted or rejected here: valid results go into the signature, script
+ * execution and MWEB caches, so that a following AcceptToMemoryPool() of the
+ * same transactions only performs the contextual checks under the locks. Does
+ * nothing without parallel script checks.
+ */
+void PrevalidateTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& txs) LOCKS_EXCLUDED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -251,10 +325,12 @@ bool TestLockPointValidity(const LockPoints* lp) EXCLUSIVE_LOCKS_REQUIRED(cs_mai
  * of the block needed for calculation or skips the calculation and uses the LockPoints
  * passed in for evaluation.
  * The LockPoints should not be considered valid if CheckSequenceLocks returns false.
+ * The spent coins are looked up in coins_view if given, or else in the mempool
+ * and the UTXO set.
  *
  * See consensus/consensus.h for flag definitions.
  */
-bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, pool.cs);
+bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false, const CCoinsView* coins_view = nullptr) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, pool.cs);
 
 /**
  * Closure representing one script verification
@@ -391,6 +467,22 @@ private:
      */
     void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight, int chain_tip_height, bool is_ibd);
 
+    /**
+     * Storage for the entries of m_block_index. With 8640 blocks per day the block
+     * index grows to millions of entries, so they are allocated in chunks of
+     * BLOCK_INDEX_CHUNK_SIZE rather than one heap allocation each. This saves the
+     * per-allocation overhead and keeps entries that were loaded together close in
+     * memory. Entries are never freed individually, only all at once in Unload().
+     */
+    std::vector<std::unique_ptr<CBlockIndex[]>> m_block_index_chunks GUARDED_BY(cs_main);
+    //! Number of entries handed out from the last chunk in m_block_index_chunks
+    size_t m_block_index_chunk_used GUARDED_BY(cs_main){0};
+    //! Whether m_block_index holds the complete block index from disk
+    bool m_block_index_loaded GUARDED_BY(cs_main){false};
+
+    /** Return a default-constructed CBlockIndex from the block index storage */
+    CBlockIndex* NewBlockIndex() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
@@ -427,11 +519,15 @@ public:
      *
      * @param[out] block_index_candidates  Fill this set with any valid blocks for
      *                                     which we've downloaded all transactions.
+     * @param[in]  chainstate_best_block   Best block of the chainstate database,
+     *                                     used to check the block index snapshot.
+     *                                     Null to always read the database.
      */
     bool LoadBlockIndex(
         const Consensus::Params& consensus_params,
         CBlockTreeDB& blocktree,
-        std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
+        std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates,
+        const uint256& chainstate_best_block)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     /** Clear all data members. */
@@ -441,18 +537,28 @@ public:
     /** Create a new block index entry for a given block hash */
     CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Write m_block_index to the snapshot file used by LoadBlockIndex on the next
+     * start, instead of walking the block index database. Must only be called
+     * once all block index changes have been flushed to the database, with the
+     * best block of the flushed chainstate database.
+     */
+    bool WriteBlockIndexSnapshot(CBlockTreeDB& blocktree, const uint256& best_block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     //! Mark one block file as pruned (modify associated database entries)
     void PruneOneBlockFile(const int fileNumber) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     * fCheckPOW may only be false if the caller already verified the header's proof of work.
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
         BlockValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     ~BlockManager() {
         Unload();
@@ -623,6 +729,9 @@ public:
     //! Destructs all objects related to accessing the UTXO set.
     void ResetCoinsViews() { m_coins_views.reset(); }
 
+    //! Whether InitCoinsDB() has been called since the coins views were last reset
+    bool HasCoinsViews() const { return (bool)m_coins_views; }
+
     //! The cache size of the on-disk coins view.
     size_t m_coinsdb_cache_size_bytes{0};
 
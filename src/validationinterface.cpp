@@ -254,3 +254,14 @@ void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared
     LOG_EVENT("%s: block hash=%s", __func__, block->GetHash().ToString());
     m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.NewPoWValidBlock(pindex, block); });
 }
+
+void CMainSignals::BlockTemplateUpdated(const uint256& prev_block_hash, uint64_t sequence, const CTransactionRef& appended_tx, CAmount fee)
+{
+    auto event = [prev_block_hash, sequence, appended_tx, fee, this] {
+        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockTemplateUpdated(prev_block_hash, sequence, appended_tx, fee); });
+    };
+    ENQUEUE_AND_LOG_EVENT(event, "%s: prev block hash=%s sequence=%d txid=%s", __func__,
+                          prev_block_hash.ToString(),
+                          sequence,
+                          appended_tx ? appended_tx->GetHash().ToString() : "null");
+}
@@ -173,6 +173,14 @@ protected:
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
+    /**
+     * Notifies listeners that the block template kept for getblocktemplate
+     * changed. appended_tx is the transaction appended to it, paying fee, or
+     * null if the template was built anew.
+     *
+     * Called on a background thread.
+     */
+    virtual void BlockTemplateUpdated(const uint256& prev_block_hash, uint64_t sequence, const CTransactionRef& appended_tx, CAmount fee) {}
     friend class CMainSignals;
 };
 
@@ -205,6 +213,7 @@ public:
     void ChainStateFlushed(const CBlockLocator &);
     void BlockChecked(const CBlock&, const BlockValidationState&);
     void NewPoWValidBlock(const CBlockIndex *, const std::shared_ptr<const CBlock>&);
+    void BlockTemplateUpdated(const uint256& prev_block_hash, uint64_t sequence, const CTransactionRef& appended_tx, CAmount fee);
 };
 
 CMainSignals& GetMainSignals();
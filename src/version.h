@@ -9,7 +9,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70017;
+static const int PROTOCOL_VERSION = 70019;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -41,6 +41,12 @@ static const int WTXID_RELAY_VERSION = 70016;
 //! "mwebheader" command for light client MWEB support starts with this version
 static const int MWEB_SYNC_VERSION = 70017;
 
+//! "sendpackages" command and package relay in "pkgtxns" start with this version
+static const int PACKAGE_RELAY_VERSION = 70018;
+
+//! "sendheaders2" command and compressed headers in "getheaders2" and "headers2" start with this version
+static const int COMPRESSED_HEADERS_VERSION = 70019;
+
 // Make sure that none of the values above collide with
 // `SERIALIZE_TRANSACTION_NO_WITNESS` or `ADDRV2_FORMAT`.
 
@@ -42,3 +42,8 @@ bool CZMQAbstractNotifier::NotifyTransactionRemoval(const CTransaction &/*transa
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyBlockTemplate(const uint256 &/*prev_block_hash*/, uint64_t /*sequence*/, const CTransaction * /*appended_tx*/, CAmount /*fee*/)
+{
+    return true;
+}
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
 #define BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
 
+#include <amount.h>
 #include <util/memory.h>
 
 #include <memory>
@@ -13,6 +14,7 @@
 class CBlockIndex;
 class CTransaction;
 class CZMQAbstractNotifier;
+class uint256;
 
 using CZMQNotifierFactory = std::unique_ptr<CZMQAbstractNotifier> (*)();
 
@@ -56,6 +58,8 @@ public:
     virtual bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t mempool_sequence);
     // Notifies of transactions added to mempool or appearing in blocks
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    // Notifies of changes to the getblocktemplate template, appended_tx is null for a new template
+    virtual bool NotifyBlockTemplate(const uint256 &prev_block_hash, uint64_t sequence, const CTransaction *appended_tx, CAmount fee);
 
 protected:
     void *psocket;
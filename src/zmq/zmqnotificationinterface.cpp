@@ -32,6 +32,7 @@ std::list<const CZMQAbstractNotifier*> CZMQNotificationInterface::GetActiveNotif
 CZMQNotificationInterface* CZMQNotificationInterface::Create()
 {
     std::map<std::string, CZMQNotifierFactory> factories;
+    factories["pubblocktemplate"] = CZMQAbstractNotifier::Create<CZMQPublishBlockTemplateNotifier>;
     factories["pubhashblock"] = CZMQAbstractNotifier::Create<CZMQPublishHashBlockNotifier>;
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
@@ -188,4 +189,11 @@ void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CB
     });
 }
 
+void CZMQNotificationInterface::BlockTemplateUpdated(const uint256& prev_block_hash, uint64_t sequence, const CTransactionRef& appended_tx, CAmount fee)
+{
+    TryForEachAndRemoveFailed(notifiers, [&](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlockTemplate(prev_block_hash, sequence, appended_tx.get(), fee);
+    });
+}
+
 CZMQNotificationInterface* g_zmq_notification_interface = nullptr;
@@ -31,6 +31,7 @@ protected:
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexDisconnected) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+    void BlockTemplateUpdated(const uint256& prev_block_hash, uint64_t sequence, const CTransactionRef& appended_tx, CAmount fee) override;
 
 private:
     CZMQNotificationInterface();
@@ -27,6 +27,7 @@ static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 static const char *MSG_SEQUENCE  = "sequence";
+static const char *MSG_BLOCKTEMPLATE = "blocktemplate";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -274,3 +275,23 @@ bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &t
     WriteLE64(data+sizeof(uint256)+1, mempool_sequence);
     return SendZmqMessage(MSG_SEQUENCE, data, sizeof(data));
 }
+
+bool CZMQPublishBlockTemplateNotifier::NotifyBlockTemplate(const uint256 &prev_block_hash, uint64_t sequence, const CTransaction *appended_tx, CAmount fee)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish blocktemplate %s %d to %s\n", prev_block_hash.GetHex(), sequence, this->address);
+    unsigned char data[sizeof(uint256)+sizeof(sequence)+1+sizeof(uint256)+sizeof(fee)];
+    for (unsigned int i = 0; i < sizeof(uint256); i++)
+        data[sizeof(uint256) - 1 - i] = prev_block_hash.begin()[i];
+    WriteLE64(data+sizeof(uint256), sequence);
+    if (!appended_tx) {
+        data[sizeof(uint256)+sizeof(sequence)] = 'N'; // (N)ew template
+        return SendZmqMessage(MSG_BLOCKTEMPLATE, data, sizeof(uint256)+sizeof(sequence)+1);
+    }
+    data[sizeof(uint256)+sizeof(sequence)] = 'A'; // Transaction (A)ppended
+    const uint256 hash = appended_tx->GetHash();
+    unsigned char* txid = data+sizeof(uint256)+sizeof(sequence)+1;
+    for (unsigned int i = 0; i < sizeof(uint256); i++)
+        txid[sizeof(uint256) - 1 - i] = hash.begin()[i];
+    WriteLE64(txid+sizeof(uint256), fee);
+    return SendZmqMessage(MSG_BLOCKTEMPLATE, data, sizeof(data));
+}
@@ -7,6 +7,7 @@
 import os
 
 from test_framework.test_framework import BitcoinTestFramework
+from test_framework.test_node import ErrorMatch
 
 
 class ConfArgsTest(BitcoinTestFramework):
@@ -84,6 +85,11 @@ class ConfArgsTest(BitcoinTestFramework):
             expected_msg='Error: No proxy server specified. Use -proxy=<ip> or -proxy=<ip:port>.',
             extra_args=['-proxy'],
         )
+        self.nodes[0].assert_start_raises_init_error(
+            expected_msg="Error: Unsupported -socketevents mode 'kqueue'. It must be one of: select",
+            extra_args=['-socketevents=kqueue'],
+            match=ErrorMatch.PARTIAL_REGEX,
+        )
 
     def test_log_buffer(self):
         with self.nodes[0].assert_debug_log(expected_msgs=['Warning: parsed potentially confusing double-negative -connect=0\n']):
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test package relay in sendpackages and pkgtxns messages.
+
+A peer that sent sendpackages may send a package of transactions in a
+pkgtxns message, which is accepted as a whole. It is also sent a transaction
+it asks for together with its unconfirmed ancestors, when these fall below
+its fee filter.
+"""
+
+from decimal import Decimal
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxInWitness,
+    CTxOut,
+    msg_feefilter,
+    msg_pkgtxns,
+    msg_sendpackages,
+)
+from test_framework.p2p import (
+    P2PInterface,
+    p2p_lock,
+)
+from test_framework.script import (
+    CScript,
+    OP_TRUE,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    hex_str_to_bytes,
+)
+from test_framework.wallet import MiniWallet
+
+PACKAGE_RELAY_VERSION = 70018
+
+
+class PackageRelayPeer(P2PInterface):
+    def peer_connect_send_version(self, services):
+        super().peer_connect_send_version(services)
+        self.on_connection_send_msg.nVersion = PACKAGE_RELAY_VERSION
+
+    def on_version(self, message):
+        # Like wtxidrelay, sendpackages goes between version and verack
+        self.send_message(msg_sendpackages())
+        super().on_version(message)
+
+
+class PackageRelayTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def spend(self, utxo, fee):
+        """Spend utxo to the OP_TRUE script, paying fee. Returns the transaction and its output."""
+        tx = CTransaction()
+        tx.vin = [CTxIn(COutPoint(int(utxo['txid'], 16), utxo['vout']))]
+        tx.vout = [CTxOut(int((utxo['value'] - fee) * COIN), self.script_pub_key)]
+        tx.wit.vtxinwit = [CTxInWitness()]
+        tx.wit.vtxinwit[0].scriptWitness.stack = [CScript([OP_TRUE])]
+        tx.rehash()
+        return tx, {'txid': tx.hash, 'vout': 0, 'value': utxo['value'] - fee}
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.script_pub_key = hex_str_to_bytes(node.validateaddress(ADDRESS_BCRT1_P2WSH_OP_TRUE)['scriptPubKey'])
+        miniwallet = MiniWallet(node)
+        miniwallet.generate(1)
+        node.generatetoaddress(100, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+
+        parent, parent_utxo = self.spend(miniwallet.get_utxo(), 0)
+        child, _ = self.spend(parent_utxo, Decimal("0.0001"))
+
+        self.log.info("Package relay is only negotiated with peers that support it")
+        legacy = node.add_p2p_connection(P2PInterface())
+        sender = node.add_p2p_connection(PackageRelayPeer())
+        receiver = node.add_p2p_connection(PackageRelayPeer())
+        with p2p_lock:
+            assert_equal(legacy.message_count['sendpackages'], 0)
+            assert_equal(sender.message_count['sendpackages'], 1)
+            assert_equal(receiver.message_count['sendpackages'], 1)
+
+        # The parent pays no fee, so it falls below any fee filter
+        receiver.send_and_ping(msg_feefilter(10000))
+
+        self.log.info("A package received in pkgtxns is accepted as a whole")
+        sender.send_and_ping(msg_pkgtxns([parent, child]))
+        assert_equal(sorted(node.getrawmempool()), sorted([parent.hash, child.hash]))
+
+        self.log.info("A requested transaction is sent with its ancestors below the fee filter")
+        # The receiver asks for the child when it is announced
+        receiver.wait_until(lambda: receiver.message_count['pkgtxns'] == 1)
+        with p2p_lock:
+            assert_equal([tx.rehash() for tx in receiver.last_message['pkgtxns'].txs], [parent.hash, child.hash])
+            assert_equal(receiver.message_count['tx'], 0)
+
+        self.log.info("Peers that did not negotiate package relay may not send packages")
+        legacy.send_message(msg_pkgtxns([parent, child]))
+        legacy.wait_for_disconnect()
+
+        self.log.info("sendpackages after verack is a protocol violation")
+        sender.send_message(msg_sendpackages())
+        sender.wait_for_disconnect()
+
+
+if __name__ == '__main__':
+    PackageRelayTest().main()
@@ -759,8 +759,8 @@ class RawTransactionsTest(BitcoinTestFramework):
             for k, v in {"string": "", "object": {"foo": "bar"}}.items():
                 assert_raises_rpc_error(-3, "Expected type number for conf_target, got {}".format(k),
                     node.fundrawtransaction, rawtx, {"estimate_mode": mode, "conf_target": v, "add_inputs": True})
-            for n in [-1, 0, 1009]:
-                assert_raises_rpc_error(-8, "Invalid conf_target, must be between 1 and 1008",  # max value of 1008 per src/policy/fees.h
+            for n in [-1, 0, 8641]:
+                assert_raises_rpc_error(-8, "Invalid conf_target, must be between 1 and 8640",  # max value of 8640 per src/policy/fees.cpp
                     node.fundrawtransaction, rawtx, {"estimate_mode": mode, "conf_target": n, "add_inputs": True})
 
         self.log.info("Test invalid fee rate settings")
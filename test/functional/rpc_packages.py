@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test package acceptance through testmempoolaccept and submitpackage."""
+
+from decimal import Decimal
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxInWitness,
+    CTxOut,
+)
+from test_framework.script import (
+    CScript,
+    OP_TRUE,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    hex_str_to_bytes,
+)
+from test_framework.wallet import MiniWallet
+
+CHILD_FEE = Decimal("0.0001")
+
+
+class RPCPackagesTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def spend(self, utxo, fee, *, witness=True):
+        """Spend utxo to the OP_TRUE script, paying fee. Returns the transaction and its output."""
+        tx = CTransaction()
+        tx.vin = [CTxIn(COutPoint(int(utxo['txid'], 16), utxo['vout']))]
+        tx.vout = [CTxOut(int((utxo['value'] - fee) * COIN), self.script_pub_key)]
+        tx.wit.vtxinwit = [CTxInWitness()]
+        if witness:
+            tx.wit.vtxinwit[0].scriptWitness.stack = [CScript([OP_TRUE])]
+        tx.rehash()
+        return tx, {'txid': tx.hash, 'vout': 0, 'value': utxo['value'] - fee}
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.script_pub_key = hex_str_to_bytes(node.validateaddress(ADDRESS_BCRT1_P2WSH_OP_TRUE)['scriptPubKey'])
+        miniwallet = MiniWallet(node)
+        miniwallet.generate(3)
+        node.generatetoaddress(100, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        self.coins = [miniwallet.get_utxo() for _ in range(3)]
+
+        self.test_package_size()
+        self.test_cpfp()
+        self.test_not_sorted()
+        self.test_invalid_child()
+
+    def test_package_size(self):
+        node = self.nodes[0]
+        self.log.info("Packages must contain between 1 and 25 transactions")
+        for rpc in [node.testmempoolaccept, node.submitpackage]:
+            assert_raises_rpc_error(-8, 'Array must contain between 1 and 25 transactions.', rpc, [])
+            assert_raises_rpc_error(-8, 'Array must contain between 1 and 25 transactions.', rpc, ['ff22'] * 26)
+
+    def test_cpfp(self):
+        node = self.nodes[0]
+        parent, parent_utxo = self.spend(self.coins.pop(), 0)
+        child, _ = self.spend(parent_utxo, CHILD_FEE)
+        package = [parent.serialize().hex(), child.serialize().hex()]
+        wtxids = ['{:064x}'.format(tx.calc_sha256(True)) for tx in [parent, child]]
+
+        self.log.info("A parent without fee is not accepted on its own")
+        assert_equal(node.testmempoolaccept([package[0]]), [
+            {'txid': parent.hash, 'wtxid': wtxids[0], 'allowed': False, 'reject-reason': 'min relay fee not met'},
+        ])
+
+        self.log.info("A child pays for its parent in testmempoolaccept")
+        assert_equal(node.testmempoolaccept(package), [
+            {'txid': parent.hash, 'wtxid': wtxids[0], 'allowed': True, 'vsize': parent.get_vsize(), 'fees': {'base': Decimal(0)}},
+            {'txid': child.hash, 'wtxid': wtxids[1], 'allowed': True, 'vsize': child.get_vsize(), 'fees': {'base': CHILD_FEE}},
+        ])
+        assert_equal(node.getrawmempool(), [])
+
+        self.log.info("A child pays for its parent in submitpackage")
+        result = node.submitpackage(package)
+        assert_equal(result['package-msg'], 'success')
+        assert 'package-feerate' in result
+        assert_equal(result['tx-results'], [
+            {'txid': parent.hash, 'wtxid': wtxids[0], 'allowed': True},
+            {'txid': child.hash, 'wtxid': wtxids[1], 'allowed': True},
+        ])
+        assert_equal(sorted(node.getrawmempool()), sorted([parent.hash, child.hash]))
+
+        self.log.info("Transactions already in the mempool are skipped")
+        result = node.submitpackage(package)
+        assert_equal(result['package-msg'], 'success')
+        assert 'package-feerate' not in result
+        assert_equal([r['allowed'] for r in result['tx-results']], [True, True])
+
+        node.generatetoaddress(1, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        assert_equal(node.getrawmempool(), [])
+
+    def test_not_sorted(self):
+        node = self.nodes[0]
+        self.log.info("Parents must come before their children")
+        parent, parent_utxo = self.spend(self.coins.pop(), 0)
+        child, _ = self.spend(parent_utxo, CHILD_FEE)
+        package = [child.serialize().hex(), parent.serialize().hex()]
+        for r in node.testmempoolaccept(package):
+            assert_equal(r['package-error'], 'package-not-sorted')
+            assert 'allowed' not in r
+        result = node.submitpackage(package)
+        assert_equal(result['package-msg'], 'package-not-sorted')
+        assert_equal([r['allowed'] for r in result['tx-results']], [False, False])
+        assert_equal(node.getrawmempool(), [])
+
+    def test_invalid_child(self):
+        node = self.nodes[0]
+        self.log.info("A package with an invalid child is not accepted at all")
+        parent, parent_utxo = self.spend(self.coins.pop(), 0)
+        child, _ = self.spend(parent_utxo, CHILD_FEE, witness=False)
+        package = [parent.serialize().hex(), child.serialize().hex()]
+        result = node.testmempoolaccept(package)
+        assert_equal(result[1]['allowed'], False)
+        assert 'allowed' not in result[0]
+        result = node.submitpackage(package)
+        assert_equal(result['package-msg'], 'transaction failed')
+        assert_equal([r['allowed'] for r in result['tx-results']], [False, False])
+        assert_equal(node.getrawmempool(), [])
+
+
+if __name__ == '__main__':
+    RPCPackagesTest().main()
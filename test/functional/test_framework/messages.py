@@ -1363,6 +1363,40 @@ class msg_wtxidrelay:
         return "msg_wtxidrelay()"
 
 
+class msg_sendpackages:
+    __slots__ = ()
+    msgtype = b"sendpackages"
+
+    def __init__(self):
+        pass
+
+    def deserialize(self, f):
+        pass
+
+    def serialize(self):
+        return b""
+
+    def __repr__(self):
+        return "msg_sendpackages()"
+
+
+class msg_pkgtxns:
+    __slots__ = ("txs",)
+    msgtype = b"pkgtxns"
+
+    def __init__(self, txs=None):
+        self.txs = txs if txs is not None else []
+
+    def deserialize(self, f):
+        self.txs = deser_vector(f, CTransaction)
+
+    def serialize(self):
+        return ser_vector(self.txs, "serialize_with_mweb")
+
+    def __repr__(self):
+        return "msg_pkgtxns(txs=%s)" % (repr(self.txs))
+
+
 class msg_no_witness_tx(msg_tx):
     __slots__ = ()
 
@@ -61,10 +61,12 @@ from test_framework.messages import (
     msg_mwebutxos,
     msg_notfound,
     msg_ping,
+    msg_pkgtxns,
     msg_pong,
     msg_sendaddrv2,
     msg_sendcmpct,
     msg_sendheaders,
+    msg_sendpackages,
     msg_tx,
     MSG_TX,
     MSG_TYPE_MASK,
@@ -113,10 +115,12 @@ MESSAGEMAP = {
     b"mwebutxos": msg_mwebutxos,
     b"notfound": msg_notfound,
     b"ping": msg_ping,
+    b"pkgtxns": msg_pkgtxns,
     b"pong": msg_pong,
     b"sendaddrv2": msg_sendaddrv2,
     b"sendcmpct": msg_sendcmpct,
     b"sendheaders": msg_sendheaders,
+    b"sendpackages": msg_sendpackages,
     b"tx": msg_tx,
     b"verack": msg_verack,
     b"version": msg_version,
@@ -403,10 +407,12 @@ class P2PInterface(P2PConnection):
     def on_mempool(self, message): pass
     def on_merkleblock(self, message): pass
     def on_notfound(self, message): pass
+    def on_pkgtxns(self, message): pass
     def on_pong(self, message): pass
     def on_sendaddrv2(self, message): pass
     def on_sendcmpct(self, message): pass
     def on_sendheaders(self, message): pass
+    def on_sendpackages(self, message): pass
     def on_tx(self, message): pass
     def on_wtxidrelay(self, message): pass
 
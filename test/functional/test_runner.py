@@ -223,6 +223,8 @@ BASE_SCRIPTS = [
     'feature_nulldummy.py',
     'feature_nulldummy.py --descriptors',
     'mempool_accept.py',
+    'rpc_packages.py',
+    'p2p_package_relay.py',
     'mempool_expiry.py',
     'wallet_import_rescan.py --legacy-wallet',
     'wallet_import_with_label.py --legacy-wallet',